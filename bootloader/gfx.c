@@ -0,0 +1,294 @@
+// bootloader/gfx.c
+// Boot screen: splash image and progress bar, drawn with GOP Blt
+//
+// The splash file is read in one go into pool memory and decoded straight
+// into the Blt buffer (EFI_GRAPHICS_OUTPUT_BLT_PIXEL is B, G, R, reserved,
+// which is also how BMP stores its pixels). Both buffers are freed before
+// returning so they don't show up in the memory map handed to the kernel.
+#include "gfx.h"
+
+#define SPLASH_MAX_DIM  4096        // Keeps width * height * 4 well in range
+
+#define BAR_HEIGHT      6
+#define BAR_TRACK       0x00303030
+#define BAR_FILL        0x00FFFFFF
+
+static EFI_BOOT_SERVICES            *g_bs;
+static EFI_GRAPHICS_OUTPUT_PROTOCOL *g_gop;
+static UINT32 g_width, g_height;
+
+// Progress bar geometry and how much of it is filled
+static UINT32 g_bar_x, g_bar_y, g_bar_w;
+static UINT32 g_bar_done;
+
+static void fill(UINT32 x, UINT32 y, UINT32 w, UINT32 h, UINT32 color) {
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL px = {
+        .Blue  = color & 0xFF,
+        .Green = (color >> 8) & 0xFF,
+        .Red   = (color >> 16) & 0xFF,
+    };
+    if (w == 0 || h == 0) return;
+    uefi_call_wrapper(g_gop->Blt, 10, g_gop, &px, EfiBltVideoFill,
+                      0, 0, x, y, w, h, 0);
+}
+
+void gfx_init(EFI_SYSTEM_TABLE *ST, EFI_GRAPHICS_OUTPUT_PROTOCOL *gop) {
+    g_bs = ST->BootServices;
+    g_gop = gop;
+    g_width = gop->Mode->Info->HorizontalResolution;
+    g_height = gop->Mode->Info->VerticalResolution;
+
+    // A third of the screen wide, three quarters of the way down: below
+    // the splash, clear of the console text at the top
+    g_bar_w = g_width / 3;
+    g_bar_x = (g_width - g_bar_w) / 2;
+    g_bar_y = g_height * 3 / 4;
+    g_bar_done = 0;
+    fill(g_bar_x, g_bar_y, g_bar_w, BAR_HEIGHT, BAR_TRACK);
+}
+
+void gfx_progress(UINT32 done, UINT32 total) {
+    if (!g_gop || total == 0) return;
+    if (done > total) done = total;
+
+    UINT32 w = (UINT32)((UINT64)g_bar_w * done / total);
+    if (w <= g_bar_done) return;
+    fill(g_bar_x + g_bar_done, g_bar_y, w - g_bar_done, BAR_HEIGHT, BAR_FILL);
+    g_bar_done = w;
+}
+
+//=============================================================================
+// Decoders
+// Each checks the header against the file size, allocates the Blt buffer
+// and fills it. They return EFI_UNSUPPORTED for anything malformed.
+//=============================================================================
+
+static UINT32 get_le16(const UINT8 *p) { return p[0] | (p[1] << 8); }
+static UINT32 get_le32(const UINT8 *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((UINT32)p[3] << 24);
+}
+static UINT32 get_be32(const UINT8 *p) {
+    return ((UINT32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static EFI_STATUS alloc_pixels(UINT32 w, UINT32 h,
+                               EFI_GRAPHICS_OUTPUT_BLT_PIXEL **out) {
+    if (w == 0 || h == 0 || w > SPLASH_MAX_DIM || h > SPLASH_MAX_DIM) {
+        return EFI_UNSUPPORTED;
+    }
+    return uefi_call_wrapper(g_bs->AllocatePool, 3, EfiLoaderData,
+                             (UINTN)w * h * sizeof(**out), (VOID **)out);
+}
+
+// Uncompressed BMP: BI_RGB at 24 or 32 bpp, or BI_BITFIELDS at 32 bpp
+// with the usual 8:8:8 masks. Rows are bottom-up unless height < 0.
+static EFI_STATUS decode_bmp(const UINT8 *file, UINTN size, UINT32 *out_w,
+                             UINT32 *out_h, EFI_GRAPHICS_OUTPUT_BLT_PIXEL **out) {
+    if (size < 54 || file[0] != 'B' || file[1] != 'M') return EFI_UNSUPPORTED;
+
+    UINT32 offset = get_le32(file + 10);
+    UINT32 dib_size = get_le32(file + 14);
+    INT32 w = (INT32)get_le32(file + 18);
+    INT32 h = (INT32)get_le32(file + 22);
+    UINT32 bpp = get_le16(file + 28);
+    UINT32 compression = get_le32(file + 30);
+    if (dib_size < 40 || w <= 0 || h == 0) return EFI_UNSUPPORTED;
+
+    if (bpp != 24 && bpp != 32) return EFI_UNSUPPORTED;
+    if (compression == 3) {
+        if (bpp != 32 || size < 66) return EFI_UNSUPPORTED;
+        if (get_le32(file + 54) != 0x00FF0000 || get_le32(file + 58) != 0x0000FF00 ||
+            get_le32(file + 62) != 0x000000FF) {
+            return EFI_UNSUPPORTED;
+        }
+    } else if (compression != 0) {
+        return EFI_UNSUPPORTED;
+    }
+
+    int top_down = h < 0;
+    UINT32 width = (UINT32)w;
+    UINT32 height = top_down ? 0u - (UINT32)h : (UINT32)h;
+    if (width > SPLASH_MAX_DIM || height > SPLASH_MAX_DIM) return EFI_UNSUPPORTED;
+
+    UINTN stride = ((UINTN)width * bpp + 31) / 32 * 4;
+    if (offset > size || (UINTN)height * stride > size - offset) return EFI_UNSUPPORTED;
+
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *px;
+    EFI_STATUS status = alloc_pixels(width, height, &px);
+    if (EFI_ERROR(status)) return status;
+
+    for (UINT32 y = 0; y < height; y++) {
+        const UINT8 *src = file + offset + (top_down ? y : height - 1 - y) * stride;
+        UINT32 *dst = (UINT32 *)(px + (UINTN)y * width);
+        if (bpp == 32) {
+            // Already B, G, R, x: just drop the alpha byte
+            for (UINT32 x = 0; x < width; x++) dst[x] = get_le32(src + x * 4) & 0x00FFFFFF;
+        } else {
+            for (UINT32 x = 0; x < width; x++, src += 3) {
+                dst[x] = src[0] | (src[1] << 8) | (src[2] << 16);
+            }
+        }
+    }
+
+    *out_w = width;
+    *out_h = height;
+    *out = px;
+    return EFI_SUCCESS;
+}
+
+// QOI (qoiformat.org). Alpha is blended against the black screen.
+#define QOI_OP_INDEX    0x00
+#define QOI_OP_DIFF     0x40
+#define QOI_OP_LUMA     0x80
+#define QOI_OP_RUN      0xC0
+#define QOI_OP_RGB      0xFE
+#define QOI_OP_RGBA     0xFF
+#define QOI_MASK_2      0xC0
+
+static EFI_STATUS decode_qoi(const UINT8 *file, UINTN size, UINT32 *out_w,
+                             UINT32 *out_h, EFI_GRAPHICS_OUTPUT_BLT_PIXEL **out) {
+    if (size < 14 + 8 || file[0] != 'q' || file[1] != 'o' ||
+        file[2] != 'i' || file[3] != 'f') {
+        return EFI_UNSUPPORTED;
+    }
+    UINT32 width = get_be32(file + 4);
+    UINT32 height = get_be32(file + 8);
+
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *px;
+    EFI_STATUS status = alloc_pixels(width, height, &px);
+    if (EFI_ERROR(status)) return status;
+
+    UINT8 index[64][4] = {{0}};
+    UINT8 r = 0, g = 0, b = 0, a = 255;
+    UINTN pos = 14, end = size - 8;     // Stream ends in an 8-byte marker
+    UINTN count = (UINTN)width * height;
+    UINT32 run = 0;
+    UINT32 *dst = (UINT32 *)px;
+    UINTN i;
+
+    for (i = 0; i < count; i++) {
+        if (run > 0) {
+            run--;
+        } else if (pos < end) {
+            UINT8 op = file[pos++];
+            if (op == QOI_OP_RGB) {
+                if (end - pos < 3) break;
+                r = file[pos]; g = file[pos + 1]; b = file[pos + 2];
+                pos += 3;
+            } else if (op == QOI_OP_RGBA) {
+                if (end - pos < 4) break;
+                r = file[pos]; g = file[pos + 1]; b = file[pos + 2]; a = file[pos + 3];
+                pos += 4;
+            } else if ((op & QOI_MASK_2) == QOI_OP_INDEX) {
+                r = index[op][0]; g = index[op][1]; b = index[op][2]; a = index[op][3];
+            } else if ((op & QOI_MASK_2) == QOI_OP_DIFF) {
+                r += ((op >> 4) & 3) - 2;
+                g += ((op >> 2) & 3) - 2;
+                b += (op & 3) - 2;
+            } else if ((op & QOI_MASK_2) == QOI_OP_LUMA) {
+                if (pos == end) break;
+                UINT8 next = file[pos++];
+                int dg = (op & 0x3F) - 32;
+                g += dg;
+                r += dg - 8 + ((next >> 4) & 0xF);
+                b += dg - 8 + (next & 0xF);
+            } else {
+                run = op & 0x3F;
+            }
+            UINT32 h = (r * 3 + g * 5 + b * 7 + a * 11) & 63;
+            index[h][0] = r; index[h][1] = g; index[h][2] = b; index[h][3] = a;
+        } else {
+            break;
+        }
+
+        if (a == 255) {
+            dst[i] = b | (g << 8) | ((UINT32)r << 16);
+        } else {
+            dst[i] = (b * a / 255) | ((g * a / 255) << 8) | ((UINT32)(r * a / 255) << 16);
+        }
+    }
+    // A truncated stream shows what decoded; the rest stays black
+    for (; i < count; i++) dst[i] = 0;
+
+    *out_w = width;
+    *out_h = height;
+    *out = px;
+    return EFI_SUCCESS;
+}
+
+//=============================================================================
+// Splash
+//=============================================================================
+
+// Read the whole file into pool memory
+static EFI_STATUS read_pool(EFI_FILE_PROTOCOL *root, CHAR16 *path,
+                            UINT8 **data, UINTN *size) {
+    EFI_GUID info_guid = EFI_FILE_INFO_GUID;
+    EFI_FILE_PROTOCOL *file;
+    EFI_STATUS status;
+
+    status = uefi_call_wrapper(root->Open, 5,
+                               root, &file, path, EFI_FILE_MODE_READ, 0);
+    if (EFI_ERROR(status)) return status;
+
+    UINT8 info_buf[sizeof(EFI_FILE_INFO) + 512];
+    UINTN info_size = sizeof(info_buf);
+    status = uefi_call_wrapper(file->GetInfo, 4,
+                               file, &info_guid, &info_size, info_buf);
+    if (EFI_ERROR(status)) goto out;
+
+    UINTN file_size = ((EFI_FILE_INFO *)info_buf)->FileSize;
+    status = uefi_call_wrapper(g_bs->AllocatePool, 3,
+                               EfiLoaderData, file_size ? file_size : 1, (VOID **)data);
+    if (EFI_ERROR(status)) goto out;
+
+    status = uefi_call_wrapper(file->Read, 3, file, &file_size, *data);
+    if (EFI_ERROR(status)) {
+        uefi_call_wrapper(g_bs->FreePool, 1, *data);
+        goto out;
+    }
+    *size = file_size;
+
+out:
+    uefi_call_wrapper(file->Close, 1, file);
+    return status;
+}
+
+EFI_STATUS gfx_splash(EFI_FILE_PROTOCOL *root, UINT32 *width, UINT32 *height) {
+    CHAR16 bmp_path[] = u"\\EFI\\BOOT\\splash.bmp";
+    CHAR16 qoi_path[] = u"\\EFI\\BOOT\\splash.qoi";
+    EFI_GRAPHICS_OUTPUT_BLT_PIXEL *px = NULL;
+    UINT8 *file;
+    UINTN size;
+    UINT32 w = 0, h = 0;
+    EFI_STATUS status;
+
+    if (!g_gop) return EFI_NOT_READY;
+
+    if (!EFI_ERROR(read_pool(root, bmp_path, &file, &size))) {
+        status = decode_bmp(file, size, &w, &h, &px);
+    } else if (!EFI_ERROR(read_pool(root, qoi_path, &file, &size))) {
+        status = decode_qoi(file, size, &w, &h, &px);
+    } else {
+        return EFI_NOT_FOUND;
+    }
+    uefi_call_wrapper(g_bs->FreePool, 1, file);
+    if (EFI_ERROR(status)) return status;
+
+    // Centre it in the space above the progress bar, clipping anything
+    // that doesn't fit; Delta keeps the source rows at full width
+    UINT32 area_h = g_bar_y;
+    UINT32 vis_w = w < g_width ? w : g_width;
+    UINT32 vis_h = h < area_h ? h : area_h;
+    UINT32 src_x = (w - vis_w) / 2, src_y = (h - vis_h) / 2;
+    UINT32 dst_x = (g_width - vis_w) / 2, dst_y = (area_h - vis_h) / 2;
+
+    status = uefi_call_wrapper(g_gop->Blt, 10, g_gop, px, EfiBltBufferToVideo,
+                               src_x, src_y, dst_x, dst_y, vis_w, vis_h,
+                               (UINTN)w * sizeof(*px));
+    uefi_call_wrapper(g_bs->FreePool, 1, px);
+
+    *width = w;
+    *height = h;
+    return status;
+}
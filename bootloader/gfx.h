@@ -0,0 +1,21 @@
+// bootloader/gfx.h
+// Boot screen: splash image and progress bar, drawn with GOP Blt
+//
+// Nothing here writes the framebuffer directly. Fills use EfiBltVideoFill
+// and the splash goes out in one EfiBltBufferToVideo, so firmware with an
+// accelerated or write-combining Blt path does the pixel work.
+#pragma once
+
+#include "../efi/efi.h"
+
+// Remember the GOP and lay out the screen. Must come first.
+void gfx_init(EFI_SYSTEM_TABLE *ST, EFI_GRAPHICS_OUTPUT_PROTOCOL *gop);
+
+// Load \EFI\BOOT\splash.bmp (uncompressed, 24 or 32 bpp) or, failing
+// that, \EFI\BOOT\splash.qoi, and draw it centred. EFI_NOT_FOUND if there
+// is neither; EFI_UNSUPPORTED if the file can't be decoded.
+EFI_STATUS gfx_splash(EFI_FILE_PROTOCOL *root, UINT32 *width, UINT32 *height);
+
+// Advance the progress bar to done/total. Only the newly covered part is
+// drawn, so each call is one small fill.
+void gfx_progress(UINT32 done, UINT32 total);
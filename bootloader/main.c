@@ -4,15 +4,65 @@
 // This bootloader:
 // 1. Gets framebuffer info via GOP
 // 2. Finds the ACPI RSDP
-// 3. Loads the kernel from disk
-// 4. Gets the memory map
-// 5. Exits boot services
-// 6. Jumps to the kernel
+// 3. Shows the splash image and a progress bar (see gfx.c)
+// 4. Loads the kernel (asynchronously, if the firmware can), modules and
+//    command line from disk, then relocates the kernel to a 2 MiB aligned
+//    address
+// 5. Records this boot's timings in a UEFI variable holding the last few
+//    boots' (see common/bootinfo.h, BOOT_TAG_BOOT_HISTORY)
+// 6. Builds the tagged BootInfo block (see common/bootinfo.h)
+// 7. Gets the memory map straight into that block
+// 8. Exits boot services
+// 9. Jumps to the kernel
 #include "../efi/efi.h"
 #include "../common/bootinfo.h"
+#include "../common/elf.h"
+#include "gfx.h"
 
-// Our boot info structure (will be passed to kernel)
-static struct BootInfo g_boot_info;
+// Everything we collect before the BootInfo block can be sized
+#define MAX_MODULES         16
+#define MODULE_NAME_MAX     64
+#define CMDLINE_MAX         1024
+
+// Progress bar steps: graphics, ACPI, modules, kernel, boot info
+#define PROGRESS_STEPS      5
+
+struct module {
+    EFI_PHYSICAL_ADDRESS base;
+    UINTN                size;
+    char                 name[MODULE_NAME_MAX];
+};
+
+static struct FramebufferInfo g_framebuffer;
+static UINT64                 g_rsdp;
+static UINT32                 g_rsdp_revision;
+static struct module          g_modules[MAX_MODULES];
+static UINT32                 g_module_count;
+static char                   g_cmdline[CMDLINE_MAX];
+static UINT64                 g_timestamps[BOOT_TS_COUNT];
+
+// The BootInfo block handed to the kernel
+static UINT8 *g_bi_buf;
+static UINTN  g_bi_cap;
+static UINTN  g_bi_used;
+static UINTN  g_bi_desc_size;   // Firmware memory descriptor stride
+static struct BootTagTimestamps *g_bi_ts;
+
+static inline UINT64 rdtsc(void) {
+    UINT32 lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((UINT64)hi << 32) | lo;
+}
+
+static void stamp(UINT32 stage) {
+    g_timestamps[stage] = rdtsc();
+}
+
+static UINTN str_len(const char *s) {
+    UINTN n = 0;
+    while (s[n]) n++;
+    return n;
+}
 
 //=============================================================================
 // Console Output Helpers
@@ -33,13 +83,13 @@ static void print(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *out, const char *s) {
 static void print_hex(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *out, UINT64 val) {
     const char *hex = "0123456789ABCDEF";
     char buf[17];
-    
+
     for (int i = 15; i >= 0; i--) {
         buf[i] = hex[val & 0xF];
         val >>= 4;
     }
     buf[16] = 0;
-    
+
     print(out, "0x");
     print(out, buf);
 }
@@ -48,7 +98,7 @@ static void print_dec(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *out, UINT64 val) {
     char buf[21];
     int i = 20;
     buf[i] = 0;
-    
+
     if (val == 0) {
         buf[--i] = '0';
     } else {
@@ -57,7 +107,7 @@ static void print_dec(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *out, UINT64 val) {
             val /= 10;
         }
     }
-    
+
     print(out, &buf[i]);
 }
 
@@ -78,23 +128,40 @@ static EFI_STATUS init_graphics(EFI_SYSTEM_TABLE *ST) {
     }
 
     // Store framebuffer info
-    g_boot_info.framebuffer.base   = gop->Mode->FrameBufferBase;
-    g_boot_info.framebuffer.width  = gop->Mode->Info->HorizontalResolution;
-    g_boot_info.framebuffer.height = gop->Mode->Info->VerticalResolution;
-    g_boot_info.framebuffer.pitch  = gop->Mode->Info->PixelsPerScanLine * 4;
-    g_boot_info.framebuffer.bpp    = 32;
+    g_framebuffer.base   = gop->Mode->FrameBufferBase;
+    g_framebuffer.width  = gop->Mode->Info->HorizontalResolution;
+    g_framebuffer.height = gop->Mode->Info->VerticalResolution;
+    g_framebuffer.pitch  = gop->Mode->Info->PixelsPerScanLine * 4;
+    g_framebuffer.bpp    = 32;
 
     print(ST->ConOut, "Framebuffer: ");
-    print_dec(ST->ConOut, g_boot_info.framebuffer.width);
+    print_dec(ST->ConOut, g_framebuffer.width);
     print(ST->ConOut, "x");
-    print_dec(ST->ConOut, g_boot_info.framebuffer.height);
+    print_dec(ST->ConOut, g_framebuffer.height);
     print(ST->ConOut, " @ ");
-    print_hex(ST->ConOut, g_boot_info.framebuffer.base);
+    print_hex(ST->ConOut, g_framebuffer.base);
     print(ST->ConOut, "\n");
 
+    gfx_init(ST, gop);
     return EFI_SUCCESS;
 }
 
+static void show_splash(EFI_SYSTEM_TABLE *ST, EFI_FILE_PROTOCOL *root) {
+    UINT32 w, h;
+    EFI_STATUS status = gfx_splash(root, &w, &h);
+
+    if (status == EFI_NOT_FOUND) return;
+    if (EFI_ERROR(status)) {
+        print(ST->ConOut, "WARNING: Can't show splash image\n");
+        return;
+    }
+    print(ST->ConOut, "Splash: ");
+    print_dec(ST->ConOut, w);
+    print(ST->ConOut, "x");
+    print_dec(ST->ConOut, h);
+    print(ST->ConOut, "\n");
+}
+
 //=============================================================================
 // Find ACPI RSDP
 //=============================================================================
@@ -103,182 +170,773 @@ static void find_rsdp(EFI_SYSTEM_TABLE *ST) {
     EFI_GUID acpi2_guid = EFI_ACPI_20_TABLE_GUID;
     EFI_GUID acpi1_guid = EFI_ACPI_TABLE_GUID;
 
-    // Search configuration tables for ACPI RSDP
+    // Search configuration tables for ACPI RSDP. Firmware often publishes
+    // both; the 2.0 one is the one with an XSDT, so it wins.
+    g_rsdp = 0;
     for (UINTN i = 0; i < ST->NumberOfTableEntries; i++) {
         EFI_CONFIGURATION_TABLE *table = &ST->ConfigurationTable[i];
-        
-        if (guid_equal(&table->VendorGuid, &acpi2_guid) ||
-            guid_equal(&table->VendorGuid, &acpi1_guid)) {
-            g_boot_info.rsdp = table->VendorTable;
-            print(ST->ConOut, "RSDP found @ ");
-            print_hex(ST->ConOut, (UINT64)g_boot_info.rsdp);
-            print(ST->ConOut, "\n");
-            return;
+
+        if (guid_equal(&table->VendorGuid, &acpi2_guid)) {
+            g_rsdp = (UINT64)table->VendorTable;
+            g_rsdp_revision = 2;
+            break;
+        }
+        if (guid_equal(&table->VendorGuid, &acpi1_guid) && !g_rsdp) {
+            g_rsdp = (UINT64)table->VendorTable;
+            g_rsdp_revision = 0;
         }
     }
-    
-    print(ST->ConOut, "WARNING: RSDP not found\n");
-    g_boot_info.rsdp = NULL;
+
+    if (!g_rsdp) {
+        print(ST->ConOut, "WARNING: RSDP not found\n");
+        return;
+    }
+
+    print(ST->ConOut, "RSDP found @ ");
+    print_hex(ST->ConOut, g_rsdp);
+    print(ST->ConOut, g_rsdp_revision ? " (ACPI 2.0+)\n" : " (ACPI 1.0)\n");
 }
 
 //=============================================================================
-// Get Memory Map
+// File Loading
 //=============================================================================
 
-static EFI_STATUS get_memory_map(EFI_SYSTEM_TABLE *ST, UINTN *out_key) {
-    UINTN map_size = 0;
-    EFI_MEMORY_DESCRIPTOR *map = NULL;
-    UINTN map_key, desc_size;
-    UINT32 desc_version;
+static EFI_STATUS open_root(EFI_SYSTEM_TABLE *ST, EFI_FILE_PROTOCOL **root) {
+    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *fs;
+    EFI_GUID fs_guid = EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
     EFI_STATUS status;
+
+    // Get file system protocol
+    status = uefi_call_wrapper(ST->BootServices->LocateProtocol, 3,
+                               &fs_guid, NULL, (VOID **)&fs);
+    if (EFI_ERROR(status)) {
+        print(ST->ConOut, "ERROR: No filesystem found\n");
+        return status;
+    }
+
+    // Open root directory
+    status = uefi_call_wrapper(fs->OpenVolume, 2, fs, root);
+    if (EFI_ERROR(status)) {
+        print(ST->ConOut, "ERROR: Failed to open volume\n");
+        return status;
+    }
+
+    return EFI_SUCCESS;
+}
+
+// Open a file and allocate pages for all of it. *addr is the preferred
+// load address on entry (0 = anywhere) and the actual one on return.
+static EFI_STATUS open_and_alloc(EFI_SYSTEM_TABLE *ST, EFI_FILE_PROTOCOL *dir,
+                                 CHAR16 *path, EFI_FILE_PROTOCOL **out,
+                                 EFI_PHYSICAL_ADDRESS *addr, UINTN *size) {
+    EFI_GUID info_guid = EFI_FILE_INFO_GUID;
     EFI_BOOT_SERVICES *BS = ST->BootServices;
+    EFI_FILE_PROTOCOL *file;
+    EFI_STATUS status;
 
-    // First call to get required size
-    status = uefi_call_wrapper(BS->GetMemoryMap, 5,
-                               &map_size, NULL, &map_key, &desc_size, &desc_version);
-    
-    // Allocate buffer (with extra space for changes)
-    map_size += 2 * desc_size;
-    status = uefi_call_wrapper(BS->AllocatePool, 3,
-                               EfiLoaderData, map_size, (VOID **)&map);
+    status = uefi_call_wrapper(dir->Open, 5,
+                               dir, &file, path, EFI_FILE_MODE_READ, 0);
     if (EFI_ERROR(status)) return status;
 
-    // Get the actual memory map
-    status = uefi_call_wrapper(BS->GetMemoryMap, 5,
-                               &map_size, map, &map_key, &desc_size, &desc_version);
-    if (EFI_ERROR(status)) return status;
+    // Get file size
+    UINT8 info_buf[sizeof(EFI_FILE_INFO) + 512];
+    UINTN info_size = sizeof(info_buf);
+    status = uefi_call_wrapper(file->GetInfo, 4,
+                               file, &info_guid, &info_size, info_buf);
+    if (EFI_ERROR(status)) goto fail;
 
-    // Convert to our format
-    g_boot_info.memory_map_count = 0;
-    UINT8 *ptr = (UINT8 *)map;
-    UINT8 *end = ptr + map_size;
-
-    while (ptr < end && g_boot_info.memory_map_count < MAX_MEMORY_MAP_ENTRIES) {
-        EFI_MEMORY_DESCRIPTOR *desc = (EFI_MEMORY_DESCRIPTOR *)ptr;
-        struct MemoryMapEntry *entry = &g_boot_info.memory_map[g_boot_info.memory_map_count];
-
-        entry->base   = desc->PhysicalStart;
-        entry->length = desc->NumberOfPages * 4096;
-
-        // Classify memory type
-        switch (desc->Type) {
-            case EfiConventionalMemory:
-            case EfiBootServicesCode:
-            case EfiBootServicesData:
-                entry->type = MEMORY_TYPE_USABLE;
-                break;
-            case EfiACPIReclaimMemory:
-            case EfiACPIMemoryNVS:
-                entry->type = MEMORY_TYPE_ACPI;
-                break;
-            case EfiMemoryMappedIO:
-            case EfiMemoryMappedIOPortSpace:
-                entry->type = MEMORY_TYPE_MMIO;
-                break;
-            default:
-                entry->type = MEMORY_TYPE_RESERVED;
-        }
+    UINTN file_size = ((EFI_FILE_INFO *)info_buf)->FileSize;
+    UINTN pages = EFI_SIZE_TO_PAGES(file_size);
+    if (pages == 0) pages = 1;
 
-        g_boot_info.memory_map_count++;
-        ptr += desc_size;
+    status = EFI_NOT_FOUND;
+    if (*addr) {
+        status = uefi_call_wrapper(BS->AllocatePages, 4,
+                                   AllocateAddress, EfiLoaderData, pages, addr);
+    }
+    if (EFI_ERROR(status)) {
+        // Try anywhere
+        status = uefi_call_wrapper(BS->AllocatePages, 4,
+                                   AllocateAnyPages, EfiLoaderData, pages, addr);
+        if (EFI_ERROR(status)) goto fail;
     }
 
-    *out_key = map_key;
-    
-    print(ST->ConOut, "Memory map: ");
-    print_dec(ST->ConOut, g_boot_info.memory_map_count);
-    print(ST->ConOut, " entries\n");
-
+    *out = file;
+    *size = file_size;
     return EFI_SUCCESS;
+
+fail:
+    uefi_call_wrapper(file->Close, 1, file);
+    return status;
+}
+
+// Read a whole file into freshly allocated pages, see open_and_alloc()
+static EFI_STATUS read_file(EFI_SYSTEM_TABLE *ST, EFI_FILE_PROTOCOL *dir,
+                            CHAR16 *path, EFI_PHYSICAL_ADDRESS *addr,
+                            UINTN *size) {
+    EFI_FILE_PROTOCOL *file;
+    UINTN file_size;
+    EFI_STATUS status;
+
+    status = open_and_alloc(ST, dir, path, &file, addr, &file_size);
+    if (EFI_ERROR(status)) return status;
+    UINTN pages = file_size ? EFI_SIZE_TO_PAGES(file_size) : 1;
+
+    status = uefi_call_wrapper(file->Read, 3, file, &file_size, (VOID *)*addr);
+    if (EFI_ERROR(status)) {
+        uefi_call_wrapper(ST->BootServices->FreePages, 2, *addr, pages);
+    }
+    *size = file_size;
+    uefi_call_wrapper(file->Close, 1, file);
+    return status;
 }
 
 //=============================================================================
 // Load Kernel from Disk
+// The read is started first thing and only waited for just before the
+// boot info is built. With a revision 2 file protocol it goes out as a
+// ReadEx with an event, which the FAT driver turns into Disk I/O 2 /
+// Block I/O 2 requests, so graphics, ACPI and module loading run while
+// the kernel streams in. Without one it is a plain blocking Read.
+//
+// kernel.elf is a static PIE linked at 0. The file is read into a staging
+// buffer; once it is in, its PT_LOAD segments are placed at a 2 MiB
+// aligned address wherever the firmware has room and the
+// R_X86_64_RELATIVE entries from PT_DYNAMIC are applied there.
 //=============================================================================
 
-static EFI_STATUS load_kernel(EFI_SYSTEM_TABLE *ST, VOID **kernel_addr) {
-    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *fs;
-    EFI_FILE_PROTOCOL *root, *file;
-    EFI_GUID fs_guid = EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
-    EFI_GUID info_guid = EFI_FILE_INFO_GUID;
-    EFI_STATUS status;
+#define KERNEL_ALIGN        0x200000ULL     // One large page
+#define KERNEL_ALIGN_PAGES  EFI_SIZE_TO_PAGES(KERNEL_ALIGN)
+
+static struct {
+    EFI_FILE_PROTOCOL   *file;
+    EFI_FILE_IO_TOKEN    token;
+    EFI_PHYSICAL_ADDRESS addr;      // Staging copy of the file
+    UINTN                size;
+    BOOLEAN              async;
+} g_kernel_read;
+
+// Where the image ended up, for BOOT_TAG_KERNEL
+static struct {
+    EFI_PHYSICAL_ADDRESS base;
+    UINT64               size;
+    UINT64               entry;
+} g_kernel;
+
+static EFI_STATUS start_kernel_read(EFI_SYSTEM_TABLE *ST, EFI_FILE_PROTOCOL *root) {
+    CHAR16 kernel_path[] = u"\\EFI\\BOOT\\kernel.elf";
     EFI_BOOT_SERVICES *BS = ST->BootServices;
+    EFI_STATUS status;
 
-    // Get file system protocol
-    status = uefi_call_wrapper(BS->LocateProtocol, 3,
-                               &fs_guid, NULL, (VOID **)&fs);
+    g_kernel_read.addr = 0;
+    status = open_and_alloc(ST, root, kernel_path, &g_kernel_read.file,
+                            &g_kernel_read.addr, &g_kernel_read.size);
     if (EFI_ERROR(status)) {
-        print(ST->ConOut, "ERROR: No filesystem found\n");
+        print(ST->ConOut, "ERROR: Failed to load kernel.elf\n");
         return status;
     }
 
-    // Open root directory
-    status = uefi_call_wrapper(fs->OpenVolume, 2, fs, &root);
+    EFI_FILE_PROTOCOL *file = g_kernel_read.file;
+    EFI_FILE_IO_TOKEN *token = &g_kernel_read.token;
+    token->BufferSize = g_kernel_read.size;
+    token->Buffer = (VOID *)g_kernel_read.addr;
+
+    if (file->Revision >= EFI_FILE_PROTOCOL_REVISION2) {
+        status = uefi_call_wrapper(BS->CreateEvent, 5,
+                                   0, TPL_CALLBACK, NULL, NULL, &token->Event);
+        if (!EFI_ERROR(status)) {
+            status = uefi_call_wrapper(file->ReadEx, 2, file, token);
+            if (!EFI_ERROR(status)) {
+                g_kernel_read.async = TRUE;
+                return EFI_SUCCESS;
+            }
+            uefi_call_wrapper(BS->CloseEvent, 1, token->Event);
+        }
+    }
+
+    // No asynchronous reads here: do it now
+    token->Status = uefi_call_wrapper(file->Read, 3,
+                                      file, &token->BufferSize, token->Buffer);
+    return EFI_SUCCESS;
+}
+
+// Check the header and find the extent of the PT_LOAD segments. Every
+// offset is checked against the file size before anything is copied.
+static EFI_STATUS elf_check(const UINT8 *file, UINTN file_size, UINT64 *span) {
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)file;
+
+    if (file_size < sizeof(*eh) ||
+        *(const UINT32 *)eh->e_ident != ELF_MAGIC ||
+        eh->e_ident[4] != ELFCLASS64 || eh->e_ident[5] != ELFDATA2LSB ||
+        eh->e_type != ET_DYN || eh->e_machine != EM_X86_64 ||
+        eh->e_phentsize != sizeof(Elf64_Phdr) ||
+        eh->e_phoff > file_size ||
+        (UINT64)eh->e_phnum * sizeof(Elf64_Phdr) > file_size - eh->e_phoff) {
+        return EFI_UNSUPPORTED;
+    }
+
+    const Elf64_Phdr *ph = (const Elf64_Phdr *)(file + eh->e_phoff);
+    UINT64 end = 0;
+    for (UINT16 i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD) continue;
+        if (ph[i].p_filesz > ph[i].p_memsz ||
+            ph[i].p_offset > file_size ||
+            ph[i].p_filesz > file_size - ph[i].p_offset ||
+            ph[i].p_vaddr + ph[i].p_memsz < ph[i].p_vaddr) {
+            return EFI_UNSUPPORTED;
+        }
+        if (ph[i].p_vaddr + ph[i].p_memsz > end) end = ph[i].p_vaddr + ph[i].p_memsz;
+    }
+    if (end == 0 || eh->e_entry >= end) return EFI_UNSUPPORTED;
+
+    *span = end;
+    return EFI_SUCCESS;
+}
+
+// Get pages at a KERNEL_ALIGN boundary: over-allocate by one alignment
+// unit and give back the ragged ends
+static EFI_STATUS alloc_aligned(EFI_BOOT_SERVICES *BS, UINTN pages,
+                                EFI_PHYSICAL_ADDRESS *out) {
+    EFI_PHYSICAL_ADDRESS raw;
+    UINTN total = pages + KERNEL_ALIGN_PAGES;
+    EFI_STATUS status = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages,
+                                          EfiLoaderData, total, &raw);
+    if (EFI_ERROR(status)) return status;
+
+    EFI_PHYSICAL_ADDRESS base = (raw + KERNEL_ALIGN - 1) & ~(KERNEL_ALIGN - 1);
+    UINTN head = EFI_SIZE_TO_PAGES(base - raw);
+    UINTN tail = total - head - pages;
+    if (head) uefi_call_wrapper(BS->FreePages, 2, raw, head);
+    if (tail) uefi_call_wrapper(BS->FreePages, 2, base + EFI_PAGES_TO_SIZE(pages), tail);
+
+    *out = base;
+    return EFI_SUCCESS;
+}
+
+// Apply the image's relocations in place. A static PIE built with hidden
+// visibility only needs R_X86_64_RELATIVE; anything else means the kernel
+// was linked wrong.
+static EFI_STATUS elf_relocate(const UINT8 *file, UINT8 *image, UINT64 span) {
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)file;
+    const Elf64_Phdr *ph = (const Elf64_Phdr *)(file + eh->e_phoff);
+    const Elf64_Dyn *dyn = NULL;
+
+    for (UINT16 i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type == PT_DYNAMIC && ph[i].p_vaddr + ph[i].p_memsz <= span) {
+            dyn = (const Elf64_Dyn *)(image + ph[i].p_vaddr);
+        }
+    }
+    if (!dyn) return EFI_SUCCESS;       // Nothing to fix up
+
+    UINT64 rela = 0, relasz = 0, relaent = sizeof(Elf64_Rela);
+    for (; dyn->d_tag != DT_NULL; dyn++) {
+        if (dyn->d_tag == DT_RELA) rela = dyn->d_val;
+        else if (dyn->d_tag == DT_RELASZ) relasz = dyn->d_val;
+        else if (dyn->d_tag == DT_RELAENT) relaent = dyn->d_val;
+    }
+    if (relaent != sizeof(Elf64_Rela) || rela > span || relasz > span - rela) {
+        return EFI_UNSUPPORTED;
+    }
+
+    const Elf64_Rela *r = (const Elf64_Rela *)(image + rela);
+    for (UINT64 n = relasz / sizeof(*r); n; n--, r++) {
+        UINT32 type = ELF64_R_TYPE(r->r_info);
+        if (type == R_X86_64_NONE) continue;
+        if (type != R_X86_64_RELATIVE || r->r_offset > span - sizeof(UINT64)) {
+            return EFI_UNSUPPORTED;
+        }
+        *(UINT64 *)(image + r->r_offset) = (UINT64)image + r->r_addend;
+    }
+    return EFI_SUCCESS;
+}
+
+// Place the segments at a fresh 2 MiB aligned address and relocate
+static EFI_STATUS load_kernel_image(EFI_SYSTEM_TABLE *ST) {
+    EFI_BOOT_SERVICES *BS = ST->BootServices;
+    const UINT8 *file = (const UINT8 *)g_kernel_read.addr;
+    UINT64 span;
+    EFI_STATUS status;
+
+    status = elf_check(file, g_kernel_read.size, &span);
     if (EFI_ERROR(status)) {
-        print(ST->ConOut, "ERROR: Failed to open volume\n");
+        print(ST->ConOut, "ERROR: kernel.elf is not an x86-64 static PIE\n");
         return status;
     }
 
-    // Open kernel file
-    CHAR16 kernel_path[] = u"\\EFI\\BOOT\\kernel.bin";
-    status = uefi_call_wrapper(root->Open, 5,
-                               root, &file, kernel_path, EFI_FILE_MODE_READ, 0);
+    UINT64 size = (span + KERNEL_ALIGN - 1) & ~(KERNEL_ALIGN - 1);
+    status = alloc_aligned(BS, EFI_SIZE_TO_PAGES(size), &g_kernel.base);
     if (EFI_ERROR(status)) {
-        print(ST->ConOut, "ERROR: Failed to open kernel.bin\n");
+        print(ST->ConOut, "ERROR: No room for the kernel image\n");
         return status;
     }
+    g_kernel.size = size;
 
-    // Get file size
-    UINT8 info_buf[sizeof(EFI_FILE_INFO) + 100];
-    UINTN info_size = sizeof(info_buf);
-    status = uefi_call_wrapper(file->GetInfo, 4,
-                               file, &info_guid, &info_size, info_buf);
+    // Zero first: covers .bss and any gaps between segments. The
+    // firmware's CopyMem/SetMem are far quicker than byte loops here.
+    UINT8 *image = (UINT8 *)g_kernel.base;
+    uefi_call_wrapper(BS->SetMem, 3, image, span, 0);
+
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)file;
+    const Elf64_Phdr *ph = (const Elf64_Phdr *)(file + eh->e_phoff);
+    for (UINT16 i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD) continue;
+        uefi_call_wrapper(BS->CopyMem, 3, image + ph[i].p_vaddr,
+                          (VOID *)(file + ph[i].p_offset), ph[i].p_filesz);
+    }
+
+    status = elf_relocate(file, image, span);
     if (EFI_ERROR(status)) {
-        print(ST->ConOut, "ERROR: Failed to get file info\n");
+        uefi_call_wrapper(BS->FreePages, 2, g_kernel.base, EFI_SIZE_TO_PAGES(size));
+        print(ST->ConOut, "ERROR: Unsupported relocation in kernel.elf\n");
         return status;
     }
 
-    EFI_FILE_INFO *info = (EFI_FILE_INFO *)info_buf;
-    UINTN kernel_size = info->FileSize;
+    g_kernel.entry = g_kernel.base + eh->e_entry;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS finish_kernel_read(EFI_SYSTEM_TABLE *ST, VOID **kernel_entry) {
+    EFI_BOOT_SERVICES *BS = ST->BootServices;
+    EFI_FILE_IO_TOKEN *token = &g_kernel_read.token;
+    UINTN staging_pages = g_kernel_read.size ? EFI_SIZE_TO_PAGES(g_kernel_read.size) : 1;
+    BOOLEAN waited = FALSE;
+    EFI_STATUS status;
+
+    if (g_kernel_read.async) {
+        // CheckEvent consumes the signal, so only wait if it wasn't there
+        if (EFI_ERROR(uefi_call_wrapper(BS->CheckEvent, 1, token->Event))) {
+            UINTN index;
+            uefi_call_wrapper(BS->WaitForEvent, 3, 1, &token->Event, &index);
+            waited = TRUE;
+        }
+        uefi_call_wrapper(BS->CloseEvent, 1, token->Event);
+    }
+    uefi_call_wrapper(g_kernel_read.file->Close, 1, g_kernel_read.file);
+
+    if (EFI_ERROR(token->Status) || token->BufferSize != g_kernel_read.size) {
+        uefi_call_wrapper(BS->FreePages, 2, g_kernel_read.addr, staging_pages);
+        print(ST->ConOut, "ERROR: Failed to load kernel.elf\n");
+        return EFI_ERROR(token->Status) ? token->Status : EFI_DEVICE_ERROR;
+    }
 
-    // Allocate memory for kernel at 1MB
-    UINTN pages = EFI_SIZE_TO_PAGES(kernel_size);
-    EFI_PHYSICAL_ADDRESS addr = 0x100000;
-    
-    status = uefi_call_wrapper(BS->AllocatePages, 4,
-                               AllocateAddress, EfiLoaderData, pages, &addr);
-    if (EFI_ERROR(status)) {
-        // Try anywhere
-        status = uefi_call_wrapper(BS->AllocatePages, 4,
-                                   AllocateAnyPages, EfiLoaderData, pages, &addr);
+    status = load_kernel_image(ST);
+    uefi_call_wrapper(BS->FreePages, 2, g_kernel_read.addr, staging_pages);
+    if (EFI_ERROR(status)) return status;
+
+    *kernel_entry = (VOID *)g_kernel.entry;
+
+    print(ST->ConOut, "Kernel loaded @ ");
+    print_hex(ST->ConOut, g_kernel.base);
+    print(ST->ConOut, " (");
+    print_dec(ST->ConOut, g_kernel_read.size);
+    print(ST->ConOut, !g_kernel_read.async ? " bytes)\n" :
+                      waited ? " bytes, async)\n" : " bytes, async, no wait)\n");
+
+    return EFI_SUCCESS;
+}
+
+//=============================================================================
+// Load Modules and Command Line
+// Both are optional: every file in \EFI\BOOT\MODULES becomes a module tag,
+// \EFI\BOOT\cmdline.txt becomes the command line.
+//=============================================================================
+
+static void load_modules(EFI_SYSTEM_TABLE *ST, EFI_FILE_PROTOCOL *root) {
+    CHAR16 dir_path[] = u"\\EFI\\BOOT\\MODULES";
+    EFI_FILE_PROTOCOL *dir;
+    EFI_STATUS status;
+
+    status = uefi_call_wrapper(root->Open, 5,
+                               root, &dir, dir_path, EFI_FILE_MODE_READ, 0);
+    if (EFI_ERROR(status)) return;
+
+    // Reading a directory returns one EFI_FILE_INFO per call, size 0 at end
+    for (;;) {
+        UINT8 info_buf[sizeof(EFI_FILE_INFO) + 512];
+        UINTN info_size = sizeof(info_buf);
+        status = uefi_call_wrapper(dir->Read, 3, dir, &info_size, info_buf);
+        if (EFI_ERROR(status) || info_size == 0) break;
+
+        EFI_FILE_INFO *info = (EFI_FILE_INFO *)info_buf;
+        if (info->Attribute & EFI_FILE_DIRECTORY) continue;
+
+        if (g_module_count == MAX_MODULES) {
+            print(ST->ConOut, "WARNING: Too many modules, rest ignored\n");
+            break;
+        }
+
+        struct module *mod = &g_modules[g_module_count];
+        mod->base = 0;
+        status = read_file(ST, dir, info->FileName, &mod->base, &mod->size);
         if (EFI_ERROR(status)) {
-            print(ST->ConOut, "ERROR: Failed to allocate memory for kernel\n");
-            return status;
+            print(ST->ConOut, "WARNING: Failed to load a module\n");
+            continue;
+        }
+
+        // File names are UCS-2; modules are named in plain ASCII
+        UINTN i = 0;
+        for (; info->FileName[i] && i < MODULE_NAME_MAX - 1; i++) {
+            CHAR16 c = info->FileName[i];
+            mod->name[i] = (c < 0x80) ? (char)c : '?';
         }
+        mod->name[i] = 0;
+        g_module_count++;
+
+        print(ST->ConOut, "Module ");
+        print(ST->ConOut, mod->name);
+        print(ST->ConOut, " @ ");
+        print_hex(ST->ConOut, mod->base);
+        print(ST->ConOut, " (");
+        print_dec(ST->ConOut, mod->size);
+        print(ST->ConOut, " bytes)\n");
     }
 
-    // Read kernel
-    status = uefi_call_wrapper(file->Read, 3, file, &kernel_size, (VOID *)addr);
-    
+    uefi_call_wrapper(dir->Close, 1, dir);
+}
+
+static void load_cmdline(EFI_SYSTEM_TABLE *ST, EFI_FILE_PROTOCOL *root) {
+    CHAR16 path[] = u"\\EFI\\BOOT\\cmdline.txt";
+    EFI_FILE_PROTOCOL *file;
+    EFI_STATUS status;
+
+    status = uefi_call_wrapper(root->Open, 5,
+                               root, &file, path, EFI_FILE_MODE_READ, 0);
+    if (EFI_ERROR(status)) return;
+
+    UINTN len = CMDLINE_MAX - 1;
+    status = uefi_call_wrapper(file->Read, 3, file, &len, g_cmdline);
     uefi_call_wrapper(file->Close, 1, file);
-    uefi_call_wrapper(root->Close, 1, root);
+    if (EFI_ERROR(status)) len = 0;
+
+    // One line; stop at the first line break
+    UINTN i = 0;
+    while (i < len && g_cmdline[i] != '\r' && g_cmdline[i] != '\n') i++;
+    g_cmdline[i] = 0;
+
+    if (i) {
+        print(ST->ConOut, "Command line: ");
+        print(ST->ConOut, g_cmdline);
+        print(ST->ConOut, "\n");
+    }
+}
+
+//=============================================================================
+// Boot History
+// A non-volatile variable with the stage timestamps of the last
+// BOOT_HISTORY_MAX boots, this one included, so a slower firmware or boot
+// setting shows up against the boots before it. SetVariable may allocate,
+// so this runs before the memory map is sized and the record ends at
+// BOOT_TS_KERNEL_LOADED. The kernel gets the earlier records.
+//=============================================================================
+
+#define HISTORY_VERSION     1
+
+// The variable's contents. A different version or size starts over.
+struct boot_history {
+    UINT32                   version;   // HISTORY_VERSION
+    UINT32                   count;     // Records in use, oldest first
+    UINT32                   next_seq;
+    UINT32                   _pad;
+    struct BootHistoryRecord records[BOOT_HISTORY_MAX];
+};
+
+_Static_assert(BOOT_TS_COUNT <= BOOT_HISTORY_STAGES, "BootHistoryRecord too small");
 
+static CHAR16               g_history_name[] = u"MyOSBootHistory";
+static EFI_GUID             g_history_guid = EFI_GUID_VALUE(0x6d3c5b1e, 0x8f2a, 0x4c71,
+                                                            0x9b, 0x4e, 0x2a, 0x51,
+                                                            0xd7, 0x0c, 0x63, 0xe8);
+static struct boot_history  g_history;
+static UINT32               g_history_earlier;  // Records before this boot's
+
+static void update_boot_history(EFI_SYSTEM_TABLE *ST) {
+    EFI_RUNTIME_SERVICES *RT = ST->RuntimeServices;
+    UINTN size = sizeof(g_history);
+    EFI_STATUS status = uefi_call_wrapper(RT->GetVariable, 5, g_history_name,
+                                          &g_history_guid, NULL, &size, &g_history);
+    if (EFI_ERROR(status) || size != sizeof(g_history) ||
+        g_history.version != HISTORY_VERSION || g_history.count > BOOT_HISTORY_MAX) {
+        if (status != EFI_NOT_FOUND) {
+            print(ST->ConOut, "Boot history: unreadable, starting over\n");
+        }
+        for (UINTN i = 0; i < sizeof(g_history); i++) ((UINT8 *)&g_history)[i] = 0;
+        g_history.version = HISTORY_VERSION;
+        g_history.next_seq = 1;
+    }
+
+    // Oldest out if full
+    if (g_history.count == BOOT_HISTORY_MAX) {
+        for (UINT32 i = 1; i < BOOT_HISTORY_MAX; i++) {
+            g_history.records[i - 1] = g_history.records[i];
+        }
+        g_history.count--;
+    }
+    g_history_earlier = g_history.count;
+
+    struct BootHistoryRecord *r = &g_history.records[g_history.count++];
+    r->seq = g_history.next_seq++;
+    r->count = BOOT_TS_COUNT;
+    for (UINT32 i = 0; i < BOOT_HISTORY_STAGES; i++) {
+        r->tsc[i] = i < BOOT_TS_COUNT ? g_timestamps[i] : 0;
+    }
+
+    status = uefi_call_wrapper(RT->SetVariable, 5, g_history_name, &g_history_guid,
+                               EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS |
+                               EFI_VARIABLE_RUNTIME_ACCESS,
+                               sizeof(g_history), &g_history);
+    print(ST->ConOut, "Boot history: boot ");
+    print_dec(ST->ConOut, r->seq);
+    print(ST->ConOut, ", ");
+    print_dec(ST->ConOut, g_history_earlier);
+    print(ST->ConOut, EFI_ERROR(status) ? " earlier recorded, not saved\n" : " earlier recorded\n");
+}
+
+//=============================================================================
+// BootInfo Construction
+// One page-allocated block, tags appended in order. The memory map tags go
+// last so that a failed ExitBootServices only has to redo those.
+//=============================================================================
+
+#define ALIGN_UP(x, a)  (((x) + (a) - 1) & ~((UINTN)(a) - 1))
+
+// Claim the next tag; the payload is left as it is
+static VOID *bi_reserve_tag(UINT32 type, UINTN size) {
+    if (g_bi_used + ALIGN_UP(size, BOOTINFO_ALIGN) > g_bi_cap) return NULL;
+
+    struct BootTag *tag = (struct BootTag *)(g_bi_buf + g_bi_used);
+    tag->type = type;
+    tag->size = (UINT32)size;
+    g_bi_used += ALIGN_UP(size, BOOTINFO_ALIGN);
+    return tag;
+}
+
+static VOID *bi_add_tag(UINT32 type, UINTN size) {
+    UINT8 *p = bi_reserve_tag(type, size);
+    if (!p) return NULL;
+    for (UINTN i = sizeof(struct BootTag); i < ALIGN_UP(size, BOOTINFO_ALIGN); i++) {
+        p[i] = 0;
+    }
+    return p;
+}
+
+static EFI_STATUS bootinfo_alloc(EFI_SYSTEM_TABLE *ST) {
+    EFI_BOOT_SERVICES *BS = ST->BootServices;
+    UINTN map_size = 0, map_key, desc_size = 0;
+    UINT32 desc_version;
+
+    // Ask how big the memory map is right now
+    uefi_call_wrapper(BS->GetMemoryMap, 5,
+                      &map_size, NULL, &map_key, &desc_size, &desc_version);
+    if (desc_size == 0) desc_size = sizeof(EFI_MEMORY_DESCRIPTOR);
+    g_bi_desc_size = desc_size;
+
+    // The map grows between now and ExitBootServices (this allocation,
+    // console output...), so leave room for a few dozen more descriptors.
+    // The converted map needs at most one entry per descriptor.
+    UINTN descs = map_size / desc_size + 32;
+    UINTN cap = sizeof(struct BootInfo)
+              + sizeof(struct BootTagFramebuffer)
+              + sizeof(struct BootTagRsdp)
+              + sizeof(struct BootTagCmdline) + CMDLINE_MAX
+              + sizeof(struct BootTagTimestamps) + BOOT_TS_COUNT * 8
+              + sizeof(struct BootTagBootHistory)
+              + BOOT_HISTORY_MAX * sizeof(struct BootHistoryRecord)
+              + sizeof(struct BootTagKernel)
+              + g_module_count * (sizeof(struct BootTagModule) + MODULE_NAME_MAX)
+              + sizeof(struct BootTagEfiMemoryMap) + descs * desc_size
+              + sizeof(struct BootTagMemoryMap)
+              + descs * sizeof(struct MemoryMapEntry)
+              + sizeof(struct BootTag)
+              + 16 * BOOTINFO_ALIGN;
+
+    EFI_PHYSICAL_ADDRESS addr;
+    EFI_STATUS status = uefi_call_wrapper(BS->AllocatePages, 4,
+                                          AllocateAnyPages, EfiLoaderData,
+                                          EFI_SIZE_TO_PAGES(cap), &addr);
     if (EFI_ERROR(status)) {
-        print(ST->ConOut, "ERROR: Failed to read kernel\n");
+        print(ST->ConOut, "ERROR: Failed to allocate boot info\n");
         return status;
     }
 
-    *kernel_addr = (VOID *)addr;
-    
-    print(ST->ConOut, "Kernel loaded @ ");
-    print_hex(ST->ConOut, addr);
-    print(ST->ConOut, " (");
-    print_dec(ST->ConOut, kernel_size);
-    print(ST->ConOut, " bytes)\n");
+    g_bi_buf = (UINT8 *)addr;
+    g_bi_cap = EFI_SIZE_TO_PAGES(cap) * 4096;
+    g_bi_used = sizeof(struct BootInfo);
+    return EFI_SUCCESS;
+}
+
+// Tags that don't change across ExitBootServices retries
+static void bootinfo_add_static(void) {
+    struct BootTagFramebuffer *fb = bi_add_tag(BOOT_TAG_FRAMEBUFFER, sizeof(*fb));
+    fb->info = g_framebuffer;
+
+    if (g_rsdp) {
+        struct BootTagRsdp *rsdp = bi_add_tag(BOOT_TAG_RSDP, sizeof(*rsdp));
+        rsdp->revision = g_rsdp_revision;
+        rsdp->address = g_rsdp;
+    }
+
+    for (UINT32 i = 0; i < g_module_count; i++) {
+        struct module *mod = &g_modules[i];
+        UINTN name_len = str_len(mod->name) + 1;
+        struct BootTagModule *tag = bi_add_tag(BOOT_TAG_MODULE,
+                                               sizeof(*tag) + name_len);
+        tag->base = mod->base;
+        tag->size = mod->size;
+        for (UINTN j = 0; j < name_len; j++) tag->name[j] = mod->name[j];
+    }
+
+    if (g_cmdline[0]) {
+        UINTN len = str_len(g_cmdline) + 1;
+        struct BootTagCmdline *tag = bi_add_tag(BOOT_TAG_CMDLINE,
+                                                sizeof(*tag) + len);
+        for (UINTN j = 0; j < len; j++) tag->cmdline[j] = g_cmdline[j];
+    }
+
+    struct BootTagKernel *kern = bi_add_tag(BOOT_TAG_KERNEL, sizeof(*kern));
+    kern->base = g_kernel.base;
+    kern->size = g_kernel.size;
+    kern->entry = g_kernel.entry;
+
+    if (g_history_earlier) {
+        struct BootTagBootHistory *h = bi_add_tag(BOOT_TAG_BOOT_HISTORY, sizeof(*h) +
+            g_history_earlier * sizeof(struct BootHistoryRecord));
+        h->record_size = sizeof(struct BootHistoryRecord);
+        h->count = g_history_earlier;
+        for (UINT32 i = 0; i < g_history_earlier; i++) h->records[i] = g_history.records[i];
+    }
+
+    // Filled in at the very end, once ExitBootServices has been timed
+    g_bi_ts = bi_add_tag(BOOT_TAG_TIMESTAMPS,
+                         sizeof(*g_bi_ts) + BOOT_TS_COUNT * sizeof(UINT64));
+    g_bi_ts->count = BOOT_TS_COUNT;
+}
+
+static UINT32 classify_memory(UINT32 efi_type) {
+    switch (efi_type) {
+        case EfiConventionalMemory:
+            return MEMORY_TYPE_USABLE;
+        case EfiBootServicesCode:
+        case EfiBootServicesData:
+            // Free after ExitBootServices, but the kernel starts out on the
+            // firmware's stack and page tables, which live here
+            return MEMORY_TYPE_BOOT_RECLAIMABLE;
+        case EfiACPIReclaimMemory:
+        case EfiACPIMemoryNVS:
+            return MEMORY_TYPE_ACPI;
+        case EfiMemoryMappedIO:
+        case EfiMemoryMappedIOPortSpace:
+            return MEMORY_TYPE_MMIO;
+        default:
+            return MEMORY_TYPE_RESERVED;
+    }
+}
+
+// Fetch the memory map directly into an EFI_MEMORY_MAP tag, then append
+// our sorted and merged classification of it. No boot services other than
+// GetMemoryMap are used, so this is safe to repeat after a failed
+// ExitBootServices.
+static EFI_STATUS bootinfo_add_memory_map(EFI_SYSTEM_TABLE *ST, UINTN *out_key) {
+    EFI_BOOT_SERVICES *BS = ST->BootServices;
+    UINTN map_key, desc_size;
+    UINT32 desc_version;
+    EFI_STATUS status;
+
+    // Split what is left: descriptors first, then up to one converted
+    // entry per descriptor behind them. Firmware descriptors are often
+    // bigger than ours, so split in proportion rather than in half.
+    struct BootTagEfiMemoryMap *raw = (struct BootTagEfiMemoryMap *)
+        (g_bi_buf + g_bi_used);
+    UINTN room = g_bi_cap - g_bi_used - sizeof(*raw)
+               - sizeof(struct BootTagMemoryMap) - sizeof(struct BootTag)
+               - 2 * BOOTINFO_ALIGN;
+    UINTN map_size = room / (g_bi_desc_size + sizeof(struct MemoryMapEntry)) * g_bi_desc_size;
 
+    status = uefi_call_wrapper(BS->GetMemoryMap, 5,
+                               &map_size, (EFI_MEMORY_DESCRIPTOR *)raw->descriptors,
+                               &map_key, &desc_size, &desc_version);
+    if (EFI_ERROR(status)) return status;
+
+    // Would the converted map fit behind it?
+    UINTN count = map_size / desc_size;
+    if (map_size + count * sizeof(struct MemoryMapEntry) > room) {
+        return EFI_BUFFER_TOO_SMALL;
+    }
+
+    // Descriptors are already in place behind the tag header
+    raw = bi_reserve_tag(BOOT_TAG_EFI_MEMORY_MAP, sizeof(*raw) + map_size);
+    raw->desc_size = (UINT32)desc_size;
+    raw->desc_version = desc_version;
+
+    struct BootTagMemoryMap *mm = bi_add_tag(BOOT_TAG_MEMORY_MAP,
+        sizeof(*mm) + count * sizeof(struct MemoryMapEntry));
+    mm->entry_size = sizeof(struct MemoryMapEntry);
+
+    // Insertion sort by base: firmware maps are usually sorted already,
+    // which makes this linear
+    UINT32 n = 0;
+    for (UINTN i = 0; i < count; i++) {
+        EFI_MEMORY_DESCRIPTOR *desc =
+            (EFI_MEMORY_DESCRIPTOR *)(raw->descriptors + i * desc_size);
+        struct MemoryMapEntry e = {
+            .base   = desc->PhysicalStart,
+            .length = desc->NumberOfPages * 4096,
+            .type   = classify_memory(desc->Type),
+        };
+        UINT32 j = n;
+        while (j > 0 && mm->entries[j - 1].base > e.base) {
+            mm->entries[j] = mm->entries[j - 1];
+            j--;
+        }
+        mm->entries[j] = e;
+        n++;
+    }
+
+    // Merge contiguous runs of the same type
+    UINT32 merged = 0;
+    for (UINT32 i = 0; i < n; i++) {
+        struct MemoryMapEntry *prev = merged ? &mm->entries[merged - 1] : NULL;
+        if (prev && prev->type == mm->entries[i].type &&
+            prev->base + prev->length == mm->entries[i].base) {
+            prev->length += mm->entries[i].length;
+        } else {
+            mm->entries[merged++] = mm->entries[i];
+        }
+    }
+    mm->entry_count = merged;
+
+    // Give back the tail the merge freed
+    g_bi_used -= ALIGN_UP(mm->tag.size, BOOTINFO_ALIGN);
+    mm->tag.size = sizeof(*mm) + merged * sizeof(struct MemoryMapEntry);
+    g_bi_used += ALIGN_UP(mm->tag.size, BOOTINFO_ALIGN);
+
+    *out_key = map_key;
     return EFI_SUCCESS;
 }
 
+// Terminate the tag list and fill in the header
+static struct BootInfo *bootinfo_finish(void) {
+    bi_add_tag(BOOT_TAG_END, sizeof(struct BootTag));
+
+    struct BootInfo *info = (struct BootInfo *)g_bi_buf;
+    info->magic = BOOTINFO_MAGIC;
+    info->version = BOOTINFO_VERSION;
+    info->total_size = (UINT32)g_bi_used;
+    info->_pad = 0;
+    return info;
+}
+
+static void bootinfo_seal(struct BootInfo *info) {
+    for (UINT32 i = 0; i < BOOT_TS_COUNT; i++) {
+        g_bi_ts->tsc[i] = g_timestamps[i];
+    }
+
+    UINT32 sum = 0;
+    info->checksum = 0;
+    UINT32 *words = (UINT32 *)info;
+    for (UINT32 i = 0; i < info->total_size / 4; i++) sum += words[i];
+    info->checksum = -sum;
+}
+
 //=============================================================================
 // Entry Point
 // NOTE: Do NOT use EFIAPI here! gnu-efi's crt0 converts MS ABI to System V
@@ -287,44 +945,84 @@ static EFI_STATUS load_kernel(EFI_SYSTEM_TABLE *ST, VOID **kernel_addr) {
 
 EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *ST) {
     EFI_STATUS status;
-    VOID *kernel_addr;
+    EFI_FILE_PROTOCOL *root;
+    VOID *kernel_entry_addr;
     UINTN map_key;
 
+    stamp(BOOT_TS_LOADER_ENTRY);
+
     // Clear screen and print banner
     uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
     print(ST->ConOut, "=== MyOS Bootloader ===\n\n");
 
-    // Initialize graphics
+    // Get the kernel read going; everything up to the boot info runs
+    // while it is in flight
+    status = open_root(ST, &root);
+    if (EFI_ERROR(status)) return status;
+    status = start_kernel_read(ST, root);
+    if (EFI_ERROR(status)) return status;
+
+    // Initialize graphics, splash before anything slow
     status = init_graphics(ST);
     if (EFI_ERROR(status)) return status;
+    show_splash(ST, root);
+    gfx_progress(1, PROGRESS_STEPS);
+    stamp(BOOT_TS_GRAPHICS);
 
     // Find ACPI tables
     find_rsdp(ST);
+    gfx_progress(2, PROGRESS_STEPS);
 
-    // Load kernel
-    status = load_kernel(ST, &kernel_addr);
+    load_modules(ST, root);
+    load_cmdline(ST, root);
+    gfx_progress(3, PROGRESS_STEPS);
+    stamp(BOOT_TS_MODULES_LOADED);
+
+    // Now the kernel has to be there
+    stamp(BOOT_TS_KERNEL_WAIT);
+    status = finish_kernel_read(ST, &kernel_entry_addr);
     if (EFI_ERROR(status)) return status;
+    uefi_call_wrapper(root->Close, 1, root);
+    gfx_progress(4, PROGRESS_STEPS);
+    stamp(BOOT_TS_KERNEL_LOADED);
 
-    // Get memory map (must be done last, right before ExitBootServices)
-    status = get_memory_map(ST, &map_key);
+    update_boot_history(ST);
+    stamp(BOOT_TS_VAR_STORE);
+
+    status = bootinfo_alloc(ST);
     if (EFI_ERROR(status)) return status;
+    bootinfo_add_static();
+    UINTN static_end = g_bi_used;
+    gfx_progress(5, PROGRESS_STEPS);
 
     print(ST->ConOut, "\nExiting boot services...\n");
 
+    // From here on nothing may allocate or print, or the map key goes stale.
     // Exit boot services - after this, no more UEFI calls!
-    status = uefi_call_wrapper(ST->BootServices->ExitBootServices, 2,
-                               ImageHandle, map_key);
-    if (EFI_ERROR(status)) {
-        // Memory map may have changed, get it again
-        status = get_memory_map(ST, &map_key);
+    struct BootInfo *info;
+    for (int attempt = 0; ; attempt++) {
+        g_bi_used = static_end;
+        status = bootinfo_add_memory_map(ST, &map_key);
+        if (EFI_ERROR(status)) {
+            if (attempt == 0) print(ST->ConOut, "ERROR: Failed to get memory map\n");
+            return status;
+        }
+        stamp(BOOT_TS_MEMORY_MAP);
+        info = bootinfo_finish();
+
         status = uefi_call_wrapper(ST->BootServices->ExitBootServices, 2,
                                    ImageHandle, map_key);
+        if (!EFI_ERROR(status)) break;
+        // Memory map changed under us; fetch it again and retry
+        if (attempt == 4) return status;
     }
+    stamp(BOOT_TS_EXIT_BOOT_SERVICES);
+    bootinfo_seal(info);
 
     // Jump to kernel!
     typedef void (*KernelEntry)(struct BootInfo *);
-    KernelEntry kernel_entry = (KernelEntry)kernel_addr;
-    kernel_entry(&g_boot_info);
+    KernelEntry kernel_entry = (KernelEntry)kernel_entry_addr;
+    kernel_entry(info);
 
     // Should never reach here
     while (1) {
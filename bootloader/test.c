@@ -17,15 +17,9 @@ EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *ST) {
     EFI_STATUS status = ST->BootServices->LocateProtocol(&gop_guid, NULL, (VOID **)&gop);
     
     if (!EFI_ERROR(status) && gop && gop->Mode) {
-        UINT32 *fb = (UINT32 *)gop->Mode->FrameBufferBase;
-        UINT32 ppsl = gop->Mode->Info->PixelsPerScanLine;
-        
-        // Draw green rectangle
-        for (UINT32 y = 100; y < 300; y++) {
-            for (UINT32 x = 100; x < 400; x++) {
-                fb[y * ppsl + x] = 0x0000FF00;
-            }
-        }
+        // Draw green rectangle: one Blt fill instead of a pixel loop
+        EFI_GRAPHICS_OUTPUT_BLT_PIXEL green = { .Green = 0xFF };
+        gop->Blt(gop, &green, EfiBltVideoFill, 0, 0, 100, 100, 300, 200, 0);
     }
     
     while (1) __asm__ volatile("hlt");
@@ -0,0 +1,72 @@
+// common/aio.h
+// Asynchronous I/O rings, shared between the kernel and a user process
+//
+// aio_setup() maps one block of memory into the process: this header,
+// the submission queue (SQ), the completion queue (CQ) and a buffer area
+// that block reads and writes go to and from without a copy. The process
+// fills SQ entries and moves sq_tail; the kernel consumes them, moving
+// sq_head, and for each posts a CQ entry and moves cq_tail; the process
+// reads those and moves cq_head. Neither side needs the other to look at
+// a queue, so completions are read without a system call.
+//
+// The kernel picks submissions up in aio_enter(), or, for a ring set up
+// with AIO_SETUP_SQPOLL, from a CPU polling on its behalf. While no such
+// CPU is running sq_flags has AIO_SQ_NEED_WAKEUP and aio_enter() is
+// needed after all.
+//
+// Every counter is free running; an index is the counter masked by the
+// entry count, a power of two.
+#pragma once
+
+#include <stdint.h>
+
+#define AIO_MAX_ENTRIES     256             // SQ; the CQ has twice as many
+#define AIO_MAX_BUF_PAGES   256             // 1 MiB buffer area
+
+// aio_setup() flags
+#define AIO_SETUP_SQPOLL    (1u << 0)
+
+// sq_flags
+#define AIO_SQ_NEED_WAKEUP  (1u << 0)
+
+// Operations. `res` in the completion is 0 or a negated E* code unless
+// said otherwise.
+#define AIO_OP_NOP          0               // Completes at once
+#define AIO_OP_READ         1               // `count` sectors at `sector` of `dev` into
+                                            // the buffer area at offset `arg`
+#define AIO_OP_WRITE        2               // The same, from the buffer area
+#define AIO_OP_FLUSH        3               // Write back `dev`'s cache
+#define AIO_OP_TIMEOUT      4               // Completes once `arg` ns have passed
+#define AIO_OP_FUTEX_WAKE   5               // Wake up to `count` sleepers on the u32 at
+                                            // address `arg`; res = how many woke
+
+struct aio_sqe {
+    uint8_t  op;
+    uint8_t  dev;                           // Block device number
+    uint16_t _pad;
+    uint32_t count;
+    uint64_t sector;                        // 512-byte units
+    uint64_t arg;
+    uint64_t user_data;                     // Handed back in the completion
+};
+
+struct aio_cqe {
+    uint64_t user_data;
+    int64_t  res;
+};
+
+// At the start of the mapping; offsets are from there too
+struct aio_ring_hdr {
+    _Alignas(64) uint32_t sq_head;          // Kernel
+    _Alignas(64) uint32_t sq_tail;          // Process
+    _Alignas(64) uint32_t cq_head;          // Process
+    _Alignas(64) uint32_t cq_tail;          // Kernel
+    _Alignas(64) uint32_t sq_flags;         // Kernel, AIO_SQ_*
+    uint32_t              sq_entries;
+    uint32_t              cq_entries;
+    uint32_t              _pad;
+    uint64_t              sq_off;           // struct aio_sqe[sq_entries]
+    uint64_t              cq_off;           // struct aio_cqe[cq_entries]
+    uint64_t              buf_off;          // Page aligned
+    uint64_t              buf_size;
+};
@@ -1,9 +1,21 @@
 // common/bootinfo.h
-// Boot information structure passed from bootloader to kernel
+// Boot information passed from bootloader to kernel
 //
 // This is the clean interface between bootloader and kernel.
 // The kernel doesn't need to know if it was loaded by UEFI or legacy BIOS -
-// it just receives this structure with all the information it needs.
+// it just receives this block with all the information it needs.
+//
+// Layout: a fixed header followed by a list of tags, each 8-byte aligned:
+//
+//   struct BootInfo     magic, version, total_size, checksum
+//   struct BootTag      type, size, payload...   (padded to 8 bytes)
+//   struct BootTag      ...
+//   struct BootTag      BOOT_TAG_END
+//
+// Only what the bootloader actually found is present, so the block is as
+// big as the machine needs. New information is added as new tag types;
+// a reader skips tags it doesn't know. The version is only bumped if the
+// header itself or an existing tag's layout changes incompatibly.
 #pragma once
 
 #include <stdint.h>
@@ -12,10 +24,13 @@
 // Memory Types (our own classification)
 //=============================================================================
 
-#define MEMORY_TYPE_USABLE    1  // Free memory, kernel can use
-#define MEMORY_TYPE_RESERVED  2  // Reserved, don't touch
-#define MEMORY_TYPE_ACPI      3  // ACPI tables, reclaimable after parsing
-#define MEMORY_TYPE_MMIO      4  // Memory-mapped I/O
+#define MEMORY_TYPE_USABLE          1  // Free memory, kernel can use
+#define MEMORY_TYPE_RESERVED        2  // Reserved, don't touch
+#define MEMORY_TYPE_ACPI            3  // ACPI tables, reclaimable after parsing
+#define MEMORY_TYPE_MMIO            4  // Memory-mapped I/O
+#define MEMORY_TYPE_BOOT_RECLAIMABLE 5 // Firmware boot services memory; holds
+                                       // the stack and page tables we arrive
+                                       // on, free once the kernel has its own
 
 //=============================================================================
 // Framebuffer Information
@@ -42,20 +57,155 @@ struct MemoryMapEntry {
 };
 
 //=============================================================================
-// Boot Information
-// This is what the bootloader passes to the kernel
+// Header
 //=============================================================================
 
-#define MAX_MEMORY_MAP_ENTRIES 256
+#define BOOTINFO_MAGIC      0x4F464E49544F4F42ULL   // "BOOTINFO"
+#define BOOTINFO_VERSION    1
+#define BOOTINFO_ALIGN      8
 
 struct BootInfo {
-    // Graphics
-    struct FramebufferInfo framebuffer;
-    
-    // Memory map
-    struct MemoryMapEntry  memory_map[MAX_MEMORY_MAP_ENTRIES];
-    uint32_t               memory_map_count;
-    
-    // ACPI (for finding hardware info later)
-    void                  *rsdp;  // ACPI RSDP pointer
+    uint64_t magic;         // BOOTINFO_MAGIC
+    uint32_t version;       // BOOTINFO_VERSION
+    uint32_t total_size;    // Header plus all tags, including BOOT_TAG_END
+    uint32_t checksum;      // Makes the 32-bit words of the block sum to 0
+    uint32_t _pad;
+};
+
+//=============================================================================
+// Tags
+//=============================================================================
+
+#define BOOT_TAG_END            0
+#define BOOT_TAG_FRAMEBUFFER    1
+#define BOOT_TAG_MEMORY_MAP     2
+#define BOOT_TAG_RSDP           3
+#define BOOT_TAG_MODULE         4   // May appear more than once
+#define BOOT_TAG_CMDLINE        5
+#define BOOT_TAG_TIMESTAMPS     6
+#define BOOT_TAG_EFI_MEMORY_MAP 7
+#define BOOT_TAG_KERNEL         8
+#define BOOT_TAG_KEXEC          9   // Only from a kernel, never the loader
+#define BOOT_TAG_BOOT_HISTORY   10
+
+struct BootTag {
+    uint32_t type;          // BOOT_TAG_*
+    uint32_t size;          // Header plus payload, excluding alignment padding
+};
+
+// Next tag starts at the following BOOTINFO_ALIGN boundary
+#define BOOT_TAG_NEXT(t) \
+    ((struct BootTag *)((uint8_t *)(t) + \
+        (((t)->size + BOOTINFO_ALIGN - 1) & ~(uint32_t)(BOOTINFO_ALIGN - 1))))
+
+struct BootTagFramebuffer {
+    struct BootTag         tag;
+    struct FramebufferInfo info;
+};
+
+// Our classification, sorted by address with adjacent same-type runs merged
+struct BootTagMemoryMap {
+    struct BootTag        tag;
+    uint32_t              entry_size;   // sizeof(struct MemoryMapEntry) today
+    uint32_t              entry_count;
+    struct MemoryMapEntry entries[];
+};
+
+struct BootTagRsdp {
+    struct BootTag tag;
+    uint32_t       revision;    // 0 = ACPI 1.0 RSDP, 2 = ACPI 2.0+ (has XSDT)
+    uint32_t       _pad;
+    uint64_t       address;     // Physical address of the RSDP
+};
+
+// A file loaded alongside the kernel (initrd, fonts, ...)
+struct BootTagModule {
+    struct BootTag tag;
+    uint64_t       base;        // Physical address, page aligned
+    uint64_t       size;        // Bytes
+    char           name[];      // NUL-terminated file name
+};
+
+struct BootTagCmdline {
+    struct BootTag tag;
+    char           cmdline[];   // NUL-terminated
+};
+
+// TSC readings taken at each bootloader stage; 0 = stage not reached.
+// Readers must use count, stages may be appended.
+#define BOOT_TS_LOADER_ENTRY        0
+#define BOOT_TS_GRAPHICS            1
+#define BOOT_TS_KERNEL_LOADED       2
+#define BOOT_TS_MODULES_LOADED      3
+#define BOOT_TS_MEMORY_MAP          4
+#define BOOT_TS_EXIT_BOOT_SERVICES  5
+#define BOOT_TS_KERNEL_WAIT         6   // Started waiting for the kernel read
+#define BOOT_TS_VAR_STORE           7   // Boot history variable written
+#define BOOT_TS_COUNT               8
+
+struct BootTagTimestamps {
+    struct BootTag tag;
+    uint32_t       count;
+    uint32_t       _pad;
+    uint64_t       tsc[];
+};
+
+// The firmware's memory map exactly as GetMemoryMap returned it
+struct BootTagEfiMemoryMap {
+    struct BootTag tag;
+    uint32_t       desc_size;   // Stride between descriptors
+    uint32_t       desc_version;
+    uint8_t        descriptors[];
+};
+
+// The start of each descriptor (EFI_MEMORY_DESCRIPTOR); step by desc_size
+#define EFI_MEMORY_BOOT_SERVICES_CODE   3
+#define EFI_MEMORY_BOOT_SERVICES_DATA   4
+
+struct EfiMemoryDescriptor {
+    uint32_t type;
+    uint32_t _pad;
+    uint64_t phys_start;
+    uint64_t virt_start;
+    uint64_t pages;
+    uint64_t attribute;
+};
+
+// Where the relocatable kernel image was placed
+struct BootTagKernel {
+    struct BootTag tag;
+    uint64_t       base;        // Physical load address, 2 MiB aligned
+    uint64_t       size;        // Bytes reserved, multiple of 2 MiB
+    uint64_t       entry;       // Physical address of kernel_main
+};
+
+// Present when the previous kernel started this one directly (see
+// kernel/boot/kexec.h). There is no TIMESTAMPS tag then: the loader's
+// readings belong to the first boot.
+struct BootTagKexec {
+    struct BootTag tag;
+    uint32_t       generation;  // 1 for the first kernel started this way
+    uint32_t       _pad;
+    uint64_t       start_tsc;   // When the previous kernel began the handoff
+};
+
+// Earlier boots' timestamps, oldest first, which the loader keeps in a
+// non-volatile UEFI variable. The variable is written before the memory
+// map is fetched, so a record stops at BOOT_TS_KERNEL_LOADED: the stages
+// after it are 0. Readings are TSC ticks from reset, as in the
+// TIMESTAMPS tag of this boot.
+#define BOOT_HISTORY_MAX        8
+#define BOOT_HISTORY_STAGES     8   // Room per record, >= BOOT_TS_COUNT
+
+struct BootHistoryRecord {
+    uint32_t seq;               // Boots the variable has seen, from 1
+    uint32_t count;             // Stages recorded
+    uint64_t tsc[BOOT_HISTORY_STAGES];
+};
+
+struct BootTagBootHistory {
+    struct BootTag           tag;
+    uint32_t                 record_size;   // sizeof(struct BootHistoryRecord) today
+    uint32_t                 count;
+    struct BootHistoryRecord records[];
 };
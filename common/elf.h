@@ -0,0 +1,86 @@
+// common/elf.h
+// The parts of the ELF-64 format the bootloader and kernel load
+//
+// From the System V ABI (generic and AMD64 supplements). Only what is
+// needed to place PT_LOAD segments and apply relocations of a static
+// position-independent executable.
+#pragma once
+
+#include <stdint.h>
+
+//=============================================================================
+// File Header
+//=============================================================================
+
+#define ELF_MAGIC       0x464C457FU     // "\x7FELF" read as a little-endian word
+
+#define ELFCLASS64      2
+#define ELFDATA2LSB     1
+#define ET_EXEC         2
+#define ET_DYN          3
+#define EM_X86_64       62
+
+typedef struct {
+    uint8_t  e_ident[16];       // Magic, class, data, version, ABI, padding
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} Elf64_Ehdr;
+
+//=============================================================================
+// Program Headers
+//=============================================================================
+
+#define PT_NULL         0
+#define PT_LOAD         1
+#define PT_DYNAMIC      2
+
+#define PF_X            1
+#define PF_W            2
+#define PF_R            4
+
+typedef struct {
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
+} Elf64_Phdr;
+
+//=============================================================================
+// Dynamic Section and Relocations
+//=============================================================================
+
+#define DT_NULL         0
+#define DT_RELA         7
+#define DT_RELASZ       8
+#define DT_RELAENT      9
+
+typedef struct {
+    int64_t  d_tag;
+    uint64_t d_val;
+} Elf64_Dyn;
+
+#define R_X86_64_NONE       0
+#define R_X86_64_RELATIVE   8       // *offset = load base + addend
+
+#define ELF64_R_TYPE(info)  ((uint32_t)(info))
+
+typedef struct {
+    uint64_t r_offset;
+    uint64_t r_info;
+    int64_t  r_addend;
+} Elf64_Rela;
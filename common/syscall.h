@@ -0,0 +1,39 @@
+// common/syscall.h
+// System call numbers and calling convention, shared with user programs
+//
+// SYSCALL with the number in RAX and up to six arguments in RDI, RSI, RDX,
+// R10, R8 and R9. The result comes back in RAX, a negated E* code on
+// failure. RCX and R11 are lost (the CPU keeps the return RIP and RFLAGS
+// in them); every other register is preserved. `int 0x80` takes the same
+// registers and is kept as the slow path to compare against.
+#pragma once
+
+#define SYS_EXIT        0       // exit(code): never returns
+#define SYS_NULL        1       // null(): returns 0, for measuring entry cost
+#define SYS_WRITE       2       // write(buf, len): to the console
+#define SYS_FORK        3       // fork(): child's pid to the parent, 0 to the child
+#define SYS_WAIT        4       // wait(pid, &status): reap child pid (0: any), returns its pid
+#define SYS_GETPID      5       // getpid()
+#define SYS_YIELD       6       // yield(): let other tasks on this CPU run
+#define SYS_CLOCK       7       // clock(): nanoseconds since boot
+#define SYS_CHAN_OPEN   8       // chan_open(id, pages): map shared channel id, returns its address
+#define SYS_FUTEX_WAIT  9       // futex_wait(addr, val): sleep while the u32 at addr == val
+#define SYS_FUTEX_WAKE  10      // futex_wake(addr, n): wake up to n sleepers on addr
+#define SYS_GRANT       11      // grant(id, buf, len): move pages into channel id, returns a handle
+#define SYS_ACCEPT      12      // accept(id, handle, buf): map granted pages at buf
+#define SYS_AIO_SETUP   13      // aio_setup(entries, buf_pages, flags): map an I/O ring, returns its address
+#define SYS_AIO_ENTER   14      // aio_enter(to_submit, min_complete): submit and wait, returns how many taken
+#define SYS_BLK_IO      15      // blk_io(dev, op, sector, buf, count): one AIO_OP_READ/WRITE/FLUSH, waited for
+#define SYS_COUNT       16
+
+// Error codes, numbered as on Linux
+#define ENOENT          2
+#define EIO             5
+#define ECHILD          10
+#define EAGAIN          11
+#define ENOMEM          12
+#define EFAULT          14
+#define EBUSY           16
+#define EINVAL          22
+#define ENOSPC          28
+#define ENOSYS          38
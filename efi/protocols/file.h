@@ -69,6 +69,21 @@ typedef struct {
     CHAR16   FileName[];
 } EFI_FILE_INFO;
 
+//=============================================================================
+// Asynchronous I/O Token (UEFI Spec 13.5, Revision 2 file protocol)
+// Event is signalled once the request finishes; Status holds the result.
+//=============================================================================
+
+#define EFI_FILE_PROTOCOL_REVISION   0x00010000
+#define EFI_FILE_PROTOCOL_REVISION2  0x00020000
+
+typedef struct {
+    EFI_EVENT  Event;
+    EFI_STATUS Status;
+    UINTN      BufferSize;
+    VOID      *Buffer;
+} EFI_FILE_IO_TOKEN;
+
 //=============================================================================
 // File Protocol Function Pointer Types
 //=============================================================================
@@ -129,6 +144,30 @@ typedef EFI_STATUS (EFIAPI *EFI_FILE_FLUSH)(
     struct _EFI_FILE_PROTOCOL *This
 );
 
+typedef EFI_STATUS (EFIAPI *EFI_FILE_OPEN_EX)(
+    struct _EFI_FILE_PROTOCOL  *This,
+    struct _EFI_FILE_PROTOCOL **NewHandle,
+    CHAR16                    *FileName,
+    UINT64                     OpenMode,
+    UINT64                     Attributes,
+    EFI_FILE_IO_TOKEN         *Token
+);
+
+typedef EFI_STATUS (EFIAPI *EFI_FILE_READ_EX)(
+    struct _EFI_FILE_PROTOCOL *This,
+    EFI_FILE_IO_TOKEN         *Token
+);
+
+typedef EFI_STATUS (EFIAPI *EFI_FILE_WRITE_EX)(
+    struct _EFI_FILE_PROTOCOL *This,
+    EFI_FILE_IO_TOKEN         *Token
+);
+
+typedef EFI_STATUS (EFIAPI *EFI_FILE_FLUSH_EX)(
+    struct _EFI_FILE_PROTOCOL *This,
+    EFI_FILE_IO_TOKEN         *Token
+);
+
 //=============================================================================
 // File Protocol
 //=============================================================================
@@ -145,6 +184,11 @@ typedef struct _EFI_FILE_PROTOCOL {
     EFI_FILE_GET_INFO    GetInfo;
     EFI_FILE_SET_INFO    SetInfo;
     EFI_FILE_FLUSH       Flush;
+    // Revision 2 and later only: check Revision before using these
+    EFI_FILE_OPEN_EX     OpenEx;
+    EFI_FILE_READ_EX     ReadEx;
+    EFI_FILE_WRITE_EX    WriteEx;
+    EFI_FILE_FLUSH_EX    FlushEx;
 } EFI_FILE_PROTOCOL;
 
 //=============================================================================
@@ -1,6 +1,6 @@
 // efi/tables.h
-// EFI System Table and Boot Services from UEFI Specification 2.10
-// Section 4.3 (EFI System Table) and Section 4.4 (EFI Boot Services)
+// EFI System Table, Boot Services and Runtime Services from UEFI
+// Specification 2.10 Sections 4.3, 4.4 and 4.5
 #pragma once
 
 #include "types.h"
@@ -105,6 +105,25 @@ typedef enum {
     MaxAllocateType
 } EFI_ALLOCATE_TYPE;
 
+//=============================================================================
+// Event Types and Task Priority Levels (UEFI Spec 7.1)
+//=============================================================================
+
+#define EVT_TIMER           0x80000000
+#define EVT_RUNTIME         0x40000000
+#define EVT_NOTIFY_WAIT     0x00000100
+#define EVT_NOTIFY_SIGNAL   0x00000200
+
+#define TPL_APPLICATION     4
+#define TPL_CALLBACK        8
+#define TPL_NOTIFY          16
+#define TPL_HIGH_LEVEL      31
+
+typedef VOID (EFIAPI *EFI_EVENT_NOTIFY)(
+    EFI_EVENT Event,
+    VOID     *Context
+);
+
 //=============================================================================
 // Boot Services Function Pointer Types
 //=============================================================================
@@ -139,6 +158,40 @@ typedef EFI_STATUS (EFIAPI *EFI_FREE_POOL)(
     VOID *Buffer
 );
 
+typedef EFI_STATUS (EFIAPI *EFI_CREATE_EVENT)(
+    UINT32           Type,
+    EFI_TPL          NotifyTpl,
+    EFI_EVENT_NOTIFY NotifyFunction,
+    VOID            *NotifyContext,
+    EFI_EVENT       *Event
+);
+
+typedef EFI_STATUS (EFIAPI *EFI_WAIT_FOR_EVENT)(
+    UINTN      NumberOfEvents,
+    EFI_EVENT *Event,
+    UINTN     *Index
+);
+
+typedef EFI_STATUS (EFIAPI *EFI_CLOSE_EVENT)(
+    EFI_EVENT Event
+);
+
+typedef EFI_STATUS (EFIAPI *EFI_CHECK_EVENT)(
+    EFI_EVENT Event
+);
+
+typedef VOID (EFIAPI *EFI_COPY_MEM)(
+    VOID  *Destination,
+    VOID  *Source,
+    UINTN  Length
+);
+
+typedef VOID (EFIAPI *EFI_SET_MEM)(
+    VOID  *Buffer,
+    UINTN  Size,
+    UINT8  Value
+);
+
 typedef EFI_STATUS (EFIAPI *EFI_EXIT_BOOT_SERVICES)(
     EFI_HANDLE ImageHandle,
     UINTN      MapKey
@@ -180,12 +233,12 @@ struct _EFI_BOOT_SERVICES {
     //-------------------------------------------------------------------------
     // Event & Timer Services (UEFI Spec 7.1)
     //-------------------------------------------------------------------------
-    VOID *CreateEvent;
+    EFI_CREATE_EVENT     CreateEvent;
     VOID *SetTimer;
-    VOID *WaitForEvent;
+    EFI_WAIT_FOR_EVENT   WaitForEvent;
     VOID *SignalEvent;
-    VOID *CloseEvent;
-    VOID *CheckEvent;
+    EFI_CLOSE_EVENT      CloseEvent;
+    EFI_CHECK_EVENT      CheckEvent;
 
     //-------------------------------------------------------------------------
     // Protocol Handler Services (UEFI Spec 7.3)
@@ -247,7 +300,71 @@ struct _EFI_BOOT_SERVICES {
     //-------------------------------------------------------------------------
     // Miscellaneous Services (UEFI Spec 7.5)
     //-------------------------------------------------------------------------
-    VOID *CopyMem;
-    VOID *SetMem;
+    EFI_COPY_MEM CopyMem;
+    EFI_SET_MEM  SetMem;
     VOID *CreateEventEx;
 };
+
+//=============================================================================
+// Variable Services (UEFI Spec 8.2)
+//=============================================================================
+
+#define EFI_VARIABLE_NON_VOLATILE       0x00000001
+#define EFI_VARIABLE_BOOTSERVICE_ACCESS 0x00000002
+#define EFI_VARIABLE_RUNTIME_ACCESS     0x00000004
+
+// On EFI_BUFFER_TOO_SMALL, *DataSize is set to the size needed
+typedef EFI_STATUS (EFIAPI *EFI_GET_VARIABLE)(
+    CHAR16   *VariableName,
+    EFI_GUID *VendorGuid,
+    UINT32   *Attributes,           // Optional
+    UINTN    *DataSize,
+    VOID     *Data
+);
+
+// DataSize 0 deletes the variable
+typedef EFI_STATUS (EFIAPI *EFI_SET_VARIABLE)(
+    CHAR16   *VariableName,
+    EFI_GUID *VendorGuid,
+    UINT32    Attributes,
+    UINTN     DataSize,
+    VOID     *Data
+);
+
+//=============================================================================
+// EFI Runtime Services Table (UEFI Spec 4.5)
+//
+// Callable after ExitBootServices too, but only from memory the firmware
+// marked EfiRuntimeServices*, identity mapped until SetVirtualAddressMap.
+// Same placeholder convention as the boot services table.
+//=============================================================================
+
+struct _EFI_RUNTIME_SERVICES {
+    EFI_TABLE_HEADER Hdr;
+
+    // Time Services (UEFI Spec 8.3)
+    VOID *GetTime;
+    VOID *SetTime;
+    VOID *GetWakeupTime;
+    VOID *SetWakeupTime;
+
+    // Virtual Memory Services (UEFI Spec 8.4)
+    VOID *SetVirtualAddressMap;
+    VOID *ConvertPointer;
+
+    // Variable Services (UEFI Spec 8.2)
+    EFI_GET_VARIABLE GetVariable;
+    VOID *GetNextVariableName;
+    EFI_SET_VARIABLE SetVariable;
+
+    // Miscellaneous Services (UEFI Spec 8.5)
+    VOID *GetNextHighMonotonicCount;
+    VOID *ResetSystem;
+
+    // UEFI 2.0 Capsule Services (UEFI Spec 8.5.3)
+    VOID *UpdateCapsule;
+    VOID *QueryCapsuleCapabilities;
+
+    // Miscellaneous UEFI 2.0 Service (UEFI Spec 8.5.4)
+    VOID *QueryVariableInfo;
+};
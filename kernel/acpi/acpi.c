@@ -0,0 +1,84 @@
+// kernel/acpi/acpi.c
+// RSDP/XSDT walking and table lookup
+#include "acpi/acpi.h"
+#include "boot/bootinfo.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+
+struct acpi_rsdp {
+    char     signature[8];      // "RSD PTR "
+    uint8_t  checksum;          // First 20 bytes
+    char     oem_id[6];
+    uint8_t  revision;          // 0 = ACPI 1.0, 2 = ACPI 2.0+
+    uint32_t rsdt_address;
+    // ACPI 2.0+
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t  extended_checksum; // Whole structure
+    uint8_t  _reserved[3];
+} __attribute__((packed));
+
+static const struct acpi_sdt_header *g_root;
+static uint32_t g_entry_size;           // 8 for the XSDT, 4 for the RSDT
+static uint32_t g_entry_count;
+
+static uint8_t sum_bytes(const void *p, uint32_t len) {
+    const uint8_t *b = p;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) sum += b[i];
+    return sum;
+}
+
+static int table_ok(const struct acpi_sdt_header *h) {
+    return h->length >= sizeof(*h) && sum_bytes(h, h->length) == 0;
+}
+
+// Root table entries are not naturally aligned in the XSDT
+static uint64_t root_entry(uint32_t i) {
+    const uint8_t *p = (const uint8_t *)(g_root + 1) + i * g_entry_size;
+    uint64_t addr = 0;
+    memcpy(&addr, p, g_entry_size);
+    return addr;
+}
+
+int acpi_init(void) {
+    if (!g_boot.rsdp) return -1;
+
+    const struct acpi_rsdp *rsdp = phys_to_virt(g_boot.rsdp);
+    if (memcmp(rsdp->signature, "RSD PTR ", 8) != 0 || sum_bytes(rsdp, 20) != 0) {
+        return -1;
+    }
+
+    const struct acpi_sdt_header *root = NULL;
+    if (rsdp->revision >= 2 && rsdp->length >= sizeof(*rsdp) &&
+        sum_bytes(rsdp, sizeof(*rsdp)) == 0 && rsdp->xsdt_address) {
+        root = phys_to_virt(rsdp->xsdt_address);
+        g_entry_size = 8;
+        if (memcmp(root->signature, "XSDT", 4) != 0 || !table_ok(root)) root = NULL;
+    }
+    if (!root && rsdp->rsdt_address) {
+        root = phys_to_virt(rsdp->rsdt_address);
+        g_entry_size = 4;
+        if (memcmp(root->signature, "RSDT", 4) != 0 || !table_ok(root)) root = NULL;
+    }
+    if (!root) return -1;
+
+    g_root = root;
+    g_entry_count = (root->length - sizeof(*root)) / g_entry_size;
+    return 0;
+}
+
+const struct acpi_sdt_header *acpi_find_table(const char *signature, uint32_t index) {
+    for (uint32_t i = 0; i < g_entry_count; i++) {
+        uint64_t addr = root_entry(i);
+        if (!addr) continue;
+        const struct acpi_sdt_header *h = phys_to_virt(addr);
+        if (memcmp(h->signature, signature, 4) != 0 || !table_ok(h)) continue;
+        if (index-- == 0) return h;
+    }
+    return NULL;
+}
+
+uint32_t acpi_table_count(void) {
+    return g_entry_count;
+}
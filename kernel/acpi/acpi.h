@@ -0,0 +1,173 @@
+// kernel/acpi/acpi.h
+// ACPI table discovery
+//
+// The RSDP from the BootInfo block leads to the XSDT (RSDT on ACPI 1.0
+// firmware), which lists every other table. Tables stay where the
+// firmware put them (MEMORY_TYPE_ACPI, identity mapped); nothing is
+// copied. Only the static tables are used - there is no AML interpreter.
+#pragma once
+
+#include <stdint.h>
+
+struct acpi_sdt_header {
+    char     signature[4];
+    uint32_t length;            // Whole table, header included
+    uint8_t  revision;
+    uint8_t  checksum;          // Makes all bytes of the table sum to 0
+    char     oem_id[6];
+    char     oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+//=============================================================================
+// MCFG: PCI Express memory-mapped configuration (ECAM) windows
+//=============================================================================
+
+struct acpi_mcfg_entry {
+    uint64_t base;              // Address of bus 0 (even if start_bus > 0)
+    uint16_t segment;
+    uint8_t  start_bus;
+    uint8_t  end_bus;
+    uint32_t _reserved;
+} __attribute__((packed));
+
+struct acpi_mcfg {
+    struct acpi_sdt_header header;
+    uint64_t               _reserved;
+    struct acpi_mcfg_entry entries[];
+} __attribute__((packed));
+
+//=============================================================================
+// MADT ("APIC"): interrupt controllers and the CPUs behind them
+//=============================================================================
+
+#define MADT_LOCAL_APIC         0
+#define MADT_LOCAL_X2APIC       9
+
+#define MADT_CPU_ENABLED        (1 << 0)
+#define MADT_CPU_ONLINE_CAPABLE (1 << 1)   // Disabled now, may be hot-added
+
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t               local_apic_address;
+    uint32_t               flags;
+    uint8_t                entries[];  // Variable-length, type and length first
+} __attribute__((packed));
+
+struct acpi_madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+struct acpi_madt_local_apic {
+    struct acpi_madt_entry entry;
+    uint8_t                processor_id;
+    uint8_t                apic_id;
+    uint32_t               flags;      // MADT_CPU_*
+} __attribute__((packed));
+
+struct acpi_madt_local_x2apic {
+    struct acpi_madt_entry entry;
+    uint16_t               _reserved;
+    uint32_t               x2apic_id;
+    uint32_t               flags;      // MADT_CPU_*
+    uint32_t               processor_uid;
+} __attribute__((packed));
+
+//=============================================================================
+// SRAT: which proximity domain each CPU and memory range belongs to
+//=============================================================================
+
+#define SRAT_CPU_APIC           0
+#define SRAT_MEMORY             1
+#define SRAT_CPU_X2APIC         2
+
+#define SRAT_ENABLED            (1 << 0)   // Same bit in all three types
+#define SRAT_MEM_HOTPLUG        (1 << 1)
+
+struct acpi_srat {
+    struct acpi_sdt_header header;
+    uint32_t               _reserved1;     // 1, for compatibility
+    uint64_t               _reserved2;
+    uint8_t                entries[];      // Variable-length, type and length first
+} __attribute__((packed));
+
+struct acpi_srat_cpu_apic {
+    uint8_t  type;
+    uint8_t  length;
+    uint8_t  domain_lo;                     // Bits 0-7 of the proximity domain
+    uint8_t  apic_id;
+    uint32_t flags;
+    uint8_t  sapic_eid;
+    uint8_t  domain_hi[3];                  // Bits 8-31
+    uint32_t clock_domain;
+} __attribute__((packed));
+
+struct acpi_srat_memory {
+    uint8_t  type;
+    uint8_t  length;
+    uint32_t domain;
+    uint16_t _reserved1;
+    uint64_t base;
+    uint64_t length_bytes;
+    uint32_t _reserved2;
+    uint32_t flags;
+    uint64_t _reserved3;
+} __attribute__((packed));
+
+struct acpi_srat_cpu_x2apic {
+    uint8_t  type;
+    uint8_t  length;
+    uint16_t _reserved1;
+    uint32_t domain;
+    uint32_t x2apic_id;
+    uint32_t flags;
+    uint32_t clock_domain;
+    uint32_t _reserved2;
+} __attribute__((packed));
+
+//=============================================================================
+// SLIT: relative distance between proximity domains, 10 = local
+//=============================================================================
+
+struct acpi_slit {
+    struct acpi_sdt_header header;
+    uint64_t               count;          // Domains; the matrix is count x count
+    uint8_t                distance[];     // Row = from, column = to
+} __attribute__((packed));
+
+//=============================================================================
+// HPET: the High Precision Event Timer block
+//=============================================================================
+
+#define ACPI_GAS_MEMORY         0       // Generic address space: system memory
+
+struct acpi_gas {
+    uint8_t  space_id;
+    uint8_t  bit_width;
+    uint8_t  bit_offset;
+    uint8_t  access_size;
+    uint64_t address;
+} __attribute__((packed));
+
+struct acpi_hpet {
+    struct acpi_sdt_header header;
+    uint32_t               block_id;    // Hardware revision, comparator count...
+    struct acpi_gas        base;
+    uint8_t                number;
+    uint16_t               min_tick;
+    uint8_t                page_protection;
+} __attribute__((packed));
+
+// Locate and validate the root table. Returns 0, or -1 if the loader found
+// no RSDP or it fails its checksum.
+int acpi_init(void);
+
+// The `index`th table (0 = first) with this signature whose checksum is
+// good, or NULL
+const struct acpi_sdt_header *acpi_find_table(const char *signature, uint32_t index);
+
+// Tables listed by the root table
+uint32_t acpi_table_count(void);
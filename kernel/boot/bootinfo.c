@@ -0,0 +1,154 @@
+// kernel/boot/bootinfo.c
+// Tagged BootInfo parsing (layout in common/bootinfo.h)
+#include "boot/bootinfo.h"
+#include "lib/string.h"
+
+struct boot_view g_boot;
+
+static const char g_empty_cmdline[] = "";
+
+static const struct BootTag *tags_end(void) {
+    return (const struct BootTag *)
+        ((const uint8_t *)g_boot.header + g_boot.header->total_size);
+}
+
+// A tag is usable if its header and payload lie inside the block
+static int tag_ok(const struct BootTag *t, const struct BootTag *end) {
+    if ((const uint8_t *)t + sizeof(*t) > (const uint8_t *)end) return 0;
+    if (t->size < sizeof(*t)) return 0;
+    return t->size <= (uint64_t)((const uint8_t *)end - (const uint8_t *)t);
+}
+
+//=============================================================================
+// Parsing
+//=============================================================================
+
+static void index_tag(const struct BootTag *t) {
+    switch (t->type) {
+    case BOOT_TAG_FRAMEBUFFER: {
+        const struct BootTagFramebuffer *fb = (const void *)t;
+        if (t->size >= sizeof(*fb)) g_boot.framebuffer = &fb->info;
+        break;
+    }
+    case BOOT_TAG_MEMORY_MAP: {
+        const struct BootTagMemoryMap *mm = (const void *)t;
+        if (t->size < sizeof(*mm) ||
+            mm->entry_size != sizeof(struct MemoryMapEntry)) break;
+        uint32_t fit = (t->size - sizeof(*mm)) / sizeof(struct MemoryMapEntry);
+        g_boot.memory_map = mm->entries;
+        g_boot.memory_map_count = mm->entry_count < fit ? mm->entry_count : fit;
+        break;
+    }
+    case BOOT_TAG_RSDP: {
+        const struct BootTagRsdp *r = (const void *)t;
+        if (t->size < sizeof(*r)) break;
+        g_boot.rsdp = r->address;
+        g_boot.rsdp_revision = r->revision;
+        break;
+    }
+    case BOOT_TAG_MODULE: {
+        const struct BootTagModule *m = (const void *)t;
+        if (t->size <= sizeof(*m)) break;
+        if (!g_boot.first_module) g_boot.first_module = m;
+        g_boot.module_count++;
+        break;
+    }
+    case BOOT_TAG_CMDLINE:
+        if (t->size > sizeof(struct BootTagCmdline)) {
+            g_boot.cmdline = ((const struct BootTagCmdline *)t)->cmdline;
+        }
+        break;
+    case BOOT_TAG_TIMESTAMPS: {
+        const struct BootTagTimestamps *ts = (const void *)t;
+        if (t->size < sizeof(*ts)) break;
+        uint32_t fit = (t->size - sizeof(*ts)) / sizeof(uint64_t);
+        g_boot.timestamps = ts->tsc;
+        g_boot.timestamp_count = ts->count < fit ? ts->count : fit;
+        break;
+    }
+    case BOOT_TAG_EFI_MEMORY_MAP: {
+        const struct BootTagEfiMemoryMap *e = (const void *)t;
+        if (t->size >= sizeof(*e) && e->desc_size) g_boot.efi_memory_map = e;
+        break;
+    }
+    case BOOT_TAG_KERNEL: {
+        const struct BootTagKernel *k = (const void *)t;
+        if (t->size >= sizeof(*k)) g_boot.kernel = k;
+        break;
+    }
+    case BOOT_TAG_KEXEC: {
+        const struct BootTagKexec *k = (const void *)t;
+        if (t->size >= sizeof(*k)) g_boot.kexec = k;
+        break;
+    }
+    case BOOT_TAG_BOOT_HISTORY: {
+        const struct BootTagBootHistory *h = (const void *)t;
+        if (t->size < sizeof(*h) || h->record_size != sizeof(struct BootHistoryRecord)) break;
+        uint32_t fit = (t->size - sizeof(*h)) / sizeof(struct BootHistoryRecord);
+        g_boot.history = h->records;
+        g_boot.history_count = h->count < fit ? h->count : fit;
+        break;
+    }
+    default:
+        g_boot.unknown_tags++;
+        break;
+    }
+}
+
+int bootinfo_parse(const struct BootInfo *info) {
+    memset(&g_boot, 0, sizeof(g_boot));
+    g_boot.cmdline = g_empty_cmdline;
+
+    if (info->magic != BOOTINFO_MAGIC || info->version != BOOTINFO_VERSION) {
+        return -1;
+    }
+    if (info->total_size < sizeof(*info) + sizeof(struct BootTag) ||
+        info->total_size % BOOTINFO_ALIGN) {
+        return -1;
+    }
+
+    uint32_t sum = 0;
+    const uint32_t *words = (const uint32_t *)info;
+    for (uint32_t i = 0; i < info->total_size / 4; i++) sum += words[i];
+    if (sum != 0) return -1;
+
+    g_boot.header = info;
+    const struct BootTag *end = tags_end();
+    const struct BootTag *t = (const struct BootTag *)(info + 1);
+    while (tag_ok(t, end) && t->type != BOOT_TAG_END) {
+        index_tag(t);
+        t = BOOT_TAG_NEXT(t);
+    }
+
+    // Command lines are NUL-terminated; make sure it is inside the tag
+    if (g_boot.cmdline != g_empty_cmdline) {
+        const struct BootTag *ct = (const struct BootTag *)
+            (g_boot.cmdline - sizeof(struct BootTagCmdline));
+        if (((const char *)ct)[ct->size - 1] != '\0') {
+            g_boot.cmdline = g_empty_cmdline;
+        }
+    }
+    return 0;
+}
+
+//=============================================================================
+// Accessors
+//=============================================================================
+
+const struct BootTagModule *bootinfo_next_module(const struct BootTagModule *prev) {
+    if (!prev) return g_boot.first_module;
+
+    const struct BootTag *end = tags_end();
+    const struct BootTag *t = BOOT_TAG_NEXT(&prev->tag);
+    while (tag_ok(t, end) && t->type != BOOT_TAG_END) {
+        if (t->type == BOOT_TAG_MODULE && t->size > sizeof(*prev)) {
+            return (const struct BootTagModule *)t;
+        }
+        t = BOOT_TAG_NEXT(t);
+    }
+    return NULL;
+}
+
+uint64_t bootinfo_timestamp(uint32_t stage) {
+    return stage < g_boot.timestamp_count ? g_boot.timestamps[stage] : 0;
+}
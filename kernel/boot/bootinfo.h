@@ -0,0 +1,42 @@
+// kernel/boot/bootinfo.h
+// Parsed view of the bootloader's tagged BootInfo block
+//
+// Parsing validates the block and records pointers into it; nothing is
+// copied, so the block (MEMORY_TYPE_RESERVED loader data) must stay
+// mapped and untouched for as long as the view is used.
+#pragma once
+
+#include <stdint.h>
+#include "common/bootinfo.h"
+
+struct boot_view {
+    const struct BootInfo              *header;
+    const struct FramebufferInfo       *framebuffer;    // NULL: headless
+    const struct MemoryMapEntry        *memory_map;
+    uint32_t                            memory_map_count;
+    uint32_t                            module_count;
+    const struct BootTagModule         *first_module;
+    uint64_t                            rsdp;           // 0: not found
+    uint32_t                            rsdp_revision;
+    const char                         *cmdline;        // Never NULL
+    const uint64_t                     *timestamps;     // TSC per BOOT_TS_*
+    uint32_t                            timestamp_count;
+    const struct BootTagEfiMemoryMap   *efi_memory_map;
+    const struct BootTagKernel         *kernel;         // NULL: older loader
+    const struct BootTagKexec          *kexec;          // NULL: started by the loader
+    const struct BootHistoryRecord     *history;        // Earlier boots, oldest first
+    uint32_t                            history_count;
+    uint32_t                            unknown_tags;   // Skipped, newer loader
+};
+
+extern struct boot_view g_boot;
+
+// Validate and index the block. Returns 0, or -1 (bad magic, version,
+// size or checksum) with g_boot left empty.
+int bootinfo_parse(const struct BootInfo *info);
+
+// Iterate over BOOT_TAG_MODULE tags: pass NULL to get g_boot.first_module
+const struct BootTagModule *bootinfo_next_module(const struct BootTagModule *prev);
+
+// Timestamp for a BOOT_TS_* stage, 0 if the loader didn't record it
+uint64_t bootinfo_timestamp(uint32_t stage);
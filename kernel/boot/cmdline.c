@@ -0,0 +1,58 @@
+// kernel/boot/cmdline.c
+// Kernel command line options
+#include "boot/cmdline.h"
+#include "boot/bootinfo.h"
+
+// Find `key` as a whole word; returns the character after it, or NULL
+static const char *find_key(const char *key) {
+    const char *s = g_boot.cmdline;
+
+    while (*s) {
+        while (*s == ' ') s++;
+        const char *k = key;
+        const char *w = s;
+        while (*k && *w == *k) { w++; k++; }
+        if (!*k && (*w == '\0' || *w == ' ' || *w == '=')) return w;
+        while (*s && *s != ' ') s++;
+    }
+    return NULL;
+}
+
+int cmdline_has(const char *key) {
+    return find_key(key) != NULL;
+}
+
+const char *cmdline_get(const char *key, char *buf, size_t size) {
+    const char *v = find_key(key);
+    if (!v || *v != '=' || size == 0) return NULL;
+
+    v++;
+    size_t n = 0;
+    while (v[n] && v[n] != ' ' && n + 1 < size) {
+        buf[n] = v[n];
+        n++;
+    }
+    buf[n] = '\0';
+    return buf;
+}
+
+uint64_t cmdline_get_u64(const char *key, uint64_t def) {
+    char buf[24];
+    const char *s = cmdline_get(key, buf, sizeof(buf));
+    if (!s || !*s) return def;
+
+    uint64_t base = 10, v = 0;
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s += 2;
+    }
+    for (; *s; s++) {
+        uint64_t d;
+        if (*s >= '0' && *s <= '9') d = *s - '0';
+        else if (base == 16 && *s >= 'a' && *s <= 'f') d = *s - 'a' + 10;
+        else if (base == 16 && *s >= 'A' && *s <= 'F') d = *s - 'A' + 10;
+        else return def;
+        v = v * base + d;
+    }
+    return v;
+}
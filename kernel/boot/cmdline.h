@@ -0,0 +1,19 @@
+// kernel/boot/cmdline.h
+// Kernel command line options
+//
+// The command line is a space-separated list of `flag` and `key=value`
+// words, e.g. "blkbench blkbench.qd=32 qemu_exit".
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Nonzero if `key` appears, with or without a value
+int cmdline_has(const char *key);
+
+// Copy the value of `key=value` into buf (NUL-terminated, truncated to
+// fit). Returns buf, or NULL if the key is absent or has no value.
+const char *cmdline_get(const char *key, char *buf, size_t size);
+
+// Numeric value of `key=value` (decimal or 0x hex), or `def` if absent
+uint64_t cmdline_get_u64(const char *key, uint64_t def);
@@ -0,0 +1,268 @@
+// kernel/boot/initcall.c
+// Dependency-ordered initcalls, run in parallel rounds on every CPU
+//
+// The BSP alternates two steps until everything has run: the ready INIT_SMP
+// calls, one after another, then a round over smp_run() of every other
+// call that can finish without a further INIT_SMP one. Inside a round each
+// CPU claims whichever member has all its dependencies done, so chains
+// run back to back and independent calls side by side.
+#include "boot/initcall.h"
+#include "lib/printk.h"
+#include "time/clock.h"
+#include "x86/cpu.h"
+#include "x86/smp.h"
+
+#define INITCALL_MAX    64
+#define INITCALL_DEPS   8
+#define NAME_MAX        32
+
+enum { IC_WAITING, IC_RUNNING, IC_DONE };
+
+extern const struct initcall __initcalls_start[];
+extern const struct initcall __initcalls_end[];
+
+// By position in the section
+static struct {
+    volatile uint32_t state;
+    uint32_t          cpu;
+    uint32_t          ndeps;
+    int32_t           after;            // Last to finish of what it waited for, or -1
+    uint16_t          deps[INITCALL_DEPS];
+    uint32_t          in_round;
+    uint64_t          start, end;       // now_ns()
+} g_ic[INITCALL_MAX];
+
+static const struct initcall *g_calls;
+static uint32_t               g_count;
+static int32_t                g_last = -1;      // Last to finish before this step
+static volatile uint32_t      g_remaining;      // Round members still to finish
+
+//=============================================================================
+// Dependencies
+//=============================================================================
+
+static int32_t find(const char *word, uint32_t len) {
+    for (uint32_t i = 0; i < g_count; i++) {
+        const char *name = g_calls[i].name;
+        uint32_t n = 0;
+        while (n < len && name[n] == word[n]) n++;
+        if (n == len && !name[n]) return i;
+    }
+    return -1;
+}
+
+static void resolve(void) {
+    for (uint32_t i = 0; i < g_count; i++) {
+        const char *p = g_calls[i].deps;
+        while (*p) {
+            if (*p == ' ') {
+                p++;
+                continue;
+            }
+            uint32_t len = 0;
+            while (p[len] && p[len] != ' ') len++;
+
+            int32_t d = find(p, len);
+            if (d < 0) {
+                char word[NAME_MAX];
+                uint32_t n = len < NAME_MAX - 1 ? len : NAME_MAX - 1;
+                for (uint32_t k = 0; k < n; k++) word[k] = p[k];
+                word[n] = 0;
+                panic("initcall %s: no initcall named %s", g_calls[i].name, word);
+            }
+            if (g_ic[i].ndeps == INITCALL_DEPS) {
+                panic("initcall %s: more than %u dependencies", g_calls[i].name,
+                      INITCALL_DEPS);
+            }
+            g_ic[i].deps[g_ic[i].ndeps++] = d;
+            p += len;
+        }
+    }
+}
+
+static int deps_done(uint32_t i) {
+    for (uint32_t k = 0; k < g_ic[i].ndeps; k++) {
+        if (__atomic_load_n(&g_ic[g_ic[i].deps[k]].state, __ATOMIC_ACQUIRE) != IC_DONE) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// The finished call that ended last, or -1
+static int32_t latest(void) {
+    int32_t last = -1;
+    for (uint32_t i = 0; i < g_count; i++) {
+        if (g_ic[i].state == IC_DONE && (last < 0 || g_ic[i].end > g_ic[last].end)) {
+            last = i;
+        }
+    }
+    return last;
+}
+
+//=============================================================================
+// Running
+//=============================================================================
+
+static void run(uint32_t i, uint32_t cpu) {
+    // It could start once its dependencies and the previous step were done
+    int32_t after = g_last;
+    for (uint32_t k = 0; k < g_ic[i].ndeps; k++) {
+        uint32_t d = g_ic[i].deps[k];
+        if (after < 0 || g_ic[d].end > g_ic[after].end) after = d;
+    }
+    g_ic[i].after = after;
+    g_ic[i].cpu = cpu;
+
+    g_ic[i].start = now_ns();
+    g_calls[i].fn();
+    g_ic[i].end = now_ns();
+    __atomic_store_n(&g_ic[i].state, IC_DONE, __ATOMIC_RELEASE);
+}
+
+// A round member that is ready, now marked running, or -1. CPU 0 looks
+// for the ones only it may run first.
+static int32_t claim(uint32_t cpu) {
+    for (int pass = cpu == 0 ? 0 : 1; pass < 2; pass++) {
+        for (uint32_t i = 0; i < g_count; i++) {
+            int bsp = g_calls[i].flags & INIT_BSP;
+            if (!g_ic[i].in_round || (pass == 0 && !bsp) || (bsp && cpu != 0)) continue;
+            if (g_ic[i].state != IC_WAITING || !deps_done(i)) continue;
+
+            uint32_t expect = IC_WAITING;
+            if (__atomic_compare_exchange_n(&g_ic[i].state, &expect, IC_RUNNING, 0,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+static void worker(void *arg, uint32_t cpu, uint32_t ncpus) {
+    (void)arg;
+    (void)ncpus;
+
+    while (__atomic_load_n(&g_remaining, __ATOMIC_ACQUIRE)) {
+        int32_t i = claim(cpu);
+        if (i < 0) {
+            cpu_relax();
+            continue;
+        }
+        run(i, cpu);
+        __atomic_sub_fetch(&g_remaining, 1, __ATOMIC_RELEASE);
+    }
+}
+
+// Mark what the next round runs: every call not done and not INIT_SMP
+// whose dependencies are all done or in the round. Returns how many.
+static uint32_t plan_round(void) {
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < g_count; i++) g_ic[i].in_round = 0;
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (uint32_t i = 0; i < g_count; i++) {
+            if (g_ic[i].in_round || g_ic[i].state == IC_DONE ||
+                (g_calls[i].flags & INIT_SMP)) {
+                continue;
+            }
+            uint32_t k = 0;
+            for (; k < g_ic[i].ndeps; k++) {
+                uint32_t d = g_ic[i].deps[k];
+                if (g_ic[d].state != IC_DONE && !g_ic[d].in_round) break;
+            }
+            if (k == g_ic[i].ndeps) {
+                g_ic[i].in_round = 1;
+                changed = 1;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+//=============================================================================
+// Report
+//=============================================================================
+
+static void report(uint64_t begin, uint64_t end, uint32_t ncpus) {
+    uint64_t work = 0;
+    uint32_t order[INITCALL_MAX], on_path[INITCALL_MAX] = { 0 };
+
+    // In the order they started
+    for (uint32_t i = 0; i < g_count; i++) {
+        work += g_ic[i].end - g_ic[i].start;
+        uint32_t j = i;
+        for (; j > 0 && g_ic[order[j - 1]].start > g_ic[i].start; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    // Back from the last to finish through whatever each waited for
+    uint32_t path[INITCALL_MAX], depth = 0;
+    for (int32_t i = latest(); i >= 0 && depth < INITCALL_MAX; i = g_ic[i].after) {
+        path[depth++] = i;
+        on_path[i] = 1;
+    }
+
+    kprintf("Init: %u initcalls on %u CPUs in %llu us, %llu us of work\n", g_count, ncpus,
+            (unsigned long long)((end - begin) / 1000), (unsigned long long)(work / 1000));
+    for (uint32_t k = 0; k < g_count; k++) {
+        uint32_t i = order[k];
+        kprintf("  %-12s cpu %-3u +%-8llu %6llu us%s\n", g_calls[i].name, g_ic[i].cpu,
+                (unsigned long long)((g_ic[i].start - begin) / 1000),
+                (unsigned long long)((g_ic[i].end - g_ic[i].start) / 1000),
+                on_path[i] ? "  *" : "");
+    }
+    if (!depth) return;
+    kprintf("  critical path:");
+    while (depth--) kprintf(" %s%s", g_calls[path[depth]].name, depth ? " ->" : "");
+    kprintf("\n");
+}
+
+void initcall_run_all(void) {
+    g_calls = __initcalls_start;
+    g_count = __initcalls_end - __initcalls_start;
+    if (g_count > INITCALL_MAX) {
+        panic("initcall: %u registered, room for %u", g_count, INITCALL_MAX);
+    }
+    resolve();
+
+    uint32_t ncpus = smp_cpu_count();
+    uint64_t begin = now_ns();
+    for (uint32_t done = 0; done < g_count;) {
+        uint32_t progress = 0;
+
+        for (uint32_t i = 0; i < g_count; i++) {
+            if (!(g_calls[i].flags & INIT_SMP) || g_ic[i].state != IC_WAITING ||
+                !deps_done(i)) {
+                continue;
+            }
+            g_ic[i].state = IC_RUNNING;
+            run(i, 0);
+            g_last = i;
+            progress++;
+        }
+
+        uint32_t n = plan_round();
+        if (n) {
+            g_remaining = n;
+            smp_run(worker, NULL, ncpus);
+            g_last = latest();
+            progress += n;
+        }
+
+        if (!progress) {
+            kprintf("initcall: waiting on each other:");
+            for (uint32_t i = 0; i < g_count; i++) {
+                if (g_ic[i].state != IC_DONE) kprintf(" %s", g_calls[i].name);
+            }
+            kprintf("\n");
+            panic("initcall: dependency cycle");
+        }
+        done += progress;
+    }
+    report(begin, now_ns(), ncpus);
+}
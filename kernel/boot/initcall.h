@@ -0,0 +1,39 @@
+// kernel/boot/initcall.h
+// Subsystem initialisation, ordered by dependencies and run on every CPU
+//
+// Each subsystem declares its init function next to its definition with
+// INITCALL(); the entries land in the .initcalls section, which linker.ld
+// gathers between __initcalls_start and __initcalls_end. initcall_run_all()
+// resolves the dependency names and runs the calls on all CPUs at once,
+// each as soon as everything it names has finished. kernel_main brings up
+// what that needs itself (memory, ACPI, the clock, the APs) and calls it
+// after smp_init().
+//
+// A call that uses smp_run() itself can't share the CPUs with others:
+// INIT_SMP ones run alone on the BSP between parallel rounds, ahead of
+// anything that became ready in the same step.
+#pragma once
+
+#include <stdint.h>
+
+#define INIT_BSP        (1U << 0)       // Only on CPU 0 (its stack, its interrupts)
+#define INIT_SMP        (1U << 1)       // Calls smp_run(): alone, on the BSP
+
+struct initcall {
+    const char *name;
+    void      (*fn)(void);
+    const char *deps;                   // Names of initcalls to finish first, space separated
+    uint32_t    flags;
+};
+
+// INITCALL(pci, pci_init, "", 0) registers pci_init() as "pci"
+#define INITCALL(id, func, dependencies, fl)                                    \
+    __attribute__((section(".initcalls"), used, aligned(8)))                    \
+    static const struct initcall initcall_##id = {                              \
+        .name = #id, .fn = (func), .deps = (dependencies), .flags = (fl),       \
+    }
+
+// Run every registered initcall, then print how long each took, on which
+// CPU, and the chain that decided the total. Panics on a name no initcall
+// has or a dependency cycle. BSP only, once.
+void initcall_run_all(void);
@@ -0,0 +1,548 @@
+// kernel/boot/kexec.c
+// Loading a kernel image and handing the machine over to it
+#include "boot/kexec.h"
+#include "boot/bootinfo.h"
+#include "boot/cmdline.h"
+#include "common/elf.h"
+#include "drivers/block.h"
+#include "fs/bcache.h"
+#include "lib/printk.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "mm/vmm.h"
+#include "x86/cpu.h"
+#include "x86/smp.h"
+
+#define KERNEL_ALIGN        0x200000ULL     // Where the loader puts it too
+#define MAX_FILE_SIZE       (64ULL << 20)   // Sanity limit for raw disk reads
+#define READ_SECTORS        256             // Per request when loading from disk
+#define HANDOFF_STACK_PAGES 32              // The 128 KiB firmware usually gives
+#define CMDLINE_MAX         1024
+#define MAP_PAINTS          5               // Ranges kexec_boot() retypes
+
+// The loaded image, waiting for kexec_boot()
+static struct {
+    uint64_t base;
+    uint64_t size;                          // Reserved, multiple of 2 MiB
+    uint64_t entry;                         // 0: nothing loaded
+} g_image;
+
+//=============================================================================
+// Loading
+// The loader's steps (bootloader/main.c), with pmm pages instead of boot
+// services allocations.
+//=============================================================================
+
+static const Elf64_Ehdr *elf_header(const uint8_t *file, uint64_t size) {
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)file;
+
+    if (size < sizeof(*eh) || *(const uint32_t *)eh->e_ident != ELF_MAGIC ||
+        eh->e_ident[4] != ELFCLASS64 || eh->e_ident[5] != ELFDATA2LSB ||
+        eh->e_type != ET_DYN || eh->e_machine != EM_X86_64 ||
+        eh->e_phentsize != sizeof(Elf64_Phdr) || eh->e_phoff > size ||
+        (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr) > size - eh->e_phoff) {
+        return NULL;
+    }
+    return eh;
+}
+
+// Bytes of the file the image is built from, judged from the headers
+// alone. 0 if they are not those of a static PIE.
+static uint64_t elf_file_size(const uint8_t *head, uint64_t head_size) {
+    const Elf64_Ehdr *eh = elf_header(head, head_size);
+    if (!eh) return 0;
+
+    const Elf64_Phdr *ph = (const Elf64_Phdr *)(head + eh->e_phoff);
+    uint64_t end = eh->e_phoff + (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr);
+    for (uint32_t i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD) continue;
+        if (ph[i].p_offset + ph[i].p_filesz < ph[i].p_offset) return 0;
+        if (ph[i].p_offset + ph[i].p_filesz > end) end = ph[i].p_offset + ph[i].p_filesz;
+    }
+    return end;
+}
+
+// The extent of the PT_LOAD segments, each checked against the file; 0
+// if anything is off
+static uint64_t elf_span(const uint8_t *file, uint64_t size) {
+    const Elf64_Ehdr *eh = elf_header(file, size);
+    if (!eh) return 0;
+
+    const Elf64_Phdr *ph = (const Elf64_Phdr *)(file + eh->e_phoff);
+    uint64_t end = 0;
+    for (uint32_t i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD) continue;
+        if (ph[i].p_filesz > ph[i].p_memsz || ph[i].p_offset > size ||
+            ph[i].p_filesz > size - ph[i].p_offset ||
+            ph[i].p_vaddr + ph[i].p_memsz < ph[i].p_vaddr) {
+            return 0;
+        }
+        if (ph[i].p_vaddr + ph[i].p_memsz > end) end = ph[i].p_vaddr + ph[i].p_memsz;
+    }
+    return eh->e_entry < end ? end : 0;
+}
+
+// R_X86_64_RELATIVE only, as for the loader
+static int elf_relocate(const uint8_t *file, uint8_t *image, uint64_t span) {
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)file;
+    const Elf64_Phdr *ph = (const Elf64_Phdr *)(file + eh->e_phoff);
+    const Elf64_Dyn *dyn = NULL;
+
+    for (uint32_t i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type == PT_DYNAMIC && ph[i].p_vaddr + ph[i].p_memsz <= span) {
+            dyn = (const Elf64_Dyn *)(image + ph[i].p_vaddr);
+        }
+    }
+    if (!dyn) return 0;
+
+    uint64_t rela = 0, relasz = 0, relaent = sizeof(Elf64_Rela);
+    for (; dyn->d_tag != DT_NULL; dyn++) {
+        if (dyn->d_tag == DT_RELA) rela = dyn->d_val;
+        else if (dyn->d_tag == DT_RELASZ) relasz = dyn->d_val;
+        else if (dyn->d_tag == DT_RELAENT) relaent = dyn->d_val;
+    }
+    if (relaent != sizeof(Elf64_Rela) || rela > span || relasz > span - rela) return -1;
+
+    const Elf64_Rela *r = (const Elf64_Rela *)(image + rela);
+    for (uint64_t n = relasz / sizeof(*r); n; n--, r++) {
+        uint32_t type = ELF64_R_TYPE(r->r_info);
+        if (type == R_X86_64_NONE) continue;
+        if (type != R_X86_64_RELATIVE || r->r_offset > span - sizeof(uint64_t)) return -1;
+        *(uint64_t *)(image + r->r_offset) = (uint64_t)image + r->r_addend;
+    }
+    return 0;
+}
+
+// `size` bytes at a KERNEL_ALIGN boundary: over-allocate by one alignment
+// unit and give back the ragged ends
+static uint64_t alloc_aligned(uint64_t size) {
+    uint64_t pages = size >> PAGE_SHIFT;
+    uint64_t extra = KERNEL_ALIGN >> PAGE_SHIFT;
+    uint64_t raw = pmm_alloc_pages(pages + extra);
+    if (!raw) return 0;
+
+    uint64_t base = (raw + KERNEL_ALIGN - 1) & ~(KERNEL_ALIGN - 1);
+    uint64_t head = (base - raw) >> PAGE_SHIFT;
+    if (head) pmm_free_pages(raw, head);
+    if (extra - head) pmm_free_pages(base + size, extra - head);
+    return base;
+}
+
+static int load_image(const uint8_t *file, uint64_t size, const char *what) {
+    uint64_t span = elf_span(file, size);
+    if (!span) {
+        kprintf("kexec: %s is not an x86-64 static PIE\n", what);
+        return -1;
+    }
+    uint64_t reserve = (span + KERNEL_ALIGN - 1) & ~(KERNEL_ALIGN - 1);
+    uint64_t base = alloc_aligned(reserve);
+    if (!base) {
+        kprintf("kexec: no room for a %llu KiB image\n", (unsigned long long)(span >> 10));
+        return -1;
+    }
+
+    // Zero first: .bss and the gaps between segments
+    uint8_t *image = phys_to_virt(base);
+    memset(image, 0, span);
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)file;
+    const Elf64_Phdr *ph = (const Elf64_Phdr *)(file + eh->e_phoff);
+    for (uint32_t i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type == PT_LOAD) {
+            memcpy(image + ph[i].p_vaddr, file + ph[i].p_offset, ph[i].p_filesz);
+        }
+    }
+    if (elf_relocate(file, image, span) < 0) {
+        pmm_free_pages(base, reserve >> PAGE_SHIFT);
+        kprintf("kexec: unsupported relocation in %s\n", what);
+        return -1;
+    }
+
+    if (g_image.entry) pmm_free_pages(g_image.base, g_image.size >> PAGE_SHIFT);
+    g_image.base = base;
+    g_image.size = reserve;
+    g_image.entry = base + eh->e_entry;
+    kprintf("kexec: %s loaded @ %#llx, %llu KiB\n", what, (unsigned long long)base,
+            (unsigned long long)(span >> 10));
+    return 0;
+}
+
+static int name_eq(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+int kexec_load_module(const char *name) {
+    for (const struct BootTagModule *m = bootinfo_next_module(NULL); m;
+         m = bootinfo_next_module(m)) {
+        if (name_eq(m->name, name)) return load_image(phys_to_virt(m->base), m->size, name);
+    }
+    kprintf("kexec: no module named %s\n", name);
+    return -1;
+}
+
+int kexec_load_blk(struct blk_device *dev, uint64_t sector) {
+    if (!dev) {
+        kprintf("kexec: no such block device\n");
+        return -1;
+    }
+
+    // The headers first, for how much of the file to read
+    uint8_t *head = pmm_alloc_zeroed(1);
+    if (!head) return -1;
+    uint64_t size = 0;
+    if (blk_rw(dev, BLK_OP_READ, sector, PAGE_SIZE / 512, head) == BLK_OK) {
+        size = elf_file_size(head, PAGE_SIZE);
+    }
+    pmm_free_pages(virt_to_phys(head), 1);
+    if (!size || size > MAX_FILE_SIZE) {
+        kprintf("kexec: no kernel image at %s sector %llu\n", dev->name,
+                (unsigned long long)sector);
+        return -1;
+    }
+
+    uint64_t pages = PAGE_ALIGN_UP(size) >> PAGE_SHIFT;
+    uint64_t file = pmm_alloc_pages(pages);
+    if (!file) {
+        kprintf("kexec: no room for a %llu KiB file\n", (unsigned long long)(size >> 10));
+        return -1;
+    }
+    uint32_t per = READ_SECTORS;
+    if (dev->max_sectors && dev->max_sectors < per) per = dev->max_sectors;
+    uint64_t sectors = (size + 511) / 512;
+    for (uint64_t done = 0; done < sectors; done += per) {
+        uint32_t n = sectors - done < per ? sectors - done : per;
+        if (blk_rw(dev, BLK_OP_READ, sector + done, n,
+                   phys_to_virt(file + done * 512)) != BLK_OK) {
+            pmm_free_pages(file, pages);
+            kprintf("kexec: read error on %s\n", dev->name);
+            return -1;
+        }
+    }
+
+    int ret = load_image(phys_to_virt(file), size, dev->name);
+    pmm_free_pages(file, pages);
+    return ret;
+}
+
+//=============================================================================
+// Page Tables
+// A copy of ours in one block, so the next kernel finds them in a single
+// boot reclaimable range and nothing it frees early is still in use.
+//=============================================================================
+
+static int leaf(uint64_t entry, int level) {
+    return level == 1 || (level <= 3 && (entry & PTE_LARGE));
+}
+
+// Table pages under `table` at `level` (1 = PT), itself included
+static uint64_t count_tables(uint64_t table, int level) {
+    uint64_t n = 1;
+    const uint64_t *e = phys_to_virt(table);
+    for (int i = 0; level > 1 && i < 512; i++) {
+        if ((e[i] & PTE_PRESENT) && !leaf(e[i], level)) {
+            n += count_tables(e[i] & PTE_ADDR_MASK, level - 1);
+        }
+    }
+    return n;
+}
+
+// Copy them to consecutive pages from *next; returns where `table` went
+static uint64_t copy_tables(uint64_t table, int level, uint64_t *next) {
+    uint64_t copy = *next;
+    *next += PAGE_SIZE;
+
+    uint64_t *e = phys_to_virt(copy);
+    memcpy(e, phys_to_virt(table), PAGE_SIZE);
+    for (int i = 0; level > 1 && i < 512; i++) {
+        if ((e[i] & PTE_PRESENT) && !leaf(e[i], level)) {
+            e[i] = copy_tables(e[i] & PTE_ADDR_MASK, level - 1, next) |
+                   (e[i] & ~PTE_ADDR_MASK);
+        }
+    }
+    return copy;
+}
+
+//=============================================================================
+// Memory Map
+// Ours, with the ranges that changed hands retyped. A retyped range always
+// becomes an entry of its own: pmm_reclaim_boot() keeps back the whole
+// entry holding the stack it runs on.
+//=============================================================================
+
+static void map_insert(struct MemoryMapEntry *map, uint32_t *count, uint32_t at,
+                       uint64_t base, uint64_t length, uint32_t type) {
+    memmove(&map[at + 1], &map[at], (*count - at) * sizeof(*map));
+    map[at] = (struct MemoryMapEntry){ .base = base, .length = length, .type = type };
+    (*count)++;
+}
+
+// Give [base, end) `type`. Adds at most two entries.
+static void map_paint(struct MemoryMapEntry *map, uint32_t *count, uint64_t base,
+                      uint64_t end, uint32_t type) {
+    for (uint32_t i = 0; i < *count; i++) {
+        struct MemoryMapEntry *e = &map[i];
+        uint64_t e_end = e->base + e->length;
+        if (e_end <= base || e->base >= end) continue;
+
+        if (e->base < base) {
+            // Keep the part below; the rest is the next entry
+            map_insert(map, count, i + 1, base, e_end - base, e->type);
+            e->length = base - e->base;
+            continue;
+        }
+        if (e_end > end) {
+            map_insert(map, count, i + 1, end, e_end - end, e->type);
+            e->length = end - e->base;
+        }
+        e->type = type;
+    }
+}
+
+// Merge adjacent runs of one type again, except the entry at `keep`
+static uint32_t map_merge(struct MemoryMapEntry *map, uint32_t count, uint64_t keep) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        struct MemoryMapEntry *last = n ? &map[n - 1] : NULL;
+        if (last && last->type == map[i].type && last->base + last->length == map[i].base &&
+            last->base != keep && map[i].base != keep) {
+            last->length += map[i].length;
+        } else {
+            map[n++] = map[i];
+        }
+    }
+    return n;
+}
+
+//=============================================================================
+// Boot Info
+//=============================================================================
+
+#define TAG_ALIGN(n)    (((n) + BOOTINFO_ALIGN - 1) & ~(uint64_t)(BOOTINFO_ALIGN - 1))
+
+static uint8_t *g_bi;
+static uint32_t g_bi_used;
+
+static void *bi_add(uint32_t type, uint32_t size) {
+    struct BootTag *t = (struct BootTag *)(g_bi + g_bi_used);
+    memset(t, 0, TAG_ALIGN(size));
+    t->type = type;
+    t->size = size;
+    g_bi_used += TAG_ALIGN(size);
+    return t;
+}
+
+static uint64_t cmdline_len(const char *s) {
+    uint64_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+// Room for everything bootinfo_build() writes
+static uint64_t bootinfo_bound(uint64_t cmdline_bytes) {
+    uint64_t size = sizeof(struct BootInfo) + sizeof(struct BootTagFramebuffer) +
+                    sizeof(struct BootTagRsdp) + sizeof(struct BootTagKernel) +
+                    sizeof(struct BootTagKexec) +
+                    TAG_ALIGN(sizeof(struct BootTagCmdline) + cmdline_bytes + 1) +
+                    sizeof(struct BootTagMemoryMap) +
+                    (g_boot.memory_map_count + 2 * MAP_PAINTS) * sizeof(struct MemoryMapEntry) +
+                    sizeof(struct BootTag) + 8 * BOOTINFO_ALIGN;
+    for (const struct BootTagModule *m = bootinfo_next_module(NULL); m;
+         m = bootinfo_next_module(m)) {
+        size += TAG_ALIGN(m->tag.size);
+    }
+    return size;
+}
+
+static struct BootInfo *bootinfo_build(uint64_t bi, uint64_t bi_pages, uint64_t handoff,
+                                       uint64_t handoff_pages, const char *cmdline,
+                                       uint64_t start_tsc) {
+    g_bi = phys_to_virt(bi);
+    g_bi_used = sizeof(struct BootInfo);
+
+    if (g_boot.framebuffer) {
+        struct BootTagFramebuffer *fb = bi_add(BOOT_TAG_FRAMEBUFFER, sizeof(*fb));
+        fb->info = *g_boot.framebuffer;
+    }
+    if (g_boot.rsdp) {
+        struct BootTagRsdp *r = bi_add(BOOT_TAG_RSDP, sizeof(*r));
+        r->revision = g_boot.rsdp_revision;
+        r->address = g_boot.rsdp;
+    }
+    for (const struct BootTagModule *m = bootinfo_next_module(NULL); m;
+         m = bootinfo_next_module(m)) {
+        memcpy(bi_add(BOOT_TAG_MODULE, m->tag.size), m, m->tag.size);
+    }
+    uint64_t len = cmdline_len(cmdline);
+    struct BootTagCmdline *c = bi_add(BOOT_TAG_CMDLINE, sizeof(*c) + len + 1);
+    memcpy(c->cmdline, cmdline, len + 1);
+
+    struct BootTagKernel *k = bi_add(BOOT_TAG_KERNEL, sizeof(*k));
+    k->base = g_image.base;
+    k->size = g_image.size;
+    k->entry = g_image.entry;
+    struct BootTagKexec *kx = bi_add(BOOT_TAG_KEXEC, sizeof(*kx));
+    kx->generation = (g_boot.kexec ? g_boot.kexec->generation : 0) + 1;
+    kx->start_tsc = start_tsc;
+
+    // Last, so its size can be settled once painting is done
+    struct BootTagMemoryMap *mm = (struct BootTagMemoryMap *)(g_bi + g_bi_used);
+    uint32_t count = g_boot.memory_map_count;
+    memcpy(mm->entries, g_boot.memory_map, count * sizeof(struct MemoryMapEntry));
+    if (g_boot.kernel) {
+        map_paint(mm->entries, &count, g_boot.kernel->base,
+                  g_boot.kernel->base + g_boot.kernel->size, MEMORY_TYPE_BOOT_RECLAIMABLE);
+    }
+    uint64_t old = virt_to_phys(g_boot.header);
+    map_paint(mm->entries, &count, PAGE_ALIGN_DOWN(old),
+              PAGE_ALIGN_UP(old + g_boot.header->total_size), MEMORY_TYPE_BOOT_RECLAIMABLE);
+    map_paint(mm->entries, &count, g_image.base, g_image.base + g_image.size,
+              MEMORY_TYPE_RESERVED);
+    map_paint(mm->entries, &count, bi, bi + bi_pages * PAGE_SIZE, MEMORY_TYPE_RESERVED);
+    map_paint(mm->entries, &count, handoff, handoff + handoff_pages * PAGE_SIZE,
+              MEMORY_TYPE_BOOT_RECLAIMABLE);
+    count = map_merge(mm->entries, count, handoff);
+    mm->tag.type = BOOT_TAG_MEMORY_MAP;
+    mm->tag.size = sizeof(*mm) + count * sizeof(struct MemoryMapEntry);
+    mm->entry_size = sizeof(struct MemoryMapEntry);
+    mm->entry_count = count;
+    g_bi_used += TAG_ALIGN(mm->tag.size);
+
+    bi_add(BOOT_TAG_END, sizeof(struct BootTag));
+
+    struct BootInfo *info = (struct BootInfo *)g_bi;
+    info->magic = BOOTINFO_MAGIC;
+    info->version = BOOTINFO_VERSION;
+    info->total_size = g_bi_used;
+    info->checksum = 0;
+    info->_pad = 0;
+    uint32_t sum = 0;
+    const uint32_t *words = (const uint32_t *)info;
+    for (uint32_t i = 0; i < info->total_size / 4; i++) sum += words[i];
+    info->checksum = -sum;
+    return info;
+}
+
+//=============================================================================
+// Handoff
+//=============================================================================
+
+// Enter the image as the loader does, kernel_main(info) with a return
+// address on the stack. Both sets of tables identity-map this code, so
+// switching CR3 under it is fine.
+__attribute__((noreturn))
+static void jump(uint64_t entry, uint64_t info, uint64_t cr3, uint64_t stack_top) {
+    __asm__ volatile("mov %2, %%cr3\n\t"
+                     "mov %3, %%rsp\n\t"
+                     "xor %%ebp, %%ebp\n\t"
+                     "push $0\n\t"
+                     "jmp *%0"
+                     :: "a"(entry), "D"(info), "d"(cr3), "c"(stack_top) : "memory");
+    __builtin_unreachable();
+}
+
+int kexec_boot(const char *cmdline) {
+    uint64_t start = rdtsc();
+    if (!g_image.entry) {
+        kprintf("kexec: no image loaded\n");
+        return -1;
+    }
+
+    // Everything that can fail comes before the devices stop
+    int levels = (read_cr4() & CR4_LA57) ? 5 : 4;
+    uint64_t root = vmm_kernel_root();
+    if (!root) root = read_cr3();
+    uint64_t handoff_pages = HANDOFF_STACK_PAGES + count_tables(root & PTE_ADDR_MASK, levels);
+    uint64_t handoff = pmm_alloc_pages(handoff_pages);
+    uint64_t bi_pages = PAGE_ALIGN_UP(bootinfo_bound(cmdline_len(cmdline))) >> PAGE_SHIFT;
+    uint64_t bi = pmm_alloc_pages(bi_pages);
+    if (!handoff || !bi) {
+        if (handoff) pmm_free_pages(handoff, handoff_pages);
+        if (bi) pmm_free_pages(bi, bi_pages);
+        kprintf("kexec: out of memory\n");
+        return -1;
+    }
+
+    uint64_t stack_top = handoff + HANDOFF_STACK_PAGES * PAGE_SIZE;
+    uint64_t next = stack_top;
+    uint64_t cr3 = copy_tables(root & PTE_ADDR_MASK, levels, &next) | (root & ~PTE_ADDR_MASK);
+    if (cr3 >= 0x100000000ULL) {
+        kprintf("kexec: page tables above 4 GiB, the next kernel can't start APs\n");
+    }
+    struct BootInfo *info = bootinfo_build(bi, bi_pages, handoff, handoff_pages, cmdline,
+                                           start);
+    kprintf("kexec: entering %#llx, %u bytes of boot info\n",
+            (unsigned long long)g_image.entry, info->total_size);
+
+    // Nothing may DMA into memory the next kernel thinks is free, and the
+    // APs stop zeroing pages
+    bflush(NULL);
+    for (uint32_t i = 0; i < blk_count(); i++) blk_shutdown(blk_get(i));
+    smp_park();
+
+    __asm__ volatile("cli");
+    clts();                             // It expects SIMD to just work
+    jump(g_image.entry, virt_to_phys(info), cr3, stack_top);
+}
+
+//=============================================================================
+// Command Line
+//=============================================================================
+
+// `word` is `key` or starts with `key=`
+static int word_is(const char *word, const char *key) {
+    while (*key && *word == *key) {
+        word++;
+        key++;
+    }
+    return !*key && (*word == '\0' || *word == ' ' || *word == '=');
+}
+
+static int load_spec(const char *spec) {
+    if (spec[0] != 'b' || spec[1] != 'l' || spec[2] != 'k' ||
+        spec[3] < '0' || spec[3] > '9') {
+        return kexec_load_module(spec);
+    }
+
+    // blkN:SECTOR
+    const char *s = spec + 3;
+    uint32_t dev = 0;
+    uint64_t sector = 0;
+    while (*s >= '0' && *s <= '9') dev = dev * 10 + (*s++ - '0');
+    if (*s++ != ':' || *s < '0' || *s > '9') {
+        kprintf("kexec: expected blkN:SECTOR, got %s\n", spec);
+        return -1;
+    }
+    while (*s >= '0' && *s <= '9') sector = sector * 10 + (*s++ - '0');
+    return kexec_load_blk(blk_get(dev), sector);
+}
+
+void kexec_run(const char *spec) {
+    if (load_spec(spec) < 0) return;
+
+    // Our command line without the kexec options, which come back only
+    // while there are hops left
+    char cmdline[CMDLINE_MAX];
+    uint64_t n = 0;
+    const char *s = g_boot.cmdline;
+    while (*s) {
+        while (*s == ' ') s++;
+        const char *w = s;
+        while (*s && *s != ' ') s++;
+        if (s == w || word_is(w, "kexec") || word_is(w, "kexec.count")) continue;
+        if (n + (s - w) + 2 > sizeof(cmdline)) break;
+        if (n) cmdline[n++] = ' ';
+        memcpy(cmdline + n, w, s - w);
+        n += s - w;
+    }
+    cmdline[n] = '\0';
+
+    uint64_t count = cmdline_get_u64("kexec.count", 1);
+    if (count > 1) {
+        ksnprintf(cmdline + n, sizeof(cmdline) - n, "%skexec=%s kexec.count=%llu",
+                  n ? " " : "", spec, (unsigned long long)(count - 1));
+    }
+    kexec_boot(cmdline);
+}
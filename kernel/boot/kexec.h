@@ -0,0 +1,32 @@
+// kernel/boot/kexec.h
+// Fast reboot: start another kernel image without going through firmware
+//
+// The image is kernel.elf, the same static PIE the loader takes. It is
+// placed at a 2 MiB aligned address and relocated while this kernel still
+// runs, so the handoff itself only stops the machine and jumps. The new
+// kernel gets a BootInfo block built from ours: same framebuffer, RSDP and
+// modules, and our memory map with its image and block reserved. Its
+// stack and page tables (a copy of ours) are boot reclaimable, as the
+// firmware's are on a normal boot, and so is our own image.
+#pragma once
+
+#include <stdint.h>
+
+struct blk_device;
+
+// Load the image from the boot module `name`, or from `dev` starting at
+// `sector` (a raw copy of the file). Returns 0, or -1 with a message.
+// A second load replaces the first.
+int kexec_load_module(const char *name);
+int kexec_load_blk(struct blk_device *dev, uint64_t sector);
+
+// Flush and stop the block devices, park the APs and enter the loaded
+// image with `cmdline`. Returns -1 (nothing loaded, out of memory) with
+// a message; once devices are stopped it does not return. BSP only, from
+// the boot task, with no user processes left.
+int kexec_boot(const char *cmdline);
+
+// kexec=SPEC on the command line: a module name, or blkN:SECTOR. The new
+// kernel gets our command line; with kexec.count=N it chains N times,
+// the last kernel getting neither option. Returns only on failure.
+void kexec_run(const char *spec);
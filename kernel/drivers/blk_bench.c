@@ -0,0 +1,250 @@
+// kernel/drivers/blk_bench.c
+// Block device benchmark: random reads at increasing queue depths
+//
+// A fixed number of requests is kept in flight. Completions (from the
+// interrupt handler or blk_poll) park requests on a ready list; the main
+// loop gives them new random sectors and resubmits the whole list as one
+// batch, so the device sees one doorbell per batch, not per request.
+//
+// The multi-CPU runs give every CPU its own state and only use CPUs that
+// submit on a queue whose interrupts come to them alone, so completions
+// never touch another CPU's ready list.
+#include "drivers/blk_bench.h"
+#include "boot/cmdline.h"
+#include "lib/printk.h"
+#include "lib/sort.h"
+#include "mm/pmm.h"
+#include "x86/cpu.h"
+#include "x86/percpu.h"
+#include "x86/smp.h"
+#include "x86/tsc.h"
+
+#define BENCH_MAX_QD    128
+
+// Per CPU
+struct bench {
+    struct blk_device  *dev;
+    struct blk_request  reqs[BENCH_MAX_QD];
+    struct blk_request *ready[BENCH_MAX_QD];
+    volatile uint32_t   nready;
+    uint64_t           *lat;            // Completion - submission, cycles
+    volatile uint32_t   nlat;
+    uint32_t            errors;
+    uint64_t            rng;
+    uint64_t            blocks;         // Device size in request-size units
+    uint32_t            sectors_per_req;
+    uint32_t            nreqs;          // Requests with a buffer
+    int                 halt;           // Completion interrupts come here
+    uint64_t            elapsed;        // Last run, cycles
+};
+
+// One run on CPUs 0..ncpus-1 at once
+struct job {
+    struct bench **b;
+    enum blk_mode  mode;
+    uint32_t       qd, ios;
+};
+
+static uint64_t xorshift(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+// Runs with interrupts off: in IRQ context, or from blk_poll
+static void bench_done(struct blk_request *req) {
+    struct bench *b = req->priv;
+    if (req->status != BLK_OK) b->errors++;
+    b->lat[b->nlat++] = req->complete_tsc - req->submit_tsc;
+    b->ready[b->nready++] = req;
+}
+
+static void aim(struct bench *b, struct blk_request *req) {
+    req->sector = (xorshift(&b->rng) % b->blocks) * b->sectors_per_req;
+}
+
+// Submit the whole list; anything the queue refuses goes back on ready
+static void submit_all(struct bench *b, struct blk_request **list, uint32_t n) {
+    uint32_t taken = blk_submit(b->dev, list, n);
+    for (uint32_t i = taken; i < n; i++) b->ready[b->nready++] = list[i];
+}
+
+static void print_us(const char *label, uint64_t cycles) {
+    uint64_t ns = tsc_to_ns(cycles);
+    kprintf("  %s %4llu.%llu", label, (unsigned long long)(ns / 1000),
+            (unsigned long long)(ns % 1000 / 100));
+}
+
+static void run(struct bench *b, enum blk_mode mode, uint32_t qd, uint32_t ios) {
+    struct blk_device *dev = b->dev;
+    struct blk_request *batch[BENCH_MAX_QD];
+
+    b->nready = b->nlat = b->errors = 0;
+
+    uint32_t issued = qd < ios ? qd : ios;
+    for (uint32_t i = 0; i < issued; i++) {
+        aim(b, &b->reqs[i]);
+        batch[i] = &b->reqs[i];
+    }
+
+    uint64_t start = rdtsc();
+    submit_all(b, batch, issued);
+
+    while (b->nlat < ios) {
+        if (mode == BLK_MODE_POLL || !b->halt) {
+            blk_poll(dev);
+        } else if (b->nready == 0 || issued == ios) {
+            __asm__ volatile("sti; hlt; cli" ::: "memory");
+        }
+
+        uint32_t n = 0;
+        while (b->nready && issued < ios) {
+            struct blk_request *req = b->ready[--b->nready];
+            aim(b, req);
+            batch[n++] = req;
+            issued++;
+        }
+        if (n) submit_all(b, batch, n);
+    }
+    b->elapsed = rdtsc() - start;
+}
+
+static void run_job(void *arg, uint32_t cpu, uint32_t ncpus) {
+    (void)ncpus;
+    struct job *j = arg;
+    run(j->b[cpu], j->mode, j->qd, j->ios);
+}
+
+// Latencies of all CPUs are merged: each CPU's array follows the previous
+// one's in the same allocation
+static void run_all(struct bench **b, uint32_t ncpus, enum blk_mode mode,
+                    uint32_t qd, uint32_t ios) {
+    struct blk_device *dev = b[0]->dev;
+    uint64_t doorbells = dev->doorbells;
+    uint64_t interrupts = dev->interrupts;
+
+    struct job j = { .b = b, .mode = mode, .qd = qd, .ios = ios };
+    smp_run(run_job, &j, ncpus);
+
+    uint64_t elapsed = 0;
+    uint32_t errors = 0;
+    for (uint32_t i = 0; i < ncpus; i++) {
+        if (b[i]->elapsed > elapsed) elapsed = b[i]->elapsed;
+        errors += b[i]->errors;
+    }
+    uint64_t total = (uint64_t)ios * ncpus;
+    uint64_t *lat = b[0]->lat;
+
+    sort_u64(lat, total);
+    uint64_t ns = tsc_to_ns(elapsed);
+    kprintf("%s %-4s qd %3u", dev->name, mode == BLK_MODE_POLL ? "poll" : "irq", qd);
+    if (ncpus > 1) kprintf(" x %u CPUs", ncpus);
+    kprintf(": %7llu IOPS", (unsigned long long)(ns ? total * 1000000000ULL / ns : 0));
+    print_us("p50", lat[total / 2]);
+    print_us("p99", lat[total * 99 / 100]);
+    print_us("p99.9", lat[total * 999 / 1000]);
+    print_us("max", lat[total - 1]);
+    kprintf(" us, %llu doorbells, %llu irqs",
+            (unsigned long long)(dev->doorbells - doorbells),
+            (unsigned long long)(dev->interrupts - interrupts));
+    if (errors) kprintf(", %u errors", errors);
+    kprintf("\n");
+}
+
+// CPUs 0..n-1 that each take the interrupts of the queue they submit on
+static uint32_t bench_cpus(struct blk_device *dev, uint32_t max) {
+    uint32_t n = 1;
+    if (!dev->ops->irq_cpu) return n;
+    while (n < smp_cpu_count() && n < max && dev->ops->irq_cpu(dev, n) == (int)n) n++;
+    return n;
+}
+
+static void setup(struct bench *b, struct blk_device *dev, uint32_t cpu, uint64_t *lat,
+                  uint32_t bs, uint32_t max_qd) {
+    b->dev = dev;
+    b->lat = lat;
+    b->rng = (rdtsc() + cpu) | 1;
+    b->sectors_per_req = bs / 512;
+    b->blocks = dev->sectors / b->sectors_per_req;
+    b->halt = !dev->ops->irq_cpu || dev->ops->irq_cpu(dev, cpu) == (int)cpu;
+
+    size_t buf_pages = PAGE_ALIGN_UP(bs) / PAGE_SIZE;
+    for (b->nreqs = 0; b->nreqs < max_qd; b->nreqs++) {
+        struct blk_request *req = &b->reqs[b->nreqs];
+        uint64_t buf = pmm_alloc_pages(buf_pages);
+        if (!buf) break;
+        req->op = BLK_OP_READ;
+        req->count = b->sectors_per_req;
+        req->buf = phys_to_virt(buf);
+        req->done = bench_done;
+        req->priv = b;
+    }
+}
+
+void blk_bench(struct blk_device *dev) {
+    uint32_t ios = cmdline_get_u64("blkbench.ios", 4096);
+    uint32_t bs = cmdline_get_u64("blkbench.bs", 4096);
+    uint32_t max_qd = cmdline_get_u64("blkbench.qd", 64);
+    uint32_t max_cpus = cmdline_get_u64("blkbench.cpus", MAX_CPUS);
+
+    if (bs < 512 || bs % 512 || bs > 1024 * 1024 || ios == 0) {
+        kprintf("blkbench: bad parameters\n");
+        return;
+    }
+    if (dev->sectors / (bs / 512) == 0) return;
+    if (max_qd > dev->queue_depth) max_qd = dev->queue_depth;
+    if (max_qd > BENCH_MAX_QD) max_qd = BENCH_MAX_QD;
+    uint32_t ncpus = bench_cpus(dev, max_cpus);
+
+    static struct bench *b[MAX_CPUS];
+    size_t state_pages = PAGE_ALIGN_UP(sizeof(struct bench)) / PAGE_SIZE;
+    size_t lat_pages = PAGE_ALIGN_UP((uint64_t)ios * ncpus * sizeof(uint64_t)) / PAGE_SIZE;
+    size_t buf_pages = PAGE_ALIGN_UP(bs) / PAGE_SIZE;
+    uint64_t *lat = pmm_alloc_zeroed(lat_pages);
+    if (!lat) {
+        kprintf("blkbench: out of memory\n");
+        return;
+    }
+    uint32_t nb = 0;
+    for (; nb < ncpus; nb++) {
+        // Too big for the kernel image's data section
+        b[nb] = pmm_alloc_zeroed(state_pages);
+        if (!b[nb]) break;
+        setup(b[nb], dev, nb, lat + (uint64_t)nb * ios, bs, max_qd);
+        if (b[nb]->nreqs == 0) {
+            pmm_free_pages(virt_to_phys(b[nb]), state_pages);
+            break;
+        }
+        // Every CPU runs at the same depth
+        if (b[nb]->nreqs < max_qd) max_qd = b[nb]->nreqs;
+    }
+    if (nb == 0) {
+        kprintf("blkbench: out of memory\n");
+        goto out;
+    }
+    ncpus = nb;
+
+    kprintf("blkbench: %s, %u x %u-byte random reads per run and CPU, TSC %llu kHz\n",
+            dev->name, ios, bs, (unsigned long long)tsc_khz);
+
+    enum blk_mode saved = dev->mode;
+    for (int m = 0; m < 2; m++) {
+        enum blk_mode mode = m == 0 ? BLK_MODE_POLL : BLK_MODE_IRQ;
+        if (blk_set_mode(dev, mode) != 0) continue;
+        for (uint32_t qd = 1; qd <= max_qd; qd *= 2) run_all(b, 1, mode, qd, ios);
+        if (ncpus == 1) continue;
+        for (uint32_t qd = 1; qd <= max_qd; qd *= 2) run_all(b, ncpus, mode, qd, ios);
+    }
+    blk_set_mode(dev, saved);
+
+out:
+    for (uint32_t i = 0; i < nb; i++) {
+        for (uint32_t r = 0; r < b[i]->nreqs; r++) {
+            pmm_free_pages(virt_to_phys(b[i]->reqs[r].buf), buf_pages);
+        }
+        pmm_free_pages(virt_to_phys(b[i]), state_pages);
+    }
+    pmm_free_pages(virt_to_phys(lat), lat_pages);
+}
@@ -0,0 +1,16 @@
+// kernel/drivers/blk_bench.h
+// Block device benchmark: random reads at increasing queue depths
+#pragma once
+
+#include "drivers/block.h"
+
+// Run random reads in every completion mode the device supports and print
+// IOPS and latency percentiles per queue depth, first from one CPU, then
+// from all CPUs that have a queue and its interrupts to themselves, at
+// once. Command line knobs:
+//   blkbench.ios=N     requests per run and CPU (default 4096)
+//   blkbench.bs=N      request size in bytes (default 4096)
+//   blkbench.qd=N      largest queue depth per CPU (default 64)
+//   blkbench.cpus=N    most CPUs in the multi-CPU runs (default all)
+// Read-only: the disk contents are never modified.
+void blk_bench(struct blk_device *dev);
@@ -0,0 +1,108 @@
+// kernel/drivers/block.c
+// Block device layer
+#include "drivers/block.h"
+#include "x86/cpu.h"
+#include "x86/percpu.h"
+
+static struct blk_device *g_devices[BLK_MAX_DEVICES];
+static uint32_t           g_count;
+
+void blk_register(struct blk_device *dev) {
+    if (g_count < BLK_MAX_DEVICES) g_devices[g_count++] = dev;
+}
+
+uint32_t blk_count(void) {
+    return g_count;
+}
+
+struct blk_device *blk_get(uint32_t index) {
+    return index < g_count ? g_devices[index] : NULL;
+}
+
+int blk_set_mode(struct blk_device *dev, enum blk_mode mode) {
+    if (mode == BLK_MODE_IRQ && !dev->irq_capable) return -1;
+    if (dev->ops->set_mode(dev, mode) != 0) return -1;
+    dev->mode = mode;
+    return 0;
+}
+
+static int request_ok(const struct blk_device *dev, const struct blk_request *req) {
+    if (req->op == BLK_OP_FLUSH) return dev->can_flush;
+    if (req->op != BLK_OP_READ && req->op != BLK_OP_WRITE) return 0;
+    if (req->count == 0) return 0;
+    return !dev->max_sectors || req->count <= dev->max_sectors;
+}
+
+int blk_submit(struct blk_device *dev, struct blk_request **reqs, int n) {
+    uint64_t now = rdtsc();
+    uint32_t cpu = this_cpu()->cpu_id;
+    int i = 0;
+
+    while (i < n) {
+        // Hand the driver the longest run of valid requests in one go
+        int end = i;
+        while (end < n && request_ok(dev, reqs[end])) {
+            reqs[end]->status = BLK_PENDING;
+            reqs[end]->submit_tsc = now;
+            reqs[end]->cpu = cpu;
+            end++;
+        }
+        if (end > i) {
+            i += dev->ops->submit(dev, reqs + i, end - i);
+            if (i < end) return i;          // Queue full
+        }
+        if (i < n) {
+            struct blk_request *req = reqs[i++];
+            req->submit_tsc = req->complete_tsc = now;
+            req->status = BLK_EUNSUPP;
+            if (req->done) req->done(req);
+        }
+    }
+    return n;
+}
+
+int blk_poll(struct blk_device *dev) {
+    return dev->ops->poll(dev);
+}
+
+// Only a CPU that takes the request's completion interrupt may halt for
+// it; nothing else would wake it
+static int irq_comes_here(struct blk_device *dev, const struct blk_request *req) {
+    if (dev->mode != BLK_MODE_IRQ || !dev->ops->irq_cpu) return 0;
+    return dev->ops->irq_cpu(dev, req->cpu) == (int)this_cpu()->cpu_id;
+}
+
+int blk_wait(struct blk_device *dev, struct blk_request *req) {
+    int halt = irq_comes_here(dev, req);
+    while (req->status == BLK_PENDING) {
+        if (!halt) {
+            if (!blk_poll(dev)) cpu_relax();
+            continue;
+        }
+        // STI's one-instruction shadow makes "sti; hlt" atomic: the
+        // completion can't slip in between the check and the halt
+        uint64_t flags = irq_save();
+        if (req->status == BLK_PENDING) {
+            __asm__ volatile("sti; hlt; cli" ::: "memory");
+        }
+        irq_restore(flags);
+    }
+    return req->status;
+}
+
+void blk_shutdown(struct blk_device *dev) {
+    if (dev->ops->shutdown) dev->ops->shutdown(dev);
+}
+
+int blk_rw(struct blk_device *dev, uint8_t op, uint64_t sector,
+           uint32_t count, void *buf) {
+    struct blk_request req = {
+        .op = op, .sector = sector, .count = count, .buf = buf,
+    };
+    struct blk_request *r = &req;
+
+    while (blk_submit(dev, &r, 1) == 0) {
+        blk_poll(dev);                  // Queue full: make room
+    }
+    return blk_wait(dev, &req);
+}
@@ -0,0 +1,101 @@
+// kernel/drivers/block.h
+// Block device layer
+//
+// Drivers register a struct blk_device; users submit struct blk_request
+// batches. A request is owned by the driver from submission until its
+// status leaves BLK_PENDING, at which point `done` (if set) has run, in
+// interrupt context or in whoever called blk_poll().
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLK_MAX_DEVICES 8
+
+#define BLK_OP_READ     0
+#define BLK_OP_WRITE    1
+#define BLK_OP_FLUSH    2
+
+#define BLK_OK          0
+#define BLK_PENDING     1
+#define BLK_EIO         (-1)
+#define BLK_EUNSUPP     (-2)
+
+struct blk_request {
+    uint8_t  op;                    // BLK_OP_*
+    uint8_t  _pad[3];
+    volatile int32_t status;        // BLK_PENDING until completed
+    uint64_t sector;                // In 512-byte units
+    uint32_t count;                 // Sectors
+    uint32_t cpu;                   // Submitting CPU, set by blk_submit()
+    void    *buf;                   // Physically contiguous
+    void   (*done)(struct blk_request *req);
+    void    *priv;                  // For the submitter
+    uint64_t submit_tsc;            // Set by blk_submit()
+    uint64_t complete_tsc;          // Set by the driver on completion
+};
+
+enum blk_mode {
+    BLK_MODE_IRQ,                   // Completions raise an interrupt
+    BLK_MODE_POLL,                  // Completions are found by blk_poll()
+};
+
+struct blk_device;
+
+struct blk_ops {
+    // Queue up to n requests on the calling CPU's queue with one doorbell.
+    // Returns how many were taken (fewer when the queue is full). Requests
+    // are already checked against max_sectors and can_flush.
+    int (*submit)(struct blk_device *dev, struct blk_request **reqs, int n);
+    // Reap completions on the calling CPU's queue; returns how many
+    int (*poll)(struct blk_device *dev);
+    // Returns 0, or -1 if the mode isn't available
+    int (*set_mode)(struct blk_device *dev, enum blk_mode mode);
+    // Stop the device for good: no more DMA or interrupts. Optional.
+    void (*shutdown)(struct blk_device *dev);
+    // CPU that takes the completion interrupts for requests submitted on
+    // `cpu`, or -1 if none does. Optional: without it nobody halts.
+    int (*irq_cpu)(struct blk_device *dev, uint32_t cpu);
+};
+
+struct blk_device {
+    char                  name[16];
+    uint64_t              sectors;      // Capacity in 512-byte units
+    uint32_t              block_size;   // Preferred I/O granularity
+    uint32_t              queue_count;
+    uint32_t              queue_depth;  // Requests in flight per queue
+    uint32_t              max_sectors;  // Per request, 0 = no limit
+    int                   can_flush;
+    enum blk_mode         mode;
+    int                   irq_capable;
+    const struct blk_ops *ops;
+    void                 *priv;
+    uint64_t              doorbells;    // Statistics, kept by the driver
+    uint64_t              interrupts;
+};
+
+void               blk_register(struct blk_device *dev);
+uint32_t           blk_count(void);
+struct blk_device *blk_get(uint32_t index);
+
+int blk_set_mode(struct blk_device *dev, enum blk_mode mode);
+
+// Returns how many of the n requests were taken, in order; the rest
+// should be resubmitted once something completes. Requests the device
+// can't do complete at once with BLK_EUNSUPP and count as taken.
+int blk_submit(struct blk_device *dev, struct blk_request **reqs, int n);
+int blk_poll(struct blk_device *dev);
+
+// Wait for a submitted request. Halts until the next interrupt if its
+// completion interrupt comes to the calling CPU, spins on blk_poll()
+// otherwise (polled mode, or a request whose interrupt goes elsewhere).
+// Returns the final status.
+int blk_wait(struct blk_device *dev, struct blk_request *req);
+
+// Stop the device before handing the machine to another kernel (see
+// boot/kexec.h). Requests still in flight never complete.
+void blk_shutdown(struct blk_device *dev);
+
+// Synchronous single request
+int blk_rw(struct blk_device *dev, uint8_t op, uint64_t sector,
+           uint32_t count, void *buf);
@@ -0,0 +1,60 @@
+// kernel/drivers/hpet.c
+// High Precision Event Timer main counter
+#include "drivers/hpet.h"
+#include "acpi/acpi.h"
+#include "mm/pmm.h"
+
+#define HPET_REG_CAP        0x000   // bits 63:32 period (fs), bit 13 64-bit
+#define HPET_REG_CONFIG     0x010
+#define HPET_REG_COUNTER    0x0F0
+
+#define HPET_CAP_COUNT_64   (1ULL << 13)
+#define HPET_CONFIG_ENABLE  (1ULL << 0)
+#define HPET_MAX_PERIOD_FS  100000000ULL    // 100 ns
+
+static volatile uint64_t *g_regs;
+static uint64_t g_period_fs;
+static int g_64bit;
+
+static uint64_t hpet_reg(uint32_t reg) {
+    return g_regs[reg / 8];
+}
+
+int hpet_init(void) {
+    const struct acpi_hpet *t = (const void *)acpi_find_table("HPET", 0);
+    if (!t || t->header.length < sizeof(*t)) return -1;
+    if (t->base.space_id != ACPI_GAS_MEMORY || !t->base.address) return -1;
+
+    volatile uint64_t *regs = phys_to_virt(t->base.address);
+    uint64_t cap = regs[HPET_REG_CAP / 8];
+    uint64_t period = cap >> 32;
+    if (period == 0 || period > HPET_MAX_PERIOD_FS) return -1;
+
+    regs[HPET_REG_CONFIG / 8] |= HPET_CONFIG_ENABLE;
+    g_period_fs = period;
+    g_64bit = (cap & HPET_CAP_COUNT_64) != 0;
+    g_regs = regs;
+    return 0;
+}
+
+int hpet_present(void) {
+    return g_regs != 0;
+}
+
+uint64_t hpet_period_fs(void) {
+    return g_period_fs;
+}
+
+int hpet_is_64bit(void) {
+    return g_64bit;
+}
+
+uint64_t hpet_read(void) {
+    if (g_64bit) return hpet_reg(HPET_REG_COUNTER);
+    return (uint32_t)hpet_reg(HPET_REG_COUNTER);
+}
+
+uint64_t hpet_delta(uint64_t from, uint64_t to) {
+    if (g_64bit) return to - from;
+    return (uint32_t)(to - from);
+}
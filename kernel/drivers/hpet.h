@@ -0,0 +1,29 @@
+// kernel/drivers/hpet.h
+// High Precision Event Timer - used as a reference clock only
+//
+// The main counter is enabled and left free-running; no comparators or
+// interrupts are set up. Reads are uncached MMIO, hundreds of cycles each,
+// so it calibrates the TSC rather than serving time itself.
+#pragma once
+
+#include <stdint.h>
+
+// Find the ACPI HPET table and start the main counter. Call after
+// acpi_init(). Returns 0, or -1 if there is no usable HPET.
+int hpet_init(void);
+
+// Nonzero once hpet_init() has succeeded
+int hpet_present(void);
+
+// Counter period in femtoseconds (at most 100 ns by the spec)
+uint64_t hpet_period_fs(void);
+
+// Nonzero if the main counter is 64 bits wide; a 32-bit one wraps in
+// about five minutes at the usual 14.3 MHz
+int hpet_is_64bit(void);
+
+// The main counter. Only the low 32 bits are meaningful on a 32-bit HPET.
+uint64_t hpet_read(void);
+
+// Ticks from `from` to `to`, allowing for one wrap of a 32-bit counter
+uint64_t hpet_delta(uint64_t from, uint64_t to);
@@ -0,0 +1,346 @@
+// kernel/drivers/pci.c
+// PCI configuration space (ECAM, or the legacy 0xCF8/0xCFC ports) and the
+// device table
+#include "drivers/pci.h"
+#include "acpi/acpi.h"
+#include "boot/initcall.h"
+#include "lib/printk.h"
+#include "lib/sort.h"
+#include "lib/spinlock.h"
+#include "mm/pmm.h"
+#include "x86/apic.h"
+#include "x86/cpu.h"
+
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+#define MSIX_CTRL_ENABLE    (1 << 15)
+#define MSIX_CTRL_MASKALL   (1 << 14)
+#define MSIX_ENTRY_MASKED   1
+
+#define MAX_ECAM_WINDOWS    8
+
+struct ecam_window {
+    uint64_t base;              // Bus 0 of the segment
+    uint16_t segment;
+    uint8_t  start_bus, end_bus;
+};
+
+static struct pci_dev     g_devices[PCI_MAX_DEVICES];
+static uint32_t           g_device_count;
+static struct ecam_window g_ecam[MAX_ECAM_WINDOWS];
+static uint32_t           g_ecam_count;
+static spinlock_t         g_config_lock = SPINLOCK_INIT;   // CF8/CFC is a pair
+
+// Sorted (key << 8 | table index): vendor << 16 | device, and
+// class << 16 | subclass << 8 | prog_if
+static uint64_t           g_by_id[PCI_MAX_DEVICES];
+static uint64_t           g_by_class[PCI_MAX_DEVICES];
+
+//=============================================================================
+// Configuration Space
+//=============================================================================
+
+static uint32_t legacy_address(const struct pci_dev *d, uint16_t off) {
+    return (1U << 31) | ((uint32_t)d->bus << 16) | ((uint32_t)d->dev << 11) |
+           ((uint32_t)d->fn << 8) | (off & 0xFC);
+}
+
+static uint32_t legacy_read(const struct pci_dev *d, uint16_t off) {
+    uint64_t flags = spin_lock_irqsave(&g_config_lock);
+    outl(PCI_CONFIG_ADDRESS, legacy_address(d, off));
+    uint32_t v = inl(PCI_CONFIG_DATA);
+    spin_unlock_irqrestore(&g_config_lock, flags);
+    return v;
+}
+
+static void legacy_write(const struct pci_dev *d, uint16_t off, uint32_t v) {
+    uint64_t flags = spin_lock_irqsave(&g_config_lock);
+    outl(PCI_CONFIG_ADDRESS, legacy_address(d, off));
+    outl(PCI_CONFIG_DATA, v);
+    spin_unlock_irqrestore(&g_config_lock, flags);
+}
+
+// ECAM accesses are plain loads and stores of the natural width: no lock
+// and no read-modify-write for sub-dword fields
+
+uint32_t pci_read32(const struct pci_dev *d, uint16_t off) {
+    if (d->ecam) return *(volatile uint32_t *)(d->ecam + (off & 0xFFC));
+    return legacy_read(d, off);
+}
+
+uint16_t pci_read16(const struct pci_dev *d, uint16_t off) {
+    if (d->ecam) return *(volatile uint16_t *)(d->ecam + (off & 0xFFE));
+    return legacy_read(d, off) >> ((off & 2) * 8);
+}
+
+uint8_t pci_read8(const struct pci_dev *d, uint16_t off) {
+    if (d->ecam) return d->ecam[off & 0xFFF];
+    return legacy_read(d, off) >> ((off & 3) * 8);
+}
+
+void pci_write32(const struct pci_dev *d, uint16_t off, uint32_t v) {
+    if (d->ecam) {
+        *(volatile uint32_t *)(d->ecam + (off & 0xFFC)) = v;
+        return;
+    }
+    legacy_write(d, off, v);
+}
+
+void pci_write16(const struct pci_dev *d, uint16_t off, uint16_t v) {
+    if (d->ecam) {
+        *(volatile uint16_t *)(d->ecam + (off & 0xFFE)) = v;
+        return;
+    }
+    uint32_t shift = (off & 2) * 8;
+    uint32_t old = legacy_read(d, off);
+    legacy_write(d, off, (old & ~(0xFFFFU << shift)) | ((uint32_t)v << shift));
+}
+
+int pci_ecam_enabled(void) {
+    return g_ecam_count != 0;
+}
+
+//=============================================================================
+// Enumeration
+//=============================================================================
+
+// A function's address, enough to reach its config space
+static struct pci_dev locate(const struct ecam_window *w, uint8_t bus, uint8_t dev,
+                             uint8_t fn) {
+    struct pci_dev d = { .bus = bus, .dev = dev, .fn = fn };
+    if (w) {
+        d.segment = w->segment;
+        d.ecam = phys_to_virt(w->base + ((uint64_t)bus << 20) +
+                              ((uint64_t)dev << 15) + ((uint64_t)fn << 12));
+    }
+    return d;
+}
+
+// Record the standard capability list so probing never walks it again
+static void read_caps(struct pci_dev *d) {
+    d->cap_count = 0;
+    if (!(pci_read16(d, PCI_STATUS) & PCI_STATUS_CAP_LIST)) return;
+
+    uint8_t off = pci_read8(d, PCI_CAP_PTR);
+    // 48 capabilities fit in the 192 bytes after the header; more is a loop
+    for (int guard = 0; off >= 0x40 && guard < 48; guard++) {
+        off &= 0xFC;
+        if (d->cap_count == PCI_MAX_CAPS) {
+            kprintf("pci: %02x:%02x.%u: capabilities past %u ignored\n",
+                    d->bus, d->dev, d->fn, PCI_MAX_CAPS);
+            return;
+        }
+        d->cap_id[d->cap_count] = pci_read8(d, off);
+        d->cap_off[d->cap_count] = off;
+        d->cap_count++;
+        off = pci_read8(d, off + 1);
+    }
+}
+
+static void scan_bus(const struct ecam_window *w, uint8_t bus, uint32_t depth);
+
+static void add_function(const struct ecam_window *w, uint8_t bus, uint8_t dev,
+                         uint8_t fn, uint32_t depth) {
+    struct pci_dev probe = locate(w, bus, dev, fn);
+    uint32_t id = pci_read32(&probe, PCI_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF) return;
+
+    if (g_device_count == PCI_MAX_DEVICES) return;
+    struct pci_dev *d = &g_devices[g_device_count++];
+    *d = probe;
+    d->vendor = id & 0xFFFF;
+    d->device = id >> 16;
+
+    uint32_t cr = pci_read32(d, PCI_CLASS_REVISION);
+    d->revision   = cr & 0xFF;
+    d->prog_if    = (cr >> 8) & 0xFF;
+    d->subclass   = (cr >> 16) & 0xFF;
+    d->class_code = cr >> 24;
+    d->header_type = pci_read8(d, PCI_HEADER_TYPE);
+    read_caps(d);
+
+    // PCI-to-PCI bridge: the buses behind it are numbered from its
+    // secondary bus. Firmware assigns them; a bridge left unconfigured
+    // (secondary 0) or pointing backwards is skipped.
+    if ((d->header_type & 0x7F) == 1 && d->class_code == PCI_CLASS_BRIDGE &&
+        d->subclass == 0x04) {
+        uint8_t secondary = pci_read8(d, PCI_SECONDARY_BUS);
+        if (secondary > bus && depth < 32) scan_bus(w, secondary, depth + 1);
+    }
+}
+
+static void scan_bus(const struct ecam_window *w, uint8_t bus, uint32_t depth) {
+    if (w && (bus < w->start_bus || bus > w->end_bus)) return;
+
+    for (uint8_t dev = 0; dev < 32; dev++) {
+        struct pci_dev probe = locate(w, bus, dev, 0);
+        if (pci_read16(&probe, PCI_VENDOR_ID) == 0xFFFF) continue;
+        add_function(w, bus, dev, 0, depth);
+
+        // Multi-function devices set bit 7 of function 0's header type
+        if (!(pci_read8(&probe, PCI_HEADER_TYPE) & 0x80)) continue;
+        for (uint8_t fn = 1; fn < 8; fn++) add_function(w, bus, dev, fn, depth);
+    }
+}
+
+static void read_mcfg(void) {
+    const struct acpi_mcfg *mcfg = (const void *)acpi_find_table("MCFG", 0);
+    if (!mcfg || mcfg->header.length < sizeof(*mcfg)) return;     // Truncated
+
+    uint32_t n = (mcfg->header.length - sizeof(*mcfg)) / sizeof(mcfg->entries[0]);
+    for (uint32_t i = 0; i < n && g_ecam_count < MAX_ECAM_WINDOWS; i++) {
+        const struct acpi_mcfg_entry *e = &mcfg->entries[i];
+        if (!e->base || e->end_bus < e->start_bus) continue;
+        g_ecam[g_ecam_count++] = (struct ecam_window){
+            .base = e->base, .segment = e->segment,
+            .start_bus = e->start_bus, .end_bus = e->end_bus,
+        };
+    }
+}
+
+static void build_index(void) {
+    for (uint32_t i = 0; i < g_device_count; i++) {
+        const struct pci_dev *d = &g_devices[i];
+        uint64_t id = (uint64_t)d->vendor << 16 | d->device;
+        uint64_t cls = (uint64_t)d->class_code << 16 | (uint64_t)d->subclass << 8 |
+                       d->prog_if;
+        g_by_id[i] = id << 8 | i;
+        g_by_class[i] = cls << 8 | i;
+    }
+    sort_u64(g_by_id, g_device_count);
+    sort_u64(g_by_class, g_device_count);
+}
+
+void pci_init(void) {
+    g_device_count = 0;
+    g_ecam_count = 0;
+
+    // Each window's hierarchy starts at its first bus; the bridges lead
+    // to the rest, so only populated buses are ever touched
+    read_mcfg();
+    for (uint32_t i = 0; i < g_ecam_count; i++) {
+        scan_bus(&g_ecam[i], g_ecam[i].start_bus, 0);
+    }
+    if (g_ecam_count == 0) scan_bus(NULL, 0, 0);
+
+    build_index();
+}
+
+static void pci_initcall(void) {
+    pci_init();
+    kprintf("PCI: %u functions, %s config access\n", pci_device_count(),
+            pci_ecam_enabled() ? "ECAM" : "legacy port");
+}
+INITCALL(pci, pci_initcall, "", 0);
+
+uint32_t pci_device_count(void) {
+    return g_device_count;
+}
+
+struct pci_dev *pci_device(uint32_t index) {
+    return index < g_device_count ? &g_devices[index] : NULL;
+}
+
+// First entry of a sorted index, at or after `start`, whose key
+// (entry >> shift) is `key`
+static struct pci_dev *index_find(const uint64_t *index, uint64_t key, int shift,
+                                  uint64_t start) {
+    uint32_t lo = 0, hi = g_device_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (index[mid] < start) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == g_device_count || (index[lo] >> shift) != key) return NULL;
+    return &g_devices[index[lo] & 0xFF];
+}
+
+struct pci_dev *pci_find(uint16_t vendor, uint16_t device, struct pci_dev *from) {
+    uint64_t key = (uint64_t)vendor << 16 | device;
+    uint64_t start = key << 8;
+    if (from) start |= (uint64_t)(from - g_devices) + 1;
+    return index_find(g_by_id, key, 8, start);
+}
+
+struct pci_dev *pci_find_class(uint8_t class_code, uint8_t subclass,
+                               struct pci_dev *from) {
+    uint64_t key = (uint64_t)class_code << 8 | subclass;
+    uint64_t start = key << 16;
+    if (from) start |= ((uint64_t)from->prog_if << 8) + (uint64_t)(from - g_devices) + 1;
+    return index_find(g_by_class, key, 16, start);
+}
+
+//=============================================================================
+// BARs and Capabilities
+//=============================================================================
+
+uint64_t pci_bar(const struct pci_dev *d, int bar) {
+    if (bar < 0 || bar > 5) return 0;
+
+    uint32_t lo = pci_read32(d, PCI_BAR0 + bar * 4);
+    if (lo & 1) return 0;                       // I/O space
+
+    uint64_t addr = lo & ~0xFULL;
+    if (((lo >> 1) & 3) == 2 && bar < 5) {      // 64-bit
+        addr |= (uint64_t)pci_read32(d, PCI_BAR0 + (bar + 1) * 4) << 32;
+    }
+    return addr;
+}
+
+uint8_t pci_find_cap(const struct pci_dev *d, uint8_t id, uint8_t prev) {
+    uint32_t i = 0;
+    if (prev) {
+        while (i < d->cap_count && d->cap_off[i] != prev) i++;
+        i++;
+    }
+    for (; i < d->cap_count; i++) {
+        if (d->cap_id[i] == id) return d->cap_off[i];
+    }
+    return 0;
+}
+
+void pci_enable(const struct pci_dev *d) {
+    uint16_t cmd = pci_read16(d, PCI_COMMAND);
+    cmd |= PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER | PCI_COMMAND_INTX_OFF;
+    pci_write16(d, PCI_COMMAND, cmd);
+}
+
+//=============================================================================
+// MSI-X
+//=============================================================================
+
+int pci_msix_enable(struct pci_dev *d) {
+    uint8_t cap = pci_find_cap(d, PCI_CAP_MSIX, 0);
+    if (!cap) return -1;
+
+    uint16_t ctrl = pci_read16(d, cap + 2);
+    uint32_t table = pci_read32(d, cap + 4);
+    uint64_t bar = pci_bar(d, table & 7);
+    if (!bar) return -1;
+
+    d->msix_size = (ctrl & 0x7FF) + 1;
+    d->msix_table = phys_to_virt(bar + (table & ~7U));
+
+    // Mask the function while the entries are set up, then each entry
+    pci_write16(d, cap + 2, ctrl | MSIX_CTRL_ENABLE | MSIX_CTRL_MASKALL);
+    for (uint16_t i = 0; i < d->msix_size; i++) {
+        d->msix_table[i * 4 + 3] |= MSIX_ENTRY_MASKED;
+    }
+    pci_write16(d, cap + 2, (ctrl | MSIX_CTRL_ENABLE) & ~MSIX_CTRL_MASKALL);
+
+    return d->msix_size;
+}
+
+void pci_msix_set(struct pci_dev *d, uint16_t entry, uint8_t vector,
+                  uint32_t apic_id) {
+    if (!d->msix_table || entry >= d->msix_size) return;
+
+    volatile uint32_t *e = &d->msix_table[entry * 4];
+    uint64_t addr = msi_address(apic_id);
+    e[3] |= MSIX_ENTRY_MASKED;
+    e[0] = (uint32_t)addr;
+    e[1] = addr >> 32;
+    e[2] = msi_data(vector);
+    e[3] &= ~MSIX_ENTRY_MASKED;
+}
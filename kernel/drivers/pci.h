@@ -0,0 +1,99 @@
+// kernel/drivers/pci.h
+// PCI configuration space, device table, BARs, capabilities and MSI-X
+//
+// pci_init() walks the bus hierarchy once and records every function,
+// together with its capability list, in a table indexed by vendor/device
+// ID and by class. Drivers probe with lookups, not config-space walks.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PCI_MAX_DEVICES     64
+#define PCI_MAX_CAPS        12
+
+// Configuration header offsets
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_CLASS_REVISION  0x08
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_CAP_PTR         0x34
+#define PCI_SECONDARY_BUS   0x19    // Bridges (header type 1)
+
+#define PCI_COMMAND_IO          (1 << 0)
+#define PCI_COMMAND_MEMORY      (1 << 1)
+#define PCI_COMMAND_MASTER      (1 << 2)
+#define PCI_COMMAND_INTX_OFF    (1 << 10)
+
+#define PCI_STATUS_CAP_LIST     (1 << 4)
+
+// Capability IDs
+#define PCI_CAP_MSI         0x05
+#define PCI_CAP_VENDOR      0x09
+#define PCI_CAP_EXP         0x10
+#define PCI_CAP_MSIX        0x11
+
+#define PCI_CLASS_STORAGE   0x01
+#define PCI_CLASS_BRIDGE    0x06
+
+struct pci_dev {
+    volatile uint8_t *ecam;         // Memory-mapped config space, NULL if
+                                    // only the legacy ports reach it
+    uint16_t segment;
+    uint8_t  bus, dev, fn;
+    uint8_t  header_type;
+    uint16_t vendor, device;
+    uint8_t  class_code, subclass, prog_if, revision;
+    uint8_t  cap_count;             // Standard capabilities, list order
+    uint8_t  cap_id[PCI_MAX_CAPS];
+    uint8_t  cap_off[PCI_MAX_CAPS];
+    volatile uint32_t *msix_table;  // Set by pci_msix_enable()
+    uint16_t msix_size;
+};
+
+// Enumerate every function behind the host bridges and build the device
+// table. Uses the ECAM windows from the ACPI MCFG table (call after
+// acpi_init()); falls back to ports 0xCF8/0xCFC on machines without one.
+void pci_init(void);
+
+// Nonzero if config space is reached through ECAM
+int pci_ecam_enabled(void);
+
+uint32_t        pci_device_count(void);
+struct pci_dev *pci_device(uint32_t index);
+
+// Next device after `from` (NULL = first) with this vendor and device ID
+struct pci_dev *pci_find(uint16_t vendor, uint16_t device, struct pci_dev *from);
+
+// Next device after `from` (NULL = first) with this class and subclass
+struct pci_dev *pci_find_class(uint8_t class_code, uint8_t subclass,
+                               struct pci_dev *from);
+
+uint8_t  pci_read8(const struct pci_dev *d, uint16_t off);
+uint16_t pci_read16(const struct pci_dev *d, uint16_t off);
+uint32_t pci_read32(const struct pci_dev *d, uint16_t off);
+void     pci_write16(const struct pci_dev *d, uint16_t off, uint16_t v);
+void     pci_write32(const struct pci_dev *d, uint16_t off, uint32_t v);
+
+// Physical address of a memory BAR (64-bit BARs span two slots); 0 for
+// I/O or unimplemented BARs
+uint64_t pci_bar(const struct pci_dev *d, int bar);
+
+// Offset of the next capability with this ID after `prev` (0 = start of
+// the list), or 0 if there is none. Answered from the table.
+uint8_t pci_find_cap(const struct pci_dev *d, uint8_t id, uint8_t prev);
+
+// Turn on memory decoding and bus mastering, turn off legacy INTx
+void pci_enable(const struct pci_dev *d);
+
+// Enable MSI-X with every entry masked. Returns the table size, or -1 if
+// the function has no MSI-X capability.
+int pci_msix_enable(struct pci_dev *d);
+
+// Point table entry `entry` at `vector` on the CPU with APIC ID `apic_id`
+// and unmask it
+void pci_msix_set(struct pci_dev *d, uint16_t entry, uint8_t vector,
+                  uint32_t apic_id);
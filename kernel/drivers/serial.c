@@ -0,0 +1,45 @@
+// kernel/drivers/serial.c
+// 16550 UART on COM1, polled, 115200 8N1
+#include "serial.h"
+#include "x86/cpu.h"
+
+#define COM1        0x3F8
+#define UART_DATA   0       // DLAB=0: data, DLAB=1: divisor low
+#define UART_IER    1       // DLAB=0: interrupt enable, DLAB=1: divisor high
+#define UART_FCR    2
+#define UART_LCR    3
+#define UART_MCR    4
+#define UART_LSR    5
+
+#define LSR_THR_EMPTY 0x20
+
+static int g_serial_ok;
+
+void serial_init(void) {
+    outb(COM1 + UART_IER, 0x00);    // no interrupts
+    outb(COM1 + UART_LCR, 0x80);    // DLAB on
+    outb(COM1 + UART_DATA, 0x01);   // divisor 1 = 115200 baud
+    outb(COM1 + UART_IER, 0x00);
+    outb(COM1 + UART_LCR, 0x03);    // 8N1, DLAB off
+    outb(COM1 + UART_FCR, 0xC7);    // FIFO on, cleared, 14-byte threshold
+    outb(COM1 + UART_MCR, 0x03);    // DTR + RTS
+
+    // No UART here reads back 0xFF; don't spin on it forever
+    g_serial_ok = inb(COM1 + UART_LSR) != 0xFF;
+}
+
+static void serial_putc(char c) {
+    while (!(inb(COM1 + UART_LSR) & LSR_THR_EMPTY)) {
+        cpu_relax();
+    }
+    outb(COM1 + UART_DATA, (uint8_t)c);
+}
+
+void serial_write(const char *s, size_t len) {
+    if (!g_serial_ok) return;
+
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '\n') serial_putc('\r');
+        serial_putc(s[i]);
+    }
+}
@@ -0,0 +1,10 @@
+// kernel/drivers/serial.h
+// 16550 UART on COM1 - the kernel console
+//
+// QEMU: -serial stdio (or -serial file:out.txt) to see the output.
+#pragma once
+
+#include <stddef.h>
+
+void serial_init(void);
+void serial_write(const char *s, size_t len);
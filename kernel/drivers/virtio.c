@@ -0,0 +1,212 @@
+// kernel/drivers/virtio.c
+// Virtio 1.x modern PCI transport and split virtqueues
+#include "drivers/virtio.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "x86/cpu.h"
+
+// virtio_pci_cap.cfg_type
+#define VIRTIO_PCI_CAP_COMMON_CFG   1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG   2
+#define VIRTIO_PCI_CAP_ISR_CFG      3
+#define VIRTIO_PCI_CAP_DEVICE_CFG   4
+
+// Offsets inside a virtio vendor capability
+#define CAP_CFG_TYPE        3
+#define CAP_BAR             4
+#define CAP_OFFSET          8
+#define CAP_NOTIFY_MUL      16
+
+struct virtio_pci_common_cfg {
+    uint32_t device_feature_select;
+    uint32_t device_feature;
+    uint32_t driver_feature_select;
+    uint32_t driver_feature;
+    uint16_t config_msix_vector;
+    uint16_t num_queues;
+    uint8_t  device_status;
+    uint8_t  config_generation;
+    uint16_t queue_select;
+    uint16_t queue_size;
+    uint16_t queue_msix_vector;
+    uint16_t queue_enable;
+    uint16_t queue_notify_off;
+    uint32_t queue_desc_lo;     // 64-bit fields, written as two halves
+    uint32_t queue_desc_hi;
+    uint32_t queue_driver_lo;
+    uint32_t queue_driver_hi;
+    uint32_t queue_device_lo;
+    uint32_t queue_device_hi;
+};
+
+//=============================================================================
+// Device Setup
+//=============================================================================
+
+int virtio_init(struct virtio_dev *vd, struct pci_dev *pci) {
+    memset(vd, 0, sizeof(*vd));
+    vd->pci = pci;
+
+    for (uint8_t cap = pci_find_cap(pci, PCI_CAP_VENDOR, 0); cap;
+         cap = pci_find_cap(pci, PCI_CAP_VENDOR, cap)) {
+        uint8_t type = pci_read8(pci, cap + CAP_CFG_TYPE);
+        uint64_t bar = pci_bar(pci, pci_read8(pci, cap + CAP_BAR));
+        if (!bar) continue;
+        volatile uint8_t *p = phys_to_virt(bar + pci_read32(pci, cap + CAP_OFFSET));
+
+        // First structure of each type is the preferred one
+        switch (type) {
+        case VIRTIO_PCI_CAP_COMMON_CFG:
+            if (!vd->common) vd->common = (volatile void *)p;
+            break;
+        case VIRTIO_PCI_CAP_NOTIFY_CFG:
+            if (!vd->notify_base) {
+                vd->notify_base = p;
+                vd->notify_mul = pci_read32(pci, cap + CAP_NOTIFY_MUL);
+            }
+            break;
+        case VIRTIO_PCI_CAP_ISR_CFG:
+            if (!vd->isr) vd->isr = p;
+            break;
+        case VIRTIO_PCI_CAP_DEVICE_CFG:
+            if (!vd->device_cfg) vd->device_cfg = p;
+            break;
+        }
+    }
+    if (!vd->common || !vd->notify_base || !vd->device_cfg) return -1;
+
+    pci_enable(pci);
+
+    virtio_reset(vd);
+    vd->common->device_status = VIRTIO_STATUS_ACKNOWLEDGE;
+    vd->common->device_status |= VIRTIO_STATUS_DRIVER;
+    return 0;
+}
+
+int virtio_negotiate(struct virtio_dev *vd, uint64_t wanted) {
+    volatile struct virtio_pci_common_cfg *c = vd->common;
+
+    c->device_feature_select = 0;
+    uint64_t offered = c->device_feature;
+    c->device_feature_select = 1;
+    offered |= (uint64_t)c->device_feature << 32;
+
+    wanted |= 1ULL << VIRTIO_F_VERSION_1;
+    if (!((offered >> VIRTIO_F_VERSION_1) & 1)) return -1;
+    vd->features = offered & wanted;
+
+    c->driver_feature_select = 0;
+    c->driver_feature = (uint32_t)vd->features;
+    c->driver_feature_select = 1;
+    c->driver_feature = vd->features >> 32;
+
+    c->device_status |= VIRTIO_STATUS_FEATURES_OK;
+    return (c->device_status & VIRTIO_STATUS_FEATURES_OK) ? 0 : -1;
+}
+
+uint16_t virtio_num_queues(struct virtio_dev *vd) {
+    return vd->common->num_queues;
+}
+
+int virtio_queue_setup(struct virtio_dev *vd, struct virtq *vq, uint16_t index,
+                       uint16_t max_size, uint16_t msix_entry) {
+    volatile struct virtio_pci_common_cfg *c = vd->common;
+
+    c->queue_select = index;
+    uint16_t size = c->queue_size;
+    if (size == 0) return -1;
+    if (size > max_size) size = max_size;
+    while (size & (size - 1)) size &= size - 1;     // Power of two: cheap wrap
+
+    // Descriptors and the available ring share pages; the used ring, which
+    // only the device writes, gets its own so the two sides don't share
+    // cache lines more than they must
+    size_t ring_bytes = PAGE_ALIGN_UP(16ULL * size + 6 + 2ULL * size);
+    size_t used_bytes = PAGE_ALIGN_UP(6 + 8ULL * size);
+    uint8_t *mem = pmm_alloc_zeroed((ring_bytes + used_bytes) / PAGE_SIZE);
+    if (!mem) return -1;
+
+    memset(vq, 0, sizeof(*vq));
+    vq->index = index;
+    vq->size  = size;
+    vq->desc  = (volatile void *)mem;
+    vq->avail = (volatile void *)(mem + 16ULL * size);
+    vq->used  = (volatile void *)(mem + ring_bytes);
+    vq->msix_entry = msix_entry;
+
+    c->queue_size   = size;
+    uint64_t desc = virt_to_phys(mem);
+    uint64_t driver = virt_to_phys((const void *)vq->avail);
+    uint64_t device = virt_to_phys((const void *)vq->used);
+    c->queue_desc_lo   = (uint32_t)desc;
+    c->queue_desc_hi   = desc >> 32;
+    c->queue_driver_lo = (uint32_t)driver;
+    c->queue_driver_hi = driver >> 32;
+    c->queue_device_lo = (uint32_t)device;
+    c->queue_device_hi = device >> 32;
+    c->queue_msix_vector = msix_entry;
+    if (c->queue_msix_vector != msix_entry) {
+        pmm_free_pages(virt_to_phys(mem), (ring_bytes + used_bytes) / PAGE_SIZE);
+        return -1;
+    }
+
+    vq->notify = (volatile uint16_t *)
+        (vd->notify_base + (uint32_t)c->queue_notify_off * vd->notify_mul);
+    c->queue_enable = 1;
+    return 0;
+}
+
+void virtio_driver_ok(struct virtio_dev *vd) {
+    vd->common->config_msix_vector = VIRTIO_MSI_NO_VECTOR;
+    vd->common->device_status |= VIRTIO_STATUS_DRIVER_OK;
+}
+
+void virtio_fail(struct virtio_dev *vd) {
+    vd->common->device_status |= VIRTIO_STATUS_FAILED;
+}
+
+// The device acknowledges a reset by reading back 0
+void virtio_reset(struct virtio_dev *vd) {
+    vd->common->device_status = 0;
+    while (vd->common->device_status != 0) cpu_relax();
+}
+
+//=============================================================================
+// Queue Operations
+//=============================================================================
+
+int virtq_kick(struct virtq *vq) {
+    if (vq->avail_idx == vq->kicked_idx) return 0;
+
+    // Descriptors and ring slots must be visible before the index
+    barrier();
+    vq->avail->idx = vq->avail_idx;
+    vq->kicked_idx = vq->avail_idx;
+
+    // ...and the index before we look at whether the device is polling
+    smp_mb();
+    if (vq->used->flags & VIRTQ_USED_F_NO_NOTIFY) {
+        vq->kicks_skipped++;
+        return 0;
+    }
+    *vq->notify = vq->index;
+    vq->kicks++;
+    return 1;
+}
+
+int virtq_pop_used(struct virtq *vq, uint32_t *id, uint32_t *len) {
+    if (vq->last_used == vq->used->idx) return 0;
+
+    // Entry contents are only valid once we've seen the index move
+    barrier();
+    volatile struct virtq_used_elem *e = &vq->used->ring[vq->last_used & (vq->size - 1)];
+    *id = e->id;
+    *len = e->len;
+    vq->last_used++;
+    return 1;
+}
+
+void virtq_set_interrupts(struct virtq *vq, int enabled) {
+    vq->avail->flags = enabled ? 0 : VIRTQ_AVAIL_F_NO_INTERRUPT;
+    smp_mb();
+}
@@ -0,0 +1,138 @@
+// kernel/drivers/virtio.h
+// Virtio 1.x over modern PCI, with split virtqueues
+//
+// Only the "modern" interface is supported: configuration structures are
+// found through vendor capabilities and accessed through memory BARs.
+// QEMU's virtio devices expose it by default.
+#pragma once
+
+#include <stdint.h>
+#include "drivers/pci.h"
+
+#define VIRTIO_PCI_VENDOR       0x1AF4
+#define VIRTIO_MSI_NO_VECTOR    0xFFFF
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE   1
+#define VIRTIO_STATUS_DRIVER        2
+#define VIRTIO_STATUS_DRIVER_OK     4
+#define VIRTIO_STATUS_FEATURES_OK   8
+#define VIRTIO_STATUS_FAILED        128
+
+// Transport feature bits
+#define VIRTIO_F_VERSION_1      32
+
+//=============================================================================
+// Split Virtqueue Layout (Virtio 1.x, 2.7)
+//=============================================================================
+
+#define VIRTQ_DESC_F_NEXT       1
+#define VIRTQ_DESC_F_WRITE      2   // Device writes into this buffer
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT  1
+#define VIRTQ_USED_F_NO_NOTIFY      1
+
+struct virtq_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+
+struct virtq_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+};
+
+struct virtq_used_elem {
+    uint32_t id;
+    uint32_t len;
+};
+
+struct virtq_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct virtq_used_elem ring[];
+};
+
+struct virtq {
+    uint16_t index;
+    uint16_t size;
+    volatile struct virtq_desc  *desc;
+    volatile struct virtq_avail *avail;
+    volatile struct virtq_used  *used;
+    volatile uint16_t           *notify;
+    uint16_t avail_idx;     // Our copy of avail->idx, ahead until kicked
+    uint16_t kicked_idx;    // avail->idx as last published
+    uint16_t last_used;     // Next used entry to consume
+    uint16_t msix_entry;    // VIRTIO_MSI_NO_VECTOR when not wired up
+    uint64_t kicks;         // Doorbell writes
+    uint64_t kicks_skipped; // Publishes the device said it didn't need
+};
+
+//=============================================================================
+// Device
+//=============================================================================
+
+struct virtio_pci_common_cfg;
+
+struct virtio_dev {
+    struct pci_dev *pci;
+    volatile struct virtio_pci_common_cfg *common;
+    volatile uint8_t *notify_base;
+    uint32_t          notify_mul;
+    volatile uint8_t *isr;
+    volatile uint8_t *device_cfg;   // Device-specific configuration
+    uint64_t          features;     // Negotiated
+};
+
+// Locate the configuration structures, reset the device and set
+// ACKNOWLEDGE | DRIVER. Returns 0, or -1 if this isn't a modern device.
+int virtio_init(struct virtio_dev *vd, struct pci_dev *pci);
+
+// Accept `wanted` & offered (VERSION_1 is always requested and required).
+// Returns 0 once the device accepts FEATURES_OK.
+int virtio_negotiate(struct virtio_dev *vd, uint64_t wanted);
+
+static inline int virtio_has(const struct virtio_dev *vd, uint32_t bit) {
+    return (vd->features >> bit) & 1;
+}
+
+uint16_t virtio_num_queues(struct virtio_dev *vd);
+
+// Allocate and enable queue `index` with at most `max_size` entries.
+// `msix_entry` is the MSI-X table entry to signal, or VIRTIO_MSI_NO_VECTOR.
+// Returns 0, or -1 (queue absent, no memory, vector refused).
+int virtio_queue_setup(struct virtio_dev *vd, struct virtq *vq, uint16_t index,
+                       uint16_t max_size, uint16_t msix_entry);
+
+void virtio_driver_ok(struct virtio_dev *vd);
+void virtio_fail(struct virtio_dev *vd);
+
+// Back to the state virtio_init() found it in: queues disabled, no more
+// DMA or interrupts. The queue memory stays allocated.
+void virtio_reset(struct virtio_dev *vd);
+
+//=============================================================================
+// Queue Operations
+// Not locked; callers serialise per queue.
+//=============================================================================
+
+// Queue a descriptor chain head; invisible to the device until kicked
+static inline void virtq_push(struct virtq *vq, uint16_t head) {
+    vq->avail->ring[vq->avail_idx & (vq->size - 1)] = head;
+    vq->avail_idx++;
+}
+
+// Publish everything pushed since the last kick with a single index
+// update, and ring the doorbell unless the device asked us not to.
+// Returns 1 if the doorbell was written.
+int virtq_kick(struct virtq *vq);
+
+// Pop one completion. Returns 1 and fills id/len, or 0 if none is ready.
+int virtq_pop_used(struct virtq *vq, uint32_t *id, uint32_t *len);
+
+// Ask the device to (not) interrupt on completions. Only a hint: the
+// device may still interrupt, and re-enabling needs a recheck of the ring.
+void virtq_set_interrupts(struct virtq *vq, int enabled);
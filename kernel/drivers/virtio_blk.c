@@ -0,0 +1,358 @@
+// kernel/drivers/virtio_blk.c
+// virtio-blk driver
+//
+// Each CPU submits to its own virtqueue (CPU n uses queue n % queues), so
+// submitters on different CPUs never share a lock or a ring. Every
+// request is a fixed three-descriptor chain - header, data, status - so
+// slot n always owns descriptors 3n..3n+2 and no descriptor free list is
+// needed. Completion is either by MSI-X, one vector per queue delivered
+// to the lowest-numbered CPU using it, or by polling the used rings with
+// interrupts suppressed.
+#include "drivers/virtio_blk.h"
+#include "boot/initcall.h"
+#include "drivers/block.h"
+#include "drivers/virtio.h"
+#include "lib/printk.h"
+#include "lib/spinlock.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "x86/cpu.h"
+#include "x86/idt.h"
+#include "x86/percpu.h"
+#include "x86/smp.h"
+
+#define VIRTIO_BLK_DEVICE_LEGACY    0x1001
+#define VIRTIO_BLK_DEVICE_MODERN    0x1042
+
+// Feature bits
+#define VIRTIO_BLK_F_SIZE_MAX   1
+#define VIRTIO_BLK_F_SEG_MAX    2
+#define VIRTIO_BLK_F_BLK_SIZE   6
+#define VIRTIO_BLK_F_FLUSH      9
+#define VIRTIO_BLK_F_MQ         12
+
+// Device configuration offsets
+#define VIRTIO_BLK_CFG_CAPACITY     0
+#define VIRTIO_BLK_CFG_SIZE_MAX     8
+#define VIRTIO_BLK_CFG_BLK_SIZE     20
+#define VIRTIO_BLK_CFG_NUM_QUEUES   34
+
+// Request types and status values
+#define VIRTIO_BLK_T_IN         0
+#define VIRTIO_BLK_T_OUT        1
+#define VIRTIO_BLK_T_FLUSH      4
+
+#define VIRTIO_BLK_S_OK         0
+#define VIRTIO_BLK_S_IOERR      1
+#define VIRTIO_BLK_S_UNSUPP     2
+
+#define VBLK_MAX_DEVICES    4
+#define VBLK_MAX_QUEUES     MAX_CPUS
+#define VBLK_QUEUE_SIZE     256
+#define VBLK_DESC_PER_REQ   3
+#define VBLK_REAP_BATCH     32
+
+// Header and status are read/written by the device
+struct vblk_slot {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+    uint8_t  status;
+    uint8_t  _pad[7];
+    struct blk_request *req;
+};
+
+struct vblk;
+
+struct vblk_queue {
+    spinlock_t         lock;
+    struct virtq       vq;
+    struct vblk_slot  *slots;
+    uint16_t          *free;        // Stack of free slot numbers
+    uint16_t           nslots;
+    uint16_t           nfree;
+    int                vector;      // -1 when polled only
+    int                irq_cpu;     // Where `vector` is delivered
+    struct vblk       *dev;
+};
+
+struct vblk {
+    struct blk_device  blk;
+    struct virtio_dev  vd;
+    uint32_t           nq;
+    struct vblk_queue  queues[VBLK_MAX_QUEUES];
+};
+
+static struct vblk *g_vblk[VBLK_MAX_DEVICES];     // From pmm: queues[] is big
+static int          g_vblk_count;
+
+static inline struct vblk_queue *my_queue(struct vblk *vb) {
+    return &vb->queues[this_cpu()->cpu_id % vb->nq];
+}
+
+//=============================================================================
+// Submission
+//=============================================================================
+
+static int vblk_submit(struct blk_device *dev, struct blk_request **reqs, int n) {
+    struct vblk *vb = dev->priv;
+    struct vblk_queue *q = my_queue(vb);
+    int taken = 0;
+
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    for (; taken < n && q->nfree; taken++) {
+        struct blk_request *req = reqs[taken];
+        uint16_t s = q->free[--q->nfree];
+        struct vblk_slot *slot = &q->slots[s];
+        slot->type = req->op == BLK_OP_READ  ? VIRTIO_BLK_T_IN :
+                     req->op == BLK_OP_WRITE ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_FLUSH;
+        slot->reserved = 0;
+        slot->sector = req->sector;
+        slot->status = 0xFF;
+        slot->req = req;
+
+        uint16_t head = s * VBLK_DESC_PER_REQ;
+        volatile struct virtq_desc *d = &q->vq.desc[head];
+        d[0].addr  = virt_to_phys(slot);
+        d[0].len   = 16;
+        d[0].flags = VIRTQ_DESC_F_NEXT;
+        d[2].addr  = virt_to_phys(&slot->status);
+        d[2].len   = 1;
+        d[2].flags = VIRTQ_DESC_F_WRITE;
+        if (req->op == BLK_OP_FLUSH) {
+            d[0].next = head + 2;
+        } else {
+            d[0].next  = head + 1;
+            d[1].addr  = virt_to_phys(req->buf);
+            d[1].len   = req->count * 512;
+            d[1].flags = VIRTQ_DESC_F_NEXT |
+                         (req->op == BLK_OP_READ ? VIRTQ_DESC_F_WRITE : 0);
+        }
+        virtq_push(&q->vq, head);
+    }
+    // One doorbell for the whole batch
+    dev->doorbells += virtq_kick(&q->vq);
+    spin_unlock_irqrestore(&q->lock, flags);
+
+    return taken;
+}
+
+//=============================================================================
+// Completion
+//=============================================================================
+
+// Pop up to `max` completions; callbacks run later, outside the lock
+static int reap(struct vblk_queue *q, struct blk_request **out, int max) {
+    uint32_t id, len;
+    int n = 0;
+
+    while (n < max && virtq_pop_used(&q->vq, &id, &len)) {
+        uint16_t s = id / VBLK_DESC_PER_REQ;
+        struct vblk_slot *slot = &q->slots[s];
+        struct blk_request *req = slot->req;
+
+        req->complete_tsc = rdtsc();
+        req->status = slot->status == VIRTIO_BLK_S_OK     ? BLK_OK :
+                      slot->status == VIRTIO_BLK_S_UNSUPP ? BLK_EUNSUPP : BLK_EIO;
+        slot->req = NULL;
+        q->free[q->nfree++] = s;
+        out[n++] = req;
+    }
+    return n;
+}
+
+static int drain(struct vblk_queue *q) {
+    struct blk_request *done[VBLK_REAP_BATCH];
+    int total = 0, n;
+
+    do {
+        uint64_t flags = spin_lock_irqsave(&q->lock);
+        n = reap(q, done, VBLK_REAP_BATCH);
+        spin_unlock_irqrestore(&q->lock, flags);
+
+        for (int i = 0; i < n; i++) {
+            if (done[i]->done) done[i]->done(done[i]);
+        }
+        total += n;
+    } while (n == VBLK_REAP_BATCH);
+
+    return total;
+}
+
+static void vblk_irq(void *arg) {
+    struct vblk_queue *q = arg;
+    q->dev->blk.interrupts++;
+    drain(q);
+}
+
+static int vblk_poll(struct blk_device *dev) {
+    return drain(my_queue(dev->priv));
+}
+
+static int vblk_set_mode(struct blk_device *dev, enum blk_mode mode) {
+    struct vblk *vb = dev->priv;
+
+    for (uint32_t i = 0; i < vb->nq; i++) {
+        struct vblk_queue *q = &vb->queues[i];
+        uint64_t flags = spin_lock_irqsave(&q->lock);
+        virtq_set_interrupts(&q->vq, mode == BLK_MODE_IRQ);
+        spin_unlock_irqrestore(&q->lock, flags);
+    }
+    // Anything that completed while interrupts were off
+    if (mode == BLK_MODE_IRQ) {
+        for (uint32_t i = 0; i < vb->nq; i++) drain(&vb->queues[i]);
+    }
+    return 0;
+}
+
+static void vblk_shutdown(struct blk_device *dev) {
+    struct vblk *vb = dev->priv;
+    virtio_reset(&vb->vd);
+}
+
+static int vblk_irq_cpu(struct blk_device *dev, uint32_t cpu) {
+    struct vblk *vb = dev->priv;
+    const struct vblk_queue *q = &vb->queues[cpu % vb->nq];
+    return q->vector < 0 ? -1 : q->irq_cpu;
+}
+
+static const struct blk_ops g_vblk_ops = {
+    .submit   = vblk_submit,
+    .poll     = vblk_poll,
+    .set_mode = vblk_set_mode,
+    .shutdown = vblk_shutdown,
+    .irq_cpu  = vblk_irq_cpu,
+};
+
+//=============================================================================
+// Probe
+//=============================================================================
+
+static int setup_queue(struct vblk *vb, uint32_t index, int use_msix) {
+    struct vblk_queue *q = &vb->queues[index];
+
+    q->dev = vb;
+    q->vector = -1;
+    q->irq_cpu = -1;
+    uint16_t entry = VIRTIO_MSI_NO_VECTOR;
+    if (use_msix) {
+        q->vector = idt_alloc_irq(vblk_irq, q);
+        if (q->vector >= 0) {
+            // Queue i serves CPUs i, i + queues, ...: the first of them
+            // takes its interrupts. Queues no CPU uses go to the BSP.
+            entry = index;
+            q->irq_cpu = index < smp_cpu_count() ? (int)index : 0;
+            pci_msix_set(vb->vd.pci, entry, q->vector, g_percpu[q->irq_cpu].apic_id);
+        }
+    }
+
+    if (virtio_queue_setup(&vb->vd, &q->vq, index, VBLK_QUEUE_SIZE, entry) != 0) {
+        return -1;
+    }
+
+    q->nslots = q->vq.size / VBLK_DESC_PER_REQ;
+    size_t bytes = q->nslots * (sizeof(struct vblk_slot) + sizeof(uint16_t));
+    uint8_t *mem = pmm_alloc_zeroed(PAGE_ALIGN_UP(bytes) / PAGE_SIZE);
+    if (!mem) return -1;
+    q->slots = (struct vblk_slot *)mem;
+    q->free = (uint16_t *)(mem + q->nslots * sizeof(struct vblk_slot));
+    for (uint16_t s = 0; s < q->nslots; s++) q->free[s] = q->nslots - 1 - s;
+    q->nfree = q->nslots;
+    return 0;
+}
+
+static int probe_one(struct pci_dev *pci) {
+    if (g_vblk_count == VBLK_MAX_DEVICES) return -1;
+
+    size_t pages = PAGE_ALIGN_UP(sizeof(struct vblk)) / PAGE_SIZE;
+    struct vblk *vb = pmm_alloc_zeroed(pages);
+    if (!vb) return -1;
+    if (virtio_init(&vb->vd, pci) != 0) {
+        pmm_free_pages(virt_to_phys(vb), pages);
+        return -1;
+    }
+
+    uint64_t wanted = (1ULL << VIRTIO_BLK_F_SIZE_MAX) | (1ULL << VIRTIO_BLK_F_BLK_SIZE) |
+                      (1ULL << VIRTIO_BLK_F_FLUSH) | (1ULL << VIRTIO_BLK_F_MQ);
+    if (virtio_negotiate(&vb->vd, wanted) != 0) goto fail;
+
+    volatile uint8_t *cfg = vb->vd.device_cfg;
+    uint64_t capacity = *(volatile uint32_t *)(cfg + VIRTIO_BLK_CFG_CAPACITY) |
+        (uint64_t)*(volatile uint32_t *)(cfg + VIRTIO_BLK_CFG_CAPACITY + 4) << 32;
+    uint32_t block_size = 512;
+    if (virtio_has(&vb->vd, VIRTIO_BLK_F_BLK_SIZE)) {
+        block_size = *(volatile uint32_t *)(cfg + VIRTIO_BLK_CFG_BLK_SIZE);
+    }
+    uint32_t max_sectors = 0;
+    if (virtio_has(&vb->vd, VIRTIO_BLK_F_SIZE_MAX)) {
+        max_sectors = *(volatile uint32_t *)(cfg + VIRTIO_BLK_CFG_SIZE_MAX) / 512;
+    }
+
+    uint32_t nq = 1;
+    if (virtio_has(&vb->vd, VIRTIO_BLK_F_MQ)) {
+        nq = *(volatile uint16_t *)(cfg + VIRTIO_BLK_CFG_NUM_QUEUES);
+    }
+    if (nq > virtio_num_queues(&vb->vd)) nq = virtio_num_queues(&vb->vd);
+    if (nq > VBLK_MAX_QUEUES) nq = VBLK_MAX_QUEUES;
+    if (nq == 0) goto fail;
+
+    // MSI-X only if every queue can have its own entry
+    int msix = pci_msix_enable(pci);
+    int use_msix = msix >= (int)nq;
+
+    for (uint32_t i = 0; i < nq; i++) {
+        if (setup_queue(vb, i, use_msix) != 0) {
+            if (i == 0) goto fail;
+            nq = i;                     // Run with what we have
+            break;
+        }
+        if (vb->queues[i].vector < 0) use_msix = 0;
+    }
+    vb->nq = nq;
+    virtio_driver_ok(&vb->vd);
+
+    struct blk_device *blk = &vb->blk;
+    ksnprintf(blk->name, sizeof(blk->name), "vblk%d", g_vblk_count);
+    blk->sectors     = capacity;
+    blk->block_size  = block_size;
+    blk->queue_count = nq;
+    blk->queue_depth = vb->queues[0].nslots;
+    blk->max_sectors = max_sectors;
+    blk->can_flush   = virtio_has(&vb->vd, VIRTIO_BLK_F_FLUSH);
+    blk->irq_capable = use_msix;
+    blk->ops  = &g_vblk_ops;
+    blk->priv = vb;
+    blk_set_mode(blk, use_msix ? BLK_MODE_IRQ : BLK_MODE_POLL);
+    blk_register(blk);
+    g_vblk[g_vblk_count++] = vb;
+
+    kprintf("%s: %llu MiB, %u queue%s x %u requests, %s completion\n",
+            blk->name, (unsigned long long)(capacity >> 11), nq,
+            nq == 1 ? "" : "s", blk->queue_depth,
+            use_msix ? "MSI-X" : "polled");
+    return 0;
+
+fail:
+    // Queue memory stays with the (failed) device; it may still own it
+    virtio_fail(&vb->vd);
+    return -1;
+}
+
+int virtio_blk_probe(void) {
+    static const uint16_t ids[] = { VIRTIO_BLK_DEVICE_MODERN, VIRTIO_BLK_DEVICE_LEGACY };
+    int found = 0;
+
+    for (uint32_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+        for (struct pci_dev *d = pci_find(VIRTIO_PCI_VENDOR, ids[i], NULL); d;
+             d = pci_find(VIRTIO_PCI_VENDOR, ids[i], d)) {
+            if (probe_one(d) == 0) found++;
+        }
+    }
+    return found;
+}
+
+// After smp_init(), so every queue's interrupt can go to a CPU that uses it
+static void virtio_blk_initcall(void) {
+    virtio_blk_probe();
+}
+INITCALL(virtio_blk, virtio_blk_initcall, "pci", INIT_BSP);
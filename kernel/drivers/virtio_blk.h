@@ -0,0 +1,8 @@
+// kernel/drivers/virtio_blk.h
+// virtio-blk driver (QEMU: -drive if=virtio,file=disk.img,format=raw)
+#pragma once
+
+// Bind every virtio-blk function in the PCI table and register it as a
+// block device. Call after pci_init() and smp_init(). Returns the number
+// of devices brought up.
+int virtio_blk_probe(void);
@@ -0,0 +1,599 @@
+// kernel/fs/bcache.c
+// Block buffer cache: hash lookup, 2Q eviction, readahead, batched
+// write-back
+//
+// One lock covers all metadata. Device I/O is always issued with it
+// dropped; completions (interrupt or poll context) take it briefly to
+// publish the result.
+#include "fs/bcache.h"
+#include "boot/cmdline.h"
+#include "boot/initcall.h"
+#include "lib/printk.h"
+#include "lib/sort.h"
+#include "lib/spinlock.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "x86/cpu.h"
+
+// buf.flags
+#define B_VALID     (1 << 0)    // data matches (or supersedes) the disk
+#define B_DIRTY     (1 << 1)    // data must be written back
+#define B_BUSY      (1 << 2)    // I/O in flight
+#define B_RA        (1 << 3)    // read ahead and not used yet
+
+// buf.queue
+#define Q_FREE      0
+#define Q_A1IN      1
+#define Q_AM        2
+
+#define MIN_BLOCKS      16
+#define MAX_BLOCKS      65536   // Buffer index must fit in 16 bits (sort keys)
+#define RA_MIN          4       // Readahead window, blocks
+#define RA_MAX          64
+#define IO_BATCH        64      // Largest single submission
+
+// Identity of a block we evicted from A1in, kept so a quick re-reference
+// can be recognised as a hot block
+struct ghost {
+    struct blk_device *dev;
+    uint64_t           blockno;
+    struct ghost      *hnext;
+    struct list_node   fifo;
+};
+
+// Per-device sequential stream detection
+struct readahead {
+    struct blk_device *dev;
+    uint64_t           last;    // Last block bread() asked for
+    uint64_t           next;    // First block not yet read ahead
+    uint32_t           seq;     // Consecutive sequential reads
+    uint32_t           window;
+};
+
+static struct buf      *g_bufs;
+static uint32_t         g_nbufs;
+static struct buf     **g_hash;
+static uint32_t         g_hash_mask;
+
+static struct ghost    *g_ghosts;
+static struct ghost   **g_ghost_hash;
+static uint32_t         g_ghost_mask;
+
+static struct list_node g_free;         // Never used buffers
+static struct list_node g_a1in;         // FIFO, newest at head
+static struct list_node g_am;           // LRU, most recent at head
+static struct list_node g_dirty;        // Oldest at head
+static struct list_node g_ghost_fifo;   // Newest at head
+static struct list_node g_ghost_free;
+
+static uint32_t         g_a1in_count;
+static uint32_t         g_kin;          // A1in target size
+static uint32_t         g_dirty_count;
+static uint32_t         g_dirty_limit;
+static uint32_t         g_busy_count;
+
+static struct readahead g_ra[BLK_MAX_DEVICES];
+static struct bcache_stats g_stats;
+static spinlock_t       g_lock = SPINLOCK_INIT;
+
+static void io_done(struct blk_request *req);
+
+static uint32_t hash(const struct blk_device *dev, uint64_t blockno) {
+    uint64_t k = (blockno ^ ((uint64_t)dev >> 6)) * 0x9E3779B97F4A7C15ULL;
+    return k >> 32;
+}
+
+static uint32_t pow2_at_least(uint32_t n) {
+    uint32_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+//=============================================================================
+// Hash Tables
+//=============================================================================
+
+static struct buf *hash_find(struct blk_device *dev, uint64_t blockno) {
+    struct buf *b = g_hash[hash(dev, blockno) & g_hash_mask];
+    while (b && (b->dev != dev || b->blockno != blockno)) b = b->hnext;
+    return b;
+}
+
+static void hash_insert(struct buf *b) {
+    struct buf **head = &g_hash[hash(b->dev, b->blockno) & g_hash_mask];
+    b->hnext = *head;
+    *head = b;
+}
+
+static void hash_remove(struct buf *b) {
+    struct buf **pp = &g_hash[hash(b->dev, b->blockno) & g_hash_mask];
+    while (*pp != b) pp = &(*pp)->hnext;
+    *pp = b->hnext;
+}
+
+static struct ghost **ghost_slot(struct blk_device *dev, uint64_t blockno) {
+    struct ghost **pp = &g_ghost_hash[hash(dev, blockno) & g_ghost_mask];
+    while (*pp && ((*pp)->dev != dev || (*pp)->blockno != blockno)) {
+        pp = &(*pp)->hnext;
+    }
+    return pp;
+}
+
+// Remember an evicted A1in block, forgetting the oldest if full
+static void ghost_add(struct blk_device *dev, uint64_t blockno) {
+    struct ghost *g;
+
+    if (!list_empty(&g_ghost_free)) {
+        g = list_entry(g_ghost_free.next, struct ghost, fifo);
+    } else {
+        g = list_entry(g_ghost_fifo.prev, struct ghost, fifo);
+        struct ghost **pp = ghost_slot(g->dev, g->blockno);
+        *pp = g->hnext;
+    }
+    list_del(&g->fifo);
+
+    g->dev = dev;
+    g->blockno = blockno;
+    struct ghost **head = &g_ghost_hash[hash(dev, blockno) & g_ghost_mask];
+    g->hnext = *head;
+    *head = g;
+    list_add_head(&g_ghost_fifo, &g->fifo);
+}
+
+// Forget a remembered block; returns whether it was remembered
+static int ghost_take(struct blk_device *dev, uint64_t blockno) {
+    struct ghost **pp = ghost_slot(dev, blockno);
+    struct ghost *g = *pp;
+    if (!g) return 0;
+
+    *pp = g->hnext;
+    list_del(&g->fifo);
+    list_add_head(&g_ghost_free, &g->fifo);
+    return 1;
+}
+
+//=============================================================================
+// 2Q Replacement
+//=============================================================================
+
+// Oldest buffer on a queue that nobody holds and that needs no I/O
+static struct buf *scan(struct list_node *queue) {
+    list_for_each_reverse_safe(n, queue) {
+        struct buf *b = list_entry(n, struct buf, lru);
+        if (b->refcnt == 0 && !(b->flags & (B_BUSY | B_DIRTY))) return b;
+    }
+    return NULL;
+}
+
+// Unhook a buffer for reuse. A1in keeps its target share by giving up
+// its oldest blocks first; their IDs go to the ghost list.
+static struct buf *take_victim(void) {
+    struct buf *b = NULL;
+
+    if (!list_empty(&g_free)) {
+        b = list_entry(g_free.next, struct buf, lru);
+        list_del(&b->lru);
+        return b;
+    }
+
+    if (g_a1in_count > g_kin) b = scan(&g_a1in);
+    if (!b) b = scan(&g_am);
+    if (!b) b = scan(&g_a1in);
+    if (!b) return NULL;
+
+    hash_remove(b);
+    list_del(&b->lru);
+    if (b->flags & B_RA) {
+        g_stats.ra_wasted++;
+    } else if (b->queue == Q_A1IN && (b->flags & B_VALID)) {
+        ghost_add(b->dev, b->blockno);
+    }
+    if (b->queue == Q_A1IN) g_a1in_count--;
+    g_stats.evictions++;
+    return b;
+}
+
+// Give a victim its new identity. Blocks we recently pushed out of A1in
+// are hot: they skip A1in and go straight to Am.
+static void install(struct buf *b, struct blk_device *dev, uint64_t blockno,
+                    uint32_t flags) {
+    b->dev = dev;
+    b->blockno = blockno;
+    b->flags = flags;
+    b->refcnt = 0;
+    hash_insert(b);
+
+    if (ghost_take(dev, blockno)) {
+        g_stats.ghost_hits++;
+        b->queue = Q_AM;
+        list_add_head(&g_am, &b->lru);
+    } else {
+        b->queue = Q_A1IN;
+        list_add_head(&g_a1in, &b->lru);
+        g_a1in_count++;
+    }
+}
+
+static void touch(struct buf *b) {
+    // A1in is a FIFO: re-references there are correlated, not a sign of
+    // heat. Am is a plain LRU.
+    if (b->queue == Q_AM) {
+        list_del(&b->lru);
+        list_add_head(&g_am, &b->lru);
+    }
+    if (b->flags & B_RA) {
+        b->flags &= ~B_RA;
+        g_stats.ra_hits++;
+    }
+}
+
+//=============================================================================
+// I/O
+//=============================================================================
+
+// All buffers on one device; the lock must not be held
+static void submit_io(struct buf **bufs, uint32_t n, uint8_t op) {
+    struct blk_request *reqs[IO_BATCH];
+    struct blk_device *dev = bufs[0]->dev;
+
+    for (uint32_t i = 0; i < n; i++) {
+        struct blk_request *req = &bufs[i]->req;
+        req->op = op;
+        req->sector = bufs[i]->blockno * BCACHE_SECTORS;
+        req->count = BCACHE_SECTORS;
+        req->buf = bufs[i]->data;
+        req->done = io_done;
+        req->priv = bufs[i];
+        reqs[i] = req;
+    }
+
+    uint32_t done = 0;
+    while (done < n) {
+        done += blk_submit(dev, reqs + done, n - done);
+        if (done < n) blk_poll(dev);        // Queue full
+    }
+}
+
+static void mark_dirty(struct buf *b) {
+    if (b->flags & B_DIRTY) return;
+    b->flags |= B_DIRTY;
+    list_add_tail(&g_dirty, &b->dirty);
+    g_dirty_count++;
+}
+
+static void io_done(struct blk_request *req) {
+    struct buf *b = req->priv;
+
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    if (req->status == BLK_OK) {
+        if (req->op == BLK_OP_READ) b->flags |= B_VALID;
+    } else {
+        g_stats.io_errors++;
+        b->flags &= ~B_RA;
+        if (req->op == BLK_OP_WRITE) mark_dirty(b);     // Try again later
+    }
+    g_busy_count--;
+    __atomic_and_fetch(&b->flags, ~B_BUSY, __ATOMIC_RELEASE);
+    spin_unlock_irqrestore(&g_lock, flags);
+}
+
+static void wait_buf(struct buf *b) {
+    while (__atomic_load_n(&b->flags, __ATOMIC_ACQUIRE) & B_BUSY) {
+        blk_wait(b->dev, &b->req);
+        cpu_relax();
+    }
+}
+
+// Reap completions everywhere; used when every buffer is busy
+static void poll_all(void) {
+    for (uint32_t i = 0; i < blk_count(); i++) blk_poll(blk_get(i));
+}
+
+// Write back up to `max` (at most IO_BATCH) of the oldest dirty blocks of
+// `dev` (of the device owning the oldest dirty block if NULL), sorted by
+// block number, as one submission. Returns how many were written; *err is
+// set on error.
+static uint32_t writeback(struct blk_device *dev, uint32_t max, int *err) {
+    struct buf *batch[IO_BATCH];
+    uint64_t keys[IO_BATCH];
+    uint32_t n = 0;
+
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    list_for_each(node, &g_dirty) {
+        struct buf *b = list_entry(node, struct buf, dirty);
+        if (!dev) dev = b->dev;
+        if (b->dev != dev || (b->flags & B_BUSY)) continue;
+        keys[n++] = (b->blockno << 16) | (uint64_t)(b - g_bufs);
+        if (n == max || n == IO_BATCH) break;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        struct buf *b = &g_bufs[keys[i] & 0xFFFF];
+        list_del(&b->dirty);
+        g_dirty_count--;
+        b->flags = (b->flags & ~B_DIRTY) | B_BUSY;
+        g_busy_count++;
+    }
+    spin_unlock_irqrestore(&g_lock, flags);
+    if (n == 0) return 0;
+
+    // Ascending block order lets the device merge and stream
+    sort_u64(keys, n);
+    for (uint32_t i = 0; i < n; i++) batch[i] = &g_bufs[keys[i] & 0xFFFF];
+    submit_io(batch, n, BLK_OP_WRITE);
+
+    for (uint32_t i = 0; i < n; i++) {
+        wait_buf(batch[i]);
+        if (batch[i]->req.status != BLK_OK && err) *err = 1;
+    }
+
+    flags = spin_lock_irqsave(&g_lock);
+    g_stats.write_batches++;
+    g_stats.blocks_written += n;
+    spin_unlock_irqrestore(&g_lock, flags);
+    return n;
+}
+
+//=============================================================================
+// Readahead
+//=============================================================================
+
+static struct readahead *ra_state(struct blk_device *dev) {
+    for (int i = 0; i < BLK_MAX_DEVICES; i++) {
+        if (g_ra[i].dev == dev) return &g_ra[i];
+        if (!g_ra[i].dev) {
+            g_ra[i].dev = dev;
+            g_ra[i].last = ~0ULL;
+            g_ra[i].window = RA_MIN;
+            return &g_ra[i];
+        }
+    }
+    return NULL;
+}
+
+// Called for every bread(). Once two reads in a row are sequential, keep
+// at least half a window of blocks in flight ahead of the reader, and
+// double the window (up to RA_MAX) each time it is refilled.
+static void readahead(struct blk_device *dev, uint64_t blockno) {
+    struct buf *batch[RA_MAX];
+    uint32_t n = 0;
+
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    struct readahead *ra = ra_state(dev);
+    if (!ra) goto out;
+
+    if (blockno == ra->last + 1) {
+        ra->seq++;
+    } else if (blockno != ra->last) {
+        ra->seq = 0;
+        ra->window = RA_MIN;
+        ra->next = blockno + 1;
+    }
+    ra->last = blockno;
+    if (ra->seq == 0) goto out;
+
+    if (ra->next <= blockno) ra->next = blockno + 1;
+    if (ra->next - blockno > ra->window / 2) goto out;
+
+    uint64_t end = ra->next + ra->window;
+    uint64_t nblocks = dev->sectors / BCACHE_SECTORS;
+    if (end > nblocks) end = nblocks;
+    for (uint64_t blk = ra->next; blk < end; blk++) {
+        if (hash_find(dev, blk)) continue;
+        struct buf *b = take_victim();
+        if (!b) break;
+        install(b, dev, blk, B_RA | B_BUSY);
+        g_busy_count++;
+        batch[n++] = b;
+    }
+    ra->next = end;
+    if (ra->window < RA_MAX) ra->window *= 2;
+    g_stats.ra_issued += n;
+
+out:
+    spin_unlock_irqrestore(&g_lock, flags);
+    if (n) submit_io(batch, n, BLK_OP_READ);
+}
+
+//=============================================================================
+// Interface
+//=============================================================================
+
+// Find or allocate the buffer for a block and take a reference
+static struct buf *acquire(struct blk_device *dev, uint64_t blockno) {
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&g_lock);
+        g_stats.lookups++;
+
+        struct buf *b = hash_find(dev, blockno);
+        if (b) {
+            if (b->flags & (B_VALID | B_BUSY)) g_stats.hits++;
+            else g_stats.misses++;
+            touch(b);
+            b->refcnt++;
+            spin_unlock_irqrestore(&g_lock, flags);
+            return b;
+        }
+
+        b = take_victim();
+        if (b) {
+            g_stats.misses++;
+            install(b, dev, blockno, 0);
+            b->refcnt = 1;
+            spin_unlock_irqrestore(&g_lock, flags);
+            return b;
+        }
+
+        // Everything is held, dirty or in flight
+        g_stats.lookups--;
+        int dirty = g_dirty_count != 0;
+        int busy = g_busy_count != 0;
+        spin_unlock_irqrestore(&g_lock, flags);
+
+        if (dirty && writeback(NULL, IO_BATCH, NULL)) continue;
+        if (busy) {
+            poll_all();
+            continue;
+        }
+        return NULL;
+    }
+}
+
+struct buf *bread(struct blk_device *dev, uint64_t blockno) {
+    struct buf *b = acquire(dev, blockno);
+    if (!b) return NULL;
+
+    // Kick off the next window before waiting for this block
+    readahead(dev, blockno);
+
+    if (!(b->flags & B_VALID)) {
+        uint64_t flags = spin_lock_irqsave(&g_lock);
+        int start = !(b->flags & (B_VALID | B_BUSY));
+        if (start) {
+            b->flags |= B_BUSY;
+            g_busy_count++;
+        }
+        spin_unlock_irqrestore(&g_lock, flags);
+
+        if (start) submit_io(&b, 1, BLK_OP_READ);
+        wait_buf(b);
+        if (!(b->flags & B_VALID)) {
+            brelse(b);
+            return NULL;
+        }
+    }
+    return b;
+}
+
+struct buf *bget(struct blk_device *dev, uint64_t blockno) {
+    struct buf *b = acquire(dev, blockno);
+    if (b) wait_buf(b);     // A readahead may still be filling it
+    return b;
+}
+
+void bdirty(struct buf *b) {
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    b->flags |= B_VALID;
+    b->flags &= ~B_RA;
+    mark_dirty(b);
+    spin_unlock_irqrestore(&g_lock, flags);
+}
+
+void brelse(struct buf *b) {
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    b->refcnt--;
+    int over = g_dirty_count > g_dirty_limit;
+    spin_unlock_irqrestore(&g_lock, flags);
+
+    // Throttle writers: past the dirty limit, whoever releases pays for
+    // one batch
+    if (over) writeback(NULL, IO_BATCH, NULL);
+}
+
+// A failed write puts its block back at the end of the dirty list, so
+// writing no more blocks than were dirty at the start gives each of them
+// one attempt; the failures are left for later writeback.
+int bflush(struct blk_device *dev) {
+    int err = 0;
+    uint32_t left = 0;
+
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    list_for_each(node, &g_dirty) {
+        struct buf *b = list_entry(node, struct buf, dirty);
+        if (!dev || b->dev == dev) left++;
+    }
+    spin_unlock_irqrestore(&g_lock, flags);
+
+    uint32_t n;
+    while (left && (n = writeback(dev, left, &err))) left -= n;
+
+    // Then make the device's own cache durable
+    for (uint32_t i = 0; i < blk_count(); i++) {
+        struct blk_device *d = blk_get(i);
+        if ((dev && d != dev) || !d->can_flush) continue;
+        if (blk_rw(d, BLK_OP_FLUSH, 0, 0, NULL) != BLK_OK) err = 1;
+    }
+    return err ? -1 : 0;
+}
+
+//=============================================================================
+// Setup and Statistics
+//=============================================================================
+
+void bcache_init(uint32_t blocks) {
+    if (blocks < MIN_BLOCKS) blocks = MIN_BLOCKS;
+    if (blocks > MAX_BLOCKS) blocks = MAX_BLOCKS;
+
+    uint32_t buckets = pow2_at_least(blocks);
+    uint32_t nghosts = blocks / 2;
+    uint32_t ghost_buckets = pow2_at_least(nghosts);
+
+    g_bufs = pmm_alloc_zeroed(PAGE_ALIGN_UP(blocks * sizeof(struct buf)) / PAGE_SIZE);
+    g_hash = pmm_alloc_zeroed(PAGE_ALIGN_UP(buckets * sizeof(struct buf *)) / PAGE_SIZE);
+    g_ghosts = pmm_alloc_zeroed(PAGE_ALIGN_UP(nghosts * sizeof(struct ghost)) / PAGE_SIZE);
+    g_ghost_hash = pmm_alloc_zeroed(PAGE_ALIGN_UP(ghost_buckets * sizeof(struct ghost *)) /
+                                    PAGE_SIZE);
+    if (!g_bufs || !g_hash || !g_ghosts || !g_ghost_hash) panic("bcache: out of memory");
+
+    g_hash_mask = buckets - 1;
+    g_ghost_mask = ghost_buckets - 1;
+    list_init(&g_free);
+    list_init(&g_a1in);
+    list_init(&g_am);
+    list_init(&g_dirty);
+    list_init(&g_ghost_fifo);
+    list_init(&g_ghost_free);
+
+    for (g_nbufs = 0; g_nbufs < blocks; g_nbufs++) {
+        struct buf *b = &g_bufs[g_nbufs];
+        uint64_t page = pmm_alloc_pages(1);
+        if (!page) break;
+        b->data = phys_to_virt(page);
+        list_init(&b->dirty);
+        list_add_tail(&g_free, &b->lru);
+    }
+    for (uint32_t i = 0; i < nghosts; i++) {
+        list_add_tail(&g_ghost_free, &g_ghosts[i].fifo);
+    }
+
+    // 2Q's usual tuning: A1in a quarter of the cache, ghosts for half
+    g_kin = g_nbufs / 4;
+    g_dirty_limit = g_nbufs / 4;
+}
+
+static void bcache_initcall(void) {
+    bcache_init(cmdline_get_u64("bcache.blocks", 1024));
+}
+INITCALL(bcache, bcache_initcall, "", 0);
+
+uint32_t bcache_blocks(void) {
+    return g_nbufs;
+}
+
+void bcache_get_stats(struct bcache_stats *out) {
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    *out = g_stats;
+    spin_unlock_irqrestore(&g_lock, flags);
+}
+
+static void print_ratio(const char *label, uint64_t part, uint64_t whole) {
+    uint64_t permille = whole ? part * 1000 / whole : 0;
+    kprintf("%s %llu.%llu%%", label, (unsigned long long)(permille / 10),
+            (unsigned long long)(permille % 10));
+}
+
+void bcache_print_stats(void) {
+    struct bcache_stats s;
+    bcache_get_stats(&s);
+
+    kprintf("bcache: %u blocks, %llu lookups,", g_nbufs,
+            (unsigned long long)s.lookups);
+    print_ratio(" hit", s.hits, s.lookups);
+    kprintf(", %llu evictions, %llu promoted from ghosts\n",
+            (unsigned long long)s.evictions, (unsigned long long)s.ghost_hits);
+    kprintf("bcache: readahead %llu blocks,", (unsigned long long)s.ra_issued);
+    print_ratio(" used", s.ra_hits, s.ra_issued);
+    print_ratio(", wasted", s.ra_wasted, s.ra_issued);
+    kprintf("; wrote %llu blocks in %llu batches, %llu I/O errors\n",
+            (unsigned long long)s.blocks_written, (unsigned long long)s.write_batches,
+            (unsigned long long)s.io_errors);
+}
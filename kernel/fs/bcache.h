@@ -0,0 +1,76 @@
+// kernel/fs/bcache.h
+// Block buffer cache
+//
+// Caches BCACHE_BLOCK_SIZE blocks of block devices, keyed by (device,
+// block number). Lookups go through a hash table. Eviction is 2Q: blocks
+// seen once sit in a FIFO (A1in) and only move to the LRU (Am) if they
+// are asked for again after falling out of it, which a remembered-IDs
+// ghost list (A1out) detects. One sequential scan therefore can't flush
+// the frequently used blocks.
+//
+// Sequential bread()s trigger asynchronous readahead with a window that
+// doubles while the stream continues. Writes are write-back: bdirty()
+// marks a block, and dirty blocks go to the device in sorted batches -
+// when too many pile up, when their buffers are needed, or on bflush().
+#pragma once
+
+#include <stdint.h>
+#include "drivers/block.h"
+#include "lib/list.h"
+
+#define BCACHE_BLOCK_SIZE   4096
+#define BCACHE_SECTORS      (BCACHE_BLOCK_SIZE / 512)
+
+struct buf {
+    struct blk_device *dev;
+    uint64_t           blockno;
+    uint8_t           *data;        // BCACHE_BLOCK_SIZE bytes
+    // Private to the cache
+    uint32_t           flags;
+    uint32_t           refcnt;
+    uint8_t            queue;
+    struct buf        *hnext;
+    struct list_node   lru;         // A1in, Am or the free list
+    struct list_node   dirty;       // Oldest first
+    struct blk_request req;
+};
+
+struct bcache_stats {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t ghost_hits;        // Misses that 2Q promoted straight to Am
+    uint64_t evictions;
+    uint64_t ra_issued;         // Blocks read ahead
+    uint64_t ra_hits;           // ...that were later used
+    uint64_t ra_wasted;         // ...that were evicted unused
+    uint64_t blocks_written;
+    uint64_t write_batches;
+    uint64_t io_errors;
+};
+
+// Allocate `blocks` buffers (and their data pages) from the page allocator
+void bcache_init(uint32_t blocks);
+
+// Return the block, read from the device if needed, with a reference
+// held. NULL on I/O error or if every buffer is in use.
+struct buf *bread(struct blk_device *dev, uint64_t blockno);
+
+// Get the block for overwriting in full: no read if it isn't cached
+struct buf *bget(struct blk_device *dev, uint64_t blockno);
+
+// The caller changed b->data; it will be written back later
+void bdirty(struct buf *b);
+
+// Drop the reference from bread()/bget()
+void brelse(struct buf *b);
+
+// Write every dirty block of `dev` (all devices if NULL) and issue a
+// device cache flush. Returns 0, or -1 if any write failed.
+int bflush(struct blk_device *dev);
+
+// Buffers actually allocated
+uint32_t bcache_blocks(void);
+
+void bcache_get_stats(struct bcache_stats *out);
+void bcache_print_stats(void);
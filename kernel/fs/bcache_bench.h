@@ -0,0 +1,11 @@
+// kernel/fs/bcache_bench.h
+// Block cache benchmark: readahead throughput and scan resistance
+#pragma once
+
+#include "drivers/block.h"
+
+// Read-only. Reports a cold sequential scan (throughput and readahead
+// use), then re-reads a hot set around a scan several times the cache
+// size and reports how much of the hot set survived. Command line knob:
+//   bcachebench.scan=N   sequential scan length in blocks (default 8192)
+void bcache_bench(struct blk_device *dev);
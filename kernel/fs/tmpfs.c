@@ -0,0 +1,610 @@
+// kernel/fs/tmpfs.c
+// In-memory filesystem: radix-tree page index, hashed directory entries,
+// boot modules and a ustar initrd mapped in place
+#include "fs/tmpfs.h"
+#include "boot/bootinfo.h"
+#include "boot/cmdline.h"
+#include "boot/initcall.h"
+#include "lib/printk.h"
+#include "lib/spinlock.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "x86/cpu.h"
+#include "x86/tsc.h"
+
+#define RADIX_SHIFT     6
+#define RADIX_SLOTS     (1u << RADIX_SHIFT)
+#define RADIX_MASK      (RADIX_SLOTS - 1)
+#define RADIX_MAX       9               // Levels for 2^54 pages
+
+#define HASH_SIZE       4096            // Directory entry buckets
+
+// A leaf slot is the page's address, with this bit set if it lies in a
+// boot module rather than a page of our own. Archive members start on
+// 512-byte boundaries, so the bit is always free.
+#define PAGE_BORROWED   1ULL
+
+struct tmpfs_node {
+    uintptr_t slots[RADIX_SLOTS];       // Nodes, or pages on the last level
+};
+
+// Fixed-size objects carved out of whole pages, never given back
+struct pool {
+    uint32_t size;
+    void    *free;
+};
+
+static struct pool          g_nodes = { sizeof(struct tmpfs_node), NULL };
+static struct pool          g_inodes = { sizeof(struct tmpfs_inode), NULL };
+static struct pool          g_dentries = { sizeof(struct tmpfs_dentry), NULL };
+
+static struct tmpfs_inode  *g_root;
+static struct tmpfs_dentry *g_hash[HASH_SIZE];
+static struct tmpfs_stats   g_stats;
+static spinlock_t           g_lock = SPINLOCK_INIT;
+
+//=============================================================================
+// Allocation
+//=============================================================================
+
+static void *pool_get(struct pool *p) {
+    if (!p->free) {
+        uint8_t *page = pmm_alloc_zeroed(1);
+        if (!page) return NULL;
+        for (uint32_t off = 0; off + p->size <= PAGE_SIZE; off += p->size) {
+            *(void **)(page + off) = p->free;
+            p->free = page + off;
+        }
+    }
+    void *obj = p->free;
+    p->free = *(void **)obj;
+    memset(obj, 0, p->size);
+    return obj;
+}
+
+static void pool_put(struct pool *p, void *obj) {
+    *(void **)obj = p->free;
+    p->free = obj;
+}
+
+//=============================================================================
+// Page Index
+//=============================================================================
+
+static void *entry_data(uintptr_t e) {
+    return (void *)(e & ~PAGE_BORROWED);
+}
+
+// Pages a tree of `height` levels has room for
+static uint64_t capacity(uint32_t height) {
+    return 1ULL << (RADIX_SHIFT * height);
+}
+
+static uintptr_t radix_get(const struct tmpfs_inode *ino, uint64_t index) {
+    if (!ino->height || index >= capacity(ino->height)) return 0;
+
+    const struct tmpfs_node *n = ino->root;
+    for (uint32_t level = ino->height - 1; level > 0; level--) {
+        n = (const struct tmpfs_node *)n->slots[(index >> (RADIX_SHIFT * level)) & RADIX_MASK];
+        if (!n) return 0;
+    }
+    return n->slots[index & RADIX_MASK];
+}
+
+// The leaf slot for `index`, adding levels on top and nodes on the way
+// down as needed. NULL if memory ran out.
+static uintptr_t *radix_slot(struct tmpfs_inode *ino, uint64_t index) {
+    while (!ino->height || index >= capacity(ino->height)) {
+        if (ino->height == RADIX_MAX) return NULL;
+        struct tmpfs_node *top = pool_get(&g_nodes);
+        if (!top) return NULL;
+        top->slots[0] = (uintptr_t)ino->root;
+        ino->root = top;
+        ino->height++;
+    }
+
+    struct tmpfs_node *n = ino->root;
+    for (uint32_t level = ino->height - 1; level > 0; level--) {
+        uintptr_t *slot = &n->slots[(index >> (RADIX_SHIFT * level)) & RADIX_MASK];
+        if (!*slot) {
+            struct tmpfs_node *child = pool_get(&g_nodes);
+            if (!child) return NULL;
+            *slot = (uintptr_t)child;
+        }
+        n = (struct tmpfs_node *)*slot;
+    }
+    return &n->slots[index & RADIX_MASK];
+}
+
+static void radix_free(struct tmpfs_node *n, uint32_t level) {
+    for (uint32_t i = 0; i < RADIX_SLOTS; i++) {
+        uintptr_t e = n->slots[i];
+        if (!e) continue;
+        if (level > 1) {
+            radix_free((struct tmpfs_node *)e, level - 1);
+        } else if (e & PAGE_BORROWED) {
+            g_stats.borrowed_pages--;
+        } else {
+            pmm_free_pages(virt_to_phys(entry_data(e)), 1);
+            g_stats.owned_pages--;
+        }
+    }
+    pool_put(&g_nodes, n);
+}
+
+// Point the file at `size` bytes of a boot module
+static int attach(struct tmpfs_inode *ino, const uint8_t *data, uint64_t size) {
+    for (uint64_t i = 0; i < PAGE_ALIGN_UP(size) >> PAGE_SHIFT; i++) {
+        uintptr_t *slot = radix_slot(ino, i);
+        if (!slot) return -1;
+        *slot = (uintptr_t)(data + i * PAGE_SIZE) | PAGE_BORROWED;
+        g_stats.borrowed_pages++;
+    }
+    ino->size = size;
+    return 0;
+}
+
+// Give the file its own copy of a boot module page: the part of it that
+// is the file's, zeros after. Returns the copy or NULL.
+static uint8_t *unshare(struct tmpfs_inode *ino, uintptr_t *slot, uint64_t index) {
+    uint8_t *page = pmm_alloc_zeroed(1);
+    if (!page) return NULL;
+
+    uint64_t start = index << PAGE_SHIFT;
+    if (ino->size > start) {
+        uint64_t valid = ino->size - start;
+        memcpy(page, entry_data(*slot), valid < PAGE_SIZE ? valid : PAGE_SIZE);
+    }
+    *slot = (uintptr_t)page;
+    g_stats.borrowed_pages--;
+    g_stats.owned_pages++;
+    return page;
+}
+
+//=============================================================================
+// Directory Entries
+//=============================================================================
+
+// FNV-1a of the name, mixed with the parent
+static uint32_t name_hash(const struct tmpfs_inode *parent, const char *name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t)name[i]) * 16777619u;
+    uint64_t p = (uint64_t)parent >> 4;
+    return h ^ (uint32_t)(p * 0x9E3779B97F4A7C15ULL >> 32);
+}
+
+static struct tmpfs_dentry *d_find(const struct tmpfs_inode *parent, const char *name,
+                                   size_t len) {
+    if (len > TMPFS_NAME_MAX) return NULL;
+    uint32_t h = name_hash(parent, name, len);
+    for (struct tmpfs_dentry *d = g_hash[h & (HASH_SIZE - 1)]; d; d = d->hnext) {
+        if (d->hash == h && d->parent == parent && !memcmp(d->name, name, len) &&
+            !d->name[len]) {
+            return d;
+        }
+    }
+    return NULL;
+}
+
+// The inode goes with its last reference. A directory has none left from
+// entries under it by then: each holds one on its parent.
+static void i_put(struct tmpfs_inode *ino) {
+    if (--ino->refs) return;
+    if (ino->root) radix_free(ino->root, ino->height);
+    pool_put(&g_inodes, ino);
+}
+
+// A new, empty inode under `parent`, referenced only by its entry. The
+// name must not be taken.
+static struct tmpfs_inode *d_add(struct tmpfs_inode *parent, const char *name, size_t len,
+                                 uint32_t type) {
+    if (!len || len > TMPFS_NAME_MAX) return NULL;
+    struct tmpfs_inode *ino = pool_get(&g_inodes);
+    struct tmpfs_dentry *d = ino ? pool_get(&g_dentries) : NULL;
+    if (!d) {
+        if (ino) pool_put(&g_inodes, ino);
+        return NULL;
+    }
+
+    ino->type = type;
+    ino->refs = 1;
+    parent->refs++;
+    d->parent = parent;
+    d->inode = ino;
+    d->hash = name_hash(parent, name, len);
+    memcpy(d->name, name, len);
+
+    struct tmpfs_dentry **bucket = &g_hash[d->hash & (HASH_SIZE - 1)];
+    d->hnext = *bucket;
+    *bucket = d;
+    d->next = parent->children;
+    parent->children = d;
+    parent->nchildren++;
+
+    if (type == TMPFS_DIR) {
+        g_stats.dirs++;
+    } else {
+        g_stats.files++;
+    }
+    return ino;
+}
+
+// Off the parent's list and gone, with the references the entry held
+static void d_free(struct tmpfs_dentry *d) {
+    struct tmpfs_inode *parent = d->parent;
+    struct tmpfs_dentry **pp = &parent->children;
+    while (*pp != d) pp = &(*pp)->next;
+    *pp = d->next;
+
+    struct tmpfs_inode *ino = d->inode;
+    pool_put(&g_dentries, d);
+    i_put(ino);
+    i_put(parent);
+}
+
+// Unlink: the name can't be found any more, and the entry stays on the
+// parent's list only while a tmpfs_readdir() walk is on it
+static void d_remove(struct tmpfs_dentry *d) {
+    struct tmpfs_dentry **pp = &g_hash[d->hash & (HASH_SIZE - 1)];
+    while (*pp != d) pp = &(*pp)->hnext;
+    *pp = d->hnext;
+    d->parent->nchildren--;
+
+    if (d->inode->type == TMPFS_DIR) {
+        g_stats.dirs--;
+    } else {
+        g_stats.files--;
+    }
+    if (d->refs) {
+        d->dead = 1;
+    } else {
+        d_free(d);
+    }
+}
+
+static void d_release(struct tmpfs_dentry *d) {
+    if (--d->refs == 0 && d->dead) d_free(d);
+}
+
+//=============================================================================
+// Paths
+//=============================================================================
+
+// The next name in *path, moving past it; "." is skipped. NULL at the end.
+static const char *component(const char **path, size_t *len) {
+    for (;;) {
+        while (**path == '/') (*path)++;
+        if (!**path) return NULL;
+
+        const char *s = *path;
+        size_t n = 0;
+        while (s[n] && s[n] != '/') n++;
+        *path = s + n;
+        if (n == 1 && s[0] == '.') continue;
+        *len = n;
+        return s;
+    }
+}
+
+// Walk all but the last name in `path`, making missing directories on the
+// way if `mkdirs`. Returns the directory holding the last name, which is
+// left in *name and *len (0 if the path is the root), or NULL.
+static struct tmpfs_inode *walk(const char *path, int mkdirs, const char **name, size_t *len) {
+    struct tmpfs_inode *dir = g_root;
+    size_t n;
+    const char *s = component(&path, &n);
+
+    *len = 0;
+    while (s) {
+        size_t next_len;
+        const char *next = component(&path, &next_len);
+        if (!next) {
+            *name = s;
+            *len = n;
+            break;
+        }
+
+        struct tmpfs_dentry *d = d_find(dir, s, n);
+        struct tmpfs_inode *ino = d ? d->inode : NULL;
+        if (!ino && mkdirs) ino = d_add(dir, s, n, TMPFS_DIR);
+        if (!ino || ino->type != TMPFS_DIR) return NULL;
+        dir = ino;
+        s = next;
+        n = next_len;
+    }
+    return dir;
+}
+
+//=============================================================================
+// Boot Tree
+//=============================================================================
+
+struct ustar {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+};
+
+_Static_assert(sizeof(struct ustar) == 512, "ustar header");
+
+#define MEMBER_PATH_MAX (155 + 1 + 100 + 1)     // prefix/name
+
+static uint64_t octal(const char *s, size_t n) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < n && s[i] >= '0' && s[i] <= '7'; i++) v = v * 8 + (s[i] - '0');
+    return v;
+}
+
+static int header_ok(const struct ustar *h) {
+    const uint8_t *b = (const uint8_t *)h;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < sizeof(*h); i++) {
+        int in_chksum = i >= offsetof(struct ustar, chksum) &&
+                        i < offsetof(struct ustar, chksum) + sizeof(h->chksum);
+        sum += in_chksum ? ' ' : b[i];
+    }
+    return sum == octal(h->chksum, sizeof(h->chksum));
+}
+
+// "prefix/name" of a member, NUL-terminated
+static void member_path(const struct ustar *h, char *out) {
+    size_t n = 0;
+    if (!memcmp(h->magic, "ustar", 5)) {
+        for (size_t i = 0; i < sizeof(h->prefix) && h->prefix[i]; i++) out[n++] = h->prefix[i];
+        if (n) out[n++] = '/';
+    }
+    for (size_t i = 0; i < sizeof(h->name) && h->name[i]; i++) out[n++] = h->name[i];
+    out[n] = 0;
+}
+
+// Make a file or directory for every member, files pointing into the
+// archive. Links and devices are skipped.
+static void unpack(const struct BootTagModule *m) {
+    const uint8_t *base = phys_to_virt(m->base);
+    uint64_t off = 0;
+    uint32_t members = 0, skipped = 0;
+    char path[MEMBER_PATH_MAX];
+
+    while (off + sizeof(struct ustar) <= m->size) {
+        const struct ustar *h = (const struct ustar *)(base + off);
+        if (!h->name[0]) break;                         // End of archive
+        if (!header_ok(h)) {
+            kprintf("tmpfs: %s: bad header at %#llx\n", m->name, (unsigned long long)off);
+            break;
+        }
+
+        uint64_t size = octal(h->size, sizeof(h->size));
+        uint64_t data = off + sizeof(struct ustar);
+        if (data > m->size || size > m->size - data) {
+            kprintf("tmpfs: %s: member at %#llx runs past the end\n", m->name,
+                    (unsigned long long)off);
+            break;
+        }
+        off = data + ((size + 511) & ~511ULL);
+
+        member_path(h, path);
+        const char *name;
+        size_t len;
+        struct tmpfs_inode *dir = walk(path, 1, &name, &len);
+        struct tmpfs_dentry *d = dir && len ? d_find(dir, name, len) : NULL;
+        members++;
+
+        if (h->typeflag == '5') {
+            if (dir && (!len || d || d_add(dir, name, len, TMPFS_DIR))) continue;
+        } else if (h->typeflag == '0' || h->typeflag == 0) {
+            struct tmpfs_inode *ino = dir && len && !d ? d_add(dir, name, len, TMPFS_FILE) : NULL;
+            if (ino && attach(ino, base + data, size) == 0) continue;
+        }
+        skipped++;
+    }
+    if (skipped) kprintf("tmpfs: %s: skipped %u of %u members\n", m->name, skipped, members);
+}
+
+void tmpfs_init(void) {
+    uint64_t start = rdtsc();
+    spin_lock(&g_lock);
+
+    g_root = pool_get(&g_inodes);
+    if (!g_root) panic("tmpfs: out of memory");
+    g_root->type = TMPFS_DIR;
+    g_root->refs = 1;                   // Never dropped
+    g_stats.dirs = 1;
+
+    char initrd[TMPFS_NAME_MAX + 1];
+    if (!cmdline_get("initrd", initrd, sizeof(initrd))) memcpy(initrd, "initrd.tar", 11);
+    size_t initrd_len = 0;
+    while (initrd[initrd_len]) initrd_len++;
+
+    struct tmpfs_inode *boot = d_add(g_root, "boot", 4, TMPFS_DIR);
+    for (const struct BootTagModule *m = bootinfo_next_module(NULL); m;
+         m = bootinfo_next_module(m)) {
+        size_t len = 0;
+        while (m->name[len]) len++;
+        struct tmpfs_inode *ino = boot ? d_add(boot, m->name, len, TMPFS_FILE) : NULL;
+        if (!ino || attach(ino, phys_to_virt(m->base), m->size) < 0) {
+            kprintf("tmpfs: no room for module %s\n", m->name);
+        }
+        if (len == initrd_len && !memcmp(m->name, initrd, len)) unpack(m);
+    }
+
+    g_stats.unpack_ns = tsc_to_ns(rdtsc() - start);
+    spin_unlock(&g_lock);
+}
+INITCALL(tmpfs, tmpfs_init, "", 0);
+
+//=============================================================================
+// Files and Directories
+//=============================================================================
+
+struct tmpfs_inode *tmpfs_lookup(const char *path) {
+    spin_lock(&g_lock);
+    const char *name;
+    size_t len;
+    struct tmpfs_inode *ino = walk(path, 0, &name, &len);
+    if (ino && len) {
+        struct tmpfs_dentry *d = d_find(ino, name, len);
+        ino = d ? d->inode : NULL;
+    }
+    if (ino) ino->refs++;
+    spin_unlock(&g_lock);
+    return ino;
+}
+
+struct tmpfs_inode *tmpfs_create(const char *path, uint32_t type) {
+    if (type != TMPFS_FILE && type != TMPFS_DIR) return NULL;
+
+    spin_lock(&g_lock);
+    const char *name;
+    size_t len;
+    struct tmpfs_inode *dir = walk(path, 0, &name, &len);
+    struct tmpfs_inode *ino = NULL;
+    if (dir && len && !d_find(dir, name, len)) ino = d_add(dir, name, len, type);
+    if (ino) ino->refs++;
+    spin_unlock(&g_lock);
+    return ino;
+}
+
+void tmpfs_put(struct tmpfs_inode *ino) {
+    spin_lock(&g_lock);
+    i_put(ino);
+    spin_unlock(&g_lock);
+}
+
+int tmpfs_unlink(const char *path) {
+    int ret = -1;
+
+    spin_lock(&g_lock);
+    const char *name;
+    size_t len;
+    struct tmpfs_inode *dir = walk(path, 0, &name, &len);
+    struct tmpfs_dentry *d = dir && len ? d_find(dir, name, len) : NULL;
+    if (d && !d->inode->nchildren) {
+        d_remove(d);
+        ret = 0;
+    }
+    spin_unlock(&g_lock);
+    return ret;
+}
+
+size_t tmpfs_read(struct tmpfs_inode *ino, uint64_t off, void *buf, size_t len) {
+    uint8_t *dst = buf;
+    size_t done = 0;
+
+    // The lock is taken per page, so a long read doesn't hold up the rest
+    while (done < len) {
+        spin_lock(&g_lock);
+        if (off >= ino->size) {
+            spin_unlock(&g_lock);
+            break;
+        }
+        uint64_t in_page = off & (PAGE_SIZE - 1);
+        uint64_t n = PAGE_SIZE - in_page;
+        if (n > len - done) n = len - done;
+        if (n > ino->size - off) n = ino->size - off;
+
+        uintptr_t e = radix_get(ino, off >> PAGE_SHIFT);
+        if (e) {
+            memcpy(dst + done, (uint8_t *)entry_data(e) + in_page, n);
+        } else {
+            memset(dst + done, 0, n);
+        }
+        spin_unlock(&g_lock);
+
+        done += n;
+        off += n;
+    }
+    return done;
+}
+
+int64_t tmpfs_write(struct tmpfs_inode *ino, uint64_t off, const void *buf, size_t len) {
+    const uint8_t *src = buf;
+    if (ino->type != TMPFS_FILE || off + len < off) return -1;
+
+    spin_lock(&g_lock);
+
+    // A module page at the old end holds whatever follows the file in the
+    // module; the bytes after the end must read as zeros once it grows
+    if (off + len > ino->size && (ino->size & (PAGE_SIZE - 1))) {
+        uint64_t last = ino->size >> PAGE_SHIFT;
+        uintptr_t *slot = radix_slot(ino, last);
+        if (!slot || ((*slot & PAGE_BORROWED) && !unshare(ino, slot, last))) {
+            spin_unlock(&g_lock);
+            return -1;
+        }
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        uint64_t index = off >> PAGE_SHIFT;
+        uint64_t in_page = off & (PAGE_SIZE - 1);
+        uint64_t n = PAGE_SIZE - in_page;
+        if (n > len - done) n = len - done;
+
+        uintptr_t *slot = radix_slot(ino, index);
+        if (!slot) break;
+        uint8_t *page;
+        if (!*slot) {
+            page = pmm_alloc_zeroed(1);
+            if (!page) break;
+            *slot = (uintptr_t)page;
+            g_stats.owned_pages++;
+        } else if (*slot & PAGE_BORROWED) {
+            page = unshare(ino, slot, index);
+            if (!page) break;
+        } else {
+            page = entry_data(*slot);
+        }
+        memcpy(page + in_page, src + done, n);
+
+        done += n;
+        off += n;
+        if (off > ino->size) ino->size = off;
+    }
+    spin_unlock(&g_lock);
+    return done == len ? (int64_t)len : -1;
+}
+
+const void *tmpfs_page(struct tmpfs_inode *ino, uint64_t index) {
+    spin_lock(&g_lock);
+    uintptr_t e = radix_get(ino, index);
+    spin_unlock(&g_lock);
+    return entry_data(e);
+}
+
+const struct tmpfs_dentry *tmpfs_readdir(struct tmpfs_inode *dir,
+                                         const struct tmpfs_dentry *prev) {
+    spin_lock(&g_lock);
+    struct tmpfs_dentry *d = prev ? prev->next : dir->children;
+    while (d && d->dead) d = d->next;
+    if (d) d->refs++;
+    if (prev) d_release((struct tmpfs_dentry *)prev);
+    spin_unlock(&g_lock);
+    return d;
+}
+
+void tmpfs_readdir_end(const struct tmpfs_dentry *last) {
+    if (!last) return;
+    spin_lock(&g_lock);
+    d_release((struct tmpfs_dentry *)last);
+    spin_unlock(&g_lock);
+}
+
+void tmpfs_get_stats(struct tmpfs_stats *out) {
+    spin_lock(&g_lock);
+    *out = g_stats;
+    spin_unlock(&g_lock);
+}
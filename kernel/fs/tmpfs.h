@@ -0,0 +1,105 @@
+// kernel/fs/tmpfs.h
+// In-memory filesystem
+//
+// Every file is a radix tree of 4 KiB pages indexed by page number, 64
+// slots per node, so finding the page for an offset takes one step per
+// six bits of the file's last page number. Directories are only a list
+// of their entries; lookups go through one hash table of (parent, name)
+// for the whole filesystem.
+//
+// At boot the filesystem holds every boot module as /boot/NAME, and the
+// files and directories of the ustar archive initrd=NAME (default
+// initrd.tar) unpacked at the root. Neither is copied: a file's pages
+// point into the module, and only a write gives a page a copy of its own.
+//
+// One lock covers everything. Path names are absolute, '/'-separated.
+//
+// Inodes are reference counted: the directory entry naming one holds a
+// reference, and so does every tmpfs_lookup() or tmpfs_create() result
+// until tmpfs_put(). Unlinking drops only the name, so an inode someone
+// still holds keeps its pages until they let go. An entry that
+// tmpfs_readdir() handed out likewise stays until the walk moves past it.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TMPFS_NAME_MAX  63
+
+enum { TMPFS_FILE = 1, TMPFS_DIR = 2 };
+
+struct tmpfs_node;
+struct tmpfs_dentry;
+
+struct tmpfs_inode {
+    uint32_t             type;          // TMPFS_*
+    uint32_t             height;        // Radix tree levels; 0: no pages
+    uint64_t             size;          // Bytes
+    // Private to the filesystem
+    struct tmpfs_node   *root;
+    struct tmpfs_dentry *children;      // Directories
+    uint32_t             nchildren;     // Not counting unlinked entries
+    uint32_t             refs;
+};
+
+struct tmpfs_dentry {
+    struct tmpfs_inode  *parent;
+    struct tmpfs_inode  *inode;
+    struct tmpfs_dentry *hnext;
+    struct tmpfs_dentry *next;          // In the parent's list
+    uint32_t             hash;
+    uint32_t             refs;          // tmpfs_readdir() walks on it
+    uint32_t             dead;          // Unlinked, still on the list for them
+    char                 name[TMPFS_NAME_MAX + 1];
+};
+
+struct tmpfs_stats {
+    uint32_t files, dirs;
+    uint64_t borrowed_pages;            // Pointing into boot modules
+    uint64_t owned_pages;               // Allocated by writes
+    uint64_t unpack_ns;                 // Building the boot tree
+};
+
+// Build the boot tree. Runs as an initcall.
+void tmpfs_init(void);
+
+// The inode at `path` with a reference for the caller, or NULL
+struct tmpfs_inode *tmpfs_lookup(const char *path);
+
+// Make a file or directory (TMPFS_*) at `path`. Returns it with a
+// reference for the caller, or NULL if the parent directory is missing,
+// the name is taken or memory ran out.
+struct tmpfs_inode *tmpfs_create(const char *path, uint32_t type);
+
+// Drop a reference from tmpfs_lookup() or tmpfs_create(). The last one
+// of an unlinked inode frees it.
+void tmpfs_put(struct tmpfs_inode *ino);
+
+// Remove a file or an empty directory's name. Returns 0 or -1.
+int tmpfs_unlink(const char *path);
+
+// Copy up to `len` bytes at `off` out of a file, a page at a time.
+// Returns how many: short at the end of the file, 0 past it.
+size_t tmpfs_read(struct tmpfs_inode *ino, uint64_t off, void *buf, size_t len);
+
+// Write `len` bytes at `off`, growing the file if needed. Pages still in
+// a boot module are copied first, and a gap past the old end reads as
+// zeros. Returns `len`, or -1 if memory ran out (the file may have grown).
+int64_t tmpfs_write(struct tmpfs_inode *ino, uint64_t off, const void *buf, size_t len);
+
+// The file's page `index`, or NULL for a hole. Valid until the file is
+// written or freed. Bytes past the end of the file are not the
+// file's. A page inside a boot module is only page aligned if the archive
+// member was; anything handing it to the MMU has to check.
+const void *tmpfs_page(struct tmpfs_inode *ino, uint64_t index);
+
+// A directory's entries: pass NULL for the first, then the last one
+// returned. Order is unspecified. Each entry, and its inode, stays valid
+// until it is passed back, even if unlinked meanwhile; a walk that stops
+// early hands its last entry to tmpfs_readdir_end(). Entries made during
+// the walk may or may not turn up.
+const struct tmpfs_dentry *tmpfs_readdir(struct tmpfs_inode *dir,
+                                         const struct tmpfs_dentry *prev);
+void tmpfs_readdir_end(const struct tmpfs_dentry *last);
+
+void tmpfs_get_stats(struct tmpfs_stats *out);
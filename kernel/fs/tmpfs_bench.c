@@ -0,0 +1,166 @@
+// kernel/fs/tmpfs_bench.c
+// In-memory filesystem benchmark: path lookups and large-file throughput
+#include "fs/tmpfs_bench.h"
+#include "boot/cmdline.h"
+#include "fs/tmpfs.h"
+#include "lib/printk.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "x86/cpu.h"
+#include "x86/tsc.h"
+
+#define MAX_PATHS       4096
+#define PATH_LEN        128
+#define PATH_PAGES      (MAX_PATHS * PATH_LEN / PAGE_SIZE)
+#define CHUNK_PAGES     16              // 64 KiB per read or write call
+#define COPY_PATH       "/tmpfsbench.copy"
+
+struct walk {
+    char               *paths;          // MAX_PATHS slots of PATH_LEN
+    uint32_t            npaths;
+    char                largest[PATH_LEN];
+    uint64_t            largest_size;
+};
+
+// Depth first from `dir`, whose path (without the trailing '/') is the
+// first `len` bytes of `path`. Paths that don't fit are left out.
+static void collect(struct walk *w, struct tmpfs_inode *dir, char *path, size_t len) {
+    for (const struct tmpfs_dentry *d = tmpfs_readdir(dir, NULL); d;
+         d = tmpfs_readdir(dir, d)) {
+        size_t n = 0;
+        while (d->name[n]) n++;
+        if (len + 1 + n >= PATH_LEN) continue;
+        path[len] = '/';
+        memcpy(path + len + 1, d->name, n + 1);
+
+        if (d->inode->type == TMPFS_DIR) {
+            collect(w, d->inode, path, len + 1 + n);
+            continue;
+        }
+        if (w->npaths < MAX_PATHS) memcpy(w->paths + w->npaths++ * PATH_LEN, path, PATH_LEN);
+        if (!w->largest[0] || d->inode->size > w->largest_size) {
+            w->largest_size = d->inode->size;
+            memcpy(w->largest, path, PATH_LEN);
+        }
+    }
+}
+
+static uint64_t mib_per_s(uint64_t bytes, uint64_t ns) {
+    return ns ? bytes * 1000000000ULL / ns >> 20 : 0;
+}
+
+static void lookups(const struct walk *w, uint64_t count) {
+    if (!count) return;
+    uint64_t misses = 0;
+    uint64_t start = rdtsc();
+    for (uint64_t i = 0; i < count; i++) {
+        struct tmpfs_inode *ino = tmpfs_lookup(w->paths + i % w->npaths * PATH_LEN);
+        if (ino) {
+            tmpfs_put(ino);
+        } else {
+            misses++;
+        }
+    }
+    uint64_t ns = tsc_to_ns(rdtsc() - start);
+
+    kprintf("tmpfsbench: %llu lookups over %u paths: %llu ns each%s\n",
+            (unsigned long long)count, w->npaths, (unsigned long long)(ns / count),
+            misses ? ", some missed" : "");
+}
+
+// Read the whole file in chunks, returning the time taken
+static uint64_t read_all(struct tmpfs_inode *ino, uint8_t *chunk) {
+    uint64_t chunk_size = CHUNK_PAGES * PAGE_SIZE;
+    uint64_t start = rdtsc();
+    for (uint64_t off = 0; off < ino->size; off += chunk_size) {
+        tmpfs_read(ino, off, chunk, chunk_size);
+    }
+    return tsc_to_ns(rdtsc() - start);
+}
+
+static void large_file(const struct walk *w, uint8_t *chunk, uint8_t *check) {
+    struct tmpfs_inode *ino = tmpfs_lookup(w->largest);
+    if (!ino) return;
+    uint64_t size = ino->size, pages = PAGE_ALIGN_UP(size) >> PAGE_SHIFT;
+    uint64_t chunk_size = CHUNK_PAGES * PAGE_SIZE;
+
+    uint64_t read_ns = read_all(ino, chunk);
+
+    // What mapping the file would cost: finding every page, no copies
+    uint64_t start = rdtsc();
+    uint64_t found = 0;
+    for (uint64_t i = 0; i < pages; i++) found += tmpfs_page(ino, i) != NULL;
+    uint64_t index_ns = tsc_to_ns(rdtsc() - start);
+
+    kprintf("tmpfsbench: %s, %llu KiB: read %llu MiB/s, page lookup %llu ns "
+            "(%llu of %llu pages present)\n", w->largest, (unsigned long long)(size >> 10),
+            (unsigned long long)mib_per_s(size, read_ns),
+            (unsigned long long)(pages ? index_ns / pages : 0), (unsigned long long)found,
+            (unsigned long long)pages);
+
+    // A copy in pages of its own, checked against the original
+    struct tmpfs_stats before, after;
+    tmpfs_get_stats(&before);
+    struct tmpfs_inode *copy = tmpfs_create(COPY_PATH, TMPFS_FILE);
+    if (!copy) {
+        kprintf("tmpfsbench: cannot create %s\n", COPY_PATH);
+        tmpfs_put(ino);
+        return;
+    }
+    start = rdtsc();
+    int err = 0;
+    for (uint64_t off = 0; off < size && !err; off += chunk_size) {
+        size_t n = tmpfs_read(ino, off, chunk, chunk_size);
+        err = tmpfs_write(copy, off, chunk, n) < 0;
+    }
+    uint64_t write_ns = tsc_to_ns(rdtsc() - start);
+    uint64_t copy_read_ns = read_all(copy, chunk);
+    for (uint64_t off = 0; off < size && !err; off += chunk_size) {
+        size_t n = tmpfs_read(ino, off, chunk, chunk_size);
+        err = tmpfs_read(copy, off, check, chunk_size) != n || memcmp(chunk, check, n);
+    }
+    tmpfs_unlink(COPY_PATH);
+    tmpfs_put(copy);                    // Its pages go here
+    tmpfs_put(ino);
+    tmpfs_get_stats(&after);
+
+    kprintf("tmpfsbench: copy of it: write %llu MiB/s, read %llu MiB/s%s%s\n",
+            (unsigned long long)mib_per_s(size, write_ns),
+            (unsigned long long)mib_per_s(size, copy_read_ns),
+            err ? ", MISMATCH" : "",
+            after.owned_pages != before.owned_pages ? ", pages leaked" : "");
+}
+
+void tmpfs_bench(void) {
+    struct tmpfs_stats s;
+    tmpfs_get_stats(&s);
+    kprintf("tmpfsbench: %u files, %u directories, %llu pages in place in boot modules, "
+            "built in %llu us\n", s.files, s.dirs, (unsigned long long)s.borrowed_pages,
+            (unsigned long long)(s.unpack_ns / 1000));
+
+    struct walk w = { 0 };
+    uint64_t paths = pmm_alloc_pages(PATH_PAGES);
+    uint64_t chunks = pmm_alloc_pages(2 * CHUNK_PAGES);
+    if (!paths || !chunks) {
+        kprintf("tmpfsbench: out of memory\n");
+        goto out;
+    }
+    w.paths = phys_to_virt(paths);
+
+    char path[PATH_LEN];
+    struct tmpfs_inode *root = tmpfs_lookup("/");
+    collect(&w, root, path, 0);
+    tmpfs_put(root);
+    if (!w.npaths) {
+        kprintf("tmpfsbench: no files\n");
+        goto out;
+    }
+
+    lookups(&w, cmdline_get_u64("tmpfsbench.lookups", 1000000));
+    uint8_t *chunk = phys_to_virt(chunks);
+    large_file(&w, chunk, chunk + CHUNK_PAGES * PAGE_SIZE);
+
+out:
+    if (paths) pmm_free_pages(paths, PATH_PAGES);
+    if (chunks) pmm_free_pages(chunks, 2 * CHUNK_PAGES);
+}
@@ -0,0 +1,11 @@
+// kernel/fs/tmpfs_bench.h
+// In-memory filesystem benchmark: path lookups and large-file throughput
+#pragma once
+
+// Reports what the boot tree holds and how long it took to build, then,
+// over the files in it: path lookups through the directory entry hash,
+// reading the largest file page by page with copies and through
+// tmpfs_page() alone, and writing a copy of it into pages of its own.
+// Command line knob:
+//   tmpfsbench.lookups=N   path lookups to time (default 1000000)
+void tmpfs_bench(void);
@@ -0,0 +1,317 @@
+// kernel/gfx/dlist.c
+// Retained display list: record, cull, merge, sort, draw
+#include "gfx/dlist.h"
+#include "gfx/font.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+
+#define OUT_CAP     (DL_MAX_CMDS * 4)   // Room for split rects
+#define STACK_CAP   256                 // Pending fragments of one rect
+#define DEAD        0xFF                // op of a command merged away
+
+static int box_overlap(const struct dl_box *a, const struct dl_box *b) {
+    return a->x0 < b->x1 && b->x0 < a->x1 && a->y0 < b->y1 && b->y0 < a->y1;
+}
+
+static int box_contains(const struct dl_box *outer, const struct dl_box *inner) {
+    return outer->x0 <= inner->x0 && outer->x1 >= inner->x1 &&
+           outer->y0 <= inner->y0 && outer->y1 >= inner->y1;
+}
+
+static uint64_t box_area(const struct dl_box *b) {
+    return (uint64_t)(b->x1 - b->x0) * (uint64_t)(b->y1 - b->y0);
+}
+
+static void *alloc_bytes(uint64_t bytes) {
+    return pmm_alloc_zeroed(PAGE_ALIGN_UP(bytes) / PAGE_SIZE);
+}
+
+//=============================================================================
+// Recording
+//=============================================================================
+
+int dl_init(struct dlist *dl, uint32_t width, uint32_t height) {
+    memset(dl, 0, sizeof(*dl));
+    dl->width = width;
+    dl->height = height;
+    dl->cmds = alloc_bytes(DL_MAX_CMDS * sizeof(struct dl_cmd));
+    dl->text = alloc_bytes(DL_TEXT_BYTES);
+    dl->out = alloc_bytes(OUT_CAP * sizeof(struct dl_cmd));
+    dl->work = alloc_bytes((DL_MAX_CMDS + STACK_CAP) * sizeof(struct dl_box));
+    return dl->cmds && dl->text && dl->out && dl->work ? 0 : -1;
+}
+
+void dl_begin(struct dlist *dl) {
+    dl->ncmds = 0;
+    dl->text_len = 0;
+    memset(&dl->stats, 0, sizeof(dl->stats));
+}
+
+// Clip to the target; NULL if nothing is left or the list is full
+static struct dl_cmd *record(struct dlist *dl, uint8_t op, int32_t x, int32_t y,
+                             uint32_t w, uint32_t h) {
+    int64_t x0 = x, y0 = y, x1 = x0 + w, y1 = y0 + h;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > dl->width) x1 = dl->width;
+    if (y1 > dl->height) y1 = dl->height;
+    if (x0 >= x1 || y0 >= y1) return NULL;
+
+    if (dl->ncmds == DL_MAX_CMDS) {
+        dl->stats.dropped++;
+        return NULL;
+    }
+    struct dl_cmd *c = &dl->cmds[dl->ncmds++];
+    memset(c, 0, sizeof(*c));
+    c->op = op;
+    c->box = (struct dl_box){ x0, y0, x1, y1 };
+    c->ox = x;
+    c->oy = y;
+    dl->stats.recorded++;
+    return c;
+}
+
+void dl_fill(struct dlist *dl, uint32_t color) {
+    dl_rect(dl, 0, 0, dl->width, dl->height, color);
+}
+
+void dl_rect(struct dlist *dl, int32_t x, int32_t y, uint32_t w, uint32_t h,
+             uint32_t color) {
+    struct dl_cmd *c = record(dl, DL_RECT, x, y, w, h);
+    if (!c) return;
+    c->opaque = 1;
+    c->color = color;
+}
+
+void dl_blit(struct dlist *dl, int32_t x, int32_t y, uint32_t w, uint32_t h,
+             const uint32_t *src, uint32_t src_stride) {
+    struct dl_cmd *c = record(dl, DL_BLIT, x, y, w, h);
+    if (!c) return;
+    c->opaque = 1;
+    c->src = src;
+    c->src_stride = src_stride;
+}
+
+void dl_text(struct dlist *dl, int32_t x, int32_t y, const char *s, uint32_t color) {
+    size_t len = 0;
+    while (s[len] && len < 0xFFFF) len++;
+    if (dl->text_len + len > DL_TEXT_BYTES) {
+        dl->stats.dropped++;
+        return;
+    }
+
+    struct dl_cmd *c = record(dl, DL_TEXT, x, y, len * FONT_W, FONT_H);
+    if (!c) return;
+    c->color = color;
+    c->len = len;
+    c->text = dl->text_len;
+    memcpy(dl->text + dl->text_len, s, len);
+    dl->text_len += len;
+}
+
+//=============================================================================
+// Drawing
+//=============================================================================
+
+// Pixels written; with fb NULL only counts them
+static uint64_t draw_text(const struct dlist *dl, const struct dl_cmd *c,
+                          const struct FramebufferInfo *fb) {
+    uint64_t n = 0;
+    for (uint32_t i = 0; i < c->len; i++) {
+        int32_t gx = c->ox + (int32_t)i * FONT_W;
+        if (gx >= c->box.x1 || gx + FONT_W <= c->box.x0) continue;
+        const uint8_t *glyph = font_glyph(dl->text[c->text + i]);
+        if (!glyph) continue;
+
+        for (int32_t row = 0; row < FONT_H; row++) {
+            int32_t y = c->oy + row;
+            if (y < c->box.y0 || y >= c->box.y1) continue;
+            uint32_t *line = fb ? (uint32_t *)(fb->base + (uint64_t)y * fb->pitch) : NULL;
+            for (int32_t col = 0; col < FONT_W; col++) {
+                int32_t x = gx + col;
+                if (!(glyph[row] & (0x80 >> col)) || x < c->box.x0 || x >= c->box.x1) {
+                    continue;
+                }
+                if (line) line[x] = c->color;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+// Bytes written
+static uint64_t draw(const struct dlist *dl, const struct dl_cmd *c,
+                     const struct FramebufferInfo *fb) {
+    const struct dl_box *b = &c->box;
+    uint32_t w = b->x1 - b->x0;
+
+    switch (c->op) {
+    case DL_RECT:
+        for (int32_t y = b->y0; y < b->y1; y++) {
+            uint32_t *line = (uint32_t *)(fb->base + (uint64_t)y * fb->pitch);
+            memset32(line + b->x0, c->color, w);
+        }
+        return box_area(b) * 4;
+    case DL_BLIT:
+        for (int32_t y = b->y0; y < b->y1; y++) {
+            uint32_t *line = (uint32_t *)(fb->base + (uint64_t)y * fb->pitch);
+            const uint32_t *src = c->src + (uint64_t)(y - c->oy) * c->src_stride +
+                                  (b->x0 - c->ox);
+            memcpy(line + b->x0, src, (uint64_t)w * 4);
+        }
+        return box_area(b) * 4;
+    case DL_TEXT:
+        return draw_text(dl, c, fb) * 4;
+    }
+    return 0;
+}
+
+//=============================================================================
+// Optimization
+//=============================================================================
+
+// Walk the frame backwards, keeping the boxes of the opaque commands seen
+// so far (the ones drawn later). A command inside one of them is never
+// visible. A solid rect is also cut into the pieces none of them covers:
+// top and bottom strips at full width, then left and right, so pieces
+// stay row-friendly. Survivors fill dl->out from the end backwards;
+// returns the index of the first.
+static uint32_t cull(struct dlist *dl) {
+    struct dl_box *covers = dl->work;
+    struct dl_box *stack = dl->work + DL_MAX_CMDS;
+    uint16_t cover_from[STACK_CAP];     // First cover a fragment must check
+    uint32_t ncovers = 0;
+    uint32_t pos = OUT_CAP;
+
+    for (uint32_t i = dl->ncmds; i-- > 0;) {
+        const struct dl_cmd *c = &dl->cmds[i];
+        uint32_t emitted = 0;
+
+        if (c->op != DL_RECT) {
+            uint32_t k = 0;
+            while (k < ncovers && !box_contains(&covers[k], &c->box)) k++;
+            if (k == ncovers) {
+                dl->out[--pos] = *c;
+                emitted = 1;
+            }
+        } else {
+            uint32_t sp = 0;
+            stack[sp] = c->box;
+            cover_from[sp++] = 0;
+            while (sp) {
+                struct dl_box f = stack[--sp];
+                uint32_t k = cover_from[sp];
+                while (k < ncovers && !box_overlap(&covers[k], &f)) k++;
+
+                if (k < ncovers && box_contains(&covers[k], &f)) continue;
+                // Every remaining original command needs a slot too
+                int room = pos >= i + sp + 4 && sp + 4 <= STACK_CAP;
+                if (k == ncovers || !room) {
+                    dl->out[--pos] = *c;
+                    dl->out[pos].box = f;
+                    emitted++;
+                    continue;
+                }
+
+                const struct dl_box *o = &covers[k];
+                int32_t my0 = f.y0 > o->y0 ? f.y0 : o->y0;
+                int32_t my1 = f.y1 < o->y1 ? f.y1 : o->y1;
+                struct dl_box pieces[4] = {
+                    { f.x0, f.y0, f.x1, o->y0 },        // Above
+                    { f.x0, o->y1, f.x1, f.y1 },        // Below
+                    { f.x0, my0, o->x0, my1 },          // Left
+                    { o->x1, my0, f.x1, my1 },          // Right
+                };
+                for (int p = 0; p < 4; p++) {
+                    if (pieces[p].x0 >= pieces[p].x1 || pieces[p].y0 >= pieces[p].y1) continue;
+                    stack[sp] = pieces[p];
+                    cover_from[sp++] = k + 1;
+                }
+            }
+        }
+
+        if (emitted == 0) dl->stats.culled++;
+        else dl->stats.split += emitted - 1;
+        if (c->opaque) covers[ncovers++] = c->box;
+    }
+    return pos;
+}
+
+static int can_merge(const struct dl_cmd *a, const struct dl_cmd *b, struct dl_box *u) {
+    if (a->op != DL_RECT || b->op != DL_RECT || a->color != b->color) return 0;
+
+    const struct dl_box *p = &a->box, *q = &b->box;
+    if (p->y0 == q->y0 && p->y1 == q->y1 && (p->x1 == q->x0 || q->x1 == p->x0)) {
+        *u = (struct dl_box){ p->x0 < q->x0 ? p->x0 : q->x0, p->y0,
+                              p->x1 > q->x1 ? p->x1 : q->x1, p->y1 };
+        return 1;
+    }
+    if (p->x0 == q->x0 && p->x1 == q->x1 && (p->y1 == q->y0 || q->y1 == p->y0)) {
+        *u = (struct dl_box){ p->x0, p->y0 < q->y0 ? p->y0 : q->y0,
+                              p->x1, p->y1 > q->y1 ? p->y1 : q->y1 };
+        return 1;
+    }
+    return 0;
+}
+
+// Join same-colour rects that share a whole edge. The union takes the
+// earlier one's place, which is only safe if nothing drawn in between
+// touches it.
+static void merge(struct dlist *dl, struct dl_cmd *list, uint32_t n) {
+    for (uint32_t a = 0; a < n; a++) {
+        if (list[a].op != DL_RECT) continue;
+        for (uint32_t b = a + 1; b < n; b++) {
+            struct dl_box u;
+            if (list[b].op == DEAD || !can_merge(&list[a], &list[b], &u)) continue;
+
+            uint32_t k = a + 1;
+            while (k < b && (list[k].op == DEAD || !box_overlap(&list[k].box, &u))) k++;
+            if (k < b) continue;
+
+            list[a].box = u;
+            list[b].op = DEAD;
+            dl->stats.merged++;
+            b = a;              // The grown rect may now meet earlier ones
+        }
+    }
+}
+
+static uint64_t sort_key(const struct dl_cmd *c) {
+    return (uint64_t)c->box.y0 << 32 | (uint32_t)c->box.x0;
+}
+
+// Insertion sort by (y0, x0) in which a command never moves past one it
+// overlaps: their order decides which is on top
+static uint32_t sort(struct dl_cmd *list, uint32_t n) {
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (list[i].op == DEAD) continue;
+        struct dl_cmd c = list[i];
+        uint32_t j = m++;
+        while (j > 0 && sort_key(&list[j - 1]) > sort_key(&c) &&
+               !box_overlap(&list[j - 1].box, &c.box)) {
+            list[j] = list[j - 1];
+            j--;
+        }
+        list[j] = c;
+    }
+    return m;
+}
+
+void dl_submit(struct dlist *dl, const struct FramebufferInfo *fb) {
+    for (uint32_t i = 0; i < dl->ncmds; i++) {
+        const struct dl_cmd *c = &dl->cmds[i];
+        dl->stats.bytes_recorded += c->op == DL_TEXT ? draw_text(dl, c, NULL) * 4
+                                                     : box_area(&c->box) * 4;
+    }
+
+    uint32_t first = cull(dl);
+    struct dl_cmd *list = dl->out + first;
+    uint32_t n = OUT_CAP - first;
+    merge(dl, list, n);
+    n = sort(list, n);
+
+    for (uint32_t i = 0; i < n; i++) dl->stats.bytes_written += draw(dl, &list[i], fb);
+    dl->stats.drawn = n;
+}
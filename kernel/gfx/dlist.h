@@ -0,0 +1,86 @@
+// kernel/gfx/dlist.h
+// Retained display list
+//
+// Drawing calls only record commands. dl_submit() then optimizes the
+// frame before touching the framebuffer:
+//   - a command hidden behind later opaque ones is dropped, and the parts
+//     of a solid rect that later opaque commands overwrite are cut away
+//   - adjacent same-colour rects are merged
+//   - commands are reordered top to bottom, left to right, wherever that
+//     can't change the picture (only overlapping commands keep their
+//     relative order)
+// and draws what is left, so each visible pixel is written about once.
+#pragma once
+
+#include <stdint.h>
+#include "common/bootinfo.h"
+
+#define DL_MAX_CMDS     1024
+#define DL_TEXT_BYTES   4096
+
+enum dl_op {
+    DL_RECT,
+    DL_BLIT,
+    DL_TEXT,
+};
+
+// A box is [x0, x1) x [y0, y1), clipped to the target
+struct dl_box {
+    int32_t x0, y0, x1, y1;
+};
+
+struct dl_cmd {
+    uint8_t         op;             // DL_*
+    uint8_t         opaque;         // Writes every pixel of its box
+    uint16_t        len;            // DL_TEXT: characters
+    struct dl_box   box;
+    uint32_t        color;          // DL_RECT, DL_TEXT
+    int32_t         ox, oy;         // DL_BLIT, DL_TEXT: unclipped origin
+    const uint32_t *src;            // DL_BLIT: pixel at the origin
+    uint32_t        src_stride;     // DL_BLIT: pixels per source row
+    uint32_t        text;           // DL_TEXT: offset in the text arena
+};
+
+struct dl_stats {
+    uint32_t recorded;
+    uint32_t culled;            // Commands dropped as fully hidden
+    uint32_t split;             // Extra rects from cutting away hidden parts
+    uint32_t merged;
+    uint32_t drawn;
+    uint32_t dropped;           // Past DL_MAX_CMDS or DL_TEXT_BYTES
+    uint64_t bytes_recorded;    // Drawing every command as recorded
+    uint64_t bytes_written;
+};
+
+struct dlist {
+    uint32_t        width, height;
+    struct dl_cmd  *cmds;
+    uint32_t        ncmds;
+    char           *text;
+    uint32_t        text_len;
+    struct dl_cmd  *out;        // Scratch for dl_submit()
+    struct dl_box  *work;
+    struct dl_stats stats;      // Of the last frame
+};
+
+// Allocate command storage for a width x height target. Returns 0, or -1
+// if memory ran out.
+int dl_init(struct dlist *dl, uint32_t width, uint32_t height);
+
+// Start recording a frame
+void dl_begin(struct dlist *dl);
+
+void dl_fill(struct dlist *dl, uint32_t color);
+void dl_rect(struct dlist *dl, int32_t x, int32_t y, uint32_t w, uint32_t h,
+             uint32_t color);
+
+// Copy a w x h block of 32-bit pixels; `src` must stay valid until
+// dl_submit()
+void dl_blit(struct dlist *dl, int32_t x, int32_t y, uint32_t w, uint32_t h,
+             const uint32_t *src, uint32_t src_stride);
+
+// 8x8 font glyphs, transparent background; the string is copied
+void dl_text(struct dlist *dl, int32_t x, int32_t y, const char *s, uint32_t color);
+
+// Optimize the recorded frame, draw it to `fb` and fill dl->stats
+void dl_submit(struct dlist *dl, const struct FramebufferInfo *fb);
@@ -0,0 +1,21 @@
+// kernel/gfx/font.h
+// 8x8 bitmap font
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FONT_W          8
+#define FONT_H          8
+#define FONT_FIRST      0x20
+#define FONT_GLYPHS     95          // 0x20 (space) to 0x7E (~)
+
+// One byte per row, top row first; bit 7 is the leftmost pixel
+extern const uint8_t font8x8[FONT_GLYPHS][FONT_H];
+
+// Glyph for `c`, or NULL for characters outside the font
+static inline const uint8_t *font_glyph(char c) {
+    uint8_t u = (uint8_t)c;
+    if (u < FONT_FIRST || u >= FONT_FIRST + FONT_GLYPHS) return NULL;
+    return font8x8[u - FONT_FIRST];
+}
@@ -0,0 +1,106 @@
+// kernel/gfx/raster.c
+// Tile-parallel rectangle rasterizer
+#include "gfx/raster.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "x86/smp.h"
+
+static void *alloc_bytes(uint64_t bytes) {
+    return pmm_alloc_zeroed(PAGE_ALIGN_UP(bytes) / PAGE_SIZE);
+}
+
+int raster_init(struct raster *r, const struct FramebufferInfo *fb) {
+    memset(r, 0, sizeof(*r));
+    r->fb = fb;
+    r->width = fb->width;
+    r->height = fb->height;
+    r->tiles_x = (fb->width + RASTER_TILE_W - 1) / RASTER_TILE_W;
+    r->bands = (fb->height + RASTER_TILE_H - 1) / RASTER_TILE_H;
+    r->max_cpus = smp_cpu_count();
+
+    r->back = alloc_bytes((uint64_t)fb->width * fb->height * 4);
+    r->cmds = alloc_bytes(RASTER_MAX_CMDS * sizeof(struct raster_cmd));
+    r->band_lists = alloc_bytes((uint64_t)r->max_cpus * RASTER_MAX_CMDS * 4);
+    return r->back && r->cmds && r->band_lists ? 0 : -1;
+}
+
+void raster_begin(struct raster *r) {
+    r->ncmds = 0;
+    r->dropped = 0;
+}
+
+void raster_rect(struct raster *r, int32_t x, int32_t y, uint32_t w, uint32_t h,
+                 uint32_t color) {
+    int64_t x0 = x, y0 = y, x1 = x0 + w, y1 = y0 + h;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > r->width) x1 = r->width;
+    if (y1 > r->height) y1 = r->height;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    if (r->ncmds == RASTER_MAX_CMDS) {
+        r->dropped++;
+        return;
+    }
+    r->cmds[r->ncmds++] = (struct raster_cmd){ x0, y0, x1, y1, color };
+}
+
+//=============================================================================
+// Per-CPU Rendering
+//=============================================================================
+
+static void fill_tile(struct raster *r, const uint32_t *list, uint32_t n,
+                      uint32_t tx0, uint32_t tx1, uint32_t ty0, uint32_t ty1) {
+    for (uint32_t i = 0; i < n; i++) {
+        const struct raster_cmd *c = &r->cmds[list[i]];
+        uint32_t x0 = c->x0 > tx0 ? c->x0 : tx0;
+        uint32_t x1 = c->x1 < tx1 ? c->x1 : tx1;
+        if (x0 >= x1) continue;
+
+        uint32_t y0 = c->y0 > ty0 ? c->y0 : ty0;
+        uint32_t y1 = c->y1 < ty1 ? c->y1 : ty1;
+        for (uint32_t y = y0; y < y1; y++) {
+            memset32(&r->back[(uint64_t)y * r->width + x0], c->color, x1 - x0);
+        }
+    }
+}
+
+// Bands [cpu * bands / ncpus, (cpu + 1) * bands / ncpus): rasterize tile
+// by tile, then copy the touched rows out
+static void render_bands(void *arg, uint32_t cpu, uint32_t ncpus) {
+    struct raster *r = arg;
+    uint32_t *list = r->band_lists + (uint64_t)cpu * RASTER_MAX_CMDS;
+    uint32_t first = (uint64_t)r->bands * cpu / ncpus;
+    uint32_t last = (uint64_t)r->bands * (cpu + 1) / ncpus;
+    uint32_t *fb = (uint32_t *)r->fb->base;
+    uint32_t fb_stride = r->fb->pitch / 4;
+
+    for (uint32_t band = first; band < last; band++) {
+        uint32_t ty0 = band * RASTER_TILE_H;
+        uint32_t ty1 = ty0 + RASTER_TILE_H < r->height ? ty0 + RASTER_TILE_H : r->height;
+
+        // Commands crossing this band, in recording order
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < r->ncmds; i++) {
+            if (r->cmds[i].y0 < ty1 && r->cmds[i].y1 > ty0) list[n++] = i;
+        }
+        if (n == 0) continue;       // Nothing drawn: the screen keeps its pixels
+
+        for (uint32_t tx = 0; tx < r->tiles_x; tx++) {
+            uint32_t tx0 = tx * RASTER_TILE_W;
+            uint32_t tx1 = tx0 + RASTER_TILE_W < r->width ? tx0 + RASTER_TILE_W : r->width;
+            fill_tile(r, list, n, tx0, tx1, ty0, ty1);
+        }
+
+        for (uint32_t y = ty0; y < ty1; y++) {
+            memcpy(&fb[(uint64_t)y * fb_stride], &r->back[(uint64_t)y * r->width],
+                   (uint64_t)r->width * 4);
+        }
+    }
+}
+
+void raster_end(struct raster *r, uint32_t ncpus) {
+    if (ncpus > r->max_cpus) ncpus = r->max_cpus;
+    if (ncpus > r->bands) ncpus = r->bands;
+    smp_run(render_bands, r, ncpus);
+}
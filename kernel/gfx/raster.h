@@ -0,0 +1,50 @@
+// kernel/gfx/raster.h
+// Tile-parallel rectangle rasterizer
+//
+// Draw commands for a frame are recorded, then raster_end() splits the
+// screen into bands of RASTER_TILE_H rows, gives each CPU a contiguous
+// run of bands, and has it fill the commands that touch its bands into
+// a cacheable back buffer one RASTER_TILE_W x RASTER_TILE_H tile at a
+// time. Each CPU then copies its own rows to the framebuffer, so the
+// copy to video memory is spread over every core.
+#pragma once
+
+#include <stdint.h>
+#include "common/bootinfo.h"
+
+#define RASTER_TILE_W       64      // 64 x 32 x 4 bytes = 8 KiB per tile
+#define RASTER_TILE_H       32
+#define RASTER_MAX_CMDS     16384
+
+// A solid rectangle, clipped to the screen: [x0, x1) x [y0, y1)
+struct raster_cmd {
+    uint16_t x0, y0, x1, y1;
+    uint32_t color;
+};
+
+struct raster {
+    const struct FramebufferInfo *fb;
+    uint32_t          *back;        // width * height pixels, no row padding
+    uint32_t           width, height;
+    uint32_t           tiles_x, bands;
+    struct raster_cmd *cmds;
+    uint32_t           ncmds;
+    uint32_t           dropped;     // Commands past RASTER_MAX_CMDS
+    uint32_t          *band_lists;  // Per CPU: commands touching a band
+    uint32_t           max_cpus;
+};
+
+// Allocate the back buffer and per-CPU scratch for `fb`, sized for the
+// CPUs online now. Returns 0, or -1 if memory ran out.
+int raster_init(struct raster *r, const struct FramebufferInfo *fb);
+
+// Start recording a frame
+void raster_begin(struct raster *r);
+
+// Record a filled rectangle; parts outside the screen are clipped
+void raster_rect(struct raster *r, int32_t x, int32_t y, uint32_t w, uint32_t h,
+                 uint32_t color);
+
+// Rasterize the recorded commands in order on `ncpus` CPUs (clamped to
+// those online and to raster_init()'s count) and present the result
+void raster_end(struct raster *r, uint32_t ncpus);
@@ -0,0 +1,104 @@
+// kernel/gfx/raster_bench.c
+// Frame time of the tile rasterizer against CPU count
+#include "gfx/raster_bench.h"
+#include "boot/cmdline.h"
+#include "gfx/raster.h"
+#include "lib/printk.h"
+#include "lib/string.h"
+#include "x86/cpu.h"
+#include "x86/smp.h"
+#include "x86/tsc.h"
+
+enum scene { SCENE_LARGE, SCENE_SMALL };
+
+// Background, border and centre box, as kernel_main draws them
+static void record_large(struct raster *r) {
+    uint32_t w = r->width, h = r->height, border = 20;
+    raster_rect(r, 0, 0, w, h, 0x00102040);
+    raster_rect(r, border, border, w - 2 * border, 4, 0x00FFFFFF);
+    raster_rect(r, border, h - border - 4, w - 2 * border, 4, 0x00FFFFFF);
+    raster_rect(r, border, border, 4, h - 2 * border, 0x00FFFFFF);
+    raster_rect(r, w - border - 4, border, 4, h - 2 * border, 0x00FFFFFF);
+    raster_rect(r, w / 2 - 100, h / 2 - 50, 200, 100, 0x0000FF00);
+}
+
+// kernel_main's 10x30 memory bars on a 12x40 grid, `count` of them
+static void record_small(struct raster *r, uint32_t count, uint32_t frame) {
+    uint32_t per_row = (r->width - 100) / 12;
+    uint32_t rows = (r->height - 100) / 40;
+    if (per_row == 0 || rows == 0) return;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t slot = i % (per_row * rows);
+        uint32_t color = ((i + frame) & 1) ? 0x0000FF00 : 0x00008000;
+        raster_rect(r, 50 + slot % per_row * 12, 50 + slot / per_row * 40, 10, 30, color);
+    }
+}
+
+static void record(struct raster *r, enum scene scene, uint32_t rects, uint32_t frame) {
+    raster_begin(r);
+    if (scene == SCENE_LARGE) record_large(r);
+    else record_small(r, rects, frame);
+}
+
+// The same commands written straight to the framebuffer, one at a time
+static void draw_direct(struct raster *r) {
+    uint32_t *fb = (uint32_t *)r->fb->base;
+    uint32_t stride = r->fb->pitch / 4;
+    for (uint32_t i = 0; i < r->ncmds; i++) {
+        const struct raster_cmd *c = &r->cmds[i];
+        for (uint32_t y = c->y0; y < c->y1; y++) {
+            memset32(&fb[(uint64_t)y * stride + c->x0], c->color, c->x1 - c->x0);
+        }
+    }
+}
+
+// Mean frame time in ns; ncpus 0 = direct drawing
+static uint64_t measure(struct raster *r, enum scene scene, uint32_t rects,
+                        uint32_t frames, uint32_t ncpus) {
+    uint64_t total = 0;
+    for (uint32_t f = 0; f < frames; f++) {
+        record(r, scene, rects, f);
+        uint64_t start = rdtsc();
+        if (ncpus == 0) draw_direct(r);
+        else raster_end(r, ncpus);
+        total += rdtsc() - start;
+    }
+    return tsc_to_ns(total / frames);
+}
+
+static void report(const char *scene, const char *how, uint32_t ncpus, uint64_t ns,
+                   uint64_t base_ns) {
+    uint64_t speedup = ns ? base_ns * 100 / ns : 0;
+    kprintf("  %-6s %-6s %2u CPU%s %7llu us  x%llu.%02llu\n", scene, how, ncpus,
+            ncpus == 1 ? " " : "s", (unsigned long long)(ns / 1000),
+            (unsigned long long)(speedup / 100), (unsigned long long)(speedup % 100));
+}
+
+void raster_bench(const struct FramebufferInfo *fb) {
+    uint32_t frames = cmdline_get_u64("rasterbench.frames", 32);
+    uint32_t rects = cmdline_get_u64("rasterbench.rects", 4096);
+    if (frames == 0) frames = 1;
+
+    static struct raster r;
+    if (raster_init(&r, fb) != 0) {
+        kprintf("rasterbench: out of memory\n");
+        return;
+    }
+    kprintf("rasterbench: %ux%u, %u CPUs, %ux%u tiles, %u frames each\n",
+            fb->width, fb->height, r.max_cpus, RASTER_TILE_W, RASTER_TILE_H, frames);
+
+    for (int s = 0; s < 2; s++) {
+        enum scene scene = s == 0 ? SCENE_LARGE : SCENE_SMALL;
+        const char *name = s == 0 ? "large" : "small";
+
+        // Speedups are relative to direct drawing on one CPU
+        uint64_t base = measure(&r, scene, rects, frames, 0);
+        report(name, "direct", 1, base, base);
+        for (uint32_t n = 1; ; n *= 2) {
+            if (n > r.max_cpus) n = r.max_cpus;
+            report(name, "tiled", n, measure(&r, scene, rects, frames, n), base);
+            if (n == r.max_cpus) break;
+        }
+    }
+}
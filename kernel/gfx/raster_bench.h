@@ -0,0 +1,13 @@
+// kernel/gfx/raster_bench.h
+// Frame time of the tile rasterizer against CPU count
+#pragma once
+
+#include "common/bootinfo.h"
+
+// Render kernel_main's two kinds of scene - a few screen-sized rects
+// (background, border, centre box) and many small ones (the memory bars,
+// multiplied) - directly on one CPU, then through the rasterizer on 1, 2,
+// 4, ... CPUs, and print the mean frame time of each. Command line knobs:
+//   rasterbench.frames=N   frames per measurement (default 32)
+//   rasterbench.rects=N    rects in the small-rect scene (default 4096)
+void raster_bench(const struct FramebufferInfo *fb);
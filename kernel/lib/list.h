@@ -0,0 +1,60 @@
+// kernel/lib/list.h
+// Intrusive circular doubly-linked list
+//
+// Embed a struct list_node in the element; a list head is a bare node
+// pointing at itself when empty.
+#pragma once
+
+#include <stddef.h>
+
+struct list_node {
+    struct list_node *prev, *next;
+};
+
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define list_entry(node, type, member) container_of(node, type, member)
+
+static inline void list_init(struct list_node *head) {
+    head->prev = head->next = head;
+}
+
+static inline int list_empty(const struct list_node *head) {
+    return head->next == head;
+}
+
+static inline void list_insert(struct list_node *n, struct list_node *prev,
+                               struct list_node *next) {
+    n->prev = prev;
+    n->next = next;
+    prev->next = n;
+    next->prev = n;
+}
+
+static inline void list_add_head(struct list_node *head, struct list_node *n) {
+    list_insert(n, head, head->next);
+}
+
+static inline void list_add_tail(struct list_node *head, struct list_node *n) {
+    list_insert(n, head->prev, head);
+}
+
+static inline void list_del(struct list_node *n) {
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+    n->prev = n->next = n;
+}
+
+// Node is on some list (nodes are self-linked after list_del)
+static inline int list_linked(const struct list_node *n) {
+    return n->next != n;
+}
+
+#define list_for_each(pos, head) \
+    for (struct list_node *pos = (head)->next; pos != (head); pos = pos->next)
+
+// Walks from the tail; `pos` may be removed from the list in the body
+#define list_for_each_reverse_safe(pos, head)                         \
+    for (struct list_node *pos = (head)->prev, *pos##_prev = pos->prev; \
+         pos != (head); pos = pos##_prev, pos##_prev = pos->prev)
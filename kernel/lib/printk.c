@@ -0,0 +1,190 @@
+// kernel/lib/printk.c
+// Formatted output to the kernel console
+#include "printk.h"
+#include <stdint.h>
+#include "drivers/serial.h"
+#include "lib/spinlock.h"
+#include "x86/cpu.h"
+
+// Whole lines from different CPUs don't interleave
+static spinlock_t g_console_lock = SPINLOCK_INIT;
+
+//=============================================================================
+// Formatter
+//=============================================================================
+
+struct out {
+    char  *buf;
+    size_t size;
+    size_t len;     // characters produced, even past `size`
+};
+
+static void emit(struct out *o, char c) {
+    if (o->len + 1 < o->size) o->buf[o->len] = c;
+    o->len++;
+}
+
+static void emit_number(struct out *o, uint64_t val, int negative, unsigned base,
+                        int upper, int width, int zero_pad, int left, const char *prefix) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char tmp[24];
+    int n = 0;
+
+    do {
+        tmp[n++] = digits[val % base];
+        val /= base;
+    } while (val);
+
+    int prefix_len = 0;
+    while (prefix && prefix[prefix_len]) prefix_len++;
+
+    int body = n + prefix_len + (negative ? 1 : 0);
+    int pad  = width > body ? width - body : 0;
+
+    if (!left && !zero_pad) while (pad-- > 0) emit(o, ' ');
+    if (negative) emit(o, '-');
+    for (int i = 0; i < prefix_len; i++) emit(o, prefix[i]);
+    if (!left && zero_pad) while (pad-- > 0) emit(o, '0');
+    while (n) emit(o, tmp[--n]);
+    if (left) while (pad-- > 0) emit(o, ' ');
+}
+
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap) {
+    struct out o = { buf, size, 0 };
+
+    for (; *fmt; fmt++) {
+        if (*fmt != '%') {
+            emit(&o, *fmt);
+            continue;
+        }
+        fmt++;
+
+        int left = 0, zero_pad = 0, alt = 0;
+        for (;; fmt++) {
+            if (*fmt == '-')      left = 1;
+            else if (*fmt == '0') zero_pad = 1;
+            else if (*fmt == '#') alt = 1;
+            else break;
+        }
+
+        int width = 0;
+        if (*fmt == '*') {
+            width = va_arg(ap, int);
+            fmt++;
+        }
+        while (*fmt >= '0' && *fmt <= '9') width = width * 10 + (*fmt++ - '0');
+
+        int length = 0;     // 0 int, 1 long, 2 long long / size_t
+        while (*fmt == 'l' || *fmt == 'z' || *fmt == 'h') {
+            if (*fmt == 'l') length++;
+            if (*fmt == 'z') length = 2;
+            fmt++;
+        }
+
+        switch (*fmt) {
+            case 'd':
+            case 'i': {
+                int64_t v = length ? va_arg(ap, int64_t) : va_arg(ap, int);
+                uint64_t mag = v < 0 ? -(uint64_t)v : (uint64_t)v;
+                emit_number(&o, mag, v < 0, 10, 0, width, zero_pad, left, NULL);
+                break;
+            }
+            case 'u': {
+                uint64_t v = length ? va_arg(ap, uint64_t) : va_arg(ap, unsigned);
+                emit_number(&o, v, 0, 10, 0, width, zero_pad, left, NULL);
+                break;
+            }
+            case 'x':
+            case 'X': {
+                uint64_t v = length ? va_arg(ap, uint64_t) : va_arg(ap, unsigned);
+                emit_number(&o, v, 0, 16, *fmt == 'X', width, zero_pad, left,
+                            alt ? "0x" : NULL);
+                break;
+            }
+            case 'p': {
+                uint64_t v = (uint64_t)va_arg(ap, void *);
+                emit_number(&o, v, 0, 16, 0, width, zero_pad, left, "0x");
+                break;
+            }
+            case 'c':
+                emit(&o, (char)va_arg(ap, int));
+                break;
+            case 's': {
+                const char *s = va_arg(ap, const char *);
+                if (!s) s = "(null)";
+                int len = 0;
+                while (s[len]) len++;
+                int pad = width > len ? width - len : 0;
+                if (!left) while (pad-- > 0) emit(&o, ' ');
+                for (int i = 0; i < len; i++) emit(&o, s[i]);
+                if (left) while (pad-- > 0) emit(&o, ' ');
+                break;
+            }
+            case '%':
+                emit(&o, '%');
+                break;
+            case 0:
+                fmt--;
+                break;
+            default:
+                emit(&o, '%');
+                emit(&o, *fmt);
+                break;
+        }
+    }
+
+    if (size) buf[o.len < size ? o.len : size - 1] = 0;
+    return (int)o.len;
+}
+
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+//=============================================================================
+// Console Output
+//=============================================================================
+
+void kprintf(const char *fmt, ...) {
+    char buf[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (n >= (int)sizeof(buf)) n = sizeof(buf) - 1;
+    uint64_t flags = spin_lock_irqsave(&g_console_lock);
+    serial_write(buf, n);
+    spin_unlock_irqrestore(&g_console_lock, flags);
+}
+
+void kwrite(const char *s, size_t len) {
+    uint64_t flags = spin_lock_irqsave(&g_console_lock);
+    serial_write(s, len);
+    spin_unlock_irqrestore(&g_console_lock, flags);
+}
+
+void panic(const char *fmt, ...) {
+    char buf[256];
+    va_list ap;
+
+    __asm__ volatile("cli");
+
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n >= (int)sizeof(buf)) n = sizeof(buf) - 1;
+
+    serial_write("\nPANIC: ", 8);
+    serial_write(buf, n);
+    serial_write("\n", 1);
+
+    while (1) {
+        __asm__ volatile("hlt");
+    }
+}
@@ -0,0 +1,21 @@
+// kernel/lib/printk.h
+// Formatted output to the kernel console
+//
+// Supports the usual subset: %d %i %u %x %X %p %s %c %%, with flags '-',
+// '0', '#', a field width, and the h/hh/l/ll/z length modifiers.
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+
+int  kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
+int  ksnprintf(char *buf, size_t size, const char *fmt, ...)
+     __attribute__((format(printf, 3, 4)));
+void kprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Unformatted, e.g. text from user programs
+void kwrite(const char *s, size_t len);
+
+// Print the message and halt this CPU with interrupts off
+__attribute__((noreturn))
+void panic(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
@@ -0,0 +1,37 @@
+// kernel/lib/seqlock.h
+// Sequence counter for data that is read far more often than written
+//
+// Readers take no lock and never write shared memory: they note the count,
+// read, and retry if the count was odd or has changed. Writers must be
+// serialised by the caller (one writer, or a spinlock around them).
+#pragma once
+
+#include <stdint.h>
+#include "x86/cpu.h"
+
+typedef struct {
+    volatile uint32_t seq;
+} seqcount_t;
+
+#define SEQCOUNT_INIT { 0 }
+
+static inline uint32_t read_seqbegin(const seqcount_t *s) {
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1) cpu_relax();
+    return seq;
+}
+
+// Nonzero if the data read since read_seqbegin() may be torn
+static inline int read_seqretry(const seqcount_t *s, uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void write_seqbegin(seqcount_t *s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_seqend(seqcount_t *s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
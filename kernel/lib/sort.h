@@ -0,0 +1,9 @@
+// kernel/lib/sort.h
+// In-place sorting without recursion or allocation
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Heapsort, ascending
+void sort_u64(uint64_t *a, size_t n);
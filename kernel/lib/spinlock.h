@@ -0,0 +1,36 @@
+// kernel/lib/spinlock.h
+// Test-and-test-and-set spinlock
+//
+// Use the _irqsave variants for anything an interrupt handler also takes,
+// or the handler can spin forever on a lock its own CPU holds.
+#pragma once
+
+#include <stdint.h>
+#include "x86/cpu.h"
+
+typedef struct {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_lock(spinlock_t *l) {
+    while (__atomic_exchange_n(&l->locked, 1, __ATOMIC_ACQUIRE)) {
+        while (l->locked) cpu_relax();
+    }
+}
+
+static inline void spin_unlock(spinlock_t *l) {
+    __atomic_store_n(&l->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t spin_lock_irqsave(spinlock_t *l) {
+    uint64_t flags = irq_save();
+    spin_lock(l);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *l, uint64_t flags) {
+    spin_unlock(l);
+    irq_restore(flags);
+}
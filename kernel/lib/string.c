@@ -0,0 +1,644 @@
+// kernel/lib/string.c
+// CPUID-dispatched memcpy/memset/memmove
+//
+// Every call is split by size class:
+//   n <= 32            inline overlapping scalar moves, no dispatch at all
+//   32 < n < rep_min   vector loop (AVX2 if the OS enabled YMM state, else SSE2)
+//   rep_min <= n       REP MOVSB/STOSB (only when ERMS/FSRM is advertised)
+//   n >= nt_min        non-temporal stores, so huge copies don't flush the LLC
+//
+// string_init() fills in g_str once at boot. Before that the SSE2 baseline
+// (always present on x86-64) is used, so early compiler-emitted calls work.
+// Interrupt handlers get REP MOVSB/STOSB instead of vector loops unless
+// they own the SIMD registers (see x86/fpu.h).
+//
+// This file must not call itself: the kernel is built with
+// -fno-tree-loop-distribute-patterns so GCC won't turn loops into memcpy().
+#include "string.h"
+#include "x86/cpufeature.h"
+
+// The kernel is built with -mgeneral-regs-only: GCC never allocates vector
+// registers there and refuses to accept them as clobbers. The host
+// benchmark build does use them, so it needs the clobbers.
+#ifdef __SSE2__
+#define XMM_CLOBBERS "xmm0", "xmm1", "xmm2", "xmm3",
+#else
+#define XMM_CLOBBERS
+#endif
+
+typedef void (*copy_fn)(uint8_t *d, const uint8_t *s, size_t n);
+typedef void (*set_fn)(uint8_t *d, uint64_t pattern, size_t n);
+
+static void copy_sse2(uint8_t *d, const uint8_t *s, size_t n);
+static void copy_avx2(uint8_t *d, const uint8_t *s, size_t n);
+static void copy_rep(uint8_t *d, const uint8_t *s, size_t n);
+static void copy_nt_sse2(uint8_t *d, const uint8_t *s, size_t n);
+static void copy_nt_avx2(uint8_t *d, const uint8_t *s, size_t n);
+static void set_sse2(uint8_t *d, uint64_t pattern, size_t n);
+static void set_avx2(uint8_t *d, uint64_t pattern, size_t n);
+static void set_rep(uint8_t *d, uint64_t pattern, size_t n);
+static void set_nt_sse2(uint8_t *d, uint64_t pattern, size_t n);
+static void set_nt_avx2(uint8_t *d, uint64_t pattern, size_t n);
+
+static struct {
+    copy_fn     copy_vec;       // 32 < n < copy_rep_min
+    copy_fn     copy_big;       // copy_rep_min <= n < nt_min
+    copy_fn     copy_nt;        // n >= nt_min
+    set_fn      set_vec;
+    set_fn      set_big;
+    set_fn      set_nt;
+    size_t      copy_rep_min;
+    size_t      set_rep_min;
+    size_t      nt_min;
+    const char *name;
+} g_str = {
+    copy_sse2, copy_sse2, copy_nt_sse2,
+    set_sse2,  set_sse2,  set_nt_sse2,
+    SIZE_MAX,  SIZE_MAX,  SIZE_MAX,
+    "sse2",
+};
+
+//=============================================================================
+// Small Sizes (n <= 32)
+// All loads happen before any store, so these are also safe for memmove.
+//=============================================================================
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t v;
+    __builtin_memcpy(&v, p, 8);
+    return v;
+}
+
+static inline void store64(uint8_t *p, uint64_t v) {
+    __builtin_memcpy(p, &v, 8);
+}
+
+static inline uint32_t load32(const uint8_t *p) {
+    uint32_t v;
+    __builtin_memcpy(&v, p, 4);
+    return v;
+}
+
+static inline void store32(uint8_t *p, uint32_t v) {
+    __builtin_memcpy(p, &v, 4);
+}
+
+static inline void copy_small(uint8_t *d, const uint8_t *s, size_t n) {
+    if (n >= 16) {
+        uint64_t a = load64(s),          b = load64(s + 8);
+        uint64_t c = load64(s + n - 16), e = load64(s + n - 8);
+        store64(d, a);
+        store64(d + 8, b);
+        store64(d + n - 16, c);
+        store64(d + n - 8, e);
+    } else if (n >= 8) {
+        uint64_t a = load64(s), b = load64(s + n - 8);
+        store64(d, a);
+        store64(d + n - 8, b);
+    } else if (n >= 4) {
+        uint32_t a = load32(s), b = load32(s + n - 4);
+        store32(d, a);
+        store32(d + n - 4, b);
+    } else if (n) {
+        uint8_t a = s[0], b = s[n / 2], c = s[n - 1];
+        d[0] = a;
+        d[n / 2] = b;
+        d[n - 1] = c;
+    }
+}
+
+// `pattern` repeats every 1 (memset) or 4 (memset32) bytes. Overlapping
+// stores keep the phase because memset32 sizes are multiples of 4.
+static inline void set_small(uint8_t *d, uint64_t pattern, size_t n) {
+    if (n >= 16) {
+        store64(d, pattern);
+        store64(d + 8, pattern);
+        store64(d + n - 16, pattern);
+        store64(d + n - 8, pattern);
+    } else if (n >= 8) {
+        store64(d, pattern);
+        store64(d + n - 8, pattern);
+    } else if (n >= 4) {
+        store32(d, (uint32_t)pattern);
+        store32(d + n - 4, (uint32_t)pattern);
+    } else if (n) {
+        d[0] = (uint8_t)pattern;
+        d[n / 2] = (uint8_t)pattern;
+        d[n - 1] = (uint8_t)pattern;
+    }
+}
+
+//=============================================================================
+// Vector Loops (n > 32)
+// Head and tail are stored unaligned, the body with aligned stores. The body
+// never runs past the end, the tail store covers the remainder.
+//=============================================================================
+
+static void copy_sse2(uint8_t *d, const uint8_t *s, size_t n) {
+    __asm__ volatile(
+        "movdqu (%[s]), %%xmm0\n\t"
+        "movdqu -16(%[s],%[n]), %%xmm1\n\t"
+        "movdqu %%xmm0, (%[d])\n\t"
+        "movdqu %%xmm1, -16(%[d],%[n])\n\t"
+        :
+        : [d] "r"(d), [s] "r"(s), [n] "r"(n)
+        : XMM_CLOBBERS "memory");
+
+    size_t skip = 16 - ((uintptr_t)d & 15);
+    d += skip;
+    s += skip;
+    n = (n - skip) & ~(size_t)15;
+
+    __asm__ volatile(
+        "cmp $64, %[n]\n\t"
+        "jb 2f\n"
+        "1:\n\t"
+        "movdqu   (%[s]), %%xmm0\n\t"
+        "movdqu 16(%[s]), %%xmm1\n\t"
+        "movdqu 32(%[s]), %%xmm2\n\t"
+        "movdqu 48(%[s]), %%xmm3\n\t"
+        "movdqa %%xmm0,   (%[d])\n\t"
+        "movdqa %%xmm1, 16(%[d])\n\t"
+        "movdqa %%xmm2, 32(%[d])\n\t"
+        "movdqa %%xmm3, 48(%[d])\n\t"
+        "add $64, %[s]\n\t"
+        "add $64, %[d]\n\t"
+        "sub $64, %[n]\n\t"
+        "cmp $64, %[n]\n\t"
+        "jae 1b\n"
+        "2:\n\t"
+        "test %[n], %[n]\n\t"
+        "jz 4f\n"
+        "3:\n\t"
+        "movdqu (%[s]), %%xmm0\n\t"
+        "movdqa %%xmm0, (%[d])\n\t"
+        "add $16, %[s]\n\t"
+        "add $16, %[d]\n\t"
+        "sub $16, %[n]\n\t"
+        "jnz 3b\n"
+        "4:\n\t"
+        : [d] "+r"(d), [s] "+r"(s), [n] "+r"(n)
+        :
+        : XMM_CLOBBERS "memory", "cc");
+}
+
+static void copy_avx2(uint8_t *d, const uint8_t *s, size_t n) {
+    __asm__ volatile(
+        "vmovdqu (%[s]), %%ymm0\n\t"
+        "vmovdqu -32(%[s],%[n]), %%ymm1\n\t"
+        "vmovdqu %%ymm0, (%[d])\n\t"
+        "vmovdqu %%ymm1, -32(%[d],%[n])\n\t"
+        :
+        : [d] "r"(d), [s] "r"(s), [n] "r"(n)
+        : XMM_CLOBBERS "memory");
+
+    size_t skip = 32 - ((uintptr_t)d & 31);
+    d += skip;
+    s += skip;
+    n = (n - skip) & ~(size_t)31;
+
+    __asm__ volatile(
+        "cmp $128, %[n]\n\t"
+        "jb 2f\n"
+        "1:\n\t"
+        "vmovdqu   (%[s]), %%ymm0\n\t"
+        "vmovdqu 32(%[s]), %%ymm1\n\t"
+        "vmovdqu 64(%[s]), %%ymm2\n\t"
+        "vmovdqu 96(%[s]), %%ymm3\n\t"
+        "vmovdqa %%ymm0,   (%[d])\n\t"
+        "vmovdqa %%ymm1, 32(%[d])\n\t"
+        "vmovdqa %%ymm2, 64(%[d])\n\t"
+        "vmovdqa %%ymm3, 96(%[d])\n\t"
+        "add $128, %[s]\n\t"
+        "add $128, %[d]\n\t"
+        "sub $128, %[n]\n\t"
+        "cmp $128, %[n]\n\t"
+        "jae 1b\n"
+        "2:\n\t"
+        "test %[n], %[n]\n\t"
+        "jz 4f\n"
+        "3:\n\t"
+        "vmovdqu (%[s]), %%ymm0\n\t"
+        "vmovdqa %%ymm0, (%[d])\n\t"
+        "add $32, %[s]\n\t"
+        "add $32, %[d]\n\t"
+        "sub $32, %[n]\n\t"
+        "jnz 3b\n"
+        "4:\n\t"
+        "vzeroupper\n\t"
+        : [d] "+r"(d), [s] "+r"(s), [n] "+r"(n)
+        :
+        : XMM_CLOBBERS "memory", "cc");
+}
+
+static void set_sse2(uint8_t *d, uint64_t pattern, size_t n) {
+    uint8_t *body = d + 16 - ((uintptr_t)d & 15);
+    size_t body_n = (n - (size_t)(body - d)) & ~(size_t)15;
+
+    __asm__ volatile(
+        "movq %[p], %%xmm0\n\t"
+        "punpcklqdq %%xmm0, %%xmm0\n\t"
+        "movdqu %%xmm0, (%[d])\n\t"
+        "movdqu %%xmm0, -16(%[d],%[n])\n\t"
+        "cmp $64, %[bn]\n\t"
+        "jb 2f\n"
+        "1:\n\t"
+        "movdqa %%xmm0,   (%[b])\n\t"
+        "movdqa %%xmm0, 16(%[b])\n\t"
+        "movdqa %%xmm0, 32(%[b])\n\t"
+        "movdqa %%xmm0, 48(%[b])\n\t"
+        "add $64, %[b]\n\t"
+        "sub $64, %[bn]\n\t"
+        "cmp $64, %[bn]\n\t"
+        "jae 1b\n"
+        "2:\n\t"
+        "test %[bn], %[bn]\n\t"
+        "jz 4f\n"
+        "3:\n\t"
+        "movdqa %%xmm0, (%[b])\n\t"
+        "add $16, %[b]\n\t"
+        "sub $16, %[bn]\n\t"
+        "jnz 3b\n"
+        "4:\n\t"
+        : [b] "+r"(body), [bn] "+r"(body_n)
+        : [d] "r"(d), [n] "r"(n), [p] "r"(pattern)
+        : XMM_CLOBBERS "memory", "cc");
+}
+
+static void set_avx2(uint8_t *d, uint64_t pattern, size_t n) {
+    uint8_t *body = d + 32 - ((uintptr_t)d & 31);
+    size_t body_n = (n - (size_t)(body - d)) & ~(size_t)31;
+
+    __asm__ volatile(
+        "vmovq %[p], %%xmm0\n\t"
+        "vpbroadcastq %%xmm0, %%ymm0\n\t"
+        "vmovdqu %%ymm0, (%[d])\n\t"
+        "vmovdqu %%ymm0, -32(%[d],%[n])\n\t"
+        "cmp $128, %[bn]\n\t"
+        "jb 2f\n"
+        "1:\n\t"
+        "vmovdqa %%ymm0,   (%[b])\n\t"
+        "vmovdqa %%ymm0, 32(%[b])\n\t"
+        "vmovdqa %%ymm0, 64(%[b])\n\t"
+        "vmovdqa %%ymm0, 96(%[b])\n\t"
+        "add $128, %[b]\n\t"
+        "sub $128, %[bn]\n\t"
+        "cmp $128, %[bn]\n\t"
+        "jae 1b\n"
+        "2:\n\t"
+        "test %[bn], %[bn]\n\t"
+        "jz 4f\n"
+        "3:\n\t"
+        "vmovdqa %%ymm0, (%[b])\n\t"
+        "add $32, %[b]\n\t"
+        "sub $32, %[bn]\n\t"
+        "jnz 3b\n"
+        "4:\n\t"
+        "vzeroupper\n\t"
+        : [b] "+r"(body), [bn] "+r"(body_n)
+        : [d] "r"(d), [n] "r"(n), [p] "r"(pattern)
+        : XMM_CLOBBERS "memory", "cc");
+}
+
+//=============================================================================
+// REP String Instructions (ERMS/FSRM)
+//=============================================================================
+
+static void copy_rep(uint8_t *d, const uint8_t *s, size_t n) {
+    __asm__ volatile("rep movsb"
+                     : "+D"(d), "+S"(s), "+c"(n)
+                     :
+                     : "memory");
+}
+
+static void set_rep(uint8_t *d, uint64_t pattern, size_t n) {
+    // STOSB only stores one byte value; a memset32 pattern needs STOSQ.
+    if ((pattern & 0xFF) * 0x0101010101010101ULL == pattern) {
+        __asm__ volatile("rep stosb"
+                         : "+D"(d), "+c"(n)
+                         : "a"(pattern)
+                         : "memory");
+        return;
+    }
+
+    size_t qwords = n / 8;
+    __asm__ volatile("rep stosq"
+                     : "+D"(d), "+c"(qwords)
+                     : "a"(pattern)
+                     : "memory");
+    if (n & 4) store32(d, (uint32_t)pattern);
+}
+
+//=============================================================================
+// Non-Temporal Stores (n >= nt_min)
+// Stores bypass the cache; the SFENCE orders them before whatever the caller
+// does next (e.g. handing the buffer to another CPU or a device).
+//=============================================================================
+
+static void copy_nt_sse2(uint8_t *d, const uint8_t *s, size_t n) {
+    uint8_t *end = d + n;
+
+    __asm__ volatile(
+        "movdqu (%[s]), %%xmm0\n\t"
+        "movdqu %%xmm0, (%[d])\n\t"
+        :
+        : [d] "r"(d), [s] "r"(s)
+        : XMM_CLOBBERS "memory");
+
+    size_t skip = 16 - ((uintptr_t)d & 15);
+    d += skip;
+    s += skip;
+    n = (n - skip) & ~(size_t)63;
+
+    __asm__ volatile(
+        "test %[n], %[n]\n\t"
+        "jz 2f\n"
+        "1:\n\t"
+        "prefetchnta 512(%[s])\n\t"
+        "movdqu   (%[s]), %%xmm0\n\t"
+        "movdqu 16(%[s]), %%xmm1\n\t"
+        "movdqu 32(%[s]), %%xmm2\n\t"
+        "movdqu 48(%[s]), %%xmm3\n\t"
+        "movntdq %%xmm0,   (%[d])\n\t"
+        "movntdq %%xmm1, 16(%[d])\n\t"
+        "movntdq %%xmm2, 32(%[d])\n\t"
+        "movntdq %%xmm3, 48(%[d])\n\t"
+        "add $64, %[s]\n\t"
+        "add $64, %[d]\n\t"
+        "sub $64, %[n]\n\t"
+        "jnz 1b\n"
+        "2:\n\t"
+        "sfence\n\t"
+        : [d] "+r"(d), [s] "+r"(s), [n] "+r"(n)
+        :
+        : XMM_CLOBBERS "memory", "cc");
+
+    // Up to 63 bytes left: finish through the cache
+    size_t rest = (size_t)(end - d);
+    if (rest > 32) copy_sse2(d, s, rest);
+    else copy_small(d, s, rest);
+}
+
+static void copy_nt_avx2(uint8_t *d, const uint8_t *s, size_t n) {
+    uint8_t *end = d + n;
+
+    __asm__ volatile(
+        "vmovdqu (%[s]), %%ymm0\n\t"
+        "vmovdqu %%ymm0, (%[d])\n\t"
+        :
+        : [d] "r"(d), [s] "r"(s)
+        : XMM_CLOBBERS "memory");
+
+    size_t skip = 32 - ((uintptr_t)d & 31);
+    d += skip;
+    s += skip;
+    n = (n - skip) & ~(size_t)127;
+
+    __asm__ volatile(
+        "test %[n], %[n]\n\t"
+        "jz 2f\n"
+        "1:\n\t"
+        "prefetchnta 512(%[s])\n\t"
+        "vmovdqu   (%[s]), %%ymm0\n\t"
+        "vmovdqu 32(%[s]), %%ymm1\n\t"
+        "vmovdqu 64(%[s]), %%ymm2\n\t"
+        "vmovdqu 96(%[s]), %%ymm3\n\t"
+        "vmovntdq %%ymm0,   (%[d])\n\t"
+        "vmovntdq %%ymm1, 32(%[d])\n\t"
+        "vmovntdq %%ymm2, 64(%[d])\n\t"
+        "vmovntdq %%ymm3, 96(%[d])\n\t"
+        "add $128, %[s]\n\t"
+        "add $128, %[d]\n\t"
+        "sub $128, %[n]\n\t"
+        "jnz 1b\n"
+        "2:\n\t"
+        "sfence\n\t"
+        "vzeroupper\n\t"
+        : [d] "+r"(d), [s] "+r"(s), [n] "+r"(n)
+        :
+        : XMM_CLOBBERS "memory", "cc");
+
+    // Up to 127 bytes left: finish through the cache
+    size_t rest = (size_t)(end - d);
+    if (rest > 32) copy_avx2(d, s, rest);
+    else copy_small(d, s, rest);
+}
+
+static void set_nt_sse2(uint8_t *d, uint64_t pattern, size_t n) {
+    uint8_t *body = d + 16 - ((uintptr_t)d & 15);
+    size_t body_n = (n - (size_t)(body - d)) & ~(size_t)63;
+
+    __asm__ volatile(
+        "movq %[p], %%xmm0\n\t"
+        "punpcklqdq %%xmm0, %%xmm0\n\t"
+        "movdqu %%xmm0, (%[d])\n\t"
+        "test %[bn], %[bn]\n\t"
+        "jz 2f\n"
+        "1:\n\t"
+        "movntdq %%xmm0,   (%[b])\n\t"
+        "movntdq %%xmm0, 16(%[b])\n\t"
+        "movntdq %%xmm0, 32(%[b])\n\t"
+        "movntdq %%xmm0, 48(%[b])\n\t"
+        "add $64, %[b]\n\t"
+        "sub $64, %[bn]\n\t"
+        "jnz 1b\n"
+        "2:\n\t"
+        "sfence\n\t"
+        : [b] "+r"(body), [bn] "+r"(body_n)
+        : [d] "r"(d), [n] "r"(n), [p] "r"(pattern)
+        : XMM_CLOBBERS "memory", "cc");
+
+    size_t rest = (size_t)(d + n - body);
+    if (rest > 32) set_sse2(body, pattern, rest);
+    else set_small(body, pattern, rest);
+}
+
+static void set_nt_avx2(uint8_t *d, uint64_t pattern, size_t n) {
+    uint8_t *body = d + 32 - ((uintptr_t)d & 31);
+    size_t body_n = (n - (size_t)(body - d)) & ~(size_t)127;
+
+    __asm__ volatile(
+        "vmovq %[p], %%xmm0\n\t"
+        "vpbroadcastq %%xmm0, %%ymm0\n\t"
+        "vmovdqu %%ymm0, (%[d])\n\t"
+        "test %[bn], %[bn]\n\t"
+        "jz 2f\n"
+        "1:\n\t"
+        "vmovntdq %%ymm0,   (%[b])\n\t"
+        "vmovntdq %%ymm0, 32(%[b])\n\t"
+        "vmovntdq %%ymm0, 64(%[b])\n\t"
+        "vmovntdq %%ymm0, 96(%[b])\n\t"
+        "add $128, %[b]\n\t"
+        "sub $128, %[bn]\n\t"
+        "jnz 1b\n"
+        "2:\n\t"
+        "sfence\n\t"
+        "vzeroupper\n\t"
+        : [b] "+r"(body), [bn] "+r"(body_n)
+        : [d] "r"(d), [p] "r"(pattern)
+        : XMM_CLOBBERS "memory", "cc");
+
+    size_t rest = (size_t)(d + n - body);
+    if (rest > 32) set_avx2(body, pattern, rest);
+    else set_small(body, pattern, rest);
+}
+
+//=============================================================================
+// Public Entry Points
+//=============================================================================
+
+// Overridden by x86/fpu.c. The host benchmark links this default.
+__attribute__((weak)) int string_simd_allowed(void) {
+    return 1;
+}
+
+void *memcpy(void *restrict dst, const void *restrict src, size_t n) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    if (n <= 32)                     copy_small(d, s, n);
+    else if (!string_simd_allowed()) copy_rep(d, s, n);
+    else if (n < g_str.copy_rep_min) g_str.copy_vec(d, s, n);
+    else if (n < g_str.nt_min)       g_str.copy_big(d, s, n);
+    else                             g_str.copy_nt(d, s, n);
+    return dst;
+}
+
+static void *set_dispatch(uint8_t *d, uint64_t pattern, size_t n) {
+    if (n <= 32)                     set_small(d, pattern, n);
+    else if (!string_simd_allowed()) set_rep(d, pattern, n);
+    else if (n < g_str.set_rep_min)  g_str.set_vec(d, pattern, n);
+    else if (n < g_str.nt_min)       g_str.set_big(d, pattern, n);
+    else                             g_str.set_nt(d, pattern, n);
+    return d;
+}
+
+void *memset(void *dst, int c, size_t n) {
+    return set_dispatch(dst, (uint8_t)c * 0x0101010101010101ULL, n);
+}
+
+void *memset32(uint32_t *dst, uint32_t value, size_t count) {
+    return set_dispatch((uint8_t *)dst, value * 0x0000000100000001ULL, count * 4);
+}
+
+void *memmove(void *dst, const void *src, size_t n) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    if (n <= 32) {
+        copy_small(d, s, n);
+        return dst;
+    }
+
+    if ((uintptr_t)d - (uintptr_t)s >= n) {
+        // Destination is below the source or disjoint: a forward copy works
+        if ((uintptr_t)s - (uintptr_t)d >= n) return memcpy(dst, src, n);
+
+        // Overlapping with dst < src. REP MOVSB is architecturally a
+        // byte-at-a-time forward copy, so overlap is handled correctly.
+        copy_rep(d, s, n);
+        return dst;
+    }
+
+    // dst > src and overlapping: copy backwards, 8 bytes at a time
+    while (n >= 8) {
+        n -= 8;
+        store64(d + n, load64(s + n));
+    }
+    while (n) {
+        n--;
+        d[n] = s[n];
+    }
+    return dst;
+}
+
+int memcmp(const void *a, const void *b, size_t n) {
+    const uint8_t *pa = a;
+    const uint8_t *pb = b;
+
+    while (n >= 8 && load64(pa) == load64(pb)) {
+        pa += 8;
+        pb += 8;
+        n -= 8;
+    }
+    for (; n; n--, pa++, pb++) {
+        if (*pa != *pb) return *pa < *pb ? -1 : 1;
+    }
+    return 0;
+}
+
+//=============================================================================
+// Implementation Selection
+//=============================================================================
+
+void string_select(uint32_t flags, size_t nt_threshold) {
+    static char name[32];
+    int avx2 = (flags & STRING_F_AVX2) != 0;
+
+    g_str.copy_vec = avx2 ? copy_avx2 : copy_sse2;
+    g_str.set_vec  = avx2 ? set_avx2  : set_sse2;
+    g_str.copy_nt  = avx2 ? copy_nt_avx2 : copy_nt_sse2;
+    g_str.set_nt   = avx2 ? set_nt_avx2  : set_nt_sse2;
+    g_str.nt_min   = nt_threshold ? nt_threshold : SIZE_MAX;
+
+    // FSRM makes REP MOVSB competitive from the smallest sizes up.
+    // Plain ERMS has a startup cost of a few dozen cycles, so the vector
+    // loop wins below a couple of KiB.
+    if (flags & STRING_F_FSRM) {
+        g_str.copy_big = copy_rep;
+        g_str.copy_rep_min = 33;
+    } else if (flags & STRING_F_ERMS) {
+        g_str.copy_big = copy_rep;
+        g_str.copy_rep_min = avx2 ? 4096 : 2048;
+    } else {
+        g_str.copy_big = g_str.copy_vec;
+        g_str.copy_rep_min = g_str.nt_min;
+    }
+
+    if (flags & (STRING_F_ERMS | STRING_F_FSRM)) {
+        g_str.set_big = set_rep;
+        g_str.set_rep_min = 2048;
+    } else {
+        g_str.set_big = g_str.set_vec;
+        g_str.set_rep_min = g_str.nt_min;
+    }
+
+    if (g_str.copy_rep_min > g_str.nt_min) g_str.copy_rep_min = g_str.nt_min;
+    if (g_str.set_rep_min > g_str.nt_min)  g_str.set_rep_min = g_str.nt_min;
+
+    // Build the name by hand, there is no snprintf in here
+    const char *parts[4];
+    int count = 0;
+    if (flags & STRING_F_FSRM)      parts[count++] = "fsrm";
+    else if (flags & STRING_F_ERMS) parts[count++] = "erms";
+    parts[count++] = avx2 ? "avx2" : "sse2";
+    if (nt_threshold)               parts[count++] = "nt";
+
+    char *out = name;
+    for (int i = 0; i < count; i++) {
+        if (i) *out++ = '+';
+        for (const char *p = parts[i]; *p; p++) *out++ = *p;
+    }
+    *out = 0;
+    g_str.name = name;
+}
+
+const char *string_impl_name(void) {
+    return g_str.name;
+}
+
+//=============================================================================
+// CPUID Selection
+//=============================================================================
+
+void string_init(void) {
+    uint32_t flags = 0;
+
+    if (cpu_has(X86_FEATURE_ERMS)) flags |= STRING_F_ERMS;
+    if (cpu_has(X86_FEATURE_FSRM)) flags |= STRING_F_FSRM;
+    if (cpu_has(X86_FEATURE_AVX2)) flags |= STRING_F_AVX2;   // only if XCR0 has YMM
+
+    // Go non-temporal once a copy would evict most of the last-level cache
+    size_t llc = boot_cpu.llc_size;
+    string_select(flags, llc ? llc * 3 / 4 : 4u << 20);
+}
@@ -0,0 +1,43 @@
+// kernel/lib/string.h
+// Freestanding memory routines for the kernel
+//
+// GCC is free to emit calls to memcpy/memset/memmove/memcmp even with
+// -ffreestanding (struct copies, large initializers), so the kernel must
+// provide them. The implementations are selected once at boot from CPUID.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+void *memcpy(void *restrict dst, const void *restrict src, size_t n);
+void *memmove(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
+int   memcmp(const void *a, const void *b, size_t n);
+
+// Fill `count` 32-bit words with `value` (framebuffer fills).
+// `dst` must be 4-byte aligned.
+void *memset32(uint32_t *dst, uint32_t value, size_t count);
+
+//=============================================================================
+// Implementation Selection
+//=============================================================================
+
+#define STRING_F_ERMS  (1u << 0)  // Enhanced REP MOVSB/STOSB
+#define STRING_F_FSRM  (1u << 1)  // Fast Short REP MOVSB
+#define STRING_F_AVX2  (1u << 2)  // AVX2 usable (CPU + OS enabled YMM state)
+
+// Pick implementations from the CPU feature bitmap. Call once, after
+// cpu_init(). Until then the SSE2 baseline paths are used.
+void string_init(void);
+
+// Select implementations for an explicit feature set. `nt_threshold` is the
+// copy/fill size at which non-temporal stores take over (0 = never).
+// Used by string_init() and by the host benchmark to force each path.
+void string_select(uint32_t flags, size_t nt_threshold);
+
+// Human-readable name of the current selection, e.g. "fsrm+avx2+nt"
+const char *string_impl_name(void);
+
+// Whether vector registers may be used right now (not in an interrupt
+// handler outside kernel_simd_begin/end). Defined by x86/fpu.c.
+int string_simd_allowed(void);
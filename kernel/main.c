@@ -1,74 +1,399 @@
 // kernel/main.c
 // Minimal kernel that demonstrates we have control
 #include "../common/bootinfo.h"
+#include "acpi/acpi.h"
+#include "boot/bootinfo.h"
+#include "boot/cmdline.h"
+#include "boot/initcall.h"
+#include "boot/kexec.h"
+#include "drivers/blk_bench.h"
+#include "drivers/block.h"
+#include "drivers/hpet.h"
+#include "drivers/serial.h"
+#include "fs/bcache_bench.h"
+#include "fs/tmpfs_bench.h"
+#include "gfx/dlist.h"
+#include "gfx/font.h"
+#include "gfx/raster_bench.h"
+#include "lib/printk.h"
+#include "lib/string.h"
+#include "mm/numa.h"
+#include "mm/numa_bench.h"
+#include "mm/pmm.h"
+#include "mm/zpool.h"
+#include "mm/zpool_bench.h"
+#include "proc/aio_bench.h"
+#include "proc/ipc_bench.h"
+#include "proc/process.h"
+#include "sched/task.h"
+#include "time/clock.h"
+#include "x86/apic.h"
+#include "x86/cpu.h"
+#include "x86/cpufeature.h"
+#include "x86/fpu.h"
+#include "x86/idle.h"
+#include "x86/idle_bench.h"
+#include "x86/idt.h"
+#include "x86/percpu.h"
+#include "x86/smp.h"
+#include "x86/syscall.h"
+#include "x86/syscall_bench.h"
+#include "x86/tsc.h"
 
-// Forward declaration so we can call from entry
-static void draw_rect(struct FramebufferInfo *fb,
-                      uint32_t x, uint32_t y,
-                      uint32_t w, uint32_t h,
-                      uint32_t color);
-static void fill_screen(struct FramebufferInfo *fb, uint32_t color);
+// Forward declarations so we can call from entry
+static void draw_screen(const struct FramebufferInfo *fb);
+static void print_boot_summary(uint64_t entry_tsc);
+static void print_boot_times(uint64_t entry_tsc, uint64_t ready_tsc);
+static void print_boot_history(void);
+static void print_numa(void);
+static void qemu_exit_if_requested(void);
+static void run_exec(const char *name);
+
+// The boot context becomes the first task once the scheduler is up
+static struct task g_boot_task;
 
 //=============================================================================
 // Kernel Entry Point - MUST BE FIRST FUNCTION
-// The bootloader jumps directly to the start of the binary
+// The bootloader jumps directly to the start of the binary.
+// .text.entry is placed first by linker.ld, whatever the object order.
 //=============================================================================
 
+__attribute__((section(".text.entry")))
 void kernel_main(struct BootInfo *boot_info) {
-    struct FramebufferInfo *fb = &boot_info->framebuffer;
-    
+    uint64_t entry_tsc = rdtsc();
+
+    // Firmware interrupt handlers are gone after ExitBootServices
+    __asm__ volatile("cli");
+
+    serial_init();
+    cpu_init();                         // CPUID bitmap; SSE/AVX/XSAVE on
+    percpu_init(0, NULL);               // our GDT + TSS, GS -> per-CPU data
+    idt_init();                         // exceptions; legacy PIC masked
+    sched_init(&g_boot_task, "boot");
+    fpu_init();                         // lazy SIMD state from here on
+    syscall_init();                     // SYSCALL MSRs, int 0x80 gate
+
+    // Pick memcpy/memset implementations before anything big gets copied
+    string_init();
+
+    kprintf("\nMyOS kernel\n");
+    kprintf("CPU: %s family %u model %u, %s %u-byte SIMD state, memcpy: %s\n",
+            boot_cpu.vendor, boot_cpu.family, boot_cpu.model,
+            cpu_has(X86_FEATURE_XSAVEOPT) ? "XSAVEOPT" :
+            cpu_has(X86_FEATURE_XSAVE) ? "XSAVE" : "FXSAVE",
+            fpu_state_size(), string_impl_name());
+
+    if (bootinfo_parse(boot_info) != 0) {
+        panic("boot info at %p is not a valid v%u block", boot_info,
+              BOOTINFO_VERSION);
+    }
+    print_boot_summary(entry_tsc);
+
+    pmm_init();
+    kprintf("Memory: %llu of %llu MiB free\n",
+            (unsigned long long)(pmm_free_count() >> 8),
+            (unsigned long long)(pmm_total_count() >> 8));
+
+    // Time, calibrated against the HPET when ACPI has one
+    if (acpi_init() < 0) kprintf("ACPI: no usable RSDP\n");
+    hpet_init();
+    const char *tsc_source = tsc_init();
+    const char *clock_source = clock_init();
+    kprintf("Clock: %s, TSC %llu kHz (%s), now_ns() %llu cycles\n",
+            clock_source, (unsigned long long)tsc_khz, tsc_source,
+            (unsigned long long)clock_read_cycles());
+
+    // Devices
+    apic_init();
+    kprintf("Idle: %s\n", idle_init());
+    numa_init();
+    pmm_numa_init();
+    print_numa();
+    kprintf("SMP: %u CPUs online\n", smp_init());
+
+    // The rest, in dependency order on every CPU (boot/initcall.h)
+    initcall_run_all();
+    clock_refine();                     // Last, for the longest baseline
+    print_boot_times(entry_tsc, rdtsc());
+    print_boot_history();
+
+    if (cmdline_has("blkbench") && blk_count()) blk_bench(blk_get(0));
+    if (cmdline_has("bcachebench") && blk_count()) bcache_bench(blk_get(0));
+    if (cmdline_has("tmpfsbench")) tmpfs_bench();
+    if (cmdline_has("zpoolbench")) zpool_bench();
+    if (cmdline_has("numabench")) numa_bench();
+    if (cmdline_has("syscallbench")) syscall_bench();
+    if (cmdline_has("idlebench")) idle_bench();
+    char exec[64];
+    if (cmdline_get("exec", exec, sizeof(exec))) run_exec(exec);
+    if (cmdline_has("ipcbench")) ipc_bench();
+    if (cmdline_has("aiobench")) aio_bench();
+    char kexec[64];
+    if (cmdline_get("kexec", kexec, sizeof(kexec))) kexec_run(kexec);
+
+    const struct FramebufferInfo *fb = g_boot.framebuffer;
+    if (!fb) goto halt;
+    if (cmdline_has("rasterbench")) raster_bench(fb);
+
+    draw_screen(fb);
+
+halt:
+    qemu_exit_if_requested();
+
+    // Idle forever, keeping the zeroed page pool topped up
+    while (1) {
+        __asm__ volatile("sti" ::: "memory");
+        uint32_t zeroed = zpool_refill(16);
+        __asm__ volatile("cli" ::: "memory");
+        if (!zeroed) idle_enter();
+    }
+}
+
+//=============================================================================
+// Boot Summary
+//=============================================================================
+
+static void print_boot_summary(uint64_t entry_tsc) {
+    static const char *const stage_names[BOOT_TS_COUNT] = {
+        "loader entry", "graphics", "kernel loaded", "modules loaded",
+        "memory map", "exit boot services", "kernel wait", "var store",
+    };
+
+    uint64_t usable = 0;
+    for (uint32_t i = 0; i < g_boot.memory_map_count; i++) {
+        if (g_boot.memory_map[i].type == MEMORY_TYPE_USABLE) {
+            usable += g_boot.memory_map[i].length;
+        }
+    }
+    kprintf("Boot info: %u bytes, %u memory regions (%llu MiB usable), "
+            "%u modules, %u unknown tags\n",
+            g_boot.header->total_size, g_boot.memory_map_count,
+            (unsigned long long)(usable >> 20), g_boot.module_count,
+            g_boot.unknown_tags);
+    if (g_boot.kernel) {
+        kprintf("  kernel @ %#llx, %llu KiB reserved, entry %#llx\n",
+                (unsigned long long)g_boot.kernel->base,
+                (unsigned long long)(g_boot.kernel->size >> 10),
+                (unsigned long long)g_boot.kernel->entry);
+    }
+
+    for (const struct BootTagModule *m = bootinfo_next_module(NULL); m;
+         m = bootinfo_next_module(m)) {
+        kprintf("  module %s @ %#llx, %llu bytes\n", m->name,
+                (unsigned long long)m->base, (unsigned long long)m->size);
+    }
+    if (g_boot.kexec) {
+        kprintf("  started by kexec, generation %u\n", g_boot.kexec->generation);
+    }
+    if (g_boot.cmdline[0]) kprintf("  cmdline: %s\n", g_boot.cmdline);
+    if (g_boot.rsdp) {
+        kprintf("  RSDP @ %#llx (revision %u)\n",
+                (unsigned long long)g_boot.rsdp, g_boot.rsdp_revision);
+    }
+
+    // Cycles spent in each stage, measured from the loader's first reading.
+    // Stages overlap (the kernel read runs behind the others), so list
+    // them in the order they were reached rather than by number.
+    uint64_t start = bootinfo_timestamp(BOOT_TS_LOADER_ENTRY);
+    if (!start) return;
+    uint32_t order[BOOT_TS_COUNT], n = 0;
+    for (uint32_t i = 1; i < BOOT_TS_COUNT; i++) {
+        uint64_t ts = bootinfo_timestamp(i);
+        if (!ts) continue;
+        uint32_t j = n++;
+        for (; j > 0 && bootinfo_timestamp(order[j - 1]) > ts; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        kprintf("  %-20s +%llu cycles\n", stage_names[order[i]],
+                (unsigned long long)(bootinfo_timestamp(order[i]) - start));
+    }
+    kprintf("  %-20s +%llu cycles\n", "kernel entry",
+            (unsigned long long)(entry_tsc - start));
+}
+
+// One line for tools/bootstats, in microseconds. The TSC starts at 0 on
+// reset, so the loader's first reading is the time spent in firmware.
+// The kernel read overlaps loader setup; kernel_wait is only the part of
+// it the loader had to wait for, and var_store is writing the boot
+// history variable.
+//
+// After a kexec there is no firmware or loader: the stages are the
+// handoff, from the previous kernel deciding to reboot to our entry, and
+// our own initialisation.
+static void print_boot_times(uint64_t entry_tsc, uint64_t ready_tsc) {
+    if (g_boot.kexec) {
+        uint64_t start = g_boot.kexec->start_tsc;
+        kprintf("boottime: kexec=%llu kernel_init=%llu total=%llu\n",
+                (unsigned long long)(tsc_to_ns(entry_tsc - start) / 1000),
+                (unsigned long long)(tsc_to_ns(ready_tsc - entry_tsc) / 1000),
+                (unsigned long long)(tsc_to_ns(ready_tsc - start) / 1000));
+        return;
+    }
+
+    uint64_t ts[BOOT_TS_COUNT];
+    for (uint32_t i = 0; i < BOOT_TS_COUNT; i++) ts[i] = bootinfo_timestamp(i);
+    // Loaders from before the boot history have no such stage
+    if (!ts[BOOT_TS_VAR_STORE]) ts[BOOT_TS_VAR_STORE] = ts[BOOT_TS_KERNEL_LOADED];
+    for (uint32_t i = 0; i < BOOT_TS_COUNT; i++) {
+        if (!ts[i]) return;
+    }
+
+    struct { const char *name; uint64_t from, to; } spans[] = {
+        { "firmware",    0,                                ts[BOOT_TS_LOADER_ENTRY] },
+        { "loader",      ts[BOOT_TS_LOADER_ENTRY],         ts[BOOT_TS_KERNEL_WAIT] },
+        { "kernel_wait", ts[BOOT_TS_KERNEL_WAIT],          ts[BOOT_TS_KERNEL_LOADED] },
+        { "var_store",   ts[BOOT_TS_KERNEL_LOADED],        ts[BOOT_TS_VAR_STORE] },
+        { "memory_map",  ts[BOOT_TS_VAR_STORE],            ts[BOOT_TS_MEMORY_MAP] },
+        { "exit_bs",     ts[BOOT_TS_MEMORY_MAP],           ts[BOOT_TS_EXIT_BOOT_SERVICES] },
+        { "handoff",     ts[BOOT_TS_EXIT_BOOT_SERVICES],   entry_tsc },
+        { "kernel_init", entry_tsc,                        ready_tsc },
+        { "total",       0,                                ready_tsc },
+    };
+    kprintf("boottime:");
+    for (uint32_t i = 0; i < sizeof(spans) / sizeof(spans[0]); i++) {
+        uint64_t d = spans[i].to > spans[i].from ? spans[i].to - spans[i].from : 0;
+        kprintf(" %s=%llu", spans[i].name, (unsigned long long)(tsc_to_ns(d) / 1000));
+    }
+    kprintf("\n");
+}
+
+// The spans of print_boot_times() that every boot history record has.
+// Returns -1 if the readings are out of order (a reset TSC, say).
+static int history_spans(const uint64_t *ts, int64_t us[3]) {
+    uint64_t entry = ts[BOOT_TS_LOADER_ENTRY], wait = ts[BOOT_TS_KERNEL_WAIT];
+    uint64_t loaded = ts[BOOT_TS_KERNEL_LOADED];
+    if (!entry || wait < entry || loaded < wait) return -1;
+    us[0] = tsc_to_ns(entry) / 1000;
+    us[1] = tsc_to_ns(wait - entry) / 1000;
+    us[2] = tsc_to_ns(loaded - wait) / 1000;
+    return 0;
+}
+
+// This boot against the previous one from the loader's boot history, in
+// microseconds: a firmware or boot setting change shows up here without
+// having to keep the logs. Older ticks are converted at this boot's TSC
+// rate. "boothistory" on the command line lists every record.
+static void print_boot_history(void) {
+    static const char *const names[3] = { "firmware", "loader", "kernel_wait" };
+    uint32_t n = g_boot.history_count;
+    if (!n || g_boot.kexec) return;
+
+    uint64_t ts[BOOT_TS_COUNT];
+    for (uint32_t i = 0; i < BOOT_TS_COUNT; i++) ts[i] = bootinfo_timestamp(i);
+    const struct BootHistoryRecord *prev = &g_boot.history[n - 1];
+    int64_t now[3], then[3];
+    if (history_spans(ts, now) == 0 && history_spans(prev->tsc, then) == 0) {
+        kprintf("boothistory: previous=%u", prev->seq);
+        for (uint32_t i = 0; i < 3; i++) {
+            int64_t d = now[i] - then[i];
+            kprintf(" %s=%s%llu", names[i], d < 0 ? "-" : "+",
+                    (unsigned long long)(d < 0 ? -d : d));
+        }
+        kprintf("\n");
+    }
+
+    if (!cmdline_has("boothistory")) return;
+    for (uint32_t r = 0; r < n; r++) {
+        const struct BootHistoryRecord *h = &g_boot.history[r];
+        if (history_spans(h->tsc, then) < 0) continue;
+        kprintf("  boot %u: firmware %lld us, loader %lld us, kernel wait %lld us\n",
+                h->seq, (long long)then[0], (long long)then[1], (long long)then[2]);
+    }
+}
+
+// Nodes with their free memory and SLIT distances; silent on UMA machines
+static void print_numa(void) {
+    uint32_t nodes = numa_node_count();
+    if (nodes == 1) return;
+
+    kprintf("NUMA: %u nodes\n", nodes);
+    for (uint32_t n = 0; n < nodes; n++) {
+        kprintf("  node %u: %llu MiB free, distance", n,
+                (unsigned long long)(pmm_node_free_count(n) >> 8));
+        for (uint32_t to = 0; to < nodes; to++) kprintf(" %u", numa_distance(n, to));
+        kprintf("\n");
+    }
+}
+
+// exec=NAME: run a user program from the boot modules to completion, with
+// what demand paging did for it
+static void run_exec(const char *name) {
+    struct process *p = process_spawn(name, 0);
+    if (!p) return;
+
+    uint64_t image = p->image_size;
+    struct uvm_stats st;
+    uint64_t start = rdtsc();
+    int64_t code = process_wait(p, &st);
+    uint64_t elapsed = rdtsc() - start;
+
+    kprintf("exec: %s exited with %lld after %llu us\n", name, (long long)code,
+            (unsigned long long)(tsc_to_ns(elapsed) / 1000));
+    kprintf("  %llu faults, avg %llu ns, max %llu ns\n", (unsigned long long)st.faults,
+            (unsigned long long)(st.faults ? tsc_to_ns(st.fault_tsc / st.faults) : 0),
+            (unsigned long long)tsc_to_ns(st.max_fault_tsc));
+    kprintf("  file: %llu pages mapped in place, %llu copied, of a %llu KiB image\n",
+            (unsigned long long)st.file_maps, (unsigned long long)st.file_copies,
+            (unsigned long long)(image >> 10));
+    kprintf("  anon: %llu zero page maps, %llu pages allocated\n",
+            (unsigned long long)st.zero_maps, (unsigned long long)st.anon_pages);
+    kprintf("  cow:  %llu pages copied, %llu taken back without a copy\n",
+            (unsigned long long)st.cow_copies, (unsigned long long)st.cow_reuse);
+}
+
+// With "qemu_exit" on the command line, leave QEMU once we're done so
+// scripted runs finish. Needs -device isa-debug-exit,iobase=0xf4,iosize=4;
+// without it the write goes nowhere.
+static void qemu_exit_if_requested(void) {
+    if (cmdline_has("qemu_exit")) outb(0xF4, 0);    // QEMU exits with 1
+}
+
+//=============================================================================
+// Screen
+//=============================================================================
+
+static void draw_screen(const struct FramebufferInfo *fb) {
+    static struct dlist dl;
+    if (dl_init(&dl, fb->width, fb->height) != 0) return;
+    dl_begin(&dl);
+
     // Dark blue background
-    fill_screen(fb, 0x00102040);
-    
+    dl_fill(&dl, 0x00102040);
+
     // White border
     uint32_t border = 20;
     uint32_t white = 0x00FFFFFF;
-    draw_rect(fb, border, border, fb->width - 2*border, 4, white);                    // Top
-    draw_rect(fb, border, fb->height - border - 4, fb->width - 2*border, 4, white);   // Bottom
-    draw_rect(fb, border, border, 4, fb->height - 2*border, white);                   // Left
-    draw_rect(fb, fb->width - border - 4, border, 4, fb->height - 2*border, white);   // Right
-    
+    dl_rect(&dl, border, border, fb->width - 2*border, 4, white);                    // Top
+    dl_rect(&dl, border, fb->height - border - 4, fb->width - 2*border, 4, white);   // Bottom
+    dl_rect(&dl, border, border, 4, fb->height - 2*border, white);                   // Left
+    dl_rect(&dl, fb->width - border - 4, border, 4, fb->height - 2*border, white);   // Right
+
     // Green "success" rectangle in center
     uint32_t cx = fb->width / 2;
     uint32_t cy = fb->height / 2;
-    draw_rect(fb, cx - 100, cy - 50, 200, 100, 0x0000FF00);
-    
+    dl_rect(&dl, cx - 100, cy - 50, 200, 100, 0x0000FF00);
+    dl_text(&dl, cx - 7 * FONT_W / 2, cy - FONT_H / 2, "MyOS OK", 0x00000000);
+
     // Draw memory indicator bars (one green bar per usable memory region)
     uint32_t bar_x = 50;
     uint32_t bar_y = fb->height - 60;
     uint32_t bar_count = 0;
-    
-    for (uint32_t i = 0; i < boot_info->memory_map_count && bar_count < 30; i++) {
-        if (boot_info->memory_map[i].type == MEMORY_TYPE_USABLE) {
-            draw_rect(fb, bar_x + bar_count * 12, bar_y, 10, 30, 0x0000FF00);
-            bar_count++;
-        }
-    }
-    
-    // Halt forever
-    while (1) {
-        __asm__ volatile("hlt");
-    }
-}
 
-//=============================================================================
-// Simple Drawing Functions (after kernel_main)
-//=============================================================================
-
-static void draw_rect(struct FramebufferInfo *fb,
-                      uint32_t x, uint32_t y,
-                      uint32_t w, uint32_t h,
-                      uint32_t color) {
-    uint32_t *pixels = (uint32_t *)fb->base;
-    uint32_t ppsl = fb->pitch / 4;  // Pixels per scan line
-    
-    for (uint32_t row = y; row < y + h && row < fb->height; row++) {
-        for (uint32_t col = x; col < x + w && col < fb->width; col++) {
-            pixels[row * ppsl + col] = color;
+    for (uint32_t i = 0; i < g_boot.memory_map_count && bar_count < 30; i++) {
+        if (g_boot.memory_map[i].type == MEMORY_TYPE_USABLE) {
+            dl_rect(&dl, bar_x + bar_count * 12, bar_y, 10, 30, 0x0000FF00);
+            bar_count++;
         }
     }
-}
+    dl_text(&dl, bar_x, bar_y - 2 * FONT_H, "Usable memory regions", white);
 
-static void fill_screen(struct FramebufferInfo *fb, uint32_t color) {
-    draw_rect(fb, 0, 0, fb->width, fb->height, color);
+    dl_submit(&dl, fb);
+    kprintf("Display list: %u commands, %u drawn (%u hidden, %u split, %u merged), "
+            "%llu of %llu KiB written\n", dl.stats.recorded, dl.stats.drawn,
+            dl.stats.culled, dl.stats.split, dl.stats.merged,
+            (unsigned long long)(dl.stats.bytes_written >> 10),
+            (unsigned long long)(dl.stats.bytes_recorded >> 10));
 }
@@ -0,0 +1,184 @@
+// kernel/mm/numa.c
+// SRAT/SLIT parsing and node lookups
+#include "mm/numa.h"
+#include "acpi/acpi.h"
+#include "x86/percpu.h"
+
+#define MAX_NUMA_RANGES 64
+#define REMOTE_DEFAULT  20      // Distance between nodes without a SLIT
+
+static uint32_t          g_nodes = 1;
+static uint32_t          g_domain[MAX_NUMA_NODES];     // Node -> proximity domain
+static struct numa_range g_ranges[MAX_NUMA_RANGES];
+static uint32_t          g_range_count;
+static struct {
+    uint32_t apic_id;
+    uint32_t node;
+} g_cpus[MAX_CPUS];
+static uint32_t          g_cpu_count;
+static uint8_t           g_distance[MAX_NUMA_NODES][MAX_NUMA_NODES];
+static uint8_t           g_fallback[MAX_NUMA_NODES][MAX_NUMA_NODES];
+
+// Dense node number for a proximity domain, allocating one the first time
+// it is seen; the last node absorbs any beyond MAX_NUMA_NODES
+static uint32_t node_for_domain(uint32_t domain, uint32_t *count) {
+    for (uint32_t n = 0; n < *count; n++) {
+        if (g_domain[n] == domain) return n;
+    }
+    if (*count == MAX_NUMA_NODES) return MAX_NUMA_NODES - 1;
+    g_domain[*count] = domain;
+    return (*count)++;
+}
+
+static void add_cpu(uint32_t apic_id, uint32_t node) {
+    if (g_cpu_count < MAX_CPUS) {
+        g_cpus[g_cpu_count].apic_id = apic_id;
+        g_cpus[g_cpu_count].node = node;
+        g_cpu_count++;
+    }
+}
+
+static void add_range(uint64_t base, uint64_t length, uint32_t node) {
+    if (!length || g_range_count == MAX_NUMA_RANGES) return;
+
+    // Insertion sort by base; the SRAT is usually in order already
+    uint32_t i = g_range_count++;
+    while (i > 0 && g_ranges[i - 1].base > base) {
+        g_ranges[i] = g_ranges[i - 1];
+        i--;
+    }
+    g_ranges[i] = (struct numa_range){ base, base + length, node };
+}
+
+static uint32_t parse_srat(const struct acpi_srat *srat) {
+    uint32_t nodes = 0;
+    const uint8_t *p = srat->entries;
+    const uint8_t *end = (const uint8_t *)srat + srat->header.length;
+
+    while (p + 2 <= end) {
+        uint8_t type = p[0], len = p[1];
+        if (len < 2 || p + len > end) break;
+
+        if (type == SRAT_CPU_APIC && len >= sizeof(struct acpi_srat_cpu_apic)) {
+            const struct acpi_srat_cpu_apic *c = (const void *)p;
+            uint32_t domain = c->domain_lo | (uint32_t)c->domain_hi[0] << 8 |
+                              (uint32_t)c->domain_hi[1] << 16 |
+                              (uint32_t)c->domain_hi[2] << 24;
+            if (c->flags & SRAT_ENABLED) add_cpu(c->apic_id, node_for_domain(domain, &nodes));
+        } else if (type == SRAT_CPU_X2APIC && len >= sizeof(struct acpi_srat_cpu_x2apic)) {
+            const struct acpi_srat_cpu_x2apic *c = (const void *)p;
+            if (c->flags & SRAT_ENABLED) {
+                add_cpu(c->x2apic_id, node_for_domain(c->domain, &nodes));
+            }
+        } else if (type == SRAT_MEMORY && len >= sizeof(struct acpi_srat_memory)) {
+            const struct acpi_srat_memory *m = (const void *)p;
+            // Hot-pluggable ranges that aren't populated yet are still
+            // listed as enabled; they simply never appear as usable RAM
+            if (m->flags & SRAT_ENABLED) {
+                add_range(m->base, m->length_bytes, node_for_domain(m->domain, &nodes));
+            }
+        }
+        p += len;
+    }
+    return nodes;
+}
+
+static void parse_slit(const struct acpi_slit *slit) {
+    uint64_t count = slit->count;
+    if (sizeof(*slit) + count * count > slit->header.length) return;
+
+    for (uint32_t a = 0; a < g_nodes; a++) {
+        for (uint32_t b = 0; b < g_nodes; b++) {
+            if (g_domain[a] >= count || g_domain[b] >= count) continue;
+            uint8_t d = slit->distance[g_domain[a] * count + g_domain[b]];
+            // 0xFF means unreachable; below 10 is invalid
+            if (d >= NUMA_LOCAL && d != 0xFF) g_distance[a][b] = d;
+        }
+    }
+}
+
+// Sort key: the node itself first, then by distance, ties by number
+static uint32_t fallback_key(uint32_t from, uint32_t n) {
+    return (n == from ? 0 : g_distance[from][n]) * MAX_NUMA_NODES + n;
+}
+
+// Per node, every node nearest first (insertion sort, at most 8 entries)
+static void build_fallback(void) {
+    for (uint32_t from = 0; from < g_nodes; from++) {
+        uint8_t *order = g_fallback[from];
+        for (uint32_t i = 0; i < g_nodes; i++) {
+            uint32_t j = i;
+            while (j > 0 && fallback_key(from, order[j - 1]) > fallback_key(from, i)) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = i;
+        }
+    }
+}
+
+void numa_init(void) {
+    const struct acpi_srat *srat = (const void *)acpi_find_table("SRAT", 0);
+    uint32_t nodes = srat ? parse_srat(srat) : 0;
+
+    if (nodes == 0 || g_range_count == 0) {
+        // No usable topology: one node, whatever the CPUs claimed
+        g_nodes = 1;
+        g_cpu_count = 0;
+        g_range_count = 0;
+    } else {
+        g_nodes = nodes;
+    }
+
+    for (uint32_t a = 0; a < g_nodes; a++) {
+        for (uint32_t b = 0; b < g_nodes; b++) {
+            g_distance[a][b] = a == b ? NUMA_LOCAL : REMOTE_DEFAULT;
+        }
+    }
+    const struct acpi_slit *slit = (const void *)acpi_find_table("SLIT", 0);
+    if (slit && g_nodes > 1) parse_slit(slit);
+    build_fallback();
+
+    numa_cpu_init();
+}
+
+void numa_cpu_init(void) {
+    struct percpu *pc = this_cpu();
+    pc->node = numa_node_of_apic(pc->apic_id);
+}
+
+//=============================================================================
+// Queries
+//=============================================================================
+
+uint32_t numa_node_count(void) {
+    return g_nodes;
+}
+
+uint32_t numa_node_of_addr(uint64_t phys) {
+    for (uint32_t i = 0; i < g_range_count; i++) {
+        if (phys >= g_ranges[i].base && phys < g_ranges[i].end) return g_ranges[i].node;
+    }
+    return 0;
+}
+
+uint32_t numa_node_of_apic(uint32_t apic_id) {
+    for (uint32_t i = 0; i < g_cpu_count; i++) {
+        if (g_cpus[i].apic_id == apic_id) return g_cpus[i].node;
+    }
+    return 0;
+}
+
+uint32_t numa_distance(uint32_t from, uint32_t to) {
+    if (from >= g_nodes || to >= g_nodes) return REMOTE_DEFAULT;
+    return g_distance[from][to];
+}
+
+const uint8_t *numa_fallback(uint32_t node) {
+    return g_fallback[node < g_nodes ? node : 0];
+}
+
+uint32_t numa_ranges(const struct numa_range **ranges) {
+    *ranges = g_ranges;
+    return g_range_count;
+}
@@ -0,0 +1,41 @@
+// kernel/mm/numa.h
+// NUMA topology from the ACPI SRAT and SLIT
+//
+// Proximity domains are renumbered into dense node numbers 0..n-1 in the
+// order the SRAT first mentions them. Without an SRAT (or with one that
+// lists no usable memory) there is a single node 0 holding everything.
+// Memory the SRAT doesn't cover is counted as node 0.
+#pragma once
+
+#include <stdint.h>
+
+#define MAX_NUMA_NODES  8
+#define NUMA_LOCAL      10      // SLIT distance of a node to itself
+
+// Parse SRAT and SLIT and set this CPU's node. Call after acpi_init() and
+// apic_init(); before, every query answers node 0.
+void numa_init(void);
+
+// Record the calling CPU's node in its per-CPU data; APs call this after
+// apic_init()
+void numa_cpu_init(void);
+
+uint32_t numa_node_count(void);
+uint32_t numa_node_of_addr(uint64_t phys);
+uint32_t numa_node_of_apic(uint32_t apic_id);
+
+// SLIT distance, NUMA_LOCAL for from == to. Without a SLIT, 20 between
+// different nodes.
+uint32_t numa_distance(uint32_t from, uint32_t to);
+
+// All nodes, nearest to `node` first (`node` itself leads). numa_node_count()
+// entries.
+const uint8_t *numa_fallback(uint32_t node);
+
+// The SRAT's memory ranges, sorted by address, for the page allocator
+struct numa_range {
+    uint64_t base;
+    uint64_t end;
+    uint32_t node;
+};
+uint32_t numa_ranges(const struct numa_range **ranges);
@@ -0,0 +1,110 @@
+// kernel/mm/numa_bench.c
+// Memory bandwidth from each node's CPUs to each node's memory
+#include "mm/numa_bench.h"
+#include "boot/cmdline.h"
+#include "lib/printk.h"
+#include "lib/string.h"
+#include "mm/numa.h"
+#include "mm/pmm.h"
+#include "x86/cpu.h"
+#include "x86/percpu.h"
+#include "x86/smp.h"
+#include "x86/tsc.h"
+
+struct job {
+    uint32_t cpu;               // The one CPU that runs it
+    uint8_t *buf;
+    uint64_t bytes;
+    uint32_t reps;
+    uint64_t read_tsc;          // Results
+    uint64_t write_tsc;
+    uint64_t sink;
+};
+
+static void record_node(void *arg, uint32_t cpu, uint32_t ncpus) {
+    (void)ncpus;
+    ((uint32_t *)arg)[cpu] = this_cpu()->node;
+}
+
+// Eight independent loads per iteration keep enough misses in flight to
+// measure the memory, not the loop
+static uint64_t read_pass(const uint64_t *p, uint64_t words) {
+    uint64_t a = 0, b = 0, c = 0, d = 0, e = 0, f = 0, g = 0, h = 0;
+    for (uint64_t i = 0; i < words; i += 8) {
+        a += p[i];     b += p[i + 1]; c += p[i + 2]; d += p[i + 3];
+        e += p[i + 4]; f += p[i + 5]; g += p[i + 6]; h += p[i + 7];
+    }
+    return a + b + c + d + e + f + g + h;
+}
+
+static void run_job(void *arg, uint32_t cpu, uint32_t ncpus) {
+    struct job *j = arg;
+    (void)ncpus;
+    if (cpu != j->cpu) return;
+
+    // One untimed pass of each to settle TLBs and page state
+    memset(j->buf, 1, j->bytes);
+    j->sink += read_pass((const uint64_t *)j->buf, j->bytes / 8);
+
+    uint64_t t0 = rdtsc();
+    for (uint32_t r = 0; r < j->reps; r++) {
+        j->sink += read_pass((const uint64_t *)j->buf, j->bytes / 8);
+    }
+    uint64_t t1 = rdtsc();
+    for (uint32_t r = 0; r < j->reps; r++) memset(j->buf, (int)r, j->bytes);
+    uint64_t t2 = rdtsc();
+
+    j->read_tsc = t1 - t0;
+    j->write_tsc = t2 - t1;
+}
+
+static uint64_t mb_per_s(uint64_t bytes, uint64_t cycles) {
+    uint64_t ns = tsc_to_ns(cycles);
+    return ns ? bytes * 1000 / ns : 0;
+}
+
+void numa_bench(void) {
+    uint32_t nodes = numa_node_count();
+    uint32_t ncpus = smp_cpu_count();
+    uint64_t mib = cmdline_get_u64("numabench.mib", 64);
+    uint32_t reps = cmdline_get_u64("numabench.reps", 4);
+    if (mib == 0) mib = 1;
+    if (reps == 0) reps = 1;
+
+    static uint32_t cpu_node[MAX_CPUS];
+    smp_run(record_node, cpu_node, ncpus);
+
+    kprintf("numabench: %u nodes, %u CPUs, %llu MiB x %u passes\n",
+            nodes, ncpus, (unsigned long long)mib, reps);
+
+    for (uint32_t cn = 0; cn < nodes; cn++) {
+        uint32_t cpu = ncpus;
+        for (uint32_t i = 0; i < ncpus && cpu == ncpus; i++) {
+            if (cpu_node[i] == cn) cpu = i;
+        }
+        if (cpu == ncpus) continue;             // Memory-only node
+
+        for (uint32_t mn = 0; mn < nodes; mn++) {
+            size_t pages = mib << (20 - PAGE_SHIFT);
+            uint64_t buf = pmm_alloc_pages_strict(pages, mn);
+            if (!buf) {
+                kprintf("  cpu node %u -> mem node %u: no %llu MiB free there\n",
+                        cn, mn, (unsigned long long)mib);
+                continue;
+            }
+
+            struct job j = { .cpu = cpu, .buf = phys_to_virt(buf),
+                             .bytes = mib << 20, .reps = reps };
+            smp_run(run_job, &j, cpu + 1);
+            pmm_free_pages(buf, pages);
+
+            uint64_t total = j.bytes * reps;
+            kprintf("  cpu node %u (cpu %u) -> mem node %u, distance %3u: "
+                    "read %6llu MB/s, write %6llu MB/s%s\n",
+                    cn, cpu, mn, numa_distance(cn, mn),
+                    (unsigned long long)mb_per_s(total, j.read_tsc),
+                    (unsigned long long)mb_per_s(total, j.write_tsc),
+                    cn == mn ? "  (local)" : "");
+        }
+    }
+}
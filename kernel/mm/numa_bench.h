@@ -0,0 +1,11 @@
+// kernel/mm/numa_bench.h
+// Memory bandwidth from each node's CPUs to each node's memory
+#pragma once
+
+// For every node with a CPU and every node with memory, allocate a buffer
+// strictly on the memory node, then stream-read and memset it from one
+// CPU of the CPU node and print MB/s next to the SLIT distance. Command
+// line knobs:
+//   numabench.mib=N    buffer size in MiB (default 64, well past the LLC)
+//   numabench.reps=N   passes per measurement (default 4)
+void numa_bench(void);
@@ -0,0 +1,421 @@
+// kernel/mm/pmm.c
+// Physical page allocator - bitmap, first fit with a rolling hint per node
+#include "mm/pmm.h"
+#include "boot/bootinfo.h"
+#include "boot/initcall.h"
+#include "lib/printk.h"
+#include "lib/spinlock.h"
+#include "lib/string.h"
+#include "mm/numa.h"
+#include "mm/vmm.h"
+#include "mm/zpool.h"
+#include "x86/percpu.h"
+
+#define LOW_MEMORY_END  0x100000ULL     // Kept for AP/kexec trampolines
+#define MAX_ZONES       130             // SRAT ranges plus the gaps between
+
+// A run of pages on one node. Zones tile [LOW_MEMORY_END, g_pages) in
+// address order, so a free run never crosses nodes.
+struct zone {
+    uint64_t start;                     // PFNs
+    uint64_t end;
+    uint32_t node;
+};
+
+// Each node's share of the bitmap works as its own free list
+struct node_free {
+    uint64_t free;
+    uint64_t hint;                      // Search starts here
+};
+
+static uint64_t        *g_bitmap;       // 1 = in use
+static uint64_t         g_pages;        // Pages covered by the bitmap
+static uint64_t         g_free;
+static uint64_t         g_total;
+static struct zone      g_zones[MAX_ZONES];
+static uint32_t         g_zone_count;
+static struct node_free g_nodes[MAX_NUMA_NODES];
+static spinlock_t       g_lock = SPINLOCK_INIT;
+
+static inline int page_used(uint64_t pfn) {
+    return (g_bitmap[pfn / 64] >> (pfn % 64)) & 1;
+}
+
+static void mark_range(uint64_t pfn, uint64_t count, int used) {
+    for (uint64_t p = pfn; p < pfn + count; p++) {
+        if (used) g_bitmap[p / 64] |= 1ULL << (p % 64);
+        else      g_bitmap[p / 64] &= ~(1ULL << (p % 64));
+    }
+}
+
+// No libgcc, and POPCNT isn't baseline x86-64
+static uint64_t popcount64(uint64_t v) {
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (v * 0x0101010101010101ULL) >> 56;
+}
+
+static uint32_t node_of_pfn(uint64_t pfn) {
+    uint32_t lo = 0, hi = g_zone_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (pfn < g_zones[mid].start) hi = mid;
+        else if (pfn >= g_zones[mid].end) lo = mid + 1;
+        else return g_zones[mid].node;
+    }
+    return 0;
+}
+
+static void add_zone(uint64_t start, uint64_t end, uint32_t node) {
+    if (end <= start) return;
+    struct zone *last = g_zone_count ? &g_zones[g_zone_count - 1] : NULL;
+    if (last && last->node == node && last->end == start) {
+        last->end = end;
+    } else if (g_zone_count < MAX_ZONES) {
+        g_zones[g_zone_count++] = (struct zone){ start, end, node };
+    } else {
+        last->end = end;                // Out of slots: lump it in
+    }
+}
+
+// Per-node free counts straight from the bitmap, after bulk changes
+static void recount_nodes(void) {
+    for (uint32_t n = 0; n < MAX_NUMA_NODES; n++) g_nodes[n].free = 0;
+    for (uint32_t z = 0; z < g_zone_count; z++) {
+        const struct zone *zn = &g_zones[z];
+        uint64_t free = 0;
+        for (uint64_t p = zn->start; p < zn->end; p++) {
+            if (p % 64 == 0 && p + 64 <= zn->end) {
+                free += 64 - popcount64(g_bitmap[p / 64]);
+                p += 63;
+            } else {
+                free += !page_used(p);
+            }
+        }
+        g_nodes[zn->node].free += free;
+    }
+}
+
+//=============================================================================
+// Setup
+//=============================================================================
+
+void pmm_init(void) {
+    const struct MemoryMapEntry *map = g_boot.memory_map;
+    uint32_t count = g_boot.memory_map_count;
+
+    // Boot services memory is added later by pmm_reclaim_boot(), so the
+    // bitmap covers it too
+    uint64_t top = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if ((map[i].type == MEMORY_TYPE_USABLE ||
+             map[i].type == MEMORY_TYPE_BOOT_RECLAIMABLE) &&
+            map[i].base + map[i].length > top) {
+            top = map[i].base + map[i].length;
+        }
+    }
+    g_pages = top >> PAGE_SHIFT;
+    uint64_t bitmap_bytes = PAGE_ALIGN_UP((g_pages + 63) / 64 * 8);
+
+    // The bitmap goes in the first usable range above 1 MiB that holds it
+    uint64_t bitmap_phys = 0;
+    for (uint32_t i = 0; i < count && !bitmap_phys; i++) {
+        uint64_t base = PAGE_ALIGN_UP(map[i].base);
+        uint64_t end = PAGE_ALIGN_DOWN(map[i].base + map[i].length);
+        if (base < LOW_MEMORY_END) base = LOW_MEMORY_END;
+        if (map[i].type == MEMORY_TYPE_USABLE && end > base &&
+            end - base >= bitmap_bytes) {
+            bitmap_phys = base;
+        }
+    }
+    if (!bitmap_phys) panic("pmm: no room for a %llu-byte bitmap",
+                            (unsigned long long)bitmap_bytes);
+
+    g_bitmap = phys_to_virt(bitmap_phys);
+    memset(g_bitmap, 0xFF, bitmap_bytes);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (map[i].type != MEMORY_TYPE_USABLE) continue;
+        uint64_t base = PAGE_ALIGN_UP(map[i].base);
+        uint64_t end = PAGE_ALIGN_DOWN(map[i].base + map[i].length);
+        if (base < LOW_MEMORY_END) base = LOW_MEMORY_END;
+        if (end <= base) continue;
+        mark_range(base >> PAGE_SHIFT, (end - base) >> PAGE_SHIFT, 0);
+        g_free += (end - base) >> PAGE_SHIFT;
+    }
+    mark_range(bitmap_phys >> PAGE_SHIFT, bitmap_bytes >> PAGE_SHIFT, 1);
+    g_free -= bitmap_bytes >> PAGE_SHIFT;
+    g_total = g_free;
+
+    // One node until pmm_numa_init() says otherwise
+    add_zone(LOW_MEMORY_END >> PAGE_SHIFT, g_pages, 0);
+    g_nodes[0].hint = LOW_MEMORY_END >> PAGE_SHIFT;
+    recount_nodes();
+}
+
+void pmm_numa_init(void) {
+    const struct numa_range *ranges;
+    uint32_t count = numa_ranges(&ranges);
+    uint64_t low = LOW_MEMORY_END >> PAGE_SHIFT;
+    if (count == 0) return;
+
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    g_zone_count = 0;
+    uint64_t next = low;
+    for (uint32_t i = 0; i < count && next < g_pages; i++) {
+        uint64_t start = PAGE_ALIGN_UP(ranges[i].base) >> PAGE_SHIFT;
+        uint64_t end = PAGE_ALIGN_DOWN(ranges[i].end) >> PAGE_SHIFT;
+        if (start < next) start = next;
+        if (end > g_pages) end = g_pages;
+        if (end <= start) continue;
+        add_zone(next, start, 0);               // Not in the SRAT
+        add_zone(start, end, ranges[i].node);
+        next = end;
+    }
+    add_zone(next, g_pages, 0);
+
+    for (uint32_t n = 0; n < MAX_NUMA_NODES; n++) g_nodes[n].hint = 0;
+    for (uint32_t z = g_zone_count; z-- > 0; ) g_nodes[g_zones[z].node].hint = g_zones[z].start;
+    recount_nodes();
+    spin_unlock_irqrestore(&g_lock, flags);
+}
+
+//=============================================================================
+// Boot Services Reclamation
+// The kernel still runs on the firmware's page tables (under a top level
+// of its own, see mm/vmm.h) and the BSP on the firmware's stack, both
+// somewhere in boot services memory. Everything else there is garbage the
+// allocator can have.
+//=============================================================================
+
+static int reclaimable(uint64_t phys) {
+    for (uint32_t i = 0; i < g_boot.memory_map_count; i++) {
+        const struct MemoryMapEntry *e = &g_boot.memory_map[i];
+        if (e->type == MEMORY_TYPE_BOOT_RECLAIMABLE &&
+            phys >= e->base && phys - e->base < e->length) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Take back a page reclaim just freed; returns 1 if it had
+static uint64_t keep_page(uint64_t phys) {
+    uint64_t pfn = phys >> PAGE_SHIFT;
+    if (pfn >= g_pages || page_used(pfn) || !reclaimable(phys)) return 0;
+    mark_range(pfn, 1, 1);
+    g_free--;
+    return 1;
+}
+
+// Every table page reachable from `table`, which is at `level` (1 = PT)
+static uint64_t keep_tables(uint64_t table, int level) {
+    uint64_t kept = keep_page(table);
+    if (level == 1) return kept;
+
+    const uint64_t *e = phys_to_virt(table);
+    for (int i = 0; i < 512; i++) {
+        if (!(e[i] & PTE_PRESENT)) continue;
+        if (level <= 3 && (e[i] & PTE_LARGE)) continue;     // 1 GiB / 2 MiB page
+        kept += keep_tables(e[i] & PTE_ADDR_MASK, level - 1);
+    }
+    return kept;
+}
+
+// The firmware allocation holding our stack: its raw descriptor if the
+// loader passed the EFI map, else the whole merged range
+static void stack_range(uint64_t sp, uint64_t *base, uint64_t *end) {
+    const struct BootTagEfiMemoryMap *raw = g_boot.efi_memory_map;
+    *base = *end = 0;
+    if (raw) {
+        uint32_t n = (raw->tag.size - sizeof(*raw)) / raw->desc_size;
+        for (uint32_t i = 0; i < n; i++) {
+            const struct EfiMemoryDescriptor *d =
+                (const void *)(raw->descriptors + (uint64_t)i * raw->desc_size);
+            if (sp >= d->phys_start && sp - d->phys_start < d->pages * PAGE_SIZE) {
+                *base = d->phys_start;
+                *end = d->phys_start + d->pages * PAGE_SIZE;
+                return;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < g_boot.memory_map_count; i++) {
+        const struct MemoryMapEntry *e = &g_boot.memory_map[i];
+        if (sp >= e->base && sp - e->base < e->length) {
+            *base = PAGE_ALIGN_DOWN(e->base);
+            *end = PAGE_ALIGN_UP(e->base + e->length);
+            return;
+        }
+    }
+}
+
+uint64_t pmm_reclaim_boot(void) {
+    uint64_t sp;
+    __asm__ volatile("mov %%rsp, %0" : "=r"(sp));
+    uint64_t stack_base, stack_end;
+    stack_range(sp, &stack_base, &stack_end);
+
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    uint64_t before = g_free;
+    for (uint32_t i = 0; i < g_boot.memory_map_count; i++) {
+        const struct MemoryMapEntry *e = &g_boot.memory_map[i];
+        if (e->type != MEMORY_TYPE_BOOT_RECLAIMABLE) continue;
+        uint64_t base = PAGE_ALIGN_UP(e->base);
+        uint64_t end = PAGE_ALIGN_DOWN(e->base + e->length);
+        if (base < LOW_MEMORY_END) base = LOW_MEMORY_END;
+
+        for (uint64_t p = base; p < end; p += PAGE_SIZE) {
+            if (p >= stack_base && p < stack_end) continue;
+            uint64_t pfn = p >> PAGE_SHIFT;
+            if (pfn < g_pages && page_used(pfn)) {
+                mark_range(pfn, 1, 0);
+                g_free++;
+            }
+        }
+    }
+
+    int levels = (read_cr4() & CR4_LA57) ? 5 : 4;
+    keep_tables(read_cr3() & PTE_ADDR_MASK, levels);
+
+    uint64_t reclaimed = g_free - before;
+    g_total += reclaimed;
+    recount_nodes();
+    spin_unlock_irqrestore(&g_lock, flags);
+    return reclaimed;
+}
+
+// Once every CPU runs on vmm_init()'s tables; the stack kept is the one
+// we are on, so this has to be the BSP
+static void reclaim_initcall(void) {
+    uint64_t reclaimed = pmm_reclaim_boot();
+    kprintf("Memory: reclaimed %llu MiB of boot services memory, %llu MiB free\n",
+            (unsigned long long)(reclaimed >> 8),
+            (unsigned long long)(pmm_free_count() >> 8));
+}
+INITCALL(reclaim, reclaim_initcall, "vmm", INIT_BSP);
+
+//=============================================================================
+// Allocation
+//=============================================================================
+
+// First fit for a run of `count` free pages in [from, to)
+static uint64_t find_run(uint64_t from, uint64_t to, size_t count) {
+    uint64_t run = 0;
+    for (uint64_t p = from; p < to; p++) {
+        // Skip fully used words quickly
+        if (run == 0 && p % 64 == 0 && g_bitmap[p / 64] == ~0ULL) {
+            p += 63;
+            continue;
+        }
+        if (page_used(p)) {
+            run = 0;
+        } else if (++run == count) {
+            return p + 1 - count;
+        }
+    }
+    return 0;
+}
+
+// First fit within one node: from its hint to the end of its memory, then
+// from the start
+static uint64_t node_alloc(uint32_t node, size_t count) {
+    struct node_free *n = &g_nodes[node];
+    if (n->free < count) return 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t z = 0; z < g_zone_count; z++) {
+            const struct zone *zn = &g_zones[z];
+            if (zn->node != node) continue;
+            uint64_t from = zn->start;
+            if (pass == 0) {
+                if (zn->end <= n->hint) continue;
+                if (from < n->hint) from = n->hint;
+            }
+            uint64_t pfn = find_run(from, zn->end, count);
+            if (pfn) {
+                mark_range(pfn, count, 1);
+                n->free -= count;
+                n->hint = pfn + count;
+                g_free -= count;
+                return pfn;
+            }
+        }
+    }
+    return 0;
+}
+
+static uint64_t alloc_pages(size_t count, uint32_t node, int fallback) {
+    if (count == 0) return 0;
+    if (node >= numa_node_count()) node = 0;
+
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    uint64_t pfn = 0;
+    if (g_free >= count) {
+        const uint8_t *order = numa_fallback(node);
+        uint32_t tries = fallback ? numa_node_count() : 1;
+        for (uint32_t i = 0; i < tries && !pfn; i++) pfn = node_alloc(order[i], count);
+    }
+    spin_unlock_irqrestore(&g_lock, flags);
+
+    return pfn << PAGE_SHIFT;
+}
+
+uint64_t pmm_alloc_pages(size_t count) {
+    return alloc_pages(count, this_cpu()->node, 1);
+}
+
+uint64_t pmm_alloc_pages_node(size_t count, uint32_t node) {
+    return alloc_pages(count, node, 1);
+}
+
+uint64_t pmm_alloc_pages_strict(size_t count, uint32_t node) {
+    return alloc_pages(count, node, 0);
+}
+
+void pmm_free_pages(uint64_t phys, size_t count) {
+    uint64_t pfn = phys >> PAGE_SHIFT;
+
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    for (uint64_t p = pfn; p < pfn + count; p++) {
+        if (p >= g_pages || !page_used(p)) panic("pmm: bad free of page %#llx",
+                                                 (unsigned long long)p << PAGE_SHIFT);
+    }
+    mark_range(pfn, count, 0);
+    g_free += count;
+    // Runs never cross zones, so the first page tells the node
+    struct node_free *n = &g_nodes[node_of_pfn(pfn)];
+    n->free += count;
+    if (pfn < n->hint) n->hint = pfn;
+    spin_unlock_irqrestore(&g_lock, flags);
+}
+
+void *pmm_alloc_zeroed(size_t count) {
+    // Single pages usually come ready-zeroed from the idle CPUs
+    if (count == 1) {
+        uint64_t page = zpool_get();
+        if (page) return phys_to_virt(page);
+    }
+
+    uint64_t phys = pmm_alloc_pages(count);
+    if (!phys) return NULL;
+    void *p = phys_to_virt(phys);
+    memset(p, 0, count * PAGE_SIZE);
+    return p;
+}
+
+uint64_t pmm_free_count(void) {
+    return g_free;
+}
+
+uint64_t pmm_total_count(void) {
+    return g_total;
+}
+
+uint64_t pmm_page_limit(void) {
+    return g_pages;
+}
+
+uint64_t pmm_node_free_count(uint32_t node) {
+    return node < MAX_NUMA_NODES ? g_nodes[node].free : 0;
+}
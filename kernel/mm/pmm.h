@@ -0,0 +1,67 @@
+// kernel/mm/pmm.h
+// Physical page allocator
+//
+// One bit per 4 KiB page up to the highest usable address. Only
+// MEMORY_TYPE_USABLE ranges from the boot memory map start out free;
+// boot services memory joins them in pmm_reclaim_boot(). The first
+// megabyte is always kept back for real-mode trampolines. On NUMA
+// machines the bitmap is cut into per-node zones, each searched with its
+// own hint, so every node's free pages work as a separate free list.
+//
+// The kernel runs on the firmware's identity mapping, so a physical
+// address is also a valid pointer.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAGE_SIZE   4096ULL
+#define PAGE_SHIFT  12
+
+#define PAGE_ALIGN_UP(x)    (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+#define PAGE_ALIGN_DOWN(x)  ((x) & ~(PAGE_SIZE - 1))
+
+static inline void *phys_to_virt(uint64_t phys) {
+    return (void *)phys;
+}
+
+static inline uint64_t virt_to_phys(const void *virt) {
+    return (uint64_t)virt;
+}
+
+// Build the bitmap from g_boot's memory map. Call after bootinfo_parse().
+void pmm_init(void);
+
+// Split the bitmap into per-node zones from the SRAT (see mm/numa.h).
+// Call after numa_init(); until then everything is node 0.
+void pmm_numa_init(void);
+
+// `count` physically contiguous pages, or 0 if none are free. Contents
+// are not cleared. Taken from the calling CPU's node if it has room, else
+// from the other nodes nearest first by SLIT distance.
+uint64_t pmm_alloc_pages(size_t count);
+void     pmm_free_pages(uint64_t phys, size_t count);
+
+// The same, starting from `node` instead of the caller's
+uint64_t pmm_alloc_pages_node(size_t count, uint32_t node);
+
+// Only from `node`: 0 if it has no room, whatever the other nodes have
+uint64_t pmm_alloc_pages_strict(size_t count, uint32_t node);
+
+// Same, returning a pointer to zeroed memory (NULL on failure). Single
+// pages come from the pre-zeroed pool when it has any (see mm/zpool.h).
+void *pmm_alloc_zeroed(size_t count);
+
+// Free the MEMORY_TYPE_BOOT_RECLAIMABLE ranges, except the page tables
+// and stack the kernel is still running on. Call once the firmware's
+// structures are no longer needed (after smp_init()). Returns the number
+// of pages added.
+uint64_t pmm_reclaim_boot(void);
+
+uint64_t pmm_free_count(void);
+uint64_t pmm_total_count(void);
+uint64_t pmm_node_free_count(uint32_t node);
+
+// One past the highest page frame number the allocator can hand out, for
+// tables indexed by page
+uint64_t pmm_page_limit(void);
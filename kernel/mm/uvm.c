@@ -0,0 +1,374 @@
+// kernel/mm/uvm.c
+// User address spaces: regions, demand paging and copy-on-write
+#include "mm/uvm.h"
+#include "lib/printk.h"
+#include "lib/spinlock.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "x86/cpu.h"
+
+// #PF error code bits
+#define PF_PRESENT      (1u << 0)
+#define PF_WRITE        (1u << 1)
+#define PF_USER         (1u << 2)
+
+//=============================================================================
+// Page References
+// One counter per page frame, set up by the first uvm_create(). A page is
+// the uvm's to free only while its counter is nonzero; file pages and the
+// zero page stay at 0 and are never touched.
+//=============================================================================
+
+static uint32_t  *g_refs;
+static uint64_t   g_ref_pages;
+static uint64_t   g_zero_page;
+static spinlock_t g_init_lock = SPINLOCK_INIT;
+
+static int refs_init(void) {
+    if (__atomic_load_n(&g_refs, __ATOMIC_ACQUIRE)) return 0;
+
+    spin_lock(&g_init_lock);
+    if (!g_refs) {
+        uint64_t pages = pmm_page_limit();
+        void *zero = pmm_alloc_zeroed(1);
+        uint32_t *refs = pmm_alloc_zeroed(PAGE_ALIGN_UP(pages * sizeof(uint32_t)) >> PAGE_SHIFT);
+        if (zero && refs) {
+            g_zero_page = virt_to_phys(zero);
+            g_ref_pages = pages;
+            __atomic_store_n(&g_refs, refs, __ATOMIC_RELEASE);
+        } else {
+            if (zero) pmm_free_pages(virt_to_phys(zero), 1);
+            if (refs) pmm_free_pages(virt_to_phys(refs),
+                                     PAGE_ALIGN_UP(pages * sizeof(uint32_t)) >> PAGE_SHIFT);
+        }
+    }
+    spin_unlock(&g_init_lock);
+    return g_refs ? 0 : -1;
+}
+
+static uint32_t *ref_of(uint64_t phys) {
+    uint64_t pfn = phys >> PAGE_SHIFT;
+    return pfn < g_ref_pages ? &g_refs[pfn] : NULL;
+}
+
+static int page_managed(uint64_t phys) {
+    uint32_t *r = ref_of(phys);
+    return r && __atomic_load_n(r, __ATOMIC_RELAXED) != 0;
+}
+
+// A new page owned by the caller: zeroed, counter at 1. 0 if out of memory.
+static uint64_t page_new(void) {
+    void *page = pmm_alloc_zeroed(1);
+    if (!page) return 0;
+    uint64_t phys = virt_to_phys(page);
+    __atomic_store_n(ref_of(phys), 1, __ATOMIC_RELAXED);
+    return phys;
+}
+
+static void page_get(uint64_t phys) {
+    if (page_managed(phys)) __atomic_add_fetch(ref_of(phys), 1, __ATOMIC_RELAXED);
+}
+
+static void page_put(uint64_t phys) {
+    if (page_managed(phys) && __atomic_sub_fetch(ref_of(phys), 1, __ATOMIC_ACQ_REL) == 0) {
+        pmm_free_pages(phys, 1);
+    }
+}
+
+//=============================================================================
+// Regions
+//=============================================================================
+
+int uvm_create(struct uvm *u) {
+    memset(u, 0, sizeof(*u));
+    if (refs_init() < 0) return -1;
+    return vmm_space_create(&u->vm);
+}
+
+void uvm_destroy(struct uvm *u) {
+    for (uint32_t i = 0; i < u->nregions; i++) {
+        const struct uvm_region *r = &u->regions[i];
+        for (uint64_t va = r->start; va < r->end; va += PAGE_SIZE) {
+            uint64_t phys = vmm_unmap(&u->vm, va);
+            if (phys) page_put(phys);
+        }
+    }
+    vmm_space_destroy(&u->vm);
+    u->nregions = 0;
+}
+
+int uvm_add_region(struct uvm *u, uint64_t start, uint64_t end, uint32_t prot,
+                   uint64_t file, uint64_t file_size) {
+    if ((start | end) & (PAGE_SIZE - 1)) return -1;
+    if (start < USER_BASE || end > USER_MAP_TOP || start >= end) return -1;
+    if (file_size > end - start || u->nregions == UVM_MAX_REGIONS) return -1;
+    for (uint32_t i = 0; i < u->nregions; i++) {
+        if (start < u->regions[i].end && u->regions[i].start < end) return -1;
+    }
+
+    u->regions[u->nregions++] = (struct uvm_region){
+        .start = start, .end = end, .prot = prot,
+        .file = file_size ? file : 0, .file_size = file ? file_size : 0,
+    };
+    return 0;
+}
+
+static const struct uvm_region *find_region(const struct uvm *u, uint64_t va) {
+    for (uint32_t i = 0; i < u->nregions; i++) {
+        if (va >= u->regions[i].start && va < u->regions[i].end) return &u->regions[i];
+    }
+    return NULL;
+}
+
+//=============================================================================
+// Fork
+//=============================================================================
+
+int uvm_fork(struct uvm *parent, struct uvm *child) {
+    memcpy(child->regions, parent->regions, sizeof(parent->regions));
+    child->nregions = parent->nregions;
+
+    for (uint32_t i = 0; i < parent->nregions; i++) {
+        const struct uvm_region *r = &parent->regions[i];
+        for (uint64_t va = r->start; va < r->end; va += PAGE_SIZE) {
+            uint64_t pte = vmm_lookup(&parent->vm, va);
+            if (!(pte & PTE_PRESENT)) continue;
+
+            uint64_t phys = pte & PTE_ADDR_MASK;
+            uint64_t flags = pte & (PTE_WRITE | PTE_COW | PTE_NX);
+            if ((flags & PTE_WRITE) && !(r->prot & UVM_SHARED)) {
+                // Both sides lose write access until one of them writes
+                flags = (flags & ~PTE_WRITE) | PTE_COW;
+                vmm_map(&parent->vm, va, phys, flags);
+            }
+            if (vmm_map(&child->vm, va, phys, flags) < 0) return -1;
+            page_get(phys);
+        }
+    }
+    return 0;
+}
+
+//=============================================================================
+// Faults
+//=============================================================================
+
+static uint64_t page_flags(const struct uvm_region *r) {
+    return ((r->prot & UVM_WRITE) ? PTE_WRITE : 0) | ((r->prot & UVM_EXEC) ? 0 : PTE_NX);
+}
+
+// First touch of `va`
+static int fill(struct uvm *u, const struct uvm_region *r, uint64_t va, int write) {
+    uint64_t flags = page_flags(r);
+    uint64_t off = va - r->start;
+
+    if (off < r->file_size) {
+        uint64_t src = r->file + off;
+        if (off + PAGE_SIZE <= r->file_size && !(src & (PAGE_SIZE - 1))) {
+            // The image's own page. Never written: a writable region gets
+            // it copy-on-write.
+            if (flags & PTE_WRITE) flags = (flags & ~PTE_WRITE) | PTE_COW;
+            u->stats.file_maps++;
+            return vmm_map(&u->vm, va, src, flags);
+        }
+
+        uint64_t n = r->file_size - off < PAGE_SIZE ? r->file_size - off : PAGE_SIZE;
+        uint64_t page = page_new();
+        if (!page) return -1;
+        memcpy(phys_to_virt(page), phys_to_virt(src), n);
+        u->stats.file_copies++;
+        if (vmm_map(&u->vm, va, page, flags) < 0) {
+            page_put(page);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!write) {
+        if (flags & PTE_WRITE) flags = (flags & ~PTE_WRITE) | PTE_COW;
+        u->stats.zero_maps++;
+        return vmm_map(&u->vm, va, g_zero_page, flags);
+    }
+
+    uint64_t page = page_new();
+    if (!page) return -1;
+    u->stats.anon_pages++;
+    if (vmm_map(&u->vm, va, page, flags) < 0) {
+        page_put(page);
+        return -1;
+    }
+    return 0;
+}
+
+// Write to a PTE_COW page
+static int cow(struct uvm *u, const struct uvm_region *r, uint64_t va, uint64_t pte) {
+    uint64_t old = pte & PTE_ADDR_MASK;
+    uint64_t flags = page_flags(r);
+
+    // Nobody else maps it: take it back as it is. The count cannot rise
+    // behind our back, only a fork of this space would raise it.
+    if (page_managed(old) && __atomic_load_n(ref_of(old), __ATOMIC_ACQUIRE) == 1) {
+        u->stats.cow_reuse++;
+        return vmm_map(&u->vm, va, old, flags);
+    }
+
+    uint64_t page = page_new();
+    if (!page) return -1;
+    if (old == g_zero_page) u->stats.anon_pages++;
+    else {
+        memcpy(phys_to_virt(page), phys_to_virt(old), PAGE_SIZE);
+        u->stats.cow_copies++;
+    }
+    if (vmm_map(&u->vm, va, page, flags) < 0) {
+        page_put(page);
+        return -1;
+    }
+    page_put(old);
+    return 0;
+}
+
+int uvm_fault(struct uvm *u, uint64_t addr, uint64_t err) {
+    uint64_t start = rdtsc();
+    uint64_t va = PAGE_ALIGN_DOWN(addr);
+    int write = (err & PF_WRITE) != 0;
+
+    // Shared regions are mapped whole up front
+    const struct uvm_region *r = find_region(u, va);
+    if (!r || (r->prot & UVM_SHARED) || (write && !(r->prot & UVM_WRITE))) return -1;
+
+    int ret;
+    uint64_t pte = vmm_lookup(&u->vm, va);
+    if (!(pte & PTE_PRESENT)) ret = fill(u, r, va, write);
+    else if (write && (pte & PTE_COW)) ret = cow(u, r, va, pte);
+    else ret = -1;
+    if (ret < 0) return -1;
+
+    uint64_t cycles = rdtsc() - start;
+    u->stats.faults++;
+    u->stats.fault_tsc += cycles;
+    if (cycles > u->stats.max_fault_tsc) u->stats.max_fault_tsc = cycles;
+    return 0;
+}
+
+int uvm_user_ok(struct uvm *u, uint64_t va, uint64_t len, int write) {
+    if (va < USER_BASE || va >= USER_TOP || len > USER_TOP - va) return 0;
+
+    for (uint64_t p = PAGE_ALIGN_DOWN(va); p < va + len; p += PAGE_SIZE) {
+        uint64_t pte = vmm_lookup(&u->vm, p);
+        int ok = (pte & PTE_PRESENT) && (!write || (pte & PTE_WRITE));
+        if (!ok && uvm_fault(u, p, PF_USER | (write ? PF_WRITE : 0)) < 0) return 0;
+    }
+    return 1;
+}
+
+//=============================================================================
+// Sharing and Moving Pages
+//=============================================================================
+
+int uvm_pages_alloc(uint64_t *phys, uint32_t n) {
+    if (refs_init() < 0) return -1;
+    for (uint32_t i = 0; i < n; i++) {
+        phys[i] = page_new();
+        if (!phys[i]) {
+            uvm_pages_put(phys, i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int uvm_pages_alloc_contig(uint64_t *phys, uint32_t n) {
+    if (refs_init() < 0) return -1;
+    void *mem = pmm_alloc_zeroed(n);
+    if (!mem) return -1;
+    for (uint32_t i = 0; i < n; i++) {
+        phys[i] = virt_to_phys(mem) + (uint64_t)i * PAGE_SIZE;
+        __atomic_store_n(ref_of(phys[i]), 1, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+void uvm_pages_put(const uint64_t *phys, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) page_put(phys[i]);
+}
+
+uint64_t uvm_map_shared(struct uvm *u, uint64_t hint, const uint64_t *phys, uint32_t n) {
+    uint64_t size = (uint64_t)n * PAGE_SIZE;
+    uint64_t start = PAGE_ALIGN_UP(hint < USER_BASE ? USER_BASE : hint);
+
+    // First fit: step past every region in the way until none is
+    int moved = 1;
+    while (moved && start <= USER_MAP_TOP - size) {
+        moved = 0;
+        for (uint32_t i = 0; i < u->nregions; i++) {
+            const struct uvm_region *r = &u->regions[i];
+            if (start < r->end && r->start < start + size) {
+                start = r->end;
+                moved = 1;
+            }
+        }
+    }
+    if (!n || start > USER_MAP_TOP - size ||
+        uvm_add_region(u, start, start + size, UVM_READ | UVM_WRITE | UVM_SHARED, 0, 0) < 0) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (vmm_map(&u->vm, start + i * PAGE_SIZE, phys[i], PTE_WRITE | PTE_NX) < 0) {
+            // Unwind: the region goes, and the references taken so far
+            for (uint32_t j = 0; j < i; j++) page_put(vmm_unmap(&u->vm, start + j * PAGE_SIZE));
+            u->nregions--;
+            return 0;
+        }
+        page_get(phys[i]);
+    }
+    return start;
+}
+
+// Every page of [va, va + n pages) in one private writable region
+static const struct uvm_region *private_range(const struct uvm *u, uint64_t va, uint32_t n) {
+    const struct uvm_region *r = find_region(u, va);
+    if (!r || (va & (PAGE_SIZE - 1)) || !n) return NULL;
+    if ((r->prot & UVM_SHARED) || !(r->prot & UVM_WRITE)) return NULL;
+    if ((uint64_t)n > (r->end - va) >> PAGE_SHIFT) return NULL;
+    return r;
+}
+
+int uvm_take(struct uvm *u, uint64_t va, uint32_t n, uint64_t *phys) {
+    if (!private_range(u, va, n)) return -1;
+
+    // Faulting for write leaves every page private to this space, with a
+    // count of 1: zero and file pages are replaced by copies
+    if (!uvm_user_ok(u, va, (uint64_t)n * PAGE_SIZE, 1)) return -1;
+    for (uint32_t i = 0; i < n; i++) phys[i] = vmm_unmap(&u->vm, va + i * PAGE_SIZE);
+    return 0;
+}
+
+int uvm_give(struct uvm *u, uint64_t va, uint32_t n, const uint64_t *phys) {
+    const struct uvm_region *r = private_range(u, va, n);
+    if (!r) {
+        uvm_pages_put(phys, n);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t old = vmm_unmap(&u->vm, va + i * PAGE_SIZE);
+        if (old) page_put(old);
+        if (vmm_map(&u->vm, va + i * PAGE_SIZE, phys[i], page_flags(r)) < 0) {
+            uvm_pages_put(phys + i, n - i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void uvm_stats_add(struct uvm_stats *to, const struct uvm_stats *from) {
+    to->faults += from->faults;
+    to->file_maps += from->file_maps;
+    to->file_copies += from->file_copies;
+    to->zero_maps += from->zero_maps;
+    to->anon_pages += from->anon_pages;
+    to->cow_copies += from->cow_copies;
+    to->cow_reuse += from->cow_reuse;
+    to->fault_tsc += from->fault_tsc;
+    if (from->max_fault_tsc > to->max_fault_tsc) to->max_fault_tsc = from->max_fault_tsc;
+}
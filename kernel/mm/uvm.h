@@ -0,0 +1,111 @@
+// kernel/mm/uvm.h
+// User address spaces: regions, demand paging and copy-on-write
+//
+// A process's memory is a short list of regions, each anonymous or backed
+// by a file image already in memory (a boot module). Nothing is mapped up
+// front: the first touch of a page faults and uvm_fault() fills it in.
+// Whole, page-aligned file pages are mapped in place, so a large image
+// costs nothing until used; the partial pages at a segment's ends are
+// copied. Untouched anonymous memory reads as one shared zero page.
+//
+// fork() shares every mapped page read-only and marks the writable ones
+// PTE_COW; the first write copies the page, or takes it back writable if
+// no one else still maps it. Pages the uvm allocated carry a reference
+// count; file and zero pages are never freed.
+//
+// Shared regions (UVM_SHARED) map pages the caller hands in, eagerly and
+// writable in every space that maps them, fork children included: IPC
+// channels (proc/ipc.h). Private pages can also move between spaces
+// without a copy, see uvm_take() and uvm_give().
+#pragma once
+
+#include <stdint.h>
+#include "mm/vmm.h"
+
+#define UVM_READ        (1u << 0)
+#define UVM_WRITE       (1u << 1)
+#define UVM_EXEC        (1u << 2)
+#define UVM_SHARED      (1u << 3)   // Never copy-on-write, see uvm_map_shared()
+
+#define UVM_MAX_REGIONS 16
+
+struct uvm_region {
+    uint64_t start, end;        // Page aligned, [start, end)
+    uint32_t prot;              // UVM_*
+    uint64_t file;              // Physical address of the bytes at `start`, 0 = anonymous
+    uint64_t file_size;         // Bytes of them; the rest of the region is zero
+};
+
+struct uvm_stats {
+    uint64_t faults;            // Resolved by uvm_fault()
+    uint64_t file_maps;         // File pages mapped in place
+    uint64_t file_copies;       // Partial file pages copied
+    uint64_t zero_maps;         // Read faults given the zero page
+    uint64_t anon_pages;        // Zeroed pages allocated
+    uint64_t cow_copies;        // Shared pages copied on write
+    uint64_t cow_reuse;         // ... taken back without a copy
+    uint64_t fault_tsc;         // Cycles in uvm_fault(), total and worst
+    uint64_t max_fault_tsc;
+};
+
+struct uvm {
+    struct vm_space   vm;
+    struct uvm_region regions[UVM_MAX_REGIONS];
+    uint32_t          nregions;
+    struct uvm_stats  stats;
+};
+
+// An empty address space. Returns 0, or -1 if out of memory or the
+// machine has no user range (see vmm_user_ready()).
+int uvm_create(struct uvm *u);
+
+// Drop every page and table. `u` must not be active on any CPU.
+void uvm_destroy(struct uvm *u);
+
+// Add [start, end) (page aligned), backed by `file_size` bytes at physical
+// `file` (0 for anonymous memory). Returns 0, or -1 if the range is
+// outside the user range, overlaps a region or the table is full.
+int uvm_add_region(struct uvm *u, uint64_t start, uint64_t end, uint32_t prot,
+                   uint64_t file, uint64_t file_size);
+
+// Make `child` (fresh from uvm_create()) a copy-on-write copy of `parent`.
+// Returns 0, or -1 if out of memory, with `child` partly filled: destroy it.
+int uvm_fork(struct uvm *parent, struct uvm *child);
+
+// Resolve a page fault at `addr` with #PF error code `err`. Returns 0 if
+// the access can be retried, -1 if it is a real fault.
+int uvm_fault(struct uvm *u, uint64_t addr, uint64_t err);
+
+// Nonzero if the user may access [va, va + len) (writing, if `write`).
+// Faults every page of it in, so the kernel can then touch it directly.
+int uvm_user_ok(struct uvm *u, uint64_t va, uint64_t len, int write);
+
+// Place `n` pages (from uvm_pages_alloc()) as a new read/write shared
+// region in the first free range at or above `hint`. Takes its own
+// reference on each. Returns the address, or 0 if out of memory, address
+// space or regions.
+uint64_t uvm_map_shared(struct uvm *u, uint64_t hint, const uint64_t *phys, uint32_t n);
+
+// Unmap the `n` pages at `va` (page aligned, in a private writable region)
+// and hand them to the caller, who owns a reference on each. Pages never
+// touched come out zeroed. Returns 0, or -1 if the range is not all
+// private writable memory or memory runs out.
+int uvm_take(struct uvm *u, uint64_t va, uint32_t n, uint64_t *phys);
+
+// Map the `n` pages in place of whatever is at `va` (page aligned, in a
+// private writable region), consuming the caller's references. Returns 0,
+// or -1 if the range does not qualify (the references are then dropped).
+int uvm_give(struct uvm *u, uint64_t va, uint32_t n, const uint64_t *phys);
+
+// `n` zeroed pages with one reference each, for the caller. Returns 0, or
+// -1 with nothing allocated.
+int uvm_pages_alloc(uint64_t *phys, uint32_t n);
+
+// The same, physically contiguous, for memory a device reads and writes
+int uvm_pages_alloc_contig(uint64_t *phys, uint32_t n);
+
+// Drop a reference on each page
+void uvm_pages_put(const uint64_t *phys, uint32_t n);
+
+// Add `from`'s counters to `to`
+void uvm_stats_add(struct uvm_stats *to, const struct uvm_stats *from);
@@ -0,0 +1,217 @@
+// kernel/mm/vmm.c
+// Top-level page tables and user mappings
+#include "mm/vmm.h"
+#include "boot/initcall.h"
+#include "lib/printk.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "sched/task.h"
+#include "x86/cpu.h"
+#include "x86/smp.h"
+
+static struct vm_space g_kernel;
+static int      g_levels;               // 4, or 5 with LA57
+static uint64_t g_nx;                   // PTE_NX if EFER.NXE is on, else 0
+static int      g_user_ready;
+
+static inline uint32_t pt_index(uint64_t va, int level) {
+    return (va >> (PAGE_SHIFT + 9 * (level - 1))) & 511;
+}
+
+static inline uint64_t *table_of(uint64_t entry) {
+    return phys_to_virt(entry & PTE_ADDR_MASK);
+}
+
+// A copy of `table`, or an empty table if `table` is 0. Returns 0 when out
+// of memory.
+static uint64_t copy_table(uint64_t table) {
+    void *copy = pmm_alloc_zeroed(1);
+    if (!copy) return 0;
+    if (table) memcpy(copy, phys_to_virt(table), PAGE_SIZE);
+    return virt_to_phys(copy);
+}
+
+// The table holding the user range's top-level entries: the root itself,
+// or with five levels the PML4 under PML5 entry 0, which the whole lower
+// half shares with the identity map
+static uint64_t *user_top(uint64_t root) {
+    uint64_t *top = phys_to_virt(root & PTE_ADDR_MASK);
+    if (g_levels == 5) top = table_of(top[pt_index(USER_BASE, 5)]);
+    return top;
+}
+
+static int user_top_level(void) {
+    return g_levels == 5 ? 4 : g_levels;
+}
+
+static void load_root(void *arg, uint32_t cpu, uint32_t ncpus) {
+    (void)arg;
+    (void)cpu;
+    (void)ncpus;
+    write_cr3(g_kernel.root);
+}
+
+void vmm_init(void) {
+    uint64_t cr3 = read_cr3();
+    g_levels = (read_cr4() & CR4_LA57) ? 5 : 4;
+    g_nx = (rdmsr(MSR_EFER) & EFER_NXE) ? PTE_NX : 0;
+
+    uint64_t root = copy_table(cr3 & PTE_ADDR_MASK);
+    if (!root) panic("vmm: out of memory for the page table root");
+    if (g_levels == 5) {
+        uint64_t *e = &((uint64_t *)phys_to_virt(root))[pt_index(USER_BASE, 5)];
+        uint64_t pml4 = copy_table((*e & PTE_PRESENT) ? *e & PTE_ADDR_MASK : 0);
+        if (!pml4) panic("vmm: out of memory for the page table root");
+        *e = pml4 | ((*e & PTE_PRESENT) ? *e & ~PTE_ADDR_MASK : PTE_PRESENT | PTE_WRITE) |
+             PTE_USER;
+    }
+    g_kernel.root = root | (cr3 & ~PTE_ADDR_MASK);
+
+    const uint64_t *top = user_top(g_kernel.root);
+    int level = user_top_level();
+    g_user_ready = 1;
+    for (uint32_t i = pt_index(USER_BASE, level); i <= pt_index(USER_TOP - 1, level); i++) {
+        if (top[i] & PTE_PRESENT) g_user_ready = 0;
+    }
+    if (!g_user_ready) kprintf("vmm: firmware maps the user range, no user mode\n");
+
+    smp_run(load_root, NULL, smp_cpu_count());
+}
+INITCALL(vmm, vmm_init, "", INIT_SMP);
+
+int vmm_user_ready(void) {
+    return g_user_ready;
+}
+
+uint64_t vmm_kernel_root(void) {
+    return g_kernel.root;
+}
+
+//=============================================================================
+// Address Spaces
+//=============================================================================
+
+int vmm_space_create(struct vm_space *vm) {
+    if (!g_user_ready) return -1;
+
+    // The kernel's user range is always empty, so a copy of its top level
+    // shares everything else and nothing user
+    uint64_t root = copy_table(g_kernel.root & PTE_ADDR_MASK);
+    if (!root) return -1;
+    if (g_levels == 5) {
+        uint64_t *e = &((uint64_t *)phys_to_virt(root))[pt_index(USER_BASE, 5)];
+        uint64_t pml4 = copy_table(*e & PTE_ADDR_MASK);
+        if (!pml4) {
+            pmm_free_pages(root, 1);
+            return -1;
+        }
+        *e = pml4 | (*e & ~PTE_ADDR_MASK);
+    }
+    vm->root = root | (g_kernel.root & ~PTE_ADDR_MASK);
+    return 0;
+}
+
+// Tables below `table` (at `level`), then `table` itself
+static void free_tables(uint64_t table, int level) {
+    const uint64_t *e = phys_to_virt(table);
+    if (level > 1) {
+        for (int i = 0; i < 512; i++) {
+            if (e[i] & PTE_PRESENT) free_tables(e[i] & PTE_ADDR_MASK, level - 1);
+        }
+    }
+    pmm_free_pages(table, 1);
+}
+
+void vmm_space_destroy(struct vm_space *vm) {
+    if (!vm->root) return;
+
+    uint64_t *top = user_top(vm->root);
+    int level = user_top_level();
+    for (uint32_t i = pt_index(USER_BASE, level); i <= pt_index(USER_TOP - 1, level); i++) {
+        if (top[i] & PTE_PRESENT) free_tables(top[i] & PTE_ADDR_MASK, level - 1);
+    }
+    if (g_levels == 5) pmm_free_pages(virt_to_phys(top), 1);
+    pmm_free_pages(vm->root & PTE_ADDR_MASK, 1);
+    vm->root = 0;
+}
+
+void vmm_activate(struct vm_space *vm) {
+    uint64_t root = vm ? vm->root : g_kernel.root;
+
+    uint64_t flags = irq_save();
+    current_task()->cr3 = vm ? vm->root : 0;
+    if (read_cr3() != root) write_cr3(root);
+    irq_restore(flags);
+}
+
+//=============================================================================
+// Mappings
+//=============================================================================
+
+// The PTE for `va`, adding missing tables on the way if `create`. NULL if
+// a table is missing (or cannot be allocated) or a large page is in the way.
+static uint64_t *walk(struct vm_space *vm, uint64_t va, int create) {
+    uint64_t table = vm->root & PTE_ADDR_MASK;
+
+    for (int level = g_levels; level > 1; level--) {
+        uint64_t *e = (uint64_t *)phys_to_virt(table) + pt_index(va, level);
+        if (!(*e & PTE_PRESENT)) {
+            if (!create) return NULL;
+            void *next = pmm_alloc_zeroed(1);
+            if (!next) return NULL;
+            *e = virt_to_phys(next) | PTE_PRESENT | PTE_WRITE | PTE_USER;
+        } else if (*e & PTE_LARGE) {
+            return NULL;
+        }
+        table = *e & PTE_ADDR_MASK;
+    }
+    return (uint64_t *)phys_to_virt(table) + pt_index(va, 1);
+}
+
+static int user_page(uint64_t va) {
+    return va >= USER_BASE && va < USER_MAP_TOP && !(va & (PAGE_SIZE - 1));
+}
+
+// Only the CPU running `vm` can have its user entries cached
+static void flush(struct vm_space *vm, uint64_t va) {
+    if ((read_cr3() & PTE_ADDR_MASK) == (vm->root & PTE_ADDR_MASK)) invlpg(va);
+}
+
+int vmm_map(struct vm_space *vm, uint64_t va, uint64_t phys, uint64_t flags) {
+    if (!user_page(va)) return -1;
+
+    uint64_t *pte = walk(vm, va, 1);
+    if (!pte) return -1;
+    uint64_t old = *pte;
+    *pte = (phys & PTE_ADDR_MASK) | PTE_PRESENT | PTE_USER |
+           (flags & (PTE_WRITE | PTE_COW)) | (flags & g_nx);
+    if (old & PTE_PRESENT) flush(vm, va);
+    return 0;
+}
+
+uint64_t vmm_unmap(struct vm_space *vm, uint64_t va) {
+    if (!user_page(va)) return 0;
+
+    uint64_t *pte = walk(vm, va, 0);
+    if (!pte || !(*pte & PTE_PRESENT)) return 0;
+    uint64_t phys = *pte & PTE_ADDR_MASK;
+    *pte = 0;
+    flush(vm, va);
+    return phys;
+}
+
+uint64_t vmm_lookup(struct vm_space *vm, uint64_t va) {
+    if (va < USER_BASE || va >= USER_TOP) return 0;
+    uint64_t *pte = walk(vm, PAGE_ALIGN_DOWN(va), 0);
+    return pte ? *pte : 0;
+}
+
+int vmm_user_ok(struct vm_space *vm, uint64_t va, uint64_t len, int write) {
+    if (va < USER_BASE || va >= USER_TOP || len > USER_TOP - va) return 0;
+
+    uint64_t need = PTE_PRESENT | PTE_USER | (write ? PTE_WRITE : 0);
+    for (uint64_t p = PAGE_ALIGN_DOWN(va); p < va + len; p += PAGE_SIZE) {
+        if ((vmm_lookup(vm, p) & need) != need) return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,71 @@
+// kernel/mm/vmm.h
+// Page tables: the kernel's identity map plus per-process user halves
+//
+// The kernel keeps running on the firmware's identity map, but under a
+// top-level table of its own so it can add entries. The user range is the
+// upper half of the lower canonical half; nothing the firmware maps lands
+// there on any machine we boot on, which vmm_init() checks.
+//
+// Every address space starts as a copy of the kernel's top level with the
+// user range empty, so kernel mappings are shared and user ones are not.
+// A space belongs to one task at a time (processes are single-threaded),
+// so nothing here locks, and only the CPU running a space can hold its
+// user TLB entries: a local INVLPG is all a change needs.
+#pragma once
+
+#include <stdint.h>
+
+#define PTE_PRESENT     (1ULL << 0)
+#define PTE_WRITE       (1ULL << 1)
+#define PTE_USER        (1ULL << 2)
+#define PTE_LARGE       (1ULL << 7)     // 2 MiB / 1 GiB page in a PD / PDPT
+#define PTE_COW         (1ULL << 9)     // Software: read-only until copied
+#define PTE_NX          (1ULL << 63)
+#define PTE_ADDR_MASK   0x000FFFFFFFFFF000ULL
+
+#define USER_BASE       0x0000400000000000ULL
+#define USER_TOP        0x0000800000000000ULL
+// The page below USER_TOP is never mapped: code ending there would return
+// from SYSCALL, or fall through, to a non-canonical RIP
+#define USER_MAP_TOP    (USER_TOP - 0x1000)
+
+struct vm_space {
+    uint64_t root;                      // CR3 value
+};
+
+// Copy the firmware's top-level table and load it on every CPU. Call after
+// smp_init() and before pmm_reclaim_boot(), which keeps the tables in use.
+void vmm_init(void);
+
+// Nonzero if vmm_init() found the user range free
+int vmm_user_ready(void);
+
+// An empty user half. Returns 0, or -1 if out of memory or there is no
+// user range.
+int vmm_space_create(struct vm_space *vm);
+
+// Free the space's page tables. The pages they mapped are the caller's.
+void vmm_space_destroy(struct vm_space *vm);
+
+// Load `vm` (NULL: the kernel's tables) on this CPU for the current task;
+// the scheduler reloads it whenever the task is switched back in
+void vmm_activate(struct vm_space *vm);
+
+// Root of the kernel's own tables, for tasks without a space
+uint64_t vmm_kernel_root(void);
+
+// Map the 4 KiB page at `va` (user range, below USER_MAP_TOP) to `phys`, user
+// accessible, plus PTE_WRITE / PTE_NX / PTE_COW from `flags`. Replaces any
+// existing mapping. Returns 0, or -1 if `va` is outside the range or a
+// table cannot be allocated.
+int vmm_map(struct vm_space *vm, uint64_t va, uint64_t phys, uint64_t flags);
+
+// Remove the mapping at `va`. Returns the page it mapped, or 0.
+uint64_t vmm_unmap(struct vm_space *vm, uint64_t va);
+
+// The PTE at `va`, 0 if none
+uint64_t vmm_lookup(struct vm_space *vm, uint64_t va);
+
+// Nonzero if every page of [va, va + len) is mapped in `vm` for user
+// access (and writable, if `write`)
+int vmm_user_ok(struct vm_space *vm, uint64_t va, uint64_t len, int write);
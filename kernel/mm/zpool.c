@@ -0,0 +1,122 @@
+// kernel/mm/zpool.c
+// Pre-zeroed page pool - a locked stack of page addresses
+#include "mm/zpool.h"
+#include "boot/cmdline.h"
+#include "boot/initcall.h"
+#include "lib/spinlock.h"
+#include "mm/pmm.h"
+#include "x86/cpu.h"
+#include "x86/smp.h"
+
+static uint64_t  *g_pages;              // Stack of zeroed pages
+static uint32_t   g_capacity;
+static uint32_t   g_count;
+static uint32_t   g_inflight;           // Slots claimed by a refill in progress
+static int        g_kicked;             // Wake-up sent, not yet refilled
+static uint64_t   g_hits, g_misses, g_zeroed, g_zero_tsc;
+static spinlock_t g_lock = SPINLOCK_INIT;
+
+// MOVNTI goes around the caches and needs no vector state, so idle loops
+// can use it without kernel_simd_begin(). Not ordered with other stores:
+// the caller fences before publishing the page.
+static void zero_page_nt(void *page) {
+    uint64_t *p = page;
+    for (uint64_t i = 0; i < PAGE_SIZE / 8; i += 8) {
+        __asm__ volatile("movnti %1, 0(%0)\n\t"
+                         "movnti %1, 8(%0)\n\t"
+                         "movnti %1, 16(%0)\n\t"
+                         "movnti %1, 24(%0)\n\t"
+                         "movnti %1, 32(%0)\n\t"
+                         "movnti %1, 40(%0)\n\t"
+                         "movnti %1, 48(%0)\n\t"
+                         "movnti %1, 56(%0)"
+                         :: "r"(p + i), "r"(0ULL) : "memory");
+    }
+}
+
+void zpool_init(uint32_t capacity) {
+    size_t pages = PAGE_ALIGN_UP((uint64_t)capacity * sizeof(uint64_t)) / PAGE_SIZE;
+    uint64_t stack = capacity ? pmm_alloc_pages(pages) : 0;
+    if (!stack) return;
+
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    g_pages = phys_to_virt(stack);
+    g_capacity = capacity;
+    spin_unlock_irqrestore(&g_lock, flags);
+
+    // Start the idle CPUs on it
+    smp_kick_idle();
+}
+
+static void zpool_initcall(void) {
+    zpool_init(cmdline_get_u64("zpool.pages", 1024));
+}
+INITCALL(zpool, zpool_initcall, "", 0);
+
+uint64_t zpool_get(void) {
+    uint64_t page = 0;
+    int kick = 0;
+
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    if (g_count) {
+        page = g_pages[--g_count];
+        g_hits++;
+    } else {
+        g_misses++;
+    }
+    if (g_capacity && !g_kicked && g_count < g_capacity / 2) {
+        g_kicked = 1;
+        kick = 1;
+    }
+    spin_unlock_irqrestore(&g_lock, flags);
+
+    if (kick) smp_kick_idle();
+    return page;
+}
+
+uint32_t zpool_refill(uint32_t max) {
+    uint32_t added = 0;
+
+    while (added < max) {
+        // Claim a slot first so concurrent refills stop at capacity
+        uint64_t flags = spin_lock_irqsave(&g_lock);
+        int room = g_count + g_inflight < g_capacity;
+        if (room) g_inflight++;
+        else g_kicked = 0;
+        spin_unlock_irqrestore(&g_lock, flags);
+        if (!room) break;
+
+        uint64_t page = pmm_alloc_pages(1);
+        uint64_t start = rdtsc();
+        if (page) {
+            zero_page_nt(phys_to_virt(page));
+            __asm__ volatile("sfence" ::: "memory");
+        }
+        uint64_t cycles = rdtsc() - start;
+
+        flags = spin_lock_irqsave(&g_lock);
+        g_inflight--;
+        if (page) {
+            g_pages[g_count++] = page;
+            g_zeroed++;
+            g_zero_tsc += cycles;
+        } else {
+            g_kicked = 0;       // Out of memory: let the next get retry
+        }
+        spin_unlock_irqrestore(&g_lock, flags);
+        if (!page) break;
+        added++;
+    }
+    return added;
+}
+
+void zpool_get_stats(struct zpool_stats *st) {
+    uint64_t flags = spin_lock_irqsave(&g_lock);
+    st->capacity = g_capacity;
+    st->count = g_count;
+    st->hits = g_hits;
+    st->misses = g_misses;
+    st->zeroed = g_zeroed;
+    st->zero_tsc = g_zero_tsc;
+    spin_unlock_irqrestore(&g_lock, flags);
+}
@@ -0,0 +1,38 @@
+// kernel/mm/zpool.h
+// Pool of pre-zeroed pages, filled by idle CPUs
+//
+// Free memory is firmware or previous-owner garbage, and clearing a page
+// when it is handed out puts 4 KiB of stores on the allocation path. Idle
+// CPUs instead take pages from the allocator, zero them with non-temporal
+// stores (no cache pollution for data nobody reads yet) and park them
+// here, so pmm_alloc_zeroed(1) is usually a pop. Only when the pool is
+// empty does the caller zero on demand.
+//
+// Pooled pages count as allocated in the pmm.
+#pragma once
+
+#include <stdint.h>
+
+struct zpool_stats {
+    uint32_t capacity;
+    uint32_t count;         // Zeroed pages waiting
+    uint64_t hits;          // zpool_get() calls served from the pool
+    uint64_t misses;        // ... that found it empty
+    uint64_t zeroed;        // Pages zeroed by zpool_refill()
+    uint64_t zero_tsc;      // Cycles spent zeroing them
+};
+
+// Hold up to `capacity` pages. Call after pmm_init(); until then the pool
+// is empty and zpool_refill() does nothing.
+void zpool_init(uint32_t capacity);
+
+// A zeroed page's physical address, or 0 if the pool is empty. Wakes an
+// idle CPU to top it up once it runs low.
+uint64_t zpool_get(void);
+
+// Zero up to `max` pages into the pool; returns how many were added (0
+// when full or out of memory). For idle loops, with interrupts enabled:
+// each page is a few hundred nanoseconds of work.
+uint32_t zpool_refill(uint32_t max);
+
+void zpool_get_stats(struct zpool_stats *st);
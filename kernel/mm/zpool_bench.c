@@ -0,0 +1,89 @@
+// kernel/mm/zpool_bench.c
+// Zeroed page allocation: pre-zeroed pool against zeroing on demand
+#include "mm/zpool_bench.h"
+#include "boot/cmdline.h"
+#include "lib/printk.h"
+#include "lib/sort.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "mm/zpool.h"
+#include "x86/cpu.h"
+#include "x86/smp.h"
+#include "x86/tsc.h"
+
+#define FILL_TIMEOUT_MS 1000
+
+static void report(const char *what, uint64_t *lat, uint32_t n) {
+    sort_u64(lat, n);
+    kprintf("  %-10s median %6llu ns  p99 %6llu ns\n", what,
+            (unsigned long long)tsc_to_ns(lat[n / 2]),
+            (unsigned long long)tsc_to_ns(lat[(uint64_t)n * 99 / 100]));
+}
+
+// Until the pool is full; without APs this CPU does the zeroing
+static void wait_full(void) {
+    struct zpool_stats st;
+    uint64_t deadline = rdtsc() + ns_to_tsc(FILL_TIMEOUT_MS * 1000000ULL);
+    smp_kick_idle();
+    do {
+        if (smp_cpu_count() == 1) zpool_refill(64);
+        else cpu_relax();
+        zpool_get_stats(&st);
+    } while (st.count < st.capacity && rdtsc() < deadline);
+}
+
+void zpool_bench(void) {
+    struct zpool_stats st;
+    zpool_get_stats(&st);
+    uint32_t n = cmdline_get_u64("zpoolbench.pages", st.capacity / 2);
+    if (n > st.capacity) n = st.capacity;
+    if (n < 2) {
+        kprintf("zpoolbench: pool disabled\n");
+        return;
+    }
+
+    size_t arr_pages = PAGE_ALIGN_UP((uint64_t)n * sizeof(uint64_t)) / PAGE_SIZE;
+    uint64_t *lat = pmm_alloc_zeroed(arr_pages);
+    uint64_t *pages = pmm_alloc_zeroed(arr_pages);
+    if (!lat || !pages) {
+        kprintf("zpoolbench: out of memory\n");
+        return;
+    }
+
+    kprintf("zpoolbench: %u single-page zeroed allocations, %u CPUs\n",
+            n, smp_cpu_count());
+
+    // From the pool. The first half of it is already full, so no wake-up
+    // traffic lands inside the measurement until it drops below half.
+    wait_full();
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t t0 = rdtsc();
+        void *p = pmm_alloc_zeroed(1);
+        lat[i] = rdtsc() - t0;
+        pages[i] = virt_to_phys(p);
+    }
+    report("pool", lat, n);
+    for (uint32_t i = 0; i < n; i++) if (pages[i]) pmm_free_pages(pages[i], 1);
+
+    // What a pool miss costs: allocate, then clear through the cache
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t t0 = rdtsc();
+        uint64_t p = pmm_alloc_pages(1);
+        if (p) memset(phys_to_virt(p), 0, PAGE_SIZE);
+        lat[i] = rdtsc() - t0;
+        pages[i] = p;
+    }
+    report("on demand", lat, n);
+    for (uint32_t i = 0; i < n; i++) if (pages[i]) pmm_free_pages(pages[i], 1);
+
+    zpool_get_stats(&st);
+    uint64_t ns = tsc_to_ns(st.zero_tsc);
+    kprintf("  background: %llu pages zeroed, %llu MB/s per CPU, "
+            "%llu hits, %llu misses\n",
+            (unsigned long long)st.zeroed,
+            (unsigned long long)(ns ? st.zeroed * PAGE_SIZE * 1000 / ns : 0),
+            (unsigned long long)st.hits, (unsigned long long)st.misses);
+
+    pmm_free_pages(virt_to_phys(lat), arr_pages);
+    pmm_free_pages(virt_to_phys(pages), arr_pages);
+}
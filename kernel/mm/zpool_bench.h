@@ -0,0 +1,10 @@
+// kernel/mm/zpool_bench.h
+// Zeroed page allocation: pre-zeroed pool against zeroing on demand
+#pragma once
+
+// Wait for the idle CPUs to fill the pool, then time single-page
+// pmm_alloc_zeroed() calls served from it against allocate-and-memset,
+// and print the median and p99 of each plus the background zeroing rate.
+// Command line knob:
+//   zpoolbench.pages=N   allocations per measurement (default: half the pool)
+void zpool_bench(void);
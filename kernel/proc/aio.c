@@ -0,0 +1,516 @@
+// kernel/proc/aio.c
+// Asynchronous I/O rings and the synchronous block I/O system call
+#include "proc/aio.h"
+#include "common/aio.h"
+#include "drivers/block.h"
+#include "lib/spinlock.h"
+#include "mm/pmm.h"
+#include "mm/uvm.h"
+#include "proc/ipc.h"
+#include "proc/process.h"
+#include "sched/task.h"
+#include "time/clock.h"
+#include "x86/cpu.h"
+
+// Below the channels (proc/ipc.c), clear of the image at the bottom
+#define AIO_MAP_BASE    (USER_BASE + (USER_TOP - USER_BASE) / 4)
+#define AIO_BATCH       32              // Block requests per doorbell, at most
+
+_Static_assert(sizeof(struct aio_sqe) == 32 && sizeof(struct aio_cqe) == 16, "common/aio.h");
+_Static_assert(BLK_MAX_DEVICES <= 32, "struct aio_ring.devs");
+
+struct aio_req {
+    struct blk_request blk;
+    struct aio_ring   *ring;
+    uint64_t           user_data;
+    struct aio_req    *next;            // Free list
+};
+
+struct aio_timer {
+    uint64_t deadline;                  // now_ns()
+    uint64_t user_data;
+};
+
+// The process can write anything to the shared header at any time, so
+// the kernel keeps its own copy of every index and size it relies on
+struct aio_ring {
+    struct aio_ring_hdr     *hdr;
+    volatile struct aio_sqe *sq;
+    struct aio_cqe          *cq;
+    uint8_t                 *buf;
+    uint64_t                 buf_size;
+    uint64_t                 phys;      // The whole mapping, contiguous
+    uint32_t                 npages;
+    uint32_t                 kpages;    // This structure
+    uint32_t                 sq_entries, cq_entries;
+    struct vm_space         *vm;        // The owner's, for futex addresses
+
+    // Consumer side: aio_enter(), the poller, aio_release()
+    spinlock_t               sq_lock;
+    uint32_t                 sq_head;
+    uint32_t                 ntimers;
+    struct aio_timer        *timers;
+    uint32_t                 devs;      // Devices it has used, by number
+
+    // Producer side, interrupts included
+    spinlock_t               cq_lock;
+    uint32_t                 cq_tail;
+    uint32_t                 inflight;  // Requests and timeouts not yet answered
+    struct aio_req          *free;
+    struct task             *waiter;    // Blocked in aio_enter()
+
+    int                      sqpoll;
+    volatile int             closing;   // In aio_release(): take no more submissions
+    struct aio_ring         *poll_next;
+    struct aio_req           reqs[];    // cq_entries of them
+};
+
+static struct aio_ring *g_poll_list;
+static uint32_t         g_pollers;
+static spinlock_t       g_poll_lock = SPINLOCK_INIT;
+
+//=============================================================================
+// Completions
+//=============================================================================
+
+// Post a completion. `retire` says it answers something in flight; `req`,
+// if not NULL, goes back on the free list.
+static void complete(struct aio_ring *r, uint64_t user_data, int64_t res, int retire,
+                     struct aio_req *req) {
+    uint64_t flags = spin_lock_irqsave(&r->cq_lock);
+    r->cq[r->cq_tail & (r->cq_entries - 1)] = (struct aio_cqe){ user_data, res };
+    __atomic_store_n(&r->hdr->cq_tail, ++r->cq_tail, __ATOMIC_RELEASE);
+    if (retire) r->inflight--;
+    if (req) {
+        req->next = r->free;
+        r->free = req;
+    }
+    struct task *w = r->waiter;
+    r->waiter = NULL;
+    spin_unlock_irqrestore(&r->cq_lock, flags);
+
+    if (w) task_wake(w);
+}
+
+static void blk_done(struct blk_request *blk) {
+    struct aio_req *req = blk->priv;
+    int64_t res = blk->status == BLK_OK      ? 0 :
+                  blk->status == BLK_EUNSUPP ? -EINVAL : -EIO;
+    complete(req->ring, req->user_data, res, 1, req);
+}
+
+// Posted and not yet consumed, as far as the process says
+static uint32_t cq_ready_locked(struct aio_ring *r) {
+    uint32_t ready = r->cq_tail - __atomic_load_n(&r->hdr->cq_head, __ATOMIC_ACQUIRE);
+    return ready > r->cq_entries ? r->cq_entries : ready;
+}
+
+// CQ entries nothing has a claim on. Completions only move a claim from
+// in flight to posted, so this can only grow behind the caller's back.
+static uint32_t cq_room(struct aio_ring *r) {
+    uint64_t flags = spin_lock_irqsave(&r->cq_lock);
+    uint32_t used = cq_ready_locked(r) + r->inflight;
+    spin_unlock_irqrestore(&r->cq_lock, flags);
+    return used < r->cq_entries ? r->cq_entries - used : 0;
+}
+
+// Expire timeouts and reap the devices that need polling. Under sq_lock.
+// Returns how many completions it found.
+static uint32_t service(struct aio_ring *r) {
+    uint32_t found = 0;
+
+    if (r->ntimers) {
+        uint64_t now = now_ns();
+        for (uint32_t i = 0; i < r->ntimers;) {
+            if (r->timers[i].deadline > now) {
+                i++;
+                continue;
+            }
+            complete(r, r->timers[i].user_data, 0, 1, NULL);
+            r->timers[i] = r->timers[--r->ntimers];
+            found++;
+        }
+    }
+    for (uint32_t d = 0; d < BLK_MAX_DEVICES; d++) {
+        struct blk_device *dev = (r->devs & (1u << d)) ? blk_get(d) : NULL;
+        if (dev && dev->mode == BLK_MODE_POLL) found += blk_poll(dev);
+    }
+    return found;
+}
+
+// Whether waiting for this ring takes polling rather than a wake-up
+static int needs_polling(struct aio_ring *r) {
+    if (r->ntimers) return 1;
+    for (uint32_t d = 0; d < BLK_MAX_DEVICES; d++) {
+        struct blk_device *dev = (r->devs & (1u << d)) ? blk_get(d) : NULL;
+        if (dev && dev->mode == BLK_MODE_POLL) return 1;
+    }
+    return 0;
+}
+
+//=============================================================================
+// Submission (under sq_lock)
+//=============================================================================
+
+// Block requests on their way to one device, from consecutive SQ entries
+struct batch {
+    struct blk_device  *dev;
+    struct blk_request *reqs[AIO_BATCH];
+    uint32_t            n;
+    uint32_t            first;          // SQ offset of reqs[0]
+};
+
+// Send the batch with one doorbell. Returns the SQ offset to carry on
+// from: past the batch, or at the first request the device had no room
+// for, which stays queued.
+static uint32_t flush(struct aio_ring *r, struct batch *b) {
+    uint32_t taken = blk_submit(b->dev, b->reqs, b->n);
+    if (taken < b->n) {
+        uint64_t flags = spin_lock_irqsave(&r->cq_lock);
+        for (uint32_t i = taken; i < b->n; i++) {
+            struct aio_req *req = b->reqs[i]->priv;
+            req->next = r->free;
+            r->free = req;
+            r->inflight--;
+        }
+        spin_unlock_irqrestore(&r->cq_lock, flags);
+    }
+    b->n = 0;
+    return b->first + taken;
+}
+
+static int64_t check_blk(struct aio_ring *r, const struct aio_sqe *s,
+                         const struct blk_device *dev) {
+    if (!dev) return -EINVAL;
+    if (s->op == AIO_OP_FLUSH) return dev->can_flush ? 0 : -EINVAL;
+
+    uint64_t len = (uint64_t)s->count * 512;
+    if (!s->count || (s->arg & 511) || s->arg > r->buf_size || len > r->buf_size - s->arg ||
+        s->sector > dev->sectors || s->count > dev->sectors - s->sector) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static struct blk_request *new_request(struct aio_ring *r, const struct aio_sqe *s) {
+    // cq_room() said there is one
+    uint64_t flags = spin_lock_irqsave(&r->cq_lock);
+    struct aio_req *req = r->free;
+    r->free = req->next;
+    r->inflight++;
+    spin_unlock_irqrestore(&r->cq_lock, flags);
+
+    req->user_data = s->user_data;
+    req->blk = (struct blk_request){
+        .op     = s->op == AIO_OP_READ  ? BLK_OP_READ :
+                  s->op == AIO_OP_WRITE ? BLK_OP_WRITE : BLK_OP_FLUSH,
+        .sector = s->sector,
+        .count  = s->count,
+        .buf    = r->buf + s->arg,
+        .done   = blk_done,
+        .priv   = req,
+    };
+    return &req->blk;
+}
+
+static void new_timer(struct aio_ring *r, const struct aio_sqe *s) {
+    uint64_t flags = spin_lock_irqsave(&r->cq_lock);
+    r->inflight++;
+    spin_unlock_irqrestore(&r->cq_lock, flags);
+
+    r->timers[r->ntimers++] = (struct aio_timer){ now_ns() + s->arg, s->user_data };
+}
+
+// What completes on the spot
+static int64_t run_now(struct aio_ring *r, const struct aio_sqe *s) {
+    switch (s->op) {
+    case AIO_OP_NOP:
+        return 0;
+    case AIO_OP_FUTEX_WAKE:
+        return ipc_futex_wake(r->vm, s->arg, s->count);
+    default:
+        return -EINVAL;
+    }
+}
+
+// Take up to `max` SQ entries, no more than the CQ has room to answer.
+// Consecutive block requests for one device go out together. Returns how
+// many were consumed.
+static uint32_t submit(struct aio_ring *r, uint32_t max) {
+    uint32_t avail = __atomic_load_n(&r->hdr->sq_tail, __ATOMIC_ACQUIRE) - r->sq_head;
+    if (avail > r->sq_entries) avail = r->sq_entries;
+    if (avail > max) avail = max;
+    uint32_t room = cq_room(r);
+    if (avail > room) avail = room;
+
+    struct batch b = { .n = 0 };
+    uint32_t i = 0;
+    while (i < avail) {
+        // One copy: the process may rewrite the entry under us
+        struct aio_sqe s = r->sq[(r->sq_head + i) & (r->sq_entries - 1)];
+        int blk = s.op == AIO_OP_READ || s.op == AIO_OP_WRITE || s.op == AIO_OP_FLUSH;
+        struct blk_device *dev = blk ? blk_get(s.dev) : NULL;
+        int64_t err = blk ? check_blk(r, &s, dev) : 0;
+
+        // Anything but one more request for the batch's device sends it
+        if (b.n && (!blk || err || dev != b.dev || b.n == AIO_BATCH)) {
+            uint32_t next = flush(r, &b);
+            if (next < i) {
+                i = next;
+                break;
+            }
+        }
+
+        if (blk && !err) {
+            if (!b.n) {
+                b.dev = dev;
+                b.first = i;
+            }
+            b.reqs[b.n++] = new_request(r, &s);
+            r->devs |= 1u << s.dev;
+        } else if (s.op == AIO_OP_TIMEOUT) {
+            new_timer(r, &s);
+        } else {
+            complete(r, s.user_data, err ? err : run_now(r, &s), 0, NULL);
+        }
+        i++;
+    }
+    if (b.n) i = flush(r, &b);
+
+    r->sq_head += i;
+    __atomic_store_n(&r->hdr->sq_head, r->sq_head, __ATOMIC_RELEASE);
+    return i;
+}
+
+//=============================================================================
+// Polling CPU
+//=============================================================================
+
+static void set_need_wakeup(struct aio_ring *r, int need) {
+    __atomic_store_n(&r->hdr->sq_flags, need ? AIO_SQ_NEED_WAKEUP : 0, __ATOMIC_RELEASE);
+}
+
+void aio_sqpoll(const volatile uint32_t *stop) {
+    spin_lock(&g_poll_lock);
+    if (g_pollers++ == 0) {
+        for (struct aio_ring *r = g_poll_list; r; r = r->poll_next) set_need_wakeup(r, 0);
+    }
+    spin_unlock(&g_poll_lock);
+
+    while (!*stop) {
+        uint32_t busy = 0;
+        spin_lock(&g_poll_lock);
+        for (struct aio_ring *r = g_poll_list; r; r = r->poll_next) {
+            spin_lock(&r->sq_lock);
+            if (!r->closing) busy += submit(r, r->sq_entries);
+            busy += service(r);
+            spin_unlock(&r->sq_lock);
+        }
+        spin_unlock(&g_poll_lock);
+        if (!busy) cpu_relax();
+    }
+
+    // From here on submissions need aio_enter() again. A process that
+    // checked just before still sees the flag the next time it looks.
+    spin_lock(&g_poll_lock);
+    if (--g_pollers == 0) {
+        for (struct aio_ring *r = g_poll_list; r; r = r->poll_next) set_need_wakeup(r, 1);
+    }
+    spin_unlock(&g_poll_lock);
+}
+
+//=============================================================================
+// Set-up and Tear-down
+//=============================================================================
+
+static void ring_free(struct aio_ring *r) {
+    for (uint32_t i = 0; i < r->npages; i++) {
+        uint64_t page = r->phys + (uint64_t)i * PAGE_SIZE;
+        uvm_pages_put(&page, 1);
+    }
+    pmm_free_pages(virt_to_phys(r), r->kpages);
+}
+
+int64_t sys_aio_setup(uint64_t entries, uint64_t buf_pages, uint64_t flags) {
+    struct process *p = process_current();
+    if (!p) return -ENOSYS;
+    if (p->aio) return -EBUSY;
+    if (!entries || entries > AIO_MAX_ENTRIES || (entries & (entries - 1)) ||
+        buf_pages > AIO_MAX_BUF_PAGES || (flags & ~(uint64_t)AIO_SETUP_SQPOLL)) {
+        return -EINVAL;
+    }
+
+    // Header, SQ and CQ, then the buffer area on a page of its own
+    uint32_t cq_entries = entries * 2;
+    uint64_t sq_off = (sizeof(struct aio_ring_hdr) + 63) & ~63ULL;
+    uint64_t cq_off = sq_off + entries * sizeof(struct aio_sqe);
+    uint64_t buf_off = PAGE_ALIGN_UP(cq_off + cq_entries * sizeof(struct aio_cqe));
+    uint32_t npages = (buf_off >> PAGE_SHIFT) + buf_pages;
+
+    size_t kbytes = sizeof(struct aio_ring) + cq_entries * sizeof(struct aio_req) +
+                    cq_entries * sizeof(struct aio_timer);
+    uint32_t kpages = PAGE_ALIGN_UP(kbytes) >> PAGE_SHIFT;
+    struct aio_ring *r = pmm_alloc_zeroed(kpages);
+    uint64_t *list = pmm_alloc_zeroed(1);
+    if (!r || !list || uvm_pages_alloc_contig(list, npages) < 0) {
+        if (r) pmm_free_pages(virt_to_phys(r), kpages);
+        if (list) pmm_free_pages(virt_to_phys(list), 1);
+        return -ENOMEM;
+    }
+
+    r->phys = list[0];
+    r->npages = npages;
+    r->kpages = kpages;
+    r->hdr = phys_to_virt(r->phys);
+    r->sq = (volatile struct aio_sqe *)((uint8_t *)r->hdr + sq_off);
+    r->cq = (struct aio_cqe *)((uint8_t *)r->hdr + cq_off);
+    r->buf = (uint8_t *)r->hdr + buf_off;
+    r->buf_size = (uint64_t)buf_pages * PAGE_SIZE;
+    r->sq_entries = entries;
+    r->cq_entries = cq_entries;
+    r->vm = &p->uvm.vm;
+    r->timers = (struct aio_timer *)&r->reqs[cq_entries];
+    r->sqpoll = (flags & AIO_SETUP_SQPOLL) != 0;
+    for (uint32_t i = 0; i < cq_entries; i++) {
+        r->reqs[i].ring = r;
+        r->reqs[i].next = i + 1 < cq_entries ? &r->reqs[i + 1] : NULL;
+    }
+    r->free = &r->reqs[0];
+
+    struct aio_ring_hdr *h = r->hdr;
+    h->sq_entries = entries;
+    h->cq_entries = cq_entries;
+    h->sq_off = sq_off;
+    h->cq_off = cq_off;
+    h->buf_off = buf_off;
+    h->buf_size = r->buf_size;
+    h->sq_flags = AIO_SQ_NEED_WAKEUP;
+
+    uint64_t va = uvm_map_shared(&p->uvm, AIO_MAP_BASE, list, npages);
+    pmm_free_pages(virt_to_phys(list), 1);
+    if (!va) {
+        ring_free(r);
+        return -ENOMEM;
+    }
+    p->aio = r;
+
+    if (r->sqpoll) {
+        spin_lock(&g_poll_lock);
+        set_need_wakeup(r, g_pollers == 0);
+        r->poll_next = g_poll_list;
+        g_poll_list = r;
+        spin_unlock(&g_poll_lock);
+    }
+    return va;
+}
+
+void aio_release(struct aio_ring *r) {
+    if (!r) return;
+
+    // Whoever is submitting finishes first; then drop the timeouts
+    r->closing = 1;
+    spin_lock(&r->sq_lock);
+    uint64_t flags = spin_lock_irqsave(&r->cq_lock);
+    r->inflight -= r->ntimers;
+    spin_unlock_irqrestore(&r->cq_lock, flags);
+    r->ntimers = 0;
+    spin_unlock(&r->sq_lock);
+
+    // The devices may still be writing to the buffer area. A polling CPU
+    // keeps reaping what it submitted until the ring leaves its list.
+    while (__atomic_load_n(&r->inflight, __ATOMIC_ACQUIRE)) {
+        spin_lock(&r->sq_lock);
+        service(r);
+        spin_unlock(&r->sq_lock);
+        task_yield();
+        cpu_relax();
+    }
+
+    if (r->sqpoll) {
+        spin_lock(&g_poll_lock);
+        for (struct aio_ring **pp = &g_poll_list; *pp; pp = &(*pp)->poll_next) {
+            if (*pp == r) {
+                *pp = r->poll_next;
+                break;
+            }
+        }
+        spin_unlock(&g_poll_lock);
+    }
+    ring_free(r);
+}
+
+//=============================================================================
+// System Calls
+//=============================================================================
+
+int64_t sys_aio_enter(uint64_t to_submit, uint64_t min_complete) {
+    struct process *p = process_current();
+    struct aio_ring *r = p ? p->aio : NULL;
+    if (!r) return -EINVAL;
+    if (to_submit > r->sq_entries) to_submit = r->sq_entries;
+    if (min_complete > r->cq_entries) min_complete = r->cq_entries;
+
+    spin_lock(&r->sq_lock);
+    uint32_t n = to_submit ? submit(r, to_submit) : 0;
+    spin_unlock(&r->sq_lock);
+
+    // Until enough are posted or nothing is left to wait for. A wake-up
+    // needs an interrupt; timeouts and polled devices need looking at.
+    while (min_complete) {
+        spin_lock(&r->sq_lock);
+        service(r);
+        int poll = needs_polling(r);
+        spin_unlock(&r->sq_lock);
+
+        uint64_t flags = spin_lock_irqsave(&r->cq_lock);
+        if (cq_ready_locked(r) >= min_complete || !r->inflight) {
+            spin_unlock_irqrestore(&r->cq_lock, flags);
+            break;
+        }
+        if (!poll) {
+            r->waiter = current_task();
+            r->waiter->state = TASK_BLOCKED;
+        }
+        spin_unlock_irqrestore(&r->cq_lock, flags);
+
+        if (poll) {
+            task_yield();
+            cpu_relax();
+        } else {
+            task_block();
+        }
+    }
+    return n;
+}
+
+// The baseline a ring is measured against: one request per call, waited
+// for. The buffer has to be physically contiguous, as the ring's is.
+int64_t sys_blk_io(uint64_t dev, uint64_t op, uint64_t sector, uint64_t buf, uint64_t count) {
+    struct process *p = process_current();
+    struct blk_device *d = blk_get(dev);
+    if (!p || !d) return -EINVAL;
+
+    void *kbuf = NULL;
+    if (op == AIO_OP_READ || op == AIO_OP_WRITE) {
+        uint64_t len = count * 512;
+        if (!count || count > AIO_MAX_BUF_PAGES * (PAGE_SIZE / 512) ||
+            sector > d->sectors || count > d->sectors - sector) {
+            return -EINVAL;
+        }
+        if (!uvm_user_ok(&p->uvm, buf, len, op == AIO_OP_READ)) return -EFAULT;
+
+        uint64_t phys = vmm_lookup(&p->uvm.vm, buf) & PTE_ADDR_MASK;
+        for (uint64_t va = PAGE_ALIGN_DOWN(buf) + PAGE_SIZE; va < buf + len; va += PAGE_SIZE) {
+            uint64_t expect = phys + (va - PAGE_ALIGN_DOWN(buf));
+            if ((vmm_lookup(&p->uvm.vm, va) & PTE_ADDR_MASK) != expect) return -EINVAL;
+        }
+        kbuf = phys_to_virt(phys + (buf & (PAGE_SIZE - 1)));
+    } else if (op != AIO_OP_FLUSH) {
+        return -EINVAL;
+    }
+
+    int status = blk_rw(d, op == AIO_OP_READ  ? BLK_OP_READ :
+                           op == AIO_OP_WRITE ? BLK_OP_WRITE : BLK_OP_FLUSH,
+                        sector, count, kbuf);
+    return status == BLK_OK ? 0 : status == BLK_EUNSUPP ? -EINVAL : -EIO;
+}
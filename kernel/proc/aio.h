@@ -0,0 +1,31 @@
+// kernel/proc/aio.h
+// Asynchronous I/O rings: batched block I/O, timeouts and futex wakes
+//
+// The shared layout and the operations are in common/aio.h. A process has
+// at most one ring. Its memory is physically contiguous and the kernel
+// reaches it through the direct map, so completions are posted straight
+// from the block layer's callback, in interrupt context or wherever
+// blk_poll() runs, and the buffer area is the DMA target itself.
+//
+// There is no timer interrupt: timeouts expire when the ring is looked
+// at, by aio_enter() waiting or by a polling CPU.
+#pragma once
+
+#include <stdint.h>
+
+struct aio_ring;
+
+// Drop a process's ring (struct process.aio) as it exits, before its
+// address space goes. Waits for the block requests still in flight, which
+// write to the ring's pages; pending timeouts are dropped. NULL is fine.
+void aio_release(struct aio_ring *r);
+
+// Serve every AIO_SETUP_SQPOLL ring from this CPU until *stop: submit what
+// the processes queue, reap polled devices and expire timeouts. No CPU
+// does this by default; kernel code lends one (see proc/aio_bench.c).
+void aio_sqpoll(const volatile uint32_t *stop);
+
+// System calls (common/syscall.h)
+int64_t sys_aio_setup(uint64_t entries, uint64_t buf_pages, uint64_t flags);
+int64_t sys_aio_enter(uint64_t to_submit, uint64_t min_complete);
+int64_t sys_blk_io(uint64_t dev, uint64_t op, uint64_t sector, uint64_t buf, uint64_t count);
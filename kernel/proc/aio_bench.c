@@ -0,0 +1,76 @@
+// kernel/proc/aio_bench.c
+// Block read IOPS through an I/O ring against one system call per request
+#include "proc/aio_bench.h"
+#include "boot/cmdline.h"
+#include "common/aio.h"
+#include "drivers/block.h"
+#include "lib/printk.h"
+#include "proc/aio.h"
+#include "proc/process.h"
+#include "x86/smp.h"
+
+#define BENCH_PROGRAM   "aiobench.elf"
+
+// user/aiobench.c's argument: mode, queue depth, reads and the span of
+// the device they land in, in 4 KiB blocks
+#define MODE_SYNC       0
+#define MODE_RING       1
+#define MODE_SQPOLL     2
+#define ARG_QD_SHIFT    2
+#define ARG_ITERS_SHIFT 11
+#define ARG_SPAN_SHIFT  35
+#define ARG_ITERS_MAX   ((1ULL << (ARG_SPAN_SHIFT - ARG_ITERS_SHIFT)) - 1)
+#define ARG_SPAN_MAX    ((1ULL << (64 - ARG_SPAN_SHIFT)) - 1)
+
+struct sqpoll_run {
+    uint64_t          arg;
+    int64_t           code;
+    volatile uint32_t stop;
+};
+
+static int64_t run(uint64_t arg) {
+    struct process *p = process_spawn(BENCH_PROGRAM, arg);
+    return p ? process_wait(p, NULL) : -1;
+}
+
+// smp_run(): CPU 0 runs the program, CPU 1 polls its ring until it exits
+static void sqpoll_side(void *arg, uint32_t cpu, uint32_t ncpus) {
+    (void)ncpus;
+    struct sqpoll_run *s = arg;
+    if (cpu == 1) {
+        aio_sqpoll(&s->stop);
+        return;
+    }
+    s->code = run(s->arg);
+    __atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+}
+
+static void check(const char *mode, int64_t code) {
+    if (code) kprintf("aiobench: %s run exited with %lld\n", mode, (long long)code);
+}
+
+void aio_bench(void) {
+    struct blk_device *dev = blk_get(0);
+    if (!dev) {
+        kprintf("aiobench: no block device\n");
+        return;
+    }
+
+    uint64_t iters = cmdline_get_u64("aiobench.iters", 20000);
+    uint64_t qd = cmdline_get_u64("aiobench.qd", 32);
+    uint64_t span = dev->sectors / 8;
+    if (!iters || iters > ARG_ITERS_MAX || !qd || qd > AIO_MAX_ENTRIES || !span) return;
+    if (span > ARG_SPAN_MAX) span = ARG_SPAN_MAX;
+
+    uint64_t common = qd << ARG_QD_SHIFT | iters << ARG_ITERS_SHIFT | span << ARG_SPAN_SHIFT;
+    kprintf("aiobench: %s, %s completion, %llu random 4 KiB reads per run\n", dev->name,
+            dev->mode == BLK_MODE_POLL ? "polled" : "interrupt", (unsigned long long)iters);
+
+    check("sync", run(common | MODE_SYNC));
+    check("ring", run(common | MODE_RING));
+
+    if (smp_cpu_count() < 2) return;
+    struct sqpoll_run s = { .arg = common | MODE_SQPOLL, .code = -1, .stop = 0 };
+    smp_run(sqpoll_side, &s, 2);
+    check("sqpoll", s.code);
+}
@@ -0,0 +1,13 @@
+// kernel/proc/aio_bench.h
+// Block read IOPS through an I/O ring against one system call per request
+#pragma once
+
+// Run user/aiobench.elf (a boot module) three times against block device
+// 0: synchronous blk_io() calls, a ring with one aio_enter() per batch,
+// and, with a second CPU polling for it, a ring with no system calls. Each
+// run prints its IOPS and how many system calls it made; the ring run
+// also checks that timeouts, no-ops and futex wakes complete in order.
+// Command line knobs:
+//   aiobench.iters=N   4 KiB random reads per run (default 20000)
+//   aiobench.qd=N      requests in flight on the ring, 1..256 (default 32)
+void aio_bench(void);
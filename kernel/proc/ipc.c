@@ -0,0 +1,263 @@
+// kernel/proc/ipc.c
+// Shared-memory channels, futex wait/wake and page grants
+#include "proc/ipc.h"
+#include "lib/spinlock.h"
+#include "mm/pmm.h"
+#include "mm/uvm.h"
+#include "proc/process.h"
+#include "sched/task.h"
+
+// Channels are mapped from the middle of the user range up, clear of the
+// image at the bottom and the stack at the top
+#define IPC_MAP_BASE        (USER_BASE + (USER_TOP - USER_BASE) / 2)
+
+#define GRANT_SLOT_BITS     5           // Handle = sequence << 5 | slot
+#define FUTEX_BUCKETS       64
+
+_Static_assert(IPC_MAX_GRANTS == 1 << GRANT_SLOT_BITS, "grant handle layout");
+_Static_assert(IPC_GRANT_PAGES * sizeof(uint64_t) == PAGE_SIZE, "grant page list");
+_Static_assert(IPC_MAX_CHANNELS <= 32, "struct process.ipc_open");
+
+struct grant {
+    uint64_t *pages;                    // Page of physical addresses, NULL: free slot
+    uint32_t  count;                    // 0 while the sender is still filling it
+    uint32_t  seq;                      // Turns stale handles away
+};
+
+struct channel {
+    uint32_t     refs;                  // Processes with it open
+    uint32_t     npages;
+    uint64_t     pages[IPC_MAX_PAGES];
+    struct grant grants[IPC_MAX_GRANTS];
+    uint32_t     grant_seq;
+};
+
+struct futex_waiter {
+    uint64_t             key;
+    struct task         *task;
+    struct futex_waiter *next;
+};
+
+static struct channel g_chans[IPC_MAX_CHANNELS];
+static spinlock_t     g_chan_lock = SPINLOCK_INIT;
+
+static struct {
+    spinlock_t           lock;
+    struct futex_waiter *head;
+} g_futex[FUTEX_BUCKETS];
+
+//=============================================================================
+// Channels
+//=============================================================================
+
+static void chan_put_locked(struct channel *c) {
+    if (--c->refs) return;
+
+    uvm_pages_put(c->pages, c->npages);
+    c->npages = 0;
+    for (uint32_t i = 0; i < IPC_MAX_GRANTS; i++) {
+        struct grant *g = &c->grants[i];
+        if (!g->pages) continue;
+        uvm_pages_put(g->pages, g->count);
+        pmm_free_pages(virt_to_phys(g->pages), 1);
+        g->pages = NULL;
+        g->count = 0;
+    }
+}
+
+void ipc_release(uint32_t open) {
+    spin_lock(&g_chan_lock);
+    for (uint32_t id = 0; id < IPC_MAX_CHANNELS; id++) {
+        if (open & (1u << id)) chan_put_locked(&g_chans[id]);
+    }
+    spin_unlock(&g_chan_lock);
+}
+
+void ipc_retain(uint32_t open) {
+    spin_lock(&g_chan_lock);
+    for (uint32_t id = 0; id < IPC_MAX_CHANNELS; id++) {
+        if (open & (1u << id)) g_chans[id].refs++;
+    }
+    spin_unlock(&g_chan_lock);
+}
+
+int64_t sys_chan_open(uint64_t id, uint64_t pages) {
+    struct process *p = process_current();
+    if (!p) return -ENOSYS;
+    if (id >= IPC_MAX_CHANNELS || !pages || pages > IPC_MAX_PAGES) return -EINVAL;
+    if (p->ipc_open & (1u << id)) return -EBUSY;
+
+    // The first opener sizes it
+    struct channel *c = &g_chans[id];
+    spin_lock(&g_chan_lock);
+    if (!c->refs) {
+        if (uvm_pages_alloc(c->pages, pages) < 0) {
+            spin_unlock(&g_chan_lock);
+            return -ENOMEM;
+        }
+        c->npages = pages;
+    } else if (pages > c->npages) {
+        spin_unlock(&g_chan_lock);
+        return -EINVAL;
+    }
+    c->refs++;
+    spin_unlock(&g_chan_lock);
+
+    // Our reference keeps c->pages as they are
+    uint64_t va = uvm_map_shared(&p->uvm, IPC_MAP_BASE, c->pages, c->npages);
+    if (!va) {
+        ipc_release(1u << id);
+        return -ENOMEM;
+    }
+    p->ipc_open |= 1u << id;
+    return va;
+}
+
+//=============================================================================
+// Futexes
+//=============================================================================
+
+// The word's physical address, the same in every space that maps it. The
+// word must be writable: faulting it in for write also gives private
+// memory a page of its own, so two processes never share a key by
+// accident through the zero page or a copy-on-write page.
+static int64_t futex_key(uint64_t addr, uint64_t *key) {
+    struct process *p = process_current();
+    if (!p || (addr & 3)) return -EINVAL;
+    if (!uvm_user_ok(&p->uvm, addr, sizeof(uint32_t), 1)) return -EFAULT;
+    *key = (vmm_lookup(&p->uvm.vm, addr) & PTE_ADDR_MASK) | (addr & (PAGE_SIZE - 1));
+    return 0;
+}
+
+static uint32_t futex_bucket(uint64_t key) {
+    return ((key >> 2) * 0x9E3779B97F4A7C15ULL) >> 58;
+}
+
+int64_t sys_futex_wait(uint64_t addr, uint64_t val) {
+    uint64_t key;
+    int64_t err = futex_key(addr, &key);
+    if (err) return err;
+
+    struct futex_waiter w = { .key = key, .task = current_task() };
+    uint32_t b = futex_bucket(key);
+
+    // Checking the word and queueing under the bucket lock is what makes
+    // a wake between the user's check and this call impossible to miss
+    spin_lock(&g_futex[b].lock);
+    if (__atomic_load_n((const uint32_t *)addr, __ATOMIC_ACQUIRE) != (uint32_t)val) {
+        spin_unlock(&g_futex[b].lock);
+        return -EAGAIN;
+    }
+    w.next = g_futex[b].head;
+    g_futex[b].head = &w;
+    w.task->state = TASK_BLOCKED;
+    spin_unlock(&g_futex[b].lock);
+
+    task_block();
+    return 0;
+}
+
+static int64_t futex_wake(uint64_t key, uint64_t n) {
+    uint32_t b = futex_bucket(key);
+    int64_t woken = 0;
+    spin_lock(&g_futex[b].lock);
+    struct futex_waiter **pp = &g_futex[b].head;
+    while (*pp && (uint64_t)woken < n) {
+        struct futex_waiter *w = *pp;
+        if (w->key != key) {
+            pp = &w->next;
+            continue;
+        }
+        // `w` is on the sleeper's stack: done with it before the wake
+        *pp = w->next;
+        task_wake(w->task);
+        woken++;
+    }
+    spin_unlock(&g_futex[b].lock);
+    return woken;
+}
+
+int64_t sys_futex_wake(uint64_t addr, uint64_t n) {
+    uint64_t key;
+    int64_t err = futex_key(addr, &key);
+    if (err) return err;
+    return futex_wake(key, n);
+}
+
+int64_t ipc_futex_wake(struct vm_space *vm, uint64_t addr, uint64_t n) {
+    if ((addr & 3) || !vmm_user_ok(vm, addr, sizeof(uint32_t), 1)) return -EFAULT;
+    return futex_wake((vmm_lookup(vm, addr) & PTE_ADDR_MASK) | (addr & (PAGE_SIZE - 1)), n);
+}
+
+//=============================================================================
+// Page Grants
+//=============================================================================
+
+static struct channel *open_channel(struct process *p, uint64_t id) {
+    if (!p || id >= IPC_MAX_CHANNELS || !(p->ipc_open & (1u << id))) return NULL;
+    return &g_chans[id];
+}
+
+int64_t sys_grant(uint64_t id, uint64_t buf, uint64_t len) {
+    struct process *p = process_current();
+    struct channel *c = open_channel(p, id);
+    if (!c || !len || (len & (PAGE_SIZE - 1)) || len > IPC_GRANT_PAGES * PAGE_SIZE) {
+        return -EINVAL;
+    }
+
+    uint64_t *list = pmm_alloc_zeroed(1);
+    if (!list) return -ENOMEM;
+
+    // Claim a slot first, so taken pages always have somewhere to go
+    spin_lock(&g_chan_lock);
+    uint32_t slot = 0;
+    while (slot < IPC_MAX_GRANTS && c->grants[slot].pages) slot++;
+    if (slot == IPC_MAX_GRANTS) {
+        spin_unlock(&g_chan_lock);
+        pmm_free_pages(virt_to_phys(list), 1);
+        return -ENOSPC;
+    }
+    struct grant *g = &c->grants[slot];
+    g->pages = list;
+    g->count = 0;
+    g->seq = ++c->grant_seq;
+    int64_t handle = ((int64_t)g->seq << GRANT_SLOT_BITS) | slot;
+    spin_unlock(&g_chan_lock);
+
+    uint32_t n = len >> PAGE_SHIFT;
+    int ok = uvm_take(&p->uvm, buf, n, list) == 0;
+
+    spin_lock(&g_chan_lock);
+    if (ok) g->count = n;
+    else g->pages = NULL;
+    spin_unlock(&g_chan_lock);
+
+    if (!ok) {
+        pmm_free_pages(virt_to_phys(list), 1);
+        return -EFAULT;
+    }
+    return handle;
+}
+
+int64_t sys_accept(uint64_t id, uint64_t handle, uint64_t buf) {
+    struct process *p = process_current();
+    struct channel *c = open_channel(p, id);
+    if (!c) return -EINVAL;
+
+    spin_lock(&g_chan_lock);
+    struct grant *g = &c->grants[handle & (IPC_MAX_GRANTS - 1)];
+    if (!g->pages || !g->count || g->seq != (uint32_t)(handle >> GRANT_SLOT_BITS)) {
+        spin_unlock(&g_chan_lock);
+        return -ENOENT;
+    }
+    uint64_t *list = g->pages;
+    uint32_t n = g->count;
+    g->pages = NULL;
+    g->count = 0;
+    spin_unlock(&g_chan_lock);
+
+    // A bad destination loses the pages: the grant is used up either way
+    int ret = uvm_give(&p->uvm, buf, n, list);
+    pmm_free_pages(virt_to_phys(list), 1);
+    return ret < 0 ? -EFAULT : (int64_t)n;
+}
@@ -0,0 +1,43 @@
+// kernel/proc/ipc.h
+// Shared-memory channels, futex wait/wake and page grants
+//
+// The kernel stays out of the message path. A channel is a set of pages
+// mapped read/write into every process that opens it by number; what goes
+// in them (see user/ring.h) is the processes' business. The kernel only:
+//
+//   - puts a process to sleep on a 32-bit word and wakes it (futexes,
+//     keyed by physical address, so both ends of a channel agree on them)
+//   - moves pages from one address space to another for large payloads:
+//     grant() unmaps them from the sender and parks them in the channel,
+//     accept() maps them into the receiver. Nothing is copied.
+//
+// A channel lives while some process has it open; fork() children
+// inherit their parent's channels.
+#pragma once
+
+#include <stdint.h>
+
+struct vm_space;
+
+#define IPC_MAX_CHANNELS    16
+#define IPC_MAX_PAGES       256         // Per channel
+#define IPC_MAX_GRANTS      32          // Pending per channel
+#define IPC_GRANT_PAGES     512         // Per grant
+
+// Drop a process's channels (struct process.ipc_open) as it exits
+void ipc_release(uint32_t open);
+
+// Take references for a fork child inheriting `open`
+void ipc_retain(uint32_t open);
+
+// futex_wake() on behalf of the owner of `vm`, from any context: the word
+// must already be mapped writable, since nothing is faulted in. For
+// asynchronous submissions (proc/aio.h).
+int64_t ipc_futex_wake(struct vm_space *vm, uint64_t addr, uint64_t n);
+
+// System calls (common/syscall.h)
+int64_t sys_chan_open(uint64_t id, uint64_t pages);
+int64_t sys_futex_wait(uint64_t addr, uint64_t val);
+int64_t sys_futex_wake(uint64_t addr, uint64_t n);
+int64_t sys_grant(uint64_t id, uint64_t buf, uint64_t len);
+int64_t sys_accept(uint64_t id, uint64_t handle, uint64_t buf);
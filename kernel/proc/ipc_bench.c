@@ -0,0 +1,66 @@
+// kernel/proc/ipc_bench.c
+// Channel ping-pong latency and bulk throughput between two processes
+#include "proc/ipc_bench.h"
+#include "boot/cmdline.h"
+#include "lib/printk.h"
+#include "proc/process.h"
+#include "x86/smp.h"
+
+#define BENCH_PROGRAM   "ipcbench.elf"
+
+// user/ipcbench.c's argument: role, placement, channel and iterations
+#define ARG_SERVER      (1ULL << 0)
+#define ARG_SAME_CPU    (1ULL << 1)
+#define ARG_CHAN_SHIFT  4
+#define ARG_ITERS_SHIFT 8
+
+struct pair {
+    uint64_t arg[2];                    // Client, server
+    int64_t  code[2];
+};
+
+static void pair_init(struct pair *pr, int same_cpu, uint32_t chan, uint64_t iters) {
+    uint64_t common = (same_cpu ? ARG_SAME_CPU : 0) | ((uint64_t)chan << ARG_CHAN_SHIFT) |
+                      (iters << ARG_ITERS_SHIFT);
+    pr->arg[0] = common;
+    pr->arg[1] = common | ARG_SERVER;
+    pr->code[0] = pr->code[1] = -1;
+}
+
+static void report(const char *where, const struct pair *pr) {
+    if (pr->code[0] || pr->code[1]) {
+        kprintf("ipcbench: %s: client exited with %lld, server with %lld\n", where,
+                (long long)pr->code[0], (long long)pr->code[1]);
+    }
+}
+
+// smp_run(): CPU 0 runs the client, CPU 1 the server
+static void run_side(void *arg, uint32_t cpu, uint32_t ncpus) {
+    (void)ncpus;
+    struct pair *pr = arg;
+    struct process *p = process_spawn(BENCH_PROGRAM, pr->arg[cpu]);
+    if (p) pr->code[cpu] = process_wait(p, NULL);
+}
+
+void ipc_bench(void) {
+    uint64_t iters = cmdline_get_u64("ipcbench.iters", 100000);
+    if (!iters || iters >> (64 - ARG_ITERS_SHIFT)) return;
+
+    // Both on this CPU: every hand-off is a block and a task switch. The
+    // server goes first so a missing module stops here.
+    struct pair pr;
+    pair_init(&pr, 1, 0, iters);
+    kprintf("ipcbench: same CPU\n");
+    struct process *server = process_spawn(BENCH_PROGRAM, pr.arg[1]);
+    if (!server) return;
+    struct process *client = process_spawn(BENCH_PROGRAM, pr.arg[0]);
+    if (client) pr.code[0] = process_wait(client, NULL);
+    pr.code[1] = process_wait(server, NULL);
+    report("same CPU", &pr);
+
+    if (smp_cpu_count() < 2) return;
+    pair_init(&pr, 0, 1, iters);
+    kprintf("ipcbench: CPUs 0 and 1\n");
+    smp_run(run_side, &pr, 2);
+    report("CPUs 0 and 1", &pr);
+}
@@ -0,0 +1,11 @@
+// kernel/proc/ipc_bench.h
+// Channel ping-pong latency and bulk throughput between two processes
+#pragma once
+
+// Run user/ipcbench.elf (a boot module) as a client and a server process,
+// first both on this CPU, then on CPUs 0 and 1. The client prints the
+// round-trip latency, streaming throughput of small ring messages, and
+// bulk throughput of 256 KiB buffers granted against copied.
+// Command line knob:
+//   ipcbench.iters=N   round trips and streamed messages per run (default 100000)
+void ipc_bench(void);
@@ -0,0 +1,346 @@
+// kernel/proc/process.c
+// User processes: ELF loading, fork, exit and wait
+#include "proc/process.h"
+#include "boot/bootinfo.h"
+#include "boot/initcall.h"
+#include "common/elf.h"
+#include "lib/printk.h"
+#include "lib/spinlock.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "proc/aio.h"
+#include "proc/ipc.h"
+#include "x86/cpu.h"
+#include "x86/idt.h"
+#include "x86/percpu.h"
+
+#define PROC_PAGES      (PAGE_ALIGN_UP(sizeof(struct process)) >> PAGE_SHIFT)
+#define USER_STACK_TOP  USER_MAP_TOP            // Unmapped guard page above
+
+static struct process *g_procs;
+static spinlock_t      g_lock = SPINLOCK_INIT;
+static int64_t         g_next_pid = 1;
+
+//=============================================================================
+// Life Cycle
+//=============================================================================
+
+static struct process *proc_alloc(const char *name) {
+    struct process *p = pmm_alloc_zeroed(PROC_PAGES);
+    if (!p) return NULL;
+
+    uint64_t kstack = pmm_alloc_pages(PROC_STACK_SIZE / PAGE_SIZE);
+    if (!kstack || uvm_create(&p->uvm) < 0) {
+        if (kstack) pmm_free_pages(kstack, PROC_STACK_SIZE / PAGE_SIZE);
+        pmm_free_pages(virt_to_phys(p), PROC_PAGES);
+        return NULL;
+    }
+    p->kstack = phys_to_virt(kstack);
+    p->pid = __atomic_fetch_add(&g_next_pid, 1, __ATOMIC_RELAXED);
+
+    size_t n = 0;
+    while (name[n] && n < PROC_NAME_MAX - 1) {
+        p->name[n] = name[n];
+        n++;
+    }
+    return p;
+}
+
+static void proc_free(struct process *p) {
+    uvm_destroy(&p->uvm);
+    pmm_free_pages(virt_to_phys(p->kstack), PROC_STACK_SIZE / PAGE_SIZE);
+    pmm_free_pages(virt_to_phys(p), PROC_PAGES);
+}
+
+static void process_main(void *arg) {
+    struct process *p = arg;
+
+    p->start_tsc = rdtsc();
+    vmm_activate(&p->uvm.vm);
+    int64_t code = user_run_regs(&p->regs);
+    vmm_activate(NULL);
+    aio_release(p->aio);
+    p->aio = NULL;
+    uvm_destroy(&p->uvm);
+    ipc_release(p->ipc_open);
+    p->ipc_open = 0;
+    p->exit_tsc = rdtsc();
+
+    spin_lock(&g_lock);
+    p->exit_code = code;
+    for (struct process *c = g_procs; c; c = c->next) {
+        if (c->parent == p) c->parent = NULL;
+    }
+    p->state = PROC_ZOMBIE;
+    spin_unlock(&g_lock);
+    // Returning ends the task; the zombie waits for its parent
+}
+
+static void proc_start(struct process *p) {
+    task_create(&p->task, p->name, process_main, p, p->kstack, PROC_STACK_SIZE);
+    p->task.proc = p;
+
+    spin_lock(&g_lock);
+    p->next = g_procs;
+    g_procs = p;
+    spin_unlock(&g_lock);
+}
+
+// Exited, and its task has switched away for the last time. The parent
+// runs on the same CPU, so once it sees TASK_DEAD the stack is free.
+static int reapable(const struct process *p) {
+    return p->state == PROC_ZOMBIE && p->task.state == TASK_DEAD;
+}
+
+static void unlink_locked(struct process *p) {
+    for (struct process **pp = &g_procs; *pp; pp = &(*pp)->next) {
+        if (*pp == p) {
+            *pp = p->next;
+            return;
+        }
+    }
+}
+
+static void reap(struct process *p) {
+    task_reap(&p->task);
+    proc_free(p);
+}
+
+// Free this CPU's zombies nobody is left to wait for
+static void reap_orphans(void) {
+    uint32_t cpu = this_cpu()->cpu_id;
+    struct process *dead = NULL;
+
+    spin_lock(&g_lock);
+    struct process **pp = &g_procs;
+    while (*pp) {
+        struct process *p = *pp;
+        if (!p->parent && !p->kernel_owned && p->task.cpu == cpu && reapable(p)) {
+            *pp = p->next;
+            p->next = dead;
+            dead = p;
+        } else {
+            pp = &p->next;
+        }
+    }
+    spin_unlock(&g_lock);
+
+    while (dead) {
+        struct process *p = dead;
+        dead = p->next;
+        reap(p);
+    }
+}
+
+//=============================================================================
+// Loading
+//=============================================================================
+
+static int name_eq(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static const struct BootTagModule *find_module(const char *name) {
+    for (const struct BootTagModule *m = bootinfo_next_module(NULL); m;
+         m = bootinfo_next_module(m)) {
+        if (name_eq(m->name, name)) return m;
+    }
+    return NULL;
+}
+
+// One region per PT_LOAD segment, backed by the module itself. Returns 0,
+// or -1 with a message.
+static int load_elf(struct process *p, const struct BootTagModule *m) {
+    const Elf64_Ehdr *eh = phys_to_virt(m->base);
+
+    if (m->size < sizeof(*eh) || *(const uint32_t *)eh->e_ident != ELF_MAGIC ||
+        eh->e_ident[4] != ELFCLASS64 || eh->e_ident[5] != ELFDATA2LSB ||
+        eh->e_type != ET_EXEC || eh->e_machine != EM_X86_64) {
+        kprintf("exec: %s is not an x86-64 static executable\n", m->name);
+        return -1;
+    }
+    if (eh->e_phentsize != sizeof(Elf64_Phdr) || eh->e_phoff > m->size ||
+        (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr) > m->size - eh->e_phoff) {
+        kprintf("exec: %s: bad program headers\n", m->name);
+        return -1;
+    }
+
+    const Elf64_Phdr *ph = phys_to_virt(m->base + eh->e_phoff);
+    for (uint32_t i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD || !ph[i].p_memsz) continue;
+
+        // The region starts on the page holding p_vaddr, and so does its
+        // file data, at the same offset into the page
+        uint64_t lead = ph[i].p_vaddr & (PAGE_SIZE - 1);
+        uint64_t start = ph[i].p_vaddr - lead;
+        uint64_t end = PAGE_ALIGN_UP(ph[i].p_vaddr + ph[i].p_memsz);
+        uint32_t prot = ((ph[i].p_flags & PF_R) ? UVM_READ : 0) |
+                        ((ph[i].p_flags & PF_W) ? UVM_WRITE : 0) |
+                        ((ph[i].p_flags & PF_X) ? UVM_EXEC : 0);
+        if (ph[i].p_filesz > ph[i].p_memsz || ph[i].p_offset < lead ||
+            ph[i].p_offset > m->size || ph[i].p_filesz > m->size - ph[i].p_offset ||
+            end < start ||
+            uvm_add_region(&p->uvm, start, end, prot, m->base + ph[i].p_offset - lead,
+                           ph[i].p_filesz + lead) < 0) {
+            kprintf("exec: %s: segment %u at %#llx does not fit\n", m->name, i,
+                    (unsigned long long)ph[i].p_vaddr);
+            return -1;
+        }
+    }
+
+    if (uvm_add_region(&p->uvm, USER_STACK_TOP - PROC_USER_STACK, USER_STACK_TOP,
+                       UVM_READ | UVM_WRITE, 0, 0) < 0 ||
+        eh->e_entry < USER_BASE || eh->e_entry >= USER_MAP_TOP) {
+        kprintf("exec: %s: entry point or stack outside the user range\n", m->name);
+        return -1;
+    }
+
+    p->image_size = m->size;
+    p->regs.rip = eh->e_entry;
+    p->regs.rsp = USER_STACK_TOP;
+    return 0;
+}
+
+struct process *process_spawn(const char *name, uint64_t arg) {
+    reap_orphans();
+
+    const struct BootTagModule *m = find_module(name);
+    if (!m) {
+        kprintf("exec: no module named %s\n", name);
+        return NULL;
+    }
+    struct process *p = proc_alloc(name);
+    if (!p) {
+        kprintf("exec: out of memory\n");
+        return NULL;
+    }
+    if (load_elf(p, m) < 0) {
+        proc_free(p);
+        return NULL;
+    }
+
+    p->regs.rdi = arg;
+    p->kernel_owned = 1;
+    proc_start(p);
+    return p;
+}
+
+int64_t process_wait(struct process *p, struct uvm_stats *stats) {
+    while (!reapable(p)) task_yield();
+
+    spin_lock(&g_lock);
+    unlink_locked(p);
+    spin_unlock(&g_lock);
+
+    int64_t code = p->exit_code;
+    if (stats) {
+        *stats = p->uvm.stats;
+        uvm_stats_add(stats, &p->child_stats);
+    }
+    reap(p);
+    reap_orphans();
+    return code;
+}
+
+//=============================================================================
+// Page Faults
+//=============================================================================
+
+static void page_fault(struct trap_frame *f) {
+    struct process *p = process_current();
+
+    // The kernel faults user pages in before touching them (see
+    // process_user_ok()), so only ring 3 gets here legitimately
+    if ((f->cs & 3) && p && uvm_fault(&p->uvm, read_cr2(), f->error) == 0) return;
+    trap_unhandled(f);
+}
+
+void process_init(void) {
+    idt_set_handler(VEC_PAGE_FAULT, page_fault);
+}
+INITCALL(process, process_init, "vmm", 0);
+
+//=============================================================================
+// System Calls
+//=============================================================================
+
+struct process *process_current(void) {
+    return current_task()->proc;
+}
+
+int process_user_ok(uint64_t va, uint64_t len, int write) {
+    struct process *p = process_current();
+    if (p) return uvm_user_ok(&p->uvm, va, len, write);
+
+    struct vm_space active = { .root = read_cr3() };
+    return vmm_user_ok(&active, va, len, write);
+}
+
+int64_t process_fork(const struct user_regs *regs) {
+    struct process *parent = process_current();
+    if (!parent) return -ENOSYS;
+
+    struct process *c = proc_alloc(parent->name);
+    if (!c) return -ENOMEM;
+    if (uvm_fork(&parent->uvm, &c->uvm) < 0) {
+        proc_free(c);
+        return -ENOMEM;
+    }
+    c->ipc_open = parent->ipc_open;
+    ipc_retain(c->ipc_open);
+    c->image_size = parent->image_size;
+    c->regs = *regs;
+    c->regs.rax = 0;
+    c->parent = parent;
+    proc_start(c);
+    fpu_task_copy(&c->task.fpu);
+    return c->pid;
+}
+
+int64_t sys_wait(uint64_t pid, uint64_t status) {
+    struct process *self = process_current();
+    if (!self) return -ECHILD;
+
+    for (;;) {
+        struct process *found = NULL;
+        int children = 0;
+
+        spin_lock(&g_lock);
+        for (struct process *c = g_procs; c && !found; c = c->next) {
+            if (c->parent != self || (pid && (uint64_t)c->pid != pid)) continue;
+            children++;
+            if (reapable(c)) found = c;
+        }
+        if (found) unlink_locked(found);
+        spin_unlock(&g_lock);
+
+        if (found) {
+            int64_t ret = found->pid;
+            if (status && process_user_ok(status, sizeof(int64_t), 1)) {
+                *(int64_t *)status = found->exit_code;
+            } else if (status) {
+                ret = -EFAULT;
+            }
+            uvm_stats_add(&self->child_stats, &found->uvm.stats);
+            uvm_stats_add(&self->child_stats, &found->child_stats);
+            reap(found);
+            return ret;
+        }
+        if (!children) return -ECHILD;
+        task_yield();
+    }
+}
+
+int64_t sys_getpid(void) {
+    struct process *p = process_current();
+    return p ? p->pid : 0;
+}
+
+int64_t sys_yield(void) {
+    task_yield();
+    return 0;
+}
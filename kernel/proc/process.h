@@ -0,0 +1,77 @@
+// kernel/proc/process.h
+// User processes: a task, an address space and a place in the family tree
+//
+// A process is a kernel task that spends its life inside user_run(). The
+// image is an ELF executable from a boot module, mapped lazily by
+// mm/uvm.c. Processes are single-threaded and never leave the CPU they
+// were created on; fork() puts the child on the parent's CPU too.
+//
+// A finished process stays a zombie, holding its exit code and fault
+// counters, until its parent (or the kernel, for process_spawn()) waits
+// for it. Zombies whose parent exited first are freed as they are found.
+#pragma once
+
+#include <stdint.h>
+#include "mm/uvm.h"
+#include "sched/task.h"
+#include "x86/syscall.h"
+
+struct aio_ring;
+
+#define PROC_STACK_SIZE     (16 * 1024)         // Kernel stack
+#define PROC_USER_STACK     (1024 * 1024)       // Ring 3 stack, demand paged
+#define PROC_NAME_MAX       32
+
+enum process_state {
+    PROC_RUNNING,
+    PROC_ZOMBIE,
+};
+
+struct process {
+    int64_t             pid;
+    enum process_state  state;
+    int                 kernel_owned;   // Spawned by the kernel, which waits for it
+    int64_t             exit_code;
+    struct process     *parent;         // NULL: kernel owned or orphaned
+    struct process     *next;           // All processes
+    struct uvm          uvm;
+    struct uvm_stats    child_stats;    // Summed from waited-for children
+    uint32_t            ipc_open;       // Channels it has open, by bit (proc/ipc.h)
+    struct aio_ring    *aio;            // Its I/O ring (proc/aio.h), or NULL
+    struct user_regs    regs;           // First entry to ring 3
+    uint64_t            image_size;     // Bytes of the ELF file
+    uint64_t            start_tsc, exit_tsc;
+    char                name[PROC_NAME_MAX];
+    void               *kstack;
+    struct task         task;
+};
+
+// Install the page fault handler. Call once, after vmm_init().
+void process_init(void);
+
+// Start the executable in boot module `name` on this CPU, with `arg` in
+// RDI. Returns the process, or NULL with a message if the module is
+// missing, not a static x86-64 executable, or memory runs out.
+struct process *process_spawn(const char *name, uint64_t arg);
+
+// Yield until `p` (from process_spawn()) exits, then free it. Returns its
+// exit code; `stats`, if not NULL, gets the fault counters of it and the
+// children it waited for.
+int64_t process_wait(struct process *p, struct uvm_stats *stats);
+
+// The process the current task runs, or NULL in a kernel task
+struct process *process_current(void);
+
+// Nonzero if the current process may access [va, va + len), which is then
+// safe for the kernel to touch. Kernel tasks in ring 3 (syscall_bench)
+// are checked against the active page tables.
+int process_user_ok(uint64_t va, uint64_t len, int write);
+
+// fork(): copy the current process, the child starting at `regs` with RAX
+// = 0. Returns the child's PID, or -ENOMEM.
+int64_t process_fork(const struct user_regs *regs);
+
+// System calls (common/syscall.h)
+int64_t sys_wait(uint64_t pid, uint64_t status);
+int64_t sys_getpid(void);
+int64_t sys_yield(void);
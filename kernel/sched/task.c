@@ -0,0 +1,132 @@
+// kernel/sched/task.c
+// Kernel tasks and context switching
+#include "task.h"
+#include "x86/cpu.h"
+#include "x86/percpu.h"
+#include "x86/syscall.h"
+#include "lib/printk.h"
+
+// x86/switch.S: push callee-saved registers, store RSP to *prev_rsp,
+// load next_rsp, pop and return on the new stack
+void context_switch(uint64_t *prev_rsp, uint64_t next_rsp);
+void task_entry_trampoline(void);
+
+void sched_init(struct task *boot_task, const char *name) {
+    struct percpu *pc = this_cpu();
+
+    boot_task->rsp   = 0;
+    boot_task->next  = boot_task;
+    boot_task->name  = name;
+    boot_task->state = TASK_RUNNING;
+    boot_task->cpu   = pc->cpu_id;
+    boot_task->switches = 0;
+    boot_task->cr3   = 0;
+    boot_task->user_rsp0 = 0;
+    boot_task->proc  = NULL;
+
+    // fpu_init() gives the boot task its SIMD state
+    pc->current = boot_task;
+}
+
+void task_create(struct task *t, const char *name, task_fn fn, void *arg,
+                 void *stack, size_t stack_size) {
+    struct percpu *pc = this_cpu();
+
+    // Initial frame popped by context_switch: r15, r14, r13, r12, rbx, rbp,
+    // then the return address. The trampoline calls r12(r13).
+    uint64_t *sp = (uint64_t *)(((uint64_t)stack + stack_size) & ~15ULL);
+    *--sp = (uint64_t)task_entry_trampoline;
+    *--sp = 0;                  // rbp
+    *--sp = 0;                  // rbx
+    *--sp = (uint64_t)fn;       // r12
+    *--sp = (uint64_t)arg;      // r13
+    *--sp = 0;                  // r14
+    *--sp = 0;                  // r15
+
+    t->rsp   = (uint64_t)sp;
+    t->name  = name;
+    t->state = TASK_READY;
+    t->cpu   = pc->cpu_id;
+    t->switches = 0;
+    t->cr3   = 0;
+    t->user_rsp0 = 0;
+    t->proc  = NULL;
+    fpu_task_init(&t->fpu);
+
+    uint64_t flags = irq_save();
+    t->next = pc->current->next;
+    pc->current->next = t;
+    irq_restore(flags);
+}
+
+static void switch_to(struct percpu *pc, struct task *prev, struct task *next) {
+    fpu_switch(prev, next);
+    user_switch(prev, next);
+
+    if (prev->state == TASK_RUNNING) prev->state = TASK_READY;
+    next->state = TASK_RUNNING;
+    next->switches++;
+    pc->current = next;
+
+    context_switch(&prev->rsp, next->rsp);
+}
+
+void task_yield(void) {
+    uint64_t flags = irq_save();
+    struct percpu *pc = this_cpu();
+    struct task *prev = pc->current;
+
+    // Unlink dead tasks as we walk past them, skip blocked ones
+    struct task *cursor = prev;
+    while (cursor->next != prev) {
+        struct task *t = cursor->next;
+        if (t->state == TASK_DEAD) cursor->next = t->next;
+        else if (__atomic_load_n(&t->state, __ATOMIC_ACQUIRE) == TASK_READY) break;
+        else cursor = t;
+    }
+
+    struct task *next = cursor->next;
+    if (next != prev) switch_to(pc, prev, next);
+
+    irq_restore(flags);
+}
+
+void task_block(void) {
+    struct task *cur = current_task();
+
+    while (__atomic_load_n(&cur->state, __ATOMIC_ACQUIRE) == TASK_BLOCKED) {
+        task_yield();
+        cpu_relax();
+    }
+    // Woken while still on the CPU: task_wake() said ready
+    cur->state = TASK_RUNNING;
+}
+
+void task_wake(struct task *t) {
+    enum task_state blocked = TASK_BLOCKED;
+    __atomic_compare_exchange_n(&t->state, &blocked, TASK_READY, 0,
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+void task_exit(void) {
+    irq_save();
+    this_cpu()->current->state = TASK_DEAD;
+    task_yield();
+    panic("task_exit: no task left to run");
+}
+
+void task_reap(struct task *t) {
+    uint64_t flags = irq_save();
+    struct task *cur = this_cpu()->current;
+    for (struct task *p = cur; p->next != cur; p = p->next) {
+        if (p->next == t && t->state == TASK_DEAD) {
+            p->next = t->next;
+            break;
+        }
+    }
+    irq_restore(flags);
+}
+
+struct task *current_task(void) {
+    return this_cpu()->current;
+}
@@ -0,0 +1,62 @@
+// kernel/sched/task.h
+// Kernel tasks and context switching
+//
+// A task is a kernel stack plus saved callee-saved registers and SIMD state.
+// Scheduling is cooperative round-robin per CPU for now: task_yield()
+// switches to the next ready task.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "x86/fpu.h"
+
+struct process;
+
+enum task_state {
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_BLOCKED,   // waiting for task_wake()
+    TASK_DEAD,
+};
+
+struct task {
+    uint64_t         rsp;       // saved stack pointer while switched out
+    struct task     *next;      // circular run list
+    const char      *name;
+    enum task_state  state;
+    uint32_t         cpu;
+    uint64_t         switches;
+    uint64_t         cr3;       // own page tables (mm/vmm.h), 0 = the kernel's
+    uint64_t         user_rsp0; // kernel stack for ring 3 entries while in user_run()
+    struct process  *proc;      // user process it runs (proc/process.h), or NULL
+    struct fpu       fpu;
+};
+
+typedef void (*task_fn)(void *arg);
+
+// Adopt the running boot context as task 0 of this CPU
+void sched_init(struct task *boot_task, const char *name);
+
+// Create a task on the current CPU. The caller owns `t` and `stack`.
+void task_create(struct task *t, const char *name, task_fn fn, void *arg,
+                 void *stack, size_t stack_size);
+
+// Switch to the next ready task (no-op if there is none)
+void task_yield(void);
+
+// Sleep until task_wake(). The caller marks itself TASK_BLOCKED first,
+// under the same lock the waker takes, so a wake-up in between is not
+// lost. Returns at once if it already came.
+void task_block(void);
+
+// Make a blocked task ready again. Any CPU; the task's own CPU picks it
+// up at its next task_yield().
+void task_wake(struct task *t);
+
+// Mark the current task dead and switch away. Returning from fn does this.
+__attribute__((noreturn)) void task_exit(void);
+
+// Unlink a dead task of this CPU so its memory can be reused
+void task_reap(struct task *t);
+
+struct task *current_task(void);
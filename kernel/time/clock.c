@@ -0,0 +1,253 @@
+// kernel/time/clock.c
+// Clock source selection, TSC synchronisation and now_ns()
+#include "time/clock.h"
+#include "boot/initcall.h"
+#include "drivers/hpet.h"
+#include "lib/printk.h"
+#include "lib/seqlock.h"
+#include "lib/spinlock.h"
+#include "x86/cpu.h"
+#include "x86/cpufeature.h"
+#include "x86/percpu.h"
+#include "x86/smp.h"
+#include "x86/tsc.h"
+
+#define CLOCK_SHIFT     32          // Same fixed point as tsc_ns_mult
+#define SYNC_ROUNDS     64          // Ping-pongs per AP; the fastest one counts
+#define WARP_TEST_NS    2000000ULL  // 2 ms of every CPU reading the clock
+#define REFINE_MIN_NS   50000000ULL
+
+enum clock_source {
+    CLOCK_NONE,
+    CLOCK_TSC,
+    CLOCK_HPET,
+};
+
+// ns = base_ns + (counter - base_cycles) * mult >> CLOCK_SHIFT. Only
+// clock_init() and clock_refine() write it, both on the BSP.
+static struct {
+    seqcount_t        seq;
+    enum clock_source source;
+    uint64_t          base_cycles;
+    uint64_t          base_ns;
+    uint64_t          mult;
+} g_clock = { .seq = SEQCOUNT_INIT };
+
+static uint64_t g_read_cycles;
+static struct tsc_ref g_ref;            // HPET sample from clock_init()
+
+// The TSC in the BSP's terms. Tasks never change CPU, so the percpu read
+// and the RDTSC are on the same one.
+static inline uint64_t read_counter(enum clock_source src) {
+    if (src == CLOCK_TSC) return rdtsc_ordered() - this_cpu()->tsc_offset;
+    return hpet_read();
+}
+
+static inline uint64_t scale(uint64_t cycles, uint64_t mult) {
+    return (uint64_t)(((unsigned __int128)cycles * mult) >> CLOCK_SHIFT);
+}
+
+uint64_t now_ns(void) {
+    uint32_t seq;
+    uint64_t ns;
+
+    do {
+        seq = read_seqbegin(&g_clock.seq);
+        enum clock_source src = g_clock.source;
+        if (src == CLOCK_NONE) return 0;
+        ns = g_clock.base_ns + scale(read_counter(src) - g_clock.base_cycles, g_clock.mult);
+    } while (read_seqretry(&g_clock.seq, seq));
+    return ns;
+}
+
+//=============================================================================
+// Setup
+//=============================================================================
+
+const char *clock_init(void) {
+    enum clock_source src = CLOCK_TSC;
+    const char *name = "tsc";
+
+    // Without the invariant TSC bit the rate may follow P-states or stop
+    // in deep C-states. Hypervisors often leave the bit clear while
+    // keeping the guest TSC constant, so trust the TSC there.
+    if (!cpu_has(X86_FEATURE_INVTSC)) {
+        if (cpu_has(X86_FEATURE_HYPERVISOR)) {
+            name = "tsc (hypervisor)";
+        } else if (hpet_present() && hpet_is_64bit()) {
+            src = CLOCK_HPET;
+            name = "hpet";
+        } else {
+            name = "tsc (not invariant)";
+        }
+    }
+    if (hpet_present()) tsc_sample_hpet(&g_ref);
+
+    write_seqbegin(&g_clock.seq);
+    g_clock.base_cycles = read_counter(src);
+    g_clock.base_ns = 0;
+    g_clock.mult = src == CLOCK_TSC ? tsc_ns_mult
+                                    : (hpet_period_fs() << CLOCK_SHIFT) / 1000000;
+    g_clock.source = src;
+    write_seqend(&g_clock.seq);
+
+    const uint32_t reps = 1000;
+    volatile uint64_t sink;
+    uint64_t start = rdtsc_ordered();
+    for (uint32_t i = 0; i < reps; i++) sink = now_ns();
+    (void)sink;
+    g_read_cycles = (rdtsc_ordered() - start) / reps;
+    return name;
+}
+
+uint64_t clock_read_cycles(void) {
+    return g_read_cycles;
+}
+
+//=============================================================================
+// TSC Synchronisation
+//=============================================================================
+
+// One BSP-AP pairing. The BSP notes its TSC, raises `req`, and notes it
+// again when `ack` comes back; the AP's reading falls somewhere between.
+// Assuming the two legs take equally long, the AP read at the midpoint,
+// give or take half the round trip.
+struct sync {
+    uint32_t          ap;
+    volatile uint32_t req;
+    volatile uint32_t ack;
+    volatile uint64_t ap_tsc;
+    uint64_t          rtt;              // Shortest round trip, cycles
+    int64_t           offset;           // AP minus BSP at that round trip
+};
+
+static void sync_bsp(struct sync *s) {
+    uint64_t flags = irq_save();
+
+    s->rtt = ~0ULL;
+    for (uint32_t i = 1; i <= SYNC_ROUNDS; i++) {
+        uint64_t t0 = rdtsc_ordered();
+        __atomic_store_n(&s->req, i, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&s->ack, __ATOMIC_ACQUIRE) != i) cpu_relax();
+        uint64_t t1 = rdtsc_ordered();
+
+        if (t1 - t0 < s->rtt) {
+            s->rtt = t1 - t0;
+            s->offset = (int64_t)(s->ap_tsc - (t0 + (t1 - t0) / 2));
+        }
+    }
+    irq_restore(flags);
+}
+
+// smp_run() work runs with interrupts off
+static void sync_ap(struct sync *s) {
+    for (uint32_t i = 1; i <= SYNC_ROUNDS; i++) {
+        while (__atomic_load_n(&s->req, __ATOMIC_ACQUIRE) != i) cpu_relax();
+        s->ap_tsc = rdtsc_ordered();
+        __atomic_store_n(&s->ack, i, __ATOMIC_RELEASE);
+    }
+}
+
+static void sync_pair(void *arg, uint32_t cpu, uint32_t ncpus) {
+    struct sync *s = arg;
+    (void)ncpus;
+
+    if (cpu == 0) sync_bsp(s);
+    else if (cpu == s->ap) sync_ap(s);
+}
+
+// Every CPU takes turns, under a lock, reading now_ns() and comparing it
+// with the last value any CPU read. With the lock ordering the reads, a
+// smaller value means time ran backwards across CPUs.
+struct warp {
+    spinlock_t lock;
+    uint64_t   last;
+    uint64_t   end;
+    uint64_t   warps;
+    uint64_t   max_warp;
+};
+
+static void warp_check(void *arg, uint32_t cpu, uint32_t ncpus) {
+    struct warp *w = arg;
+    uint64_t now;
+    (void)cpu;
+    (void)ncpus;
+
+    do {
+        spin_lock(&w->lock);
+        uint64_t prev = w->last;
+        now = now_ns();
+        w->last = now;
+        if (now < prev) {
+            w->warps++;
+            if (prev - now > w->max_warp) w->max_warp = prev - now;
+        }
+        spin_unlock(&w->lock);
+    } while (now < w->end);
+}
+
+void clock_sync_check(void) {
+    uint32_t ncpus = smp_cpu_count();
+    if (ncpus < 2) return;
+
+    uint32_t corrected = 0;
+    uint64_t max_rtt = 0;
+    int64_t max_offset = 0;
+    for (uint32_t cpu = 1; cpu < ncpus; cpu++) {
+        struct sync s = { .ap = cpu };
+        smp_run(sync_pair, &s, cpu + 1);
+
+        // Anything within half the round trip is measurement error
+        uint64_t mag = s.offset < 0 ? -(uint64_t)s.offset : (uint64_t)s.offset;
+        if (mag > s.rtt / 2) {
+            g_percpu[cpu].tsc_offset = s.offset;
+            corrected++;
+        }
+        if (s.rtt > max_rtt) max_rtt = s.rtt;
+        if (mag > (uint64_t)(max_offset < 0 ? -max_offset : max_offset)) max_offset = s.offset;
+    }
+
+    struct warp w = { .lock = SPINLOCK_INIT };
+    w.end = now_ns() + WARP_TEST_NS;
+    smp_run(warp_check, &w, ncpus);
+
+    kprintf("Clock: max TSC offset %lld cycles (round trip %llu), %u CPUs corrected, "
+            "%llu backward steps",
+            (long long)max_offset, (unsigned long long)max_rtt, corrected,
+            (unsigned long long)w.warps);
+    if (w.warps) kprintf(" (worst %llu ns)", (unsigned long long)w.max_warp);
+    kprintf("\n");
+}
+INITCALL(clock_sync, clock_sync_check, "", INIT_SMP);
+
+//=============================================================================
+// Recalibration
+//=============================================================================
+
+void clock_refine(void) {
+    if (!tsc_khz_measured || !hpet_present() || g_clock.source != CLOCK_TSC) return;
+
+    struct tsc_ref now;
+    tsc_sample_hpet(&now);
+    uint64_t elapsed = hpet_delta(g_ref.ref, now.ref) * hpet_period_fs() / 1000000;
+    if (elapsed < REFINE_MIN_NS) return;
+    uint64_t khz = tsc_khz_between(&g_ref, &now);
+    uint64_t old = tsc_khz;
+    if (!khz || khz == old) return;
+
+    // Rebase at the switch so time carries on from where the old factor
+    // had it
+    uint64_t flags = irq_save();
+    write_seqbegin(&g_clock.seq);
+    uint64_t cycles = read_counter(CLOCK_TSC);
+    g_clock.base_ns += scale(cycles - g_clock.base_cycles, g_clock.mult);
+    g_clock.base_cycles = cycles;
+    tsc_set_khz(khz);
+    g_clock.mult = tsc_ns_mult;
+    write_seqend(&g_clock.seq);
+    irq_restore(flags);
+
+    kprintf("Clock: TSC %llu -> %llu kHz over %llu ms of HPET time\n",
+            (unsigned long long)old, (unsigned long long)khz,
+            (unsigned long long)(elapsed / 1000000));
+}
@@ -0,0 +1,35 @@
+// kernel/time/clock.h
+// Monotonic nanosecond clock
+//
+// now_ns() is a counter read, a subtraction and a 64x64->128 multiply by a
+// fixed-point factor - no division and no lock. Readers only spin if they
+// catch clock_refine() in the middle of replacing the factors, which
+// happens once per boot.
+//
+// The counter is the TSC when it runs at a constant rate (CPUID invariant
+// TSC, or a hypervisor that keeps it so), corrected per CPU by the offset
+// clock_sync_check() measured. Without that, a 64-bit HPET is used: slower
+// to read (uncached MMIO) but steady.
+#pragma once
+
+#include <stdint.h>
+
+// Nanoseconds since clock_init(); 0 before it
+uint64_t now_ns(void);
+
+// Pick the counter and set the factors from tsc_khz. Call after
+// tsc_init() on the BSP. Returns the name of the counter chosen.
+const char *clock_init(void);
+
+// Average cost of one now_ns() call, measured by clock_init()
+uint64_t clock_read_cycles(void);
+
+// Measure each AP's TSC against the BSP's and store any offset larger than
+// the measurement error in its percpu, then check that now_ns() never runs
+// backwards between CPUs. Call after smp_init(); prints a summary.
+void clock_sync_check(void);
+
+// If the TSC rate was only measured over a few ms at boot, measure it again
+// against the HPET over the whole boot so far (at least 50 ms) and switch
+// to the better factors without a jump in time. Prints the change.
+void clock_refine(void);
@@ -0,0 +1,109 @@
+// kernel/x86/apic.c
+// Local APIC (xAPIC MMIO or x2APIC MSRs)
+#include "x86/apic.h"
+#include "x86/cpu.h"
+#include "x86/cpufeature.h"
+#include "x86/idt.h"
+#include "x86/percpu.h"
+
+#define APIC_BASE_X2APIC    (1ULL << 10)
+#define APIC_BASE_ENABLE    (1ULL << 11)
+#define APIC_BASE_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+// Register offsets in the xAPIC page; x2APIC MSR = 0x800 + offset / 16
+#define APIC_REG_ID     0x020
+#define APIC_REG_TPR    0x080
+#define APIC_REG_EOI    0x0B0
+#define APIC_REG_SVR    0x0F0
+#define APIC_REG_ICR    0x300       // x2APIC: one 64-bit MSR
+#define APIC_REG_ICR_HI 0x310       // xAPIC only
+
+#define APIC_SVR_ENABLE (1U << 8)
+
+#define ICR_FIXED       (0U << 8)
+#define ICR_INIT        (5U << 8)
+#define ICR_STARTUP     (6U << 8)
+#define ICR_PENDING     (1U << 12)  // xAPIC delivery status
+#define ICR_ASSERT      (1U << 14)
+
+static volatile uint32_t *g_xapic;      // NULL in x2APIC mode
+static int g_x2apic;
+
+static uint32_t apic_read(uint32_t reg) {
+    if (g_x2apic) return (uint32_t)rdmsr(0x800 + reg / 16);
+    return g_xapic[reg / 4];
+}
+
+static void apic_write(uint32_t reg, uint32_t v) {
+    if (g_x2apic) wrmsr(0x800 + reg / 16, v);
+    else g_xapic[reg / 4] = v;
+}
+
+static void spurious_handler(struct trap_frame *f) {
+    (void)f;                            // No EOI for spurious interrupts
+}
+
+void apic_init(void) {
+    uint64_t base = rdmsr(MSR_APIC_BASE);
+
+    // Disabled -> xAPIC -> x2APIC; skipping the middle step faults
+    g_x2apic = cpu_has(X86_FEATURE_X2APIC) || (base & APIC_BASE_X2APIC);
+    if (!(base & APIC_BASE_ENABLE)) {
+        base |= APIC_BASE_ENABLE;
+        wrmsr(MSR_APIC_BASE, base);
+    }
+    if (g_x2apic && !(base & APIC_BASE_X2APIC)) {
+        base |= APIC_BASE_X2APIC;
+        wrmsr(MSR_APIC_BASE, base);
+    }
+    // Firmware identity-maps the APIC page
+    if (!g_x2apic) g_xapic = (volatile uint32_t *)(base & APIC_BASE_ADDR_MASK);
+
+    idt_set_handler(VEC_SPURIOUS, spurious_handler);
+    apic_write(APIC_REG_TPR, 0);
+    apic_write(APIC_REG_SVR, APIC_SVR_ENABLE | VEC_SPURIOUS);
+
+    this_cpu()->apic_id = apic_id();
+}
+
+void apic_eoi(void) {
+    apic_write(APIC_REG_EOI, 0);
+}
+
+uint32_t apic_id(void) {
+    uint32_t id = apic_read(APIC_REG_ID);
+    return g_x2apic ? id : id >> 24;
+}
+
+int apic_is_x2apic(void) {
+    return g_x2apic;
+}
+
+//=============================================================================
+// Inter-Processor Interrupts
+//=============================================================================
+
+static void send_icr(uint32_t dest, uint32_t low) {
+    if (g_x2apic) {
+        wrmsr(0x800 + APIC_REG_ICR / 16, ((uint64_t)dest << 32) | low);
+        return;
+    }
+
+    uint64_t flags = irq_save();
+    apic_write(APIC_REG_ICR_HI, dest << 24);
+    apic_write(APIC_REG_ICR, low);              // Writing the low half sends
+    while (apic_read(APIC_REG_ICR) & ICR_PENDING) cpu_relax();
+    irq_restore(flags);
+}
+
+void apic_send_ipi(uint32_t dest, uint8_t vector) {
+    send_icr(dest, ICR_FIXED | ICR_ASSERT | vector);
+}
+
+void apic_send_init(uint32_t dest) {
+    send_icr(dest, ICR_INIT | ICR_ASSERT);
+}
+
+void apic_send_sipi(uint32_t dest, uint8_t page) {
+    send_icr(dest, ICR_STARTUP | ICR_ASSERT | page);
+}
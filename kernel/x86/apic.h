@@ -0,0 +1,32 @@
+// kernel/x86/apic.h
+// Local APIC (xAPIC MMIO or x2APIC MSRs) and MSI message encoding
+#pragma once
+
+#include <stdint.h>
+
+// Enable the calling CPU's local APIC: x2APIC mode when the CPU has it,
+// spurious vector VEC_SPURIOUS, accept all priorities. Records the APIC ID
+// in this_cpu()->apic_id.
+void apic_init(void);
+
+void     apic_eoi(void);
+uint32_t apic_id(void);
+int      apic_is_x2apic(void);
+
+// Fixed interrupt `vector` to the CPU with APIC ID `dest`
+void apic_send_ipi(uint32_t dest, uint8_t vector);
+
+// AP startup: INIT resets the target into wait-for-SIPI; a STARTUP IPI
+// then starts it in real mode at `page` << 12
+void apic_send_init(uint32_t dest);
+void apic_send_sipi(uint32_t dest, uint8_t page);
+
+// MSI/MSI-X message for `vector`, delivered fixed to the APIC `dest`.
+// Without interrupt remapping only 8-bit destinations are reachable.
+static inline uint64_t msi_address(uint32_t dest) {
+    return 0xFEE00000ULL | ((uint64_t)(dest & 0xFF) << 12);
+}
+
+static inline uint32_t msi_data(uint8_t vector) {
+    return vector;              // Fixed delivery, edge triggered
+}
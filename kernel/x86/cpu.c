@@ -0,0 +1,59 @@
+// kernel/x86/cpu.c
+// CPU bring-up: enable SSE, AVX and XSAVE according to CPUID
+//
+// UEFI hands over with SSE usable but XCR0 untouched, so AVX instructions
+// would #UD. cpu_init() runs on every CPU; the BSP also fills boot_cpu.
+#include "cpu.h"
+#include "cpufeature.h"
+#include "fpu.h"
+
+static int g_identified;
+
+static uint32_t xsave_size_for_current_xcr0(void) {
+    uint32_t a, b, c, d;
+    cpuid(0xD, 0, &a, &b, &c, &d);
+    return b;
+}
+
+void cpu_init(void) {
+    if (!g_identified) {
+        cpu_identify(&boot_cpu);
+        g_identified = 1;
+    }
+
+    // x87/SSE on, no emulation, no #NM until the FPU code arms TS
+    uint64_t cr0 = read_cr0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+
+    uint64_t cr4 = read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if (cpu_has(X86_FEATURE_XSAVE)) cr4 |= CR4_OSXSAVE;
+    write_cr4(cr4);
+
+    if (cpu_has(X86_FEATURE_XSAVE)) {
+        uint64_t xcr0 = XFEATURE_X87 | XFEATURE_SSE;
+
+        if (cpu_has(X86_FEATURE_AVX) && (boot_cpu.xfeatures & XFEATURE_AVX)) {
+            xcr0 |= XFEATURE_AVX;
+        }
+        if (cpu_has(X86_FEATURE_AVX512F) &&
+            (boot_cpu.xfeatures & XFEATURE_AVX512) == XFEATURE_AVX512) {
+            xcr0 |= XFEATURE_AVX512;
+        }
+        xsetbv(0, xcr0);
+
+        // Every task carries a fixed-size save area; drop AVX-512 rather
+        // than overflow it
+        if (xsave_size_for_current_xcr0() > FPU_AREA_SIZE) {
+            xcr0 &= ~XFEATURE_AVX512;
+            xsetbv(0, xcr0);
+        }
+    }
+
+    cpu_sync_os_support(&boot_cpu);
+
+    // Clean x87 and SSE control state
+    uint32_t mxcsr = 0x1F80;
+    __asm__ volatile("fninit; ldmxcsr %0" :: "m"(mxcsr));
+}
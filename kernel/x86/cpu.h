@@ -0,0 +1,200 @@
+// kernel/x86/cpu.h
+// Control registers, MSRs, port I/O and CPU bring-up
+#pragma once
+
+#include <stdint.h>
+
+//=============================================================================
+// Control Register Bits
+//=============================================================================
+
+#define CR0_MP          (1ULL << 1)   // Monitor coprocessor (WAIT honours TS)
+#define CR0_EM          (1ULL << 2)   // x87 emulation - must be clear for SSE
+#define CR0_TS          (1ULL << 3)   // Task switched: next FPU/SIMD use -> #NM
+#define CR0_NE          (1ULL << 5)   // Native x87 error reporting
+
+#define CR4_OSFXSR      (1ULL << 9)   // FXSAVE/FXRSTOR + SSE enabled
+#define CR4_OSXMMEXCPT  (1ULL << 10)  // Unmasked SIMD FP exceptions -> #XM
+#define CR4_LA57        (1ULL << 12)  // 5-level paging
+#define CR4_OSXSAVE     (1ULL << 18)  // XSAVE and XGETBV/XSETBV enabled
+
+// XCR0 state components
+#define XFEATURE_X87        (1ULL << 0)
+#define XFEATURE_SSE        (1ULL << 1)
+#define XFEATURE_AVX        (1ULL << 2)
+#define XFEATURE_OPMASK     (1ULL << 5)
+#define XFEATURE_ZMM_HI256  (1ULL << 6)
+#define XFEATURE_HI16_ZMM   (1ULL << 7)
+#define XFEATURE_AVX512     (XFEATURE_OPMASK | XFEATURE_ZMM_HI256 | XFEATURE_HI16_ZMM)
+
+//=============================================================================
+// MSRs
+//=============================================================================
+
+#define MSR_APIC_BASE       0x0000001B
+#define MSR_EFER            0xC0000080
+#define MSR_STAR            0xC0000081  // SYSCALL/SYSRET selector bases
+#define MSR_LSTAR           0xC0000082  // 64-bit SYSCALL entry point
+#define MSR_SFMASK          0xC0000084  // RFLAGS bits SYSCALL clears
+#define MSR_FS_BASE         0xC0000100
+#define MSR_GS_BASE         0xC0000101
+#define MSR_KERNEL_GS_BASE  0xC0000102  // Swapped with GS base by SWAPGS
+
+#define EFER_SCE            (1ULL << 0)   // SYSCALL/SYSRET enabled
+#define EFER_NXE            (1ULL << 11)  // No-execute page bit enabled
+
+#define RFLAGS_TF           (1ULL << 8)
+#define RFLAGS_IF           (1ULL << 9)
+#define RFLAGS_DF           (1ULL << 10)
+#define RFLAGS_AC           (1ULL << 18)
+
+//=============================================================================
+// Inline Helpers
+//=============================================================================
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf,
+                         uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ volatile("cpuid"
+                     : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                     : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint64_t read_cr0(void) {
+    uint64_t v;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr0(uint64_t v) {
+    __asm__ volatile("mov %0, %%cr0" :: "r"(v) : "memory");
+}
+
+static inline uint64_t read_cr2(void) {
+    uint64_t v;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(v));
+    return v;
+}
+
+static inline uint64_t read_cr3(void) {
+    uint64_t v;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr3(uint64_t v) {
+    __asm__ volatile("mov %0, %%cr3" :: "r"(v) : "memory");
+}
+
+static inline void invlpg(uint64_t va) {
+    __asm__ volatile("invlpg (%0)" :: "r"(va) : "memory");
+}
+
+static inline uint64_t read_cr4(void) {
+    uint64_t v;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr4(uint64_t v) {
+    __asm__ volatile("mov %0, %%cr4" :: "r"(v) : "memory");
+}
+
+static inline uint64_t xgetbv(uint32_t index) {
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(index));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void xsetbv(uint32_t index, uint64_t v) {
+    __asm__ volatile("xsetbv" :: "c"(index), "a"((uint32_t)v), "d"((uint32_t)(v >> 32)));
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t v) {
+    __asm__ volatile("wrmsr" :: "c"(msr), "a"((uint32_t)v), "d"((uint32_t)(v >> 32)));
+}
+
+static inline void clts(void) {
+    __asm__ volatile("clts" ::: "memory");
+}
+
+static inline void stts(void) {
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// RDTSC can execute ahead of earlier loads; LFENCE holds it until they
+// are done, so time read after an event is not taken before it
+static inline uint64_t rdtsc_ordered(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("lfence; rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void outb(uint16_t port, uint8_t v) {
+    __asm__ volatile("outb %0, %1" :: "a"(v), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t v;
+    __asm__ volatile("inb %1, %0" : "=a"(v) : "Nd"(port));
+    return v;
+}
+
+static inline void outw(uint16_t port, uint16_t v) {
+    __asm__ volatile("outw %0, %1" :: "a"(v), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t v;
+    __asm__ volatile("inw %1, %0" : "=a"(v) : "Nd"(port));
+    return v;
+}
+
+static inline void outl(uint16_t port, uint32_t v) {
+    __asm__ volatile("outl %0, %1" :: "a"(v), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t v;
+    __asm__ volatile("inl %1, %0" : "=a"(v) : "Nd"(port));
+    return v;
+}
+
+// x86 keeps stores ordered with stores and loads with loads; only a store
+// followed by a load of another location needs a real fence
+#define barrier()   __asm__ volatile("" ::: "memory")
+#define smp_mb()    __asm__ volatile("mfence" ::: "memory")
+
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; popq %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & (1 << 9)) __asm__ volatile("sti" ::: "memory");
+}
+
+static inline void cpu_relax(void) {
+    __asm__ volatile("pause" ::: "memory");
+}
+
+//=============================================================================
+// Bring-up
+//=============================================================================
+
+// Read CPUID into boot_cpu (first call only) and enable SSE, AVX and XSAVE
+// on the calling CPU. Features the OS could not enable are cleared from the
+// bitmap, so cpu_has() always means "usable".
+void cpu_init(void);
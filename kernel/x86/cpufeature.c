@@ -0,0 +1,120 @@
+// kernel/x86/cpufeature.c
+// CPUID feature bitmap
+#include "cpufeature.h"
+
+struct cpuinfo boot_cpu;
+
+static inline void cpuid_raw(uint32_t leaf, uint32_t subleaf,
+                             uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ volatile("cpuid"
+                     : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                     : "a"(leaf), "c"(subleaf));
+}
+
+// Size of the largest cache reported by the deterministic cache parameter
+// leaf (4 on Intel, 0x8000001D on AMD). Returns 0 if neither exists.
+static size_t last_level_cache_size(const struct cpuinfo *c) {
+    uint32_t a, b, cx, d;
+    uint32_t leaf;
+
+    if (c->max_leaf >= 4) leaf = 4;
+    else if (c->max_ext_leaf >= 0x8000001D) leaf = 0x8000001D;
+    else return 0;
+
+    size_t best = 0;
+    for (uint32_t i = 0; i < 16; i++) {
+        cpuid_raw(leaf, i, &a, &b, &cx, &d);
+        if ((a & 0x1F) == 0) break;           // no more caches
+        if ((a & 0x1F) == 2) continue;        // instruction cache
+
+        size_t ways       = ((b >> 22) & 0x3FF) + 1;
+        size_t partitions = ((b >> 12) & 0x3FF) + 1;
+        size_t line       = (b & 0xFFF) + 1;
+        size_t sets       = (size_t)cx + 1;
+        size_t size = ways * partitions * line * sets;
+        if (size > best) best = size;
+    }
+    return best;
+}
+
+void cpu_identify(struct cpuinfo *c) {
+    uint32_t a, b, cx, d;
+
+    for (int i = 0; i < CPU_CAP_WORDS; i++) c->caps[i] = 0;
+
+    cpuid_raw(0, 0, &a, &b, &cx, &d);
+    c->max_leaf = a;
+    // Vendor string is EBX, EDX, ECX in that order
+    for (int i = 0; i < 4; i++) {
+        c->vendor[i]     = (char)(b >> (i * 8));
+        c->vendor[4 + i] = (char)(d >> (i * 8));
+        c->vendor[8 + i] = (char)(cx >> (i * 8));
+    }
+    c->vendor[12] = 0;
+
+    cpuid_raw(1, 0, &a, &b, &cx, &d);
+    c->caps[CPU_WORD_1_EDX] = d;
+    c->caps[CPU_WORD_1_ECX] = cx;
+    c->stepping = a & 0xF;
+    c->model    = (a >> 4) & 0xF;
+    c->family   = (a >> 8) & 0xF;
+    if (c->family == 0xF) c->family += (a >> 20) & 0xFF;
+    if (c->family >= 6)   c->model  += ((a >> 16) & 0xF) << 4;
+
+    if (c->max_leaf >= 7) {
+        cpuid_raw(7, 0, &a, &b, &cx, &d);
+        c->caps[CPU_WORD_7_EBX] = b;
+        c->caps[CPU_WORD_7_ECX] = cx;
+        c->caps[CPU_WORD_7_EDX] = d;
+    }
+
+    c->xfeatures = 0;
+    if (c->max_leaf >= 0xD) {
+        cpuid_raw(0xD, 0, &a, &b, &cx, &d);
+        c->xfeatures = ((uint64_t)d << 32) | a;
+        cpuid_raw(0xD, 1, &a, &b, &cx, &d);
+        c->caps[CPU_WORD_D1_EAX] = a;
+    }
+
+    cpuid_raw(0x80000000, 0, &a, &b, &cx, &d);
+    c->max_ext_leaf = a;
+    if (c->max_ext_leaf >= 0x80000001) {
+        cpuid_raw(0x80000001, 0, &a, &b, &cx, &d);
+        c->caps[CPU_WORD_81_EDX] = d;
+        c->caps[CPU_WORD_81_ECX] = cx;
+    }
+    if (c->max_ext_leaf >= 0x80000007) {
+        cpuid_raw(0x80000007, 0, &a, &b, &cx, &d);
+        c->caps[CPU_WORD_87_EDX] = d;
+    }
+
+    c->llc_size = last_level_cache_size(c);
+}
+
+void cpu_sync_os_support(struct cpuinfo *c) {
+    uint32_t a, b, cx, d;
+    uint64_t xcr0 = 0;
+
+    // OSXSAVE reflects CR4 *now*, so re-read it rather than trust the copy
+    cpuid_raw(1, 0, &a, &b, &cx, &d);
+    c->caps[CPU_WORD_1_ECX] = cx;
+
+    if (cx & (1u << 27)) {
+        uint32_t lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = ((uint64_t)hi << 32) | lo;
+    }
+
+    if ((xcr0 & 0x6) != 0x6) {
+        cpu_clear_cap(c, X86_FEATURE_AVX);
+        cpu_clear_cap(c, X86_FEATURE_AVX2);
+        cpu_clear_cap(c, X86_FEATURE_FMA);
+    }
+    if ((xcr0 & 0xE6) != 0xE6) {
+        cpu_clear_cap(c, X86_FEATURE_AVX512F);
+    }
+    if (!(cx & (1u << 27))) {
+        cpu_clear_cap(c, X86_FEATURE_XSAVEOPT);
+        cpu_clear_cap(c, X86_FEATURE_XSAVEC);
+    }
+}
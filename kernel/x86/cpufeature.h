@@ -0,0 +1,101 @@
+// kernel/x86/cpufeature.h
+// CPUID feature bitmap
+//
+// CPUID is read once at boot into boot_cpu. Each feature is a bit number:
+// word * 32 + bit, where the word is one CPUID output register.
+// This file and cpufeature.c have no kernel dependencies, so the host
+// benchmarks can link them too.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//=============================================================================
+// Feature Words
+//=============================================================================
+
+#define CPU_WORD_1_EDX      0   // CPUID 1.EDX
+#define CPU_WORD_1_ECX      1   // CPUID 1.ECX
+#define CPU_WORD_7_EBX      2   // CPUID 7.0.EBX
+#define CPU_WORD_7_ECX      3   // CPUID 7.0.ECX
+#define CPU_WORD_7_EDX      4   // CPUID 7.0.EDX
+#define CPU_WORD_81_EDX     5   // CPUID 0x80000001.EDX
+#define CPU_WORD_81_ECX     6   // CPUID 0x80000001.ECX
+#define CPU_WORD_D1_EAX     7   // CPUID 0xD.1.EAX (XSAVE variants)
+#define CPU_WORD_87_EDX     8   // CPUID 0x80000007.EDX (power management)
+#define CPU_CAP_WORDS       9
+
+#define X86_FEATURE(word, bit)  ((word) * 32 + (bit))
+
+#define X86_FEATURE_FPU         X86_FEATURE(CPU_WORD_1_EDX, 0)
+#define X86_FEATURE_TSC         X86_FEATURE(CPU_WORD_1_EDX, 4)
+#define X86_FEATURE_MSR         X86_FEATURE(CPU_WORD_1_EDX, 5)
+#define X86_FEATURE_APIC        X86_FEATURE(CPU_WORD_1_EDX, 9)
+#define X86_FEATURE_FXSR        X86_FEATURE(CPU_WORD_1_EDX, 24)
+#define X86_FEATURE_SSE         X86_FEATURE(CPU_WORD_1_EDX, 25)
+#define X86_FEATURE_SSE2        X86_FEATURE(CPU_WORD_1_EDX, 26)
+
+#define X86_FEATURE_SSE3        X86_FEATURE(CPU_WORD_1_ECX, 0)
+#define X86_FEATURE_MONITOR     X86_FEATURE(CPU_WORD_1_ECX, 3)
+#define X86_FEATURE_SSSE3       X86_FEATURE(CPU_WORD_1_ECX, 9)
+#define X86_FEATURE_FMA         X86_FEATURE(CPU_WORD_1_ECX, 12)
+#define X86_FEATURE_PCID        X86_FEATURE(CPU_WORD_1_ECX, 17)
+#define X86_FEATURE_SSE4_1      X86_FEATURE(CPU_WORD_1_ECX, 19)
+#define X86_FEATURE_SSE4_2      X86_FEATURE(CPU_WORD_1_ECX, 20)
+#define X86_FEATURE_X2APIC      X86_FEATURE(CPU_WORD_1_ECX, 21)
+#define X86_FEATURE_TSC_DEADLINE X86_FEATURE(CPU_WORD_1_ECX, 24)
+#define X86_FEATURE_XSAVE       X86_FEATURE(CPU_WORD_1_ECX, 26)
+#define X86_FEATURE_OSXSAVE     X86_FEATURE(CPU_WORD_1_ECX, 27)
+#define X86_FEATURE_AVX         X86_FEATURE(CPU_WORD_1_ECX, 28)
+#define X86_FEATURE_HYPERVISOR  X86_FEATURE(CPU_WORD_1_ECX, 31)
+
+#define X86_FEATURE_FSGSBASE    X86_FEATURE(CPU_WORD_7_EBX, 0)
+#define X86_FEATURE_AVX2        X86_FEATURE(CPU_WORD_7_EBX, 5)
+#define X86_FEATURE_ERMS        X86_FEATURE(CPU_WORD_7_EBX, 9)
+#define X86_FEATURE_AVX512F     X86_FEATURE(CPU_WORD_7_EBX, 16)
+
+#define X86_FEATURE_FSRM        X86_FEATURE(CPU_WORD_7_EDX, 4)
+
+#define X86_FEATURE_SYSCALL     X86_FEATURE(CPU_WORD_81_EDX, 11)
+#define X86_FEATURE_NX          X86_FEATURE(CPU_WORD_81_EDX, 20)
+#define X86_FEATURE_PDPE1GB     X86_FEATURE(CPU_WORD_81_EDX, 26)
+#define X86_FEATURE_RDTSCP      X86_FEATURE(CPU_WORD_81_EDX, 27)
+#define X86_FEATURE_LM          X86_FEATURE(CPU_WORD_81_EDX, 29)
+
+#define X86_FEATURE_XSAVEOPT    X86_FEATURE(CPU_WORD_D1_EAX, 0)
+#define X86_FEATURE_XSAVEC      X86_FEATURE(CPU_WORD_D1_EAX, 1)
+
+#define X86_FEATURE_INVTSC      X86_FEATURE(CPU_WORD_87_EDX, 8)
+
+//=============================================================================
+// CPU Information
+//=============================================================================
+
+struct cpuinfo {
+    char     vendor[13];
+    uint32_t max_leaf;
+    uint32_t max_ext_leaf;
+    uint32_t family;
+    uint32_t model;
+    uint32_t stepping;
+    uint32_t caps[CPU_CAP_WORDS];
+    uint64_t xfeatures;     // XCR0 bits the CPU supports (CPUID 0xD.0)
+    size_t   llc_size;      // Largest data/unified cache, 0 if unknown
+};
+
+extern struct cpuinfo boot_cpu;
+
+// Fill `c` from CPUID. Does not touch control registers.
+void cpu_identify(struct cpuinfo *c);
+
+// Clear features whose register state the OS has not enabled in XCR0
+// (AVX, AVX2, FMA, AVX-512). Call after XCR0 is final.
+void cpu_sync_os_support(struct cpuinfo *c);
+
+static inline int cpu_has(unsigned feature) {
+    return (boot_cpu.caps[feature / 32] >> (feature % 32)) & 1;
+}
+
+static inline void cpu_clear_cap(struct cpuinfo *c, unsigned feature) {
+    c->caps[feature / 32] &= ~(1u << (feature % 32));
+}
@@ -0,0 +1,169 @@
+// kernel/x86/fpu.c
+// Lazy FPU/SIMD context switching with XSAVEOPT/XRSTOR
+//
+// Invariant: CR0.TS clear means the SIMD registers belong to
+// this_cpu()->current. At every switch-out that state is saved (it may
+// have changed), so saved areas are always authoritative once TS is set.
+// fpu_owner remembers whose state is still sitting in the registers, so
+// switching back to that task needs no trap and no restore.
+#include "fpu.h"
+#include "cpu.h"
+#include "cpufeature.h"
+#include "idt.h"
+#include "percpu.h"
+#include "sched/task.h"
+#include "lib/printk.h"
+#include "lib/string.h"
+
+static struct fpu g_fpu_init_state;
+static uint32_t   g_fpu_size = 512;
+
+//=============================================================================
+// Save / Restore
+// EDX:EAX = all ones: save every component enabled in XCR0.
+//=============================================================================
+
+// The operands name the whole area array, not its first byte, so the
+// compiler knows every byte of it is read or written
+
+static void fpu_save(struct fpu *fpu) {
+    if (cpu_has(X86_FEATURE_XSAVEOPT)) {
+        __asm__ volatile("xsaveopt64 %0" : "+m"(fpu->area) : "a"(-1), "d"(-1));
+    } else if (cpu_has(X86_FEATURE_XSAVE)) {
+        __asm__ volatile("xsave64 %0" : "+m"(fpu->area) : "a"(-1), "d"(-1));
+    } else {
+        __asm__ volatile("fxsave64 %0" : "+m"(fpu->area));
+    }
+    fpu->saves++;
+}
+
+static void fpu_restore(struct fpu *fpu) {
+    if (cpu_has(X86_FEATURE_XSAVE)) {
+        __asm__ volatile("xrstor64 %0" :: "m"(fpu->area), "a"(-1), "d"(-1));
+    } else {
+        __asm__ volatile("fxrstor64 %0" :: "m"(fpu->area));
+    }
+    fpu->restores++;
+}
+
+//=============================================================================
+// #NM: first SIMD use since the last switch
+//=============================================================================
+
+static void fpu_handle_nm(struct trap_frame *f) {
+    struct percpu *pc = this_cpu();
+    struct task *cur = pc->current;
+
+    if (pc->simd_depth || pc->irq_depth) {
+        kprintf("#NM at %#lx\n", f->rip);
+        panic("SIMD used in interrupt context without kernel_simd_begin()");
+    }
+
+    clts();
+    if (pc->fpu_owner != cur || cur->fpu.last_cpu != (int32_t)pc->cpu_id) {
+        fpu_restore(&cur->fpu);
+        pc->fpu_owner = cur;
+        cur->fpu.last_cpu = pc->cpu_id;
+    }
+}
+
+//=============================================================================
+// Public API
+//=============================================================================
+
+void fpu_init(void) {
+    struct percpu *pc = this_cpu();
+
+    if (pc->cpu_id == 0) {
+        uint32_t a, b, c, d;
+
+        if (cpu_has(X86_FEATURE_XSAVE)) {
+            cpuid(0xD, 0, &a, &b, &c, &d);
+            g_fpu_size = b;
+        }
+
+        // cpu_init() just ran FNINIT/LDMXCSR, so the live state is clean.
+        // XSAVE needs a zeroed header in the destination.
+        memset(g_fpu_init_state.area, 0, sizeof(g_fpu_init_state.area));
+        clts();
+        fpu_save(&g_fpu_init_state);
+        g_fpu_init_state.saves = 0;
+
+        idt_set_handler(VEC_DEVICE_NA, fpu_handle_nm);
+    }
+
+    fpu_task_init(&pc->current->fpu);
+    pc->fpu_owner = NULL;
+    stts();
+}
+
+void fpu_task_init(struct fpu *fpu) {
+    memcpy(fpu->area, g_fpu_init_state.area, g_fpu_size);
+    fpu->last_cpu = -1;
+    fpu->saves    = 0;
+    fpu->restores = 0;
+}
+
+void fpu_task_copy(struct fpu *fpu) {
+    uint64_t flags = irq_save();
+    struct task *cur = this_cpu()->current;
+
+    if (!(read_cr0() & CR0_TS)) fpu_save(&cur->fpu);   // live state is newer
+    memcpy(fpu->area, cur->fpu.area, g_fpu_size);
+    fpu->last_cpu = -1;
+    fpu->saves    = 0;
+    fpu->restores = 0;
+    irq_restore(flags);
+}
+
+void fpu_switch(struct task *prev, struct task *next) {
+    struct percpu *pc = this_cpu();
+
+    if (!(read_cr0() & CR0_TS)) {
+        // prev trapped in during this slice: its live state is newer
+        fpu_save(&prev->fpu);
+        pc->fpu_owner = prev;
+        prev->fpu.last_cpu = pc->cpu_id;
+    }
+
+    if (pc->fpu_owner == next && next->fpu.last_cpu == (int32_t)pc->cpu_id) {
+        clts();     // registers still hold next's state
+    } else {
+        stts();
+    }
+}
+
+void kernel_simd_begin(void) {
+    struct percpu *pc = this_cpu();
+
+    if (pc->simd_depth++) return;
+
+    if (!(read_cr0() & CR0_TS)) {
+        // The interrupted task's state is live and may be unsaved
+        struct task *cur = pc->current;
+        fpu_save(&cur->fpu);
+        cur->fpu.last_cpu = -1;
+    } else {
+        clts();
+    }
+    pc->fpu_owner = NULL;   // about to be clobbered
+}
+
+void kernel_simd_end(void) {
+    struct percpu *pc = this_cpu();
+
+    if (--pc->simd_depth) return;
+    stts();     // the task's next SIMD use restores its saved state
+}
+
+uint32_t fpu_state_size(void) {
+    return g_fpu_size;
+}
+
+// lib/string.c asks before taking a vector path. Interrupt handlers may
+// only touch SIMD registers inside kernel_simd_begin/end, and so may system
+// calls: between user_run() and its return the registers are the user's.
+int string_simd_allowed(void) {
+    struct percpu *pc = this_cpu();
+    return (pc->irq_depth == 0 && !pc->user_return) || pc->simd_depth != 0;
+}
@@ -0,0 +1,52 @@
+// kernel/x86/fpu.h
+// Lazy FPU/SIMD context switching
+//
+// The kernel itself is built with -mgeneral-regs-only; SIMD registers are
+// only touched by explicit code (lib/string.c, SIMD kernels). Rules:
+//
+//   Task context (preemptible): just use SIMD. A task switch leaves CR0.TS
+//   set, the first SIMD instruction traps (#NM) and the task's state is
+//   restored. The outgoing task is saved with XSAVEOPT only if it actually
+//   touched the registers since it was switched in.
+//
+//   Interrupt handlers / IRQs-off sections: bracket SIMD with
+//   kernel_simd_begin()/kernel_simd_end(), with interrupts disabled.
+#pragma once
+
+#include <stdint.h>
+
+// Fixed per-task save area. Enough for x87/SSE/AVX/AVX-512 (2.7 KiB);
+// cpu_init() leaves AVX-512 off if the CPU needs more.
+#define FPU_AREA_SIZE 4096
+
+struct task;
+
+struct fpu {
+    uint8_t  area[FPU_AREA_SIZE] __attribute__((aligned(64)));
+    int32_t  last_cpu;      // CPU whose registers last held this state, -1 = none
+    uint32_t _pad;
+    uint64_t saves;         // XSAVE(OPT)s at switch-out
+    uint64_t restores;      // XRSTORs from #NM
+};
+
+// Capture the clean state image, install the #NM handler, arm CR0.TS.
+// Call once per CPU after cpu_init(), idt_init() and sched_init().
+void fpu_init(void);
+
+// Give a new task the clean initial state
+void fpu_task_init(struct fpu *fpu);
+
+// Give a new task a copy of the current task's state (fork)
+void fpu_task_copy(struct fpu *fpu);
+
+// Called by the scheduler with interrupts disabled, before switching stacks
+void fpu_switch(struct task *prev, struct task *next);
+
+// Use SIMD registers with interrupts disabled (interrupt handlers, IRQs-off
+// sections). Saves the interrupted task's live state if needed. Not nestable
+// across interrupt levels.
+void kernel_simd_begin(void);
+void kernel_simd_end(void);
+
+// Bytes XSAVE writes for the enabled features (512 with FXSAVE only)
+uint32_t fpu_state_size(void);
@@ -0,0 +1,251 @@
+// kernel/x86/idle.c
+// Idle loop: adaptive polling, then MWAIT on the wake flag or HLT
+#include "x86/idle.h"
+#include "boot/cmdline.h"
+#include "lib/printk.h"
+#include "lib/string.h"
+#include "x86/apic.h"
+#include "x86/cpu.h"
+#include "x86/cpufeature.h"
+#include "x86/idt.h"
+#include "x86/percpu.h"
+#include "x86/tsc.h"
+
+#define POLL_START_NS   2000        // Window after the first short sleep
+#define POLL_MAX_NS     50000
+#define DEEP_MIN_NS     200000      // Idle periods this long may go deep
+#define HISTORY         4           // Idle periods the choices look at
+
+enum { STATE_RUNNING, STATE_POLL, STATE_MWAIT, STATE_HLT };
+
+// What other CPUs touch, alone on a line so that MWAIT only wakes for
+// it. 64 bytes is the monitor line of every CPU we know; a bigger one
+// would only cost early wake-ups.
+struct wake_line {
+    volatile uint32_t wake;
+    volatile uint32_t state;        // STATE_*, written by the owner
+    volatile uint64_t wake_tsc;     // At idle_wake(), on the BSP's TSC
+} __attribute__((aligned(64)));
+
+// Only ever written by its own CPU
+struct idle_cpu {
+    uint64_t          poll;         // Poll window, TSC ticks; 0: don't
+    uint64_t          recent[HISTORY];  // Last idle periods, TSC ticks
+    uint32_t          next;
+    struct idle_stats stats;        // poll_ns unused
+};
+
+static struct wake_line g_lines[MAX_CPUS];
+static struct idle_cpu  g_cpu[MAX_CPUS];
+
+static int      g_method = IDLE_METHOD_HLT;     // Until idle_init() decides
+static int      g_have_mwait;
+static uint32_t g_deep_hint;        // MWAIT hint of the deepest state
+static uint32_t g_deep_cstate;      // Its C-state number; 0: only C1
+static int      g_vector = -1;
+static uint64_t g_poll_start, g_poll_max, g_deep_min;   // TSC ticks
+static char     g_desc[80];
+
+static const char *const g_kind_names[IDLE_KINDS] = { "poll", "mwait C1", "mwait deep", "hlt" };
+
+//=============================================================================
+// Sleeping
+//=============================================================================
+
+static void wake_handler(void *arg) {
+    (void)arg;                  // The interrupt itself ends the hlt
+}
+
+static inline void monitor(const volatile void *addr) {
+    __asm__ volatile("monitor" :: "a"(addr), "c"(0), "d"(0) : "memory");
+}
+
+// STI holds interrupts off for one more instruction, so as with `sti; hlt`
+// one arriving between the flag check and the MWAIT still ends it
+static inline void sti_mwait(uint32_t hint) {
+    __asm__ volatile("sti; mwait; cli" :: "a"(hint), "c"(0) : "memory");
+}
+
+static uint64_t shortest_recent(const struct idle_cpu *c) {
+    uint64_t m = c->recent[0];
+    for (uint32_t i = 1; i < HISTORY; i++) if (c->recent[i] < m) m = c->recent[i];
+    return m;
+}
+
+// Spin with interrupts on until woken or `until`. Interrupts don't end
+// it, since nothing here can tell that they happened.
+static int poll(struct wake_line *l, uint64_t until) {
+    __atomic_store_n(&l->state, STATE_POLL, __ATOMIC_RELAXED);
+    __asm__ volatile("sti" ::: "memory");
+    while (!l->wake && rdtsc() < until) cpu_relax();
+    __asm__ volatile("cli" ::: "memory");
+    return l->wake;
+}
+
+// The flag store in idle_wake() and the state store here are each
+// followed by a load of the other, both sequentially consistent: either
+// the waker sees STATE_HLT and sends the IPI or we see the flag.
+static void hlt(struct wake_line *l) {
+    __atomic_store_n(&l->state, STATE_HLT, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&l->wake, __ATOMIC_SEQ_CST)) {
+        __asm__ volatile("sti; hlt; cli" ::: "memory");
+    }
+}
+
+// A flag write after MONITOR ends the MWAIT, or keeps it from starting
+static void mwait(struct wake_line *l, uint32_t hint) {
+    __atomic_store_n(&l->state, STATE_MWAIT, __ATOMIC_RELAXED);
+    monitor(&l->wake);
+    if (!l->wake) sti_mwait(hint);
+}
+
+static void account(struct idle_cpu *c, uint32_t kind, uint64_t ticks, int woken,
+                    uint64_t wake_tsc) {
+    c->stats.periods[kind]++;
+    c->recent[c->next++ % HISTORY] = ticks;
+    if (woken) {
+        uint64_t now = rdtsc() - this_cpu()->tsc_offset;
+        uint64_t ns = now > wake_tsc ? tsc_to_ns(now - wake_tsc) : 0;
+        uint32_t b = 0;
+        while (b < IDLE_HIST_BUCKETS - 1 && ns >= 128ULL << b) b++;
+        c->stats.wakes[kind]++;
+        c->stats.hist[kind][b]++;
+    }
+
+    // Haltpoll's rule, counting only the wakes polling could have caught:
+    // a sleep that a longer window would have avoided grows the window,
+    // a long one shrinks it
+    if (kind == IDLE_POLL) return;
+    if (ticks > g_poll_max) {
+        c->poll /= 2;
+        if (c->poll < g_poll_start) c->poll = 0;
+    } else if (woken) {
+        c->poll = c->poll ? c->poll * 2 : g_poll_start;
+        if (c->poll > g_poll_max) c->poll = g_poll_max;
+    }
+}
+
+void idle_enter(void) {
+    uint32_t self = this_cpu()->cpu_id;
+    struct wake_line *l = &g_lines[self];
+    struct idle_cpu *c = &g_cpu[self];
+
+    // Woken while still busy: the caller has work to look at again
+    if (__atomic_exchange_n(&l->wake, 0, __ATOMIC_ACQUIRE)) return;
+
+    uint64_t start = rdtsc();
+    uint64_t recent = shortest_recent(c);
+    int method = g_method;
+    uint32_t kind = IDLE_POLL;
+
+    if (!(c->poll && recent <= c->poll && poll(l, start + c->poll))) {
+        if (method == IDLE_METHOD_MWAIT) {
+            kind = g_deep_cstate && recent >= g_deep_min ? IDLE_DEEP : IDLE_C1;
+            mwait(l, kind == IDLE_DEEP ? g_deep_hint : 0);
+        } else if (g_vector >= 0) {
+            kind = IDLE_HLT;
+            hlt(l);
+        } else {
+            poll(l, start + g_poll_max);    // Nothing could wake a HLT
+        }
+    }
+    __atomic_store_n(&l->state, STATE_RUNNING, __ATOMIC_RELAXED);
+    uint64_t ticks = rdtsc() - start;
+    int woken = __atomic_exchange_n(&l->wake, 0, __ATOMIC_ACQUIRE);
+    account(c, kind, ticks, woken, l->wake_tsc);
+}
+
+void idle_wake(uint32_t cpu) {
+    struct wake_line *l = &g_lines[cpu];
+
+    // Already pending: whoever set it made sure it will be seen
+    if (__atomic_load_n(&l->wake, __ATOMIC_RELAXED)) return;
+    l->wake_tsc = rdtsc() - this_cpu()->tsc_offset;
+    __atomic_store_n(&l->wake, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&l->state, __ATOMIC_SEQ_CST) == STATE_HLT) {
+        g_cpu[this_cpu()->cpu_id].stats.ipis++;
+        apic_send_ipi(g_percpu[cpu].apic_id, g_vector);
+    }
+}
+
+//=============================================================================
+// Setup and Statistics
+//=============================================================================
+
+// CPUID.5 EDX counts the MWAIT sub-states of C0..C7, four bits each. The
+// hint for sub-state s of C(n) is (n - 1) << 4 | s.
+static void find_deep_state(void) {
+    uint32_t a, b, c, d;
+    if (boot_cpu.max_leaf < 5) return;
+    cpuid(5, 0, &a, &b, &c, &d);
+    if (!(c & 1)) return;               // EDX not enumerated
+    for (uint32_t n = 7; n >= 2; n--) {
+        uint32_t subs = (d >> (n * 4)) & 0xF;
+        if (subs) {
+            g_deep_cstate = n;
+            g_deep_hint = (n - 1) << 4 | (subs - 1);
+            return;
+        }
+    }
+}
+
+const char *idle_init(void) {
+    g_poll_start = ns_to_tsc(POLL_START_NS);
+    g_poll_max = ns_to_tsc(POLL_MAX_NS);
+    g_deep_min = ns_to_tsc(DEEP_MIN_NS);
+    g_vector = idt_alloc_irq(wake_handler, NULL);
+
+    g_have_mwait = cpu_has(X86_FEATURE_MONITOR);
+    if (g_have_mwait) find_deep_state();
+    char opt[8];
+    int force_hlt = cmdline_get("idle", opt, sizeof(opt)) && !memcmp(opt, "hlt", 4);
+    if (g_have_mwait && !force_hlt) g_method = IDLE_METHOD_MWAIT;
+
+    if (g_method == IDLE_METHOD_MWAIT && g_deep_cstate) {
+        ksnprintf(g_desc, sizeof(g_desc), "MWAIT, C1 or C%u (hint %#x), polls up to %u us",
+                  g_deep_cstate, g_deep_hint, POLL_MAX_NS / 1000);
+    } else if (g_method == IDLE_METHOD_MWAIT) {
+        ksnprintf(g_desc, sizeof(g_desc), "MWAIT, C1 only, polls up to %u us",
+                  POLL_MAX_NS / 1000);
+    } else {
+        ksnprintf(g_desc, sizeof(g_desc), "%s (%s), polls up to %u us",
+                  g_vector >= 0 ? "HLT" : "polling", force_hlt ? "idle=hlt" : "no MWAIT",
+                  POLL_MAX_NS / 1000);
+    }
+    return g_desc;
+}
+
+int idle_set_method(int method) {
+    if (method == IDLE_METHOD_MWAIT && !g_have_mwait) return -1;
+    if (method == IDLE_METHOD_HLT && g_vector < 0) return -1;
+    g_method = method;
+    return 0;
+}
+
+int idle_get_method(void) {
+    return g_method;
+}
+
+void idle_get_stats(struct idle_stats *out) {
+    memset(out, 0, sizeof(*out));
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        const struct idle_stats *s = &g_cpu[i].stats;
+        for (uint32_t k = 0; k < IDLE_KINDS; k++) {
+            out->periods[k] += s->periods[k];
+            out->wakes[k] += s->wakes[k];
+            for (uint32_t b = 0; b < IDLE_HIST_BUCKETS; b++) out->hist[k][b] += s->hist[k][b];
+        }
+        out->ipis += s->ipis;
+        uint64_t ns = tsc_to_ns(g_cpu[i].poll);
+        if (ns > out->poll_ns) out->poll_ns = ns;
+    }
+}
+
+// Racing with idle CPUs: a count or two may survive
+void idle_reset_stats(void) {
+    for (uint32_t i = 0; i < MAX_CPUS; i++) memset(&g_cpu[i].stats, 0, sizeof(g_cpu[i].stats));
+}
+
+const char *idle_kind_name(uint32_t kind) {
+    return kind < IDLE_KINDS ? g_kind_names[kind] : "?";
+}
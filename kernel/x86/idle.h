@@ -0,0 +1,64 @@
+// kernel/x86/idle.h
+// What a CPU does when it has nothing to do
+//
+// Every CPU has a wake flag on a cache line of its own. idle_wake() sets
+// it, and an idle CPU returns as soon as it sees it: while polling,
+// straight away; in MWAIT, because the line it is monitoring was
+// written; in HLT, only through an IPI, which idle_wake() sends when it
+// finds the CPU there. Interrupts end every kind of sleep as well.
+//
+// Before sleeping, a CPU whose recent idle periods were short spins on
+// its flag for a window that adapts like haltpoll's: it doubles when a
+// sleep ended soon after the window closed and halves when sleeps run
+// long. With MWAIT the sleep is C1 unless the last few idle periods were
+// all long enough to pay for the deepest C-state CPUID advertises.
+#pragma once
+
+#include <stdint.h>
+
+#define IDLE_HIST_BUCKETS   16      // Bucket i: wake latency < 2^(i + 7) ns
+
+// How an idle period ended
+enum {
+    IDLE_POLL,                      // Spinning on the flag
+    IDLE_C1,                        // MWAIT, shallowest state
+    IDLE_DEEP,                      // MWAIT, deepest advertised state
+    IDLE_HLT,
+    IDLE_KINDS,
+};
+
+enum {
+    IDLE_METHOD_HLT,
+    IDLE_METHOD_MWAIT,
+};
+
+struct idle_stats {
+    uint64_t periods[IDLE_KINDS];
+    uint64_t wakes[IDLE_KINDS];     // Ended by idle_wake(), the rest by interrupts
+    uint64_t ipis;                  // idle_wake() calls that needed one
+    // Time from idle_wake() to the CPU running again, for the wakes
+    uint64_t hist[IDLE_KINDS][IDLE_HIST_BUCKETS];
+    uint64_t poll_ns;               // Largest poll window now, over all CPUs
+};
+
+// Pick the method: MWAIT when CPUID has MONITOR/MWAIT, else HLT;
+// "idle=hlt" on the command line forces HLT. Call after tsc_init() and
+// apic_init(), before smp_init(). Returns a description for the log.
+const char *idle_init(void);
+
+// Idle until idle_wake() or an interrupt. Call with interrupts off, after
+// checking for work: a wake that comes in between still ends the sleep.
+// Interrupts are on while polling and sleeping, off again on return.
+void idle_enter(void);
+
+// Make CPU `cpu` return from idle_enter(), or not enter it next time
+void idle_wake(uint32_t cpu);
+
+// Switch method at run time, for comparisons. Returns -1 if unsupported.
+int idle_set_method(int method);
+int idle_get_method(void);
+
+void idle_get_stats(struct idle_stats *out);
+void idle_reset_stats(void);
+
+const char *idle_kind_name(uint32_t kind);
@@ -0,0 +1,92 @@
+// kernel/x86/idle_bench.c
+// Idle wake-up latency: MWAIT on the wake flag against HLT and an IPI
+#include "x86/idle_bench.h"
+#include "boot/cmdline.h"
+#include "lib/printk.h"
+#include "x86/cpu.h"
+#include "x86/idle.h"
+#include "x86/smp.h"
+#include "x86/tsc.h"
+
+static const uint64_t g_gaps_us[] = { 1, 10, 100, 1000 };
+
+static void nop(void *arg, uint32_t cpu, uint32_t ncpus) {
+    (void)arg;
+    (void)cpu;
+    (void)ncpus;
+}
+
+static void wakes(uint64_t n, uint64_t gap_us) {
+    uint64_t gap = ns_to_tsc(gap_us * 1000);
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t until = rdtsc() + gap;
+        while (rdtsc() < until) cpu_relax();
+        smp_run(nop, NULL, smp_cpu_count());
+    }
+}
+
+// Upper bound of the bucket below which `pct` percent of the wakes fall
+static uint64_t percentile(const uint64_t *hist, uint64_t total, uint64_t pct) {
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < IDLE_HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen * 100 >= total * pct) return 128ULL << b;
+    }
+    return 128ULL << (IDLE_HIST_BUCKETS - 1);
+}
+
+static void report(uint64_t gap_us, const struct idle_stats *s) {
+    kprintf("  gap %4llu us: %llu IPIs, poll window now %llu ns\n",
+            (unsigned long long)gap_us, (unsigned long long)s->ipis,
+            (unsigned long long)s->poll_ns);
+    for (uint32_t k = 0; k < IDLE_KINDS; k++) {
+        if (!s->periods[k]) continue;
+        kprintf("    %-10s %6llu periods, %6llu woken", idle_kind_name(k),
+                (unsigned long long)s->periods[k], (unsigned long long)s->wakes[k]);
+        if (!s->wakes[k]) {
+            kprintf("\n");
+            continue;
+        }
+        kprintf(": median < %llu ns, p99 < %llu ns\n     ",
+                (unsigned long long)percentile(s->hist[k], s->wakes[k], 50),
+                (unsigned long long)percentile(s->hist[k], s->wakes[k], 99));
+        for (uint32_t b = 0; b < IDLE_HIST_BUCKETS; b++) {
+            if (!s->hist[k][b]) continue;
+            if (b == IDLE_HIST_BUCKETS - 1) kprintf(" more:%llu", (unsigned long long)s->hist[k][b]);
+            else kprintf(" <%llu:%llu", 128ULL << b, (unsigned long long)s->hist[k][b]);
+        }
+        kprintf("\n");
+    }
+}
+
+void idle_bench(void) {
+    static const int methods[] = { IDLE_METHOD_MWAIT, IDLE_METHOD_HLT };
+    static const char *const names[] = { "MWAIT on the wake flag", "HLT and an IPI" };
+    if (smp_cpu_count() < 2) {
+        kprintf("idlebench: needs two CPUs\n");
+        return;
+    }
+    uint64_t n = cmdline_get_u64("idlebench.wakes", 1000);
+    if (!n) return;
+    int before = idle_get_method();
+
+    kprintf("idlebench: %llu wakes of %u APs per gap, latency buckets in ns\n",
+            (unsigned long long)n, smp_cpu_count() - 1);
+    for (uint32_t m = 0; m < 2; m++) {
+        if (idle_set_method(methods[m]) < 0) {
+            kprintf("idlebench: %s: not available\n", names[m]);
+            continue;
+        }
+        kprintf("idlebench: %s\n", names[m]);
+        for (uint32_t g = 0; g < sizeof(g_gaps_us) / sizeof(g_gaps_us[0]); g++) {
+            // Let the poll window and depth choice settle on this gap first
+            wakes(n / 10 + 1, g_gaps_us[g]);
+            idle_reset_stats();
+            wakes(n, g_gaps_us[g]);
+            struct idle_stats s;
+            idle_get_stats(&s);
+            report(g_gaps_us[g], &s);
+        }
+    }
+    idle_set_method(before);
+}
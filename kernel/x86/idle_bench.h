@@ -0,0 +1,10 @@
+// kernel/x86/idle_bench.h
+// Idle wake-up latency: MWAIT on the wake flag against HLT and an IPI
+#pragma once
+
+// With every idle method the CPU has, wake the APs through smp_run() after
+// gaps of 1 us to 1 ms, and print for each gap how their idle periods
+// ended and a histogram of the time from idle_wake() to running again.
+// Needs two CPUs. Command line knob:
+//   idlebench.wakes=N   wakes per gap (default 1000)
+void idle_bench(void);
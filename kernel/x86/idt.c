@@ -0,0 +1,165 @@
+// kernel/x86/idt.c
+// Interrupt Descriptor Table and trap dispatch
+#include "idt.h"
+#include "apic.h"
+#include "cpu.h"
+#include "percpu.h"
+#include "syscall.h"
+#include "lib/spinlock.h"
+#include "lib/printk.h"
+
+struct idt_entry {
+    uint16_t offset_lo;
+    uint16_t selector;
+    uint8_t  ist;
+    uint8_t  type_attr;
+    uint16_t offset_mid;
+    uint32_t offset_hi;
+    uint32_t zero;
+} __attribute__((packed));
+
+#define IDT_INTERRUPT_GATE  0x8E    // present, DPL0, 64-bit interrupt gate
+#define IDT_DPL3            0x60
+
+extern char isr_stubs[];
+
+static struct idt_entry g_idt[256] __attribute__((aligned(16)));
+static trap_handler_t   g_handlers[256];
+static struct {
+    irq_handler_t fn;
+    void         *arg;
+} g_irqs[256];
+static spinlock_t       g_irq_lock = SPINLOCK_INIT;
+static int              g_idt_built;
+
+static const char *const g_exception_names[32] = {
+    "#DE divide error", "#DB debug", "NMI", "#BP breakpoint",
+    "#OF overflow", "#BR bound range", "#UD invalid opcode", "#NM device not available",
+    "#DF double fault", "coprocessor overrun", "#TS invalid TSS", "#NP segment not present",
+    "#SS stack fault", "#GP general protection", "#PF page fault", "reserved",
+    "#MF x87 FP error", "#AC alignment check", "#MC machine check", "#XM SIMD FP error",
+    "#VE virtualization", "#CP control protection", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "reserved",
+    "#HV hypervisor injection", "#VC VMM communication", "#SX security", "reserved",
+};
+
+//=============================================================================
+// Legacy PIC
+// The 8259 powers up delivering IRQ0-7 on vectors 8-15, on top of the CPU
+// exceptions. Remap it out of the way and mask everything; devices use
+// MSI/MSI-X or the local APIC.
+//=============================================================================
+
+static void pic_disable(void) {
+    outb(0x20, 0x11);               // ICW1: init, expect ICW4
+    outb(0xA0, 0x11);
+    outb(0x21, VEC_PIC_BASE);       // ICW2: vector offsets
+    outb(0xA1, VEC_PIC_BASE + 8);
+    outb(0x21, 0x04);               // ICW3: slave on IRQ2
+    outb(0xA1, 0x02);
+    outb(0x21, 0x01);               // ICW4: 8086 mode
+    outb(0xA1, 0x01);
+    outb(0x21, 0xFF);               // mask all
+    outb(0xA1, 0xFF);
+}
+
+//=============================================================================
+// Table Setup
+//=============================================================================
+
+static void set_gate(uint8_t vector, uint8_t ist, uint8_t type_attr) {
+    uint64_t addr = (uint64_t)(isr_stubs + vector * 16);
+    struct idt_entry *e = &g_idt[vector];
+
+    e->offset_lo  = addr & 0xFFFF;
+    e->selector   = GDT_KERNEL_CODE;
+    e->ist        = ist;
+    e->type_attr  = type_attr;
+    e->offset_mid = (addr >> 16) & 0xFFFF;
+    e->offset_hi  = addr >> 32;
+    e->zero       = 0;
+}
+
+void idt_init(void) {
+    if (!g_idt_built) {
+        for (int v = 0; v < 256; v++) {
+            set_gate(v, v == VEC_DOUBLE_FAULT ? IST_DOUBLE_FAULT : 0, IDT_INTERRUPT_GATE);
+        }
+        pic_disable();
+        g_idt_built = 1;
+    }
+
+    struct {
+        uint16_t limit;
+        uint64_t base;
+    } __attribute__((packed)) idtr = { sizeof(g_idt) - 1, (uint64_t)g_idt };
+
+    __asm__ volatile("lidt %0" :: "m"(idtr));
+}
+
+void idt_set_handler(uint8_t vector, trap_handler_t handler) {
+    g_handlers[vector] = handler;
+}
+
+void idt_set_user_gate(uint8_t vector) {
+    set_gate(vector, 0, IDT_INTERRUPT_GATE | IDT_DPL3);
+}
+
+int idt_alloc_irq(irq_handler_t fn, void *arg) {
+    int vector = -1;
+
+    spin_lock(&g_irq_lock);
+    for (int v = VEC_DEVICE_BASE; v < VEC_SPURIOUS; v++) {
+        if (!g_irqs[v].fn && !g_handlers[v]) {
+            g_irqs[v].arg = arg;
+            g_irqs[v].fn = fn;
+            vector = v;
+            break;
+        }
+    }
+    spin_unlock(&g_irq_lock);
+    return vector;
+}
+
+//=============================================================================
+// Dispatch
+//=============================================================================
+
+void trap_unhandled(struct trap_frame *f) {
+    if ((f->cs & 3) && user_active()) {
+        kprintf("user: %s at %#lx, CR2 %#lx\n", g_exception_names[f->vector],
+                f->rip, read_cr2());
+        user_exit(-128 - (int64_t)f->vector);
+    }
+
+    kprintf("\n*** %s (vector %lu, error %#lx)\n",
+            g_exception_names[f->vector], f->vector, f->error);
+    kprintf("RIP %016lx  CS %04lx  RFLAGS %016lx\n", f->rip, f->cs, f->rflags);
+    kprintf("RSP %016lx  SS %04lx  CR2 %016lx\n", f->rsp, f->ss, read_cr2());
+    kprintf("RAX %016lx  RBX %016lx  RCX %016lx\n", f->rax, f->rbx, f->rcx);
+    kprintf("RDX %016lx  RSI %016lx  RDI %016lx\n", f->rdx, f->rsi, f->rdi);
+    kprintf("RBP %016lx  R8  %016lx  R9  %016lx\n", f->rbp, f->r8, f->r9);
+    kprintf("R10 %016lx  R11 %016lx  R12 %016lx\n", f->r10, f->r11, f->r12);
+    kprintf("R13 %016lx  R14 %016lx  R15 %016lx\n", f->r13, f->r14, f->r15);
+    panic("unhandled exception");
+}
+
+void trap_dispatch(struct trap_frame *f) {
+    trap_handler_t handler = g_handlers[f->vector];
+
+    if (f->vector < VEC_IRQ_BASE || f->vector == VEC_SYSCALL) {
+        if (handler) handler(f);
+        else trap_unhandled(f);
+        return;
+    }
+
+    struct percpu *pc = this_cpu();
+    pc->irq_depth++;
+    if (handler) {
+        handler(f);
+    } else if (g_irqs[f->vector].fn) {
+        g_irqs[f->vector].fn(g_irqs[f->vector].arg);
+        apic_eoi();
+    }
+    pc->irq_depth--;
+}
@@ -0,0 +1,65 @@
+// kernel/x86/idt.h
+// Interrupt Descriptor Table and trap dispatch
+#pragma once
+
+#include <stdint.h>
+
+//=============================================================================
+// Vectors
+//=============================================================================
+
+#define VEC_DIVIDE_ERROR    0
+#define VEC_DEBUG           1
+#define VEC_NMI             2
+#define VEC_BREAKPOINT      3
+#define VEC_INVALID_OPCODE  6
+#define VEC_DEVICE_NA       7   // #NM: FPU/SIMD use with CR0.TS set
+#define VEC_DOUBLE_FAULT    8
+#define VEC_GP_FAULT        13
+#define VEC_PAGE_FAULT      14
+#define VEC_X87_FP          16
+#define VEC_SIMD_FP         19
+
+#define VEC_IRQ_BASE        32  // first vector counted as an interrupt
+#define VEC_PIC_BASE        32  // legacy 8259, remapped and masked
+#define VEC_DEVICE_BASE     48  // handed out by idt_alloc_irq()
+#define VEC_SYSCALL         128 // int 0x80 from ring 3 (x86/syscall.h)
+#define VEC_SPURIOUS        255
+
+//=============================================================================
+// Trap Frame
+// Pushed by isr.S: GPRs, then vector and error code (0 if the CPU didn't
+// push one), then the hardware interrupt frame.
+//=============================================================================
+
+struct trap_frame {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    uint64_t vector;
+    uint64_t error;
+    uint64_t rip, cs, rflags, rsp, ss;
+};
+
+typedef void (*trap_handler_t)(struct trap_frame *f);
+
+// Build the IDT (first call) and load it on the calling CPU.
+// The legacy PIC is remapped to VEC_PIC_BASE and masked on the first call.
+void idt_init(void);
+
+// Install a C handler for a vector. Interrupt handlers (>= VEC_IRQ_BASE,
+// except VEC_SYSCALL) run with irq_depth raised and must send their own EOI.
+void idt_set_handler(uint8_t vector, trap_handler_t handler);
+
+// What an exception without a handler gets: the user code that raised it
+// is ended (see user_exit()), the kernel panics with a register dump. For
+// handlers that only deal with some cases.
+void trap_unhandled(struct trap_frame *f);
+
+// Allow `int vector` from ring 3 (DPL 3 gate)
+void idt_set_user_gate(uint8_t vector);
+
+// Device interrupt: claim a free vector from VEC_DEVICE_BASE up and route
+// it to fn(arg). The local APIC EOI is sent after fn returns.
+// Returns the vector, or -1 when all are taken.
+typedef void (*irq_handler_t)(void *arg);
+int idt_alloc_irq(irq_handler_t fn, void *arg);
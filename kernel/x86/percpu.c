@@ -0,0 +1,84 @@
+// kernel/x86/percpu.c
+// Per-CPU GDT, TSS and GS base
+//
+// We stop using the firmware's GDT here: the IDT needs a code selector we
+// control, and each CPU needs its own TSS.
+#include "percpu.h"
+#include "cpu.h"
+
+struct percpu g_percpu[MAX_CPUS];
+
+static uint8_t g_bsp_df_stack[IST_STACK_SIZE] __attribute__((aligned(16)));
+
+//=============================================================================
+// Descriptors
+//=============================================================================
+
+#define SEG_KERNEL_CODE  0x00AF9A000000FFFFULL  // L=1, DPL0, exec/read
+#define SEG_KERNEL_DATA  0x00CF92000000FFFFULL  // DPL0, read/write
+#define SEG_USER_CODE32  0x00CFFA000000FFFFULL  // DPL3, 32-bit (SYSRET slot)
+#define SEG_USER_DATA    0x00CFF2000000FFFFULL  // DPL3, read/write
+#define SEG_USER_CODE    0x00AFFA000000FFFFULL  // L=1, DPL3, exec/read
+
+static void set_tss_descriptor(uint64_t *gdt, struct tss *tss) {
+    uint64_t base  = (uint64_t)tss;
+    uint64_t limit = sizeof(*tss) - 1;
+
+    gdt[0] = (limit & 0xFFFF) |
+             ((base & 0xFFFFFF) << 16) |
+             (0x89ULL << 40) |                  // present, 64-bit available TSS
+             (((limit >> 16) & 0xF) << 48) |
+             (((base >> 24) & 0xFF) << 56);
+    gdt[1] = base >> 32;
+}
+
+static void load_gdt(uint64_t *gdt) {
+    struct {
+        uint16_t limit;
+        uint64_t base;
+    } __attribute__((packed)) gdtr = { GDT_ENTRIES * 8 - 1, (uint64_t)gdt };
+
+    // Far return to reload CS, then the data segments. Loading GS clears
+    // the GS base, so this has to happen before the base is set.
+    __asm__ volatile(
+        "lgdt %0\n\t"
+        "pushq %1\n\t"
+        "leaq 1f(%%rip), %%rax\n\t"
+        "pushq %%rax\n\t"
+        "lretq\n"
+        "1:\n\t"
+        "mov %2, %%ax\n\t"
+        "mov %%ax, %%ds\n\t"
+        "mov %%ax, %%es\n\t"
+        "mov %%ax, %%ss\n\t"
+        "xor %%eax, %%eax\n\t"
+        "mov %%ax, %%fs\n\t"
+        "mov %%ax, %%gs\n\t"
+        :
+        : "m"(gdtr), "i"(GDT_KERNEL_CODE), "i"(GDT_KERNEL_DATA)
+        : "rax", "memory");
+
+    __asm__ volatile("ltr %w0" :: "r"(GDT_TSS));
+}
+
+void percpu_init(uint32_t cpu_id, void *df_stack_top) {
+    struct percpu *pc = &g_percpu[cpu_id];
+
+    pc->self   = pc;
+    pc->cpu_id = cpu_id;
+
+    pc->gdt[0] = 0;
+    pc->gdt[GDT_KERNEL_CODE / 8] = SEG_KERNEL_CODE;
+    pc->gdt[GDT_KERNEL_DATA / 8] = SEG_KERNEL_DATA;
+    pc->gdt[GDT_USER_CODE32 / 8] = SEG_USER_CODE32;
+    pc->gdt[GDT_USER_DATA / 8]   = SEG_USER_DATA;
+    pc->gdt[GDT_USER_CODE / 8]   = SEG_USER_CODE;
+    set_tss_descriptor(&pc->gdt[GDT_TSS / 8], &pc->tss);
+
+    if (!df_stack_top) df_stack_top = g_bsp_df_stack + IST_STACK_SIZE;
+    pc->tss.ist[IST_DOUBLE_FAULT - 1] = (uint64_t)df_stack_top;
+    pc->tss.iomap_base = sizeof(struct tss);    // no I/O permission bitmap
+
+    load_gdt(pc->gdt);
+    wrmsr(MSR_GS_BASE, (uint64_t)pc);
+}
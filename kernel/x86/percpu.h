@@ -0,0 +1,79 @@
+// kernel/x86/percpu.h
+// Per-CPU data, reached through the GS base
+//
+// Each CPU's GS base points at its own struct percpu, whose first field
+// points back at itself, so this_cpu() is a single %gs-relative load.
+#pragma once
+
+#include <stdint.h>
+
+#define MAX_CPUS 64
+
+//=============================================================================
+// GDT Layout
+// The user selectors are ordered for SYSRET: user data = base + 8,
+// user code = base + 16, with base = GDT_USER_CODE32.
+//=============================================================================
+
+#define GDT_KERNEL_CODE  0x08
+#define GDT_KERNEL_DATA  0x10
+#define GDT_USER_CODE32  0x18
+#define GDT_USER_DATA    0x20
+#define GDT_USER_CODE    0x28
+#define GDT_TSS          0x30   // 16-byte system descriptor
+#define GDT_ENTRIES      8
+
+//=============================================================================
+// Task State Segment (64-bit)
+// Only used for the ring-0 stack pointer and the IST stacks.
+//=============================================================================
+
+struct tss {
+    uint32_t reserved0;
+    uint64_t rsp[3];
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+#define IST_DOUBLE_FAULT 1
+#define IST_STACK_SIZE   4096
+
+struct task;
+
+struct percpu {
+    struct percpu *self;        // must be first: this_cpu() reads %gs:0
+    // x86/syscall_entry.S reaches these three at fixed offsets
+    uint64_t       kernel_rsp;  // stack SYSCALL switches to, set by user_run()
+    uint64_t       user_rsp;    // user RSP, parked here during the switch
+    uint64_t       user_return; // kernel RSP user_exit() goes back to
+    uint32_t       cpu_id;      // dense index, 0 = BSP
+    uint32_t       irq_depth;   // > 0 while running an interrupt handler
+    uint32_t       simd_depth;  // > 0 inside kernel_simd_begin/end
+    uint32_t       apic_id;     // local APIC ID, set by apic_init()
+    uint32_t       node;        // NUMA node, set by numa_cpu_init()
+    int64_t        tsc_offset;  // this TSC minus the BSP's, set by clock_sync_check()
+    struct task   *current;     // task running on this CPU
+    struct task   *fpu_owner;   // task whose state is live in the SIMD registers
+    uint64_t       gdt[GDT_ENTRIES] __attribute__((aligned(16)));
+    struct tss     tss;
+};
+
+extern struct percpu g_percpu[MAX_CPUS];
+
+static inline struct percpu *this_cpu(void) {
+    struct percpu *p;
+    __asm__ volatile("mov %%gs:0, %0" : "=r"(p));
+    return p;
+}
+
+static inline int in_interrupt(void) {
+    return this_cpu()->irq_depth != 0;
+}
+
+// Load a GDT and TSS for the calling CPU and point GS at g_percpu[cpu_id].
+// `df_stack_top` is the double-fault IST stack (IST_STACK_SIZE bytes); the
+// BSP passes NULL and gets a static one, since nothing can allocate yet.
+void percpu_init(uint32_t cpu_id, void *df_stack_top);
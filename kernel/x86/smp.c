@@ -0,0 +1,262 @@
+// kernel/x86/smp.c
+// AP bring-up through INIT/SIPI and the smp_run() dispatcher
+#include "x86/smp.h"
+#include "acpi/acpi.h"
+#include "boot/bootinfo.h"
+#include "lib/printk.h"
+#include "lib/string.h"
+#include "mm/numa.h"
+#include "mm/pmm.h"
+#include "mm/zpool.h"
+#include "sched/task.h"
+#include "x86/apic.h"
+#include "x86/cpu.h"
+#include "x86/fpu.h"
+#include "x86/idle.h"
+#include "x86/idt.h"
+#include "x86/percpu.h"
+#include "x86/syscall.h"
+#include "x86/tsc.h"
+
+#define AP_STACK_PAGES  4
+#define AP_TIMEOUT_MS   100
+#define IDLE_ZERO_BATCH 16          // Pages between checks for work
+
+// Layout of smp_trampoline_params in trampoline.S
+struct trampoline_params {
+    uint64_t cr3;
+    uint64_t efer;
+    uint64_t entry;
+    uint32_t next;              // APs claim stacks[next++]
+    uint32_t _pad;
+    uint64_t stacks[MAX_CPUS];
+};
+
+extern const uint8_t smp_trampoline_start[];
+extern const uint8_t smp_trampoline_params[];
+extern const uint8_t smp_trampoline_end[];
+
+static volatile uint32_t g_online = 1;
+static uint32_t          g_apic_ids[MAX_CPUS];      // By CPU number
+
+// Allocated by the BSP for each AP, by CPU number
+static struct {
+    void        *df_stack_top;
+    struct task *idle;
+} g_ap[MAX_CPUS];
+
+// The current smp_run() call
+static struct {
+    smp_fn            fn;
+    void             *arg;
+    uint32_t          ncpus;
+    volatile uint32_t generation;
+    volatile uint32_t pending;
+} g_work;
+
+static void delay_us(uint64_t us) {
+    uint64_t end = rdtsc() + ns_to_tsc(us * 1000);
+    while (rdtsc() < end) cpu_relax();
+}
+
+//=============================================================================
+// AP Side
+//=============================================================================
+
+// Check for work with interrupts off and idle (x86/idle.h), which wakes
+// for anything sent since the check. Before idling, zero pages for the
+// pool a batch at a time, interrupts on, until it is full.
+__attribute__((noreturn)) static void ap_idle(uint32_t cpu) {
+    uint32_t seen = 0;
+
+    for (;;) {
+        while (__atomic_load_n(&g_work.generation, __ATOMIC_ACQUIRE) == seen) {
+            __asm__ volatile("sti" ::: "memory");
+            uint32_t zeroed = zpool_refill(IDLE_ZERO_BATCH);
+            __asm__ volatile("cli" ::: "memory");
+            if (zeroed) continue;
+            idle_enter();
+        }
+        seen = g_work.generation;
+        if (cpu < g_work.ncpus) {
+            g_work.fn(g_work.arg, cpu, g_work.ncpus);
+            __atomic_sub_fetch(&g_work.pending, 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+// Entered from the trampoline on the slot's stack, in long mode on the
+// BSP's page tables with the trampoline GDT and no IDT
+__attribute__((noreturn)) static void ap_main(uint64_t slot) {
+    uint32_t cpu = slot + 1;
+
+    // Same order as kernel_main
+    cpu_init();
+    percpu_init(cpu, g_ap[cpu].df_stack_top);
+    idt_init();
+    sched_init(g_ap[cpu].idle, "idle");
+    fpu_init();
+    syscall_init();
+    apic_init();
+    numa_cpu_init();
+
+    g_apic_ids[cpu] = this_cpu()->apic_id;
+    __atomic_add_fetch(&g_online, 1, __ATOMIC_RELEASE);
+    ap_idle(cpu);
+}
+
+//=============================================================================
+// BSP Side
+//=============================================================================
+
+// A free page below 1 MiB: pmm never hands those out, so any page the
+// memory map calls usable is ours
+static uint64_t trampoline_page(void) {
+    for (uint32_t i = 0; i < g_boot.memory_map_count; i++) {
+        const struct MemoryMapEntry *e = &g_boot.memory_map[i];
+        if (e->type != MEMORY_TYPE_USABLE) continue;
+
+        uint64_t page = PAGE_ALIGN_UP(e->base);
+        if (page < 0x1000) page = 0x1000;           // Real-mode IVT
+        if (page + PAGE_SIZE <= e->base + e->length && page + PAGE_SIZE <= 0x100000) {
+            return page;
+        }
+    }
+    return 0;
+}
+
+// APIC IDs of the enabled CPUs other than this one
+static uint32_t find_aps(uint32_t *ids, uint32_t max) {
+    const struct acpi_madt *madt = (const void *)acpi_find_table("APIC", 0);
+    if (!madt) return 0;
+
+    uint32_t self = this_cpu()->apic_id;
+    uint32_t n = 0;
+    const uint8_t *p = madt->entries;
+    const uint8_t *end = (const uint8_t *)madt + madt->header.length;
+    while (p + sizeof(struct acpi_madt_entry) <= end) {
+        const struct acpi_madt_entry *e = (const void *)p;
+        if (e->length < sizeof(*e) || p + e->length > end) break;
+
+        uint32_t id = ~0U, flags = 0;
+        if (e->type == MADT_LOCAL_APIC && e->length >= sizeof(struct acpi_madt_local_apic)) {
+            const struct acpi_madt_local_apic *l = (const void *)e;
+            id = l->apic_id;
+            flags = l->flags;
+        } else if (e->type == MADT_LOCAL_X2APIC &&
+                   e->length >= sizeof(struct acpi_madt_local_x2apic)) {
+            const struct acpi_madt_local_x2apic *x = (const void *)e;
+            id = x->x2apic_id;
+            flags = x->flags;
+        }
+        if (id != ~0U && id != self && (flags & MADT_CPU_ENABLED) && n < max) {
+            // xAPIC mode can't address IDs above 254
+            if (apic_is_x2apic() || id < 0xFF) ids[n++] = id;
+        }
+        p += e->length;
+    }
+    return n;
+}
+
+uint32_t smp_init(void) {
+    uint32_t ids[MAX_CPUS - 1];
+
+    g_apic_ids[0] = this_cpu()->apic_id;
+    uint32_t count = find_aps(ids, MAX_CPUS - 1);
+    if (count == 0) return g_online;
+
+    uint64_t page = trampoline_page();
+    uint64_t cr3 = read_cr3();
+    if (!page || cr3 >= 0x100000000ULL) {
+        kprintf("SMP: can't start APs (%s)\n",
+                page ? "page tables above 4 GiB" : "no page below 1 MiB");
+        return g_online;
+    }
+
+    uint8_t *tramp = phys_to_virt(page);
+    memcpy(tramp, smp_trampoline_start, smp_trampoline_end - smp_trampoline_start);
+    struct trampoline_params *params =
+        (void *)(tramp + (smp_trampoline_params - smp_trampoline_start));
+    params->cr3 = cr3;
+    params->efer = rdmsr(MSR_EFER);
+    params->entry = (uint64_t)ap_main;
+    params->next = 0;
+    size_t task_pages = PAGE_ALIGN_UP(sizeof(struct task)) / PAGE_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t node = numa_node_of_apic(ids[i]);
+        uint64_t stack = pmm_alloc_pages_node(AP_STACK_PAGES, node);
+        uint64_t df_stack = pmm_alloc_pages_node(1, node);
+        struct task *idle = pmm_alloc_zeroed(task_pages);
+        if (!stack || !df_stack || !idle) {
+            count = i;
+            break;
+        }
+        params->stacks[i] = stack + AP_STACK_PAGES * PAGE_SIZE;
+        g_ap[i + 1].df_stack_top = phys_to_virt(df_stack + IST_STACK_SIZE);
+        g_ap[i + 1].idle = idle;
+    }
+
+    // INIT everyone, one wait, then the SIPIs: all APs boot in parallel.
+    // The second SIPI is ignored by APs the first one already started.
+    for (uint32_t i = 0; i < count; i++) apic_send_init(ids[i]);
+    delay_us(10000);
+    for (uint32_t i = 0; i < count; i++) apic_send_sipi(ids[i], page >> 12);
+    delay_us(200);
+    for (uint32_t i = 0; i < count; i++) apic_send_sipi(ids[i], page >> 12);
+
+    uint64_t deadline = rdtsc() + ns_to_tsc(AP_TIMEOUT_MS * 1000000ULL);
+    while (g_online < count + 1 && rdtsc() < deadline) cpu_relax();
+    if (g_online < count + 1) {
+        kprintf("SMP: %u of %u APs did not start\n", count + 1 - g_online, count);
+    }
+    return g_online;
+}
+
+uint32_t smp_cpu_count(void) {
+    return g_online;
+}
+
+// The highest-numbered AP: smp_run() callers asking for fewer CPUs leave
+// it alone
+void smp_kick_idle(void) {
+    uint32_t last = __atomic_load_n(&g_online, __ATOMIC_ACQUIRE) - 1;
+    if (last == 0) return;
+    idle_wake(last);
+}
+
+void smp_run(smp_fn fn, void *arg, uint32_t ncpus) {
+    if (ncpus > g_online) ncpus = g_online;
+    if (ncpus <= 1) {
+        fn(arg, 0, 1);
+        return;
+    }
+
+    g_work.fn = fn;
+    g_work.arg = arg;
+    g_work.ncpus = ncpus;
+    g_work.pending = ncpus - 1;
+    __atomic_add_fetch(&g_work.generation, 1, __ATOMIC_RELEASE);
+    for (uint32_t cpu = 1; cpu < ncpus; cpu++) idle_wake(cpu);
+
+    fn(arg, 0, ncpus);
+    while (__atomic_load_n(&g_work.pending, __ATOMIC_ACQUIRE)) cpu_relax();
+}
+
+// smp_park()'s work: it never returns, so it does the count smp_run()
+// waits on itself
+static void park(void *arg, uint32_t cpu, uint32_t ncpus) {
+    (void)arg;
+    (void)ncpus;
+    if (cpu == 0) return;
+    __atomic_sub_fetch(&g_work.pending, 1, __ATOMIC_RELEASE);
+    for (;;) __asm__ volatile("cli; hlt" ::: "memory");
+}
+
+void smp_park(void) {
+    uint32_t n = g_online;
+    if (n <= 1) return;
+
+    smp_run(park, NULL, n);
+    for (uint32_t cpu = 1; cpu < n; cpu++) apic_send_init(g_apic_ids[cpu]);
+    g_online = 1;
+}
@@ -0,0 +1,33 @@
+// kernel/x86/smp.h
+// Application processor startup and cross-CPU work dispatch
+//
+// CPU 0 is the BSP. APs are numbered 1.. in the order they come up; after
+// the same per-CPU setup as the BSP they idle (x86/idle.h) until smp_run()
+// hands them work. Before idling they refill the pre-zeroed page pool
+// (mm/zpool.h).
+#pragma once
+
+#include <stdint.h>
+
+// Start every enabled CPU listed in the ACPI MADT and wait for them to
+// come online. Call after acpi_init(), apic_init(), pmm_init() and
+// tsc_init(). Returns the number of CPUs online, BSP included.
+uint32_t smp_init(void);
+
+// CPUs online, BSP included
+uint32_t smp_cpu_count(void);
+
+// Run fn(arg, i, n) on CPUs 0..n-1, the caller being CPU 0, and return
+// once every call has returned. `n` is clamped to smp_cpu_count(). BSP
+// only, one at a time.
+typedef void (*smp_fn)(void *arg, uint32_t cpu, uint32_t ncpus);
+void smp_run(smp_fn fn, void *arg, uint32_t ncpus);
+
+// Stop every AP for good, before handing the machine to another kernel
+// (boot/kexec.h): each leaves its idle loop, reports in and halts with
+// interrupts off, then gets an INIT so it waits for the next kernel's
+// SIPI. BSP only; smp_cpu_count() is 1 afterwards.
+void smp_park(void);
+
+// Wake an idle AP to look for background work. No-op without APs.
+void smp_kick_idle(void);
@@ -0,0 +1,186 @@
+// kernel/x86/syscall.c
+// SYSCALL setup, the system call table and the int 0x80 gate
+#include "x86/syscall.h"
+#include <stddef.h>
+#include "lib/printk.h"
+#include "mm/vmm.h"
+#include "proc/aio.h"
+#include "proc/ipc.h"
+#include "proc/process.h"
+#include "sched/task.h"
+#include "time/clock.h"
+#include "x86/cpu.h"
+#include "x86/idt.h"
+#include "x86/percpu.h"
+
+_Static_assert(offsetof(struct percpu, kernel_rsp) == 8, "PERCPU_KERNEL_RSP in syscall_entry.S");
+_Static_assert(offsetof(struct percpu, user_rsp) == 16, "PERCPU_USER_RSP in syscall_entry.S");
+_Static_assert(offsetof(struct percpu, user_return) == 24, "PERCPU_USER_RETURN in syscall_entry.S");
+_Static_assert(USER_TOP == 0x0000800000000000ULL, "USER_TOP in syscall_entry.S");
+_Static_assert(offsetof(struct user_regs, rbx) == 8 && offsetof(struct user_regs, rbp) == 48 &&
+               offsetof(struct user_regs, r8) == 56 && offsetof(struct user_regs, r15) == 112 &&
+               offsetof(struct user_regs, rip) == 120 && offsetof(struct user_regs, rflags) == 136,
+               "REGS_* in syscall_entry.S");
+
+typedef int64_t (*syscall_fn)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+
+extern char syscall_entry[];
+int64_t user_enter(const struct user_regs *regs, void *tss_rsp0);
+int64_t sys_fork(void);
+__attribute__((noreturn)) void syscall_bad_rip(uint64_t rip);
+
+// What syscall_entry pushed, just below the stack user_enter() left in
+// percpu.kernel_rsp
+struct syscall_frame {
+    uint64_t pad, r10, r9, r8, rdx, rsi, rdi, rcx, r11, rsp;
+};
+
+// The user's callee-saved registers, pushed by sys_fork
+struct callee_saved {
+    uint64_t rbx, rbp, r12, r13, r14, r15;
+};
+
+// Flags ring 3 may set through user_run_regs(): CF PF AF ZF SF TF DF OF AC
+#define RFLAGS_USER_MASK    0x40DD5ULL
+
+//=============================================================================
+// System Calls
+//=============================================================================
+
+static int64_t sys_exit(uint64_t code) {
+    user_exit((int64_t)code);
+}
+
+static int64_t sys_null(void) {
+    return 0;
+}
+
+static int64_t sys_clock(void) {
+    return now_ns();
+}
+
+static int64_t sys_write(uint64_t buf, uint64_t len) {
+    if (!process_user_ok(buf, len, 0)) return -EFAULT;
+    kwrite((const char *)buf, len);
+    return len;
+}
+
+// Called by the sys_fork stub with the registers syscall_entry did not save
+int64_t syscall_fork(const struct callee_saved *cs) {
+    const struct syscall_frame *f =
+        (const struct syscall_frame *)this_cpu()->kernel_rsp - 1;
+    struct user_regs r = {
+        .rbx = cs->rbx, .rbp = cs->rbp, .r12 = cs->r12, .r13 = cs->r13,
+        .r14 = cs->r14, .r15 = cs->r15,
+        .rdx = f->rdx, .rsi = f->rsi, .rdi = f->rdi,
+        .r8 = f->r8, .r9 = f->r9, .r10 = f->r10,
+        .rip = f->rcx, .rsp = f->rsp, .rflags = f->r11,
+    };
+    return process_fork(&r);
+}
+
+// Where the CPU would have raised #GP had SYSRET been able to return: the
+// code ends as if it had taken it in ring 3
+static int64_t bad_rip(uint64_t rip) {
+    kprintf("user: return to %#lx, outside user space\n", rip);
+    return -128 - VEC_GP_FAULT;
+}
+
+// Called by syscall_entry instead of a SYSRET to `rip`
+void syscall_bad_rip(uint64_t rip) {
+    user_exit(bad_rip(rip));
+}
+
+// Handlers declare only the arguments they use; the SysV convention lets
+// a caller pass more. The cast through void (*)(void) says so to GCC.
+#define SYSCALL(fn) ((syscall_fn)(void (*)(void))(fn))
+
+// Indexed by RAX in syscall_entry.S
+const syscall_fn syscall_table[SYS_COUNT] = {
+    [SYS_EXIT]       = SYSCALL(sys_exit),
+    [SYS_NULL]       = SYSCALL(sys_null),
+    [SYS_WRITE]      = SYSCALL(sys_write),
+    [SYS_FORK]       = SYSCALL(sys_fork),
+    [SYS_WAIT]       = SYSCALL(sys_wait),
+    [SYS_GETPID]     = SYSCALL(sys_getpid),
+    [SYS_YIELD]      = SYSCALL(sys_yield),
+    [SYS_CLOCK]      = SYSCALL(sys_clock),
+    [SYS_CHAN_OPEN]  = SYSCALL(sys_chan_open),
+    [SYS_FUTEX_WAIT] = SYSCALL(sys_futex_wait),
+    [SYS_FUTEX_WAKE] = SYSCALL(sys_futex_wake),
+    [SYS_GRANT]      = SYSCALL(sys_grant),
+    [SYS_ACCEPT]     = SYSCALL(sys_accept),
+    [SYS_AIO_SETUP]  = SYSCALL(sys_aio_setup),
+    [SYS_AIO_ENTER]  = SYSCALL(sys_aio_enter),
+    [SYS_BLK_IO]     = SYSCALL(sys_blk_io),
+};
+
+//=============================================================================
+// Entry Setup
+//=============================================================================
+
+// The same table through a full trap frame and IRETQ
+static void int80_handler(struct trap_frame *f) {
+    if (f->rax >= SYS_COUNT) {
+        f->rax = -ENOSYS;
+        return;
+    }
+    if (f->rax == SYS_FORK) {
+        struct user_regs r = {
+            .rbx = f->rbx, .rcx = f->rcx, .rdx = f->rdx, .rsi = f->rsi, .rdi = f->rdi,
+            .rbp = f->rbp, .r8 = f->r8, .r9 = f->r9, .r10 = f->r10, .r11 = f->r11,
+            .r12 = f->r12, .r13 = f->r13, .r14 = f->r14, .r15 = f->r15,
+            .rip = f->rip, .rsp = f->rsp, .rflags = f->rflags,
+        };
+        f->rax = process_fork(&r);
+        return;
+    }
+    f->rax = syscall_table[f->rax](f->rdi, f->rsi, f->rdx, f->r10, f->r8, f->r9);
+}
+
+void syscall_init(void) {
+    // SYSCALL loads CS from STAR[47:32] and SS 8 above it. SYSRET to 64-bit
+    // mode loads CS from STAR[63:48] + 16 and SS from STAR[63:48] + 8,
+    // hence the GDT order user code32, user data, user code.
+    wrmsr(MSR_STAR, ((uint64_t)(GDT_USER_CODE32 | 3) << 48) |
+                    ((uint64_t)GDT_KERNEL_CODE << 32));
+    wrmsr(MSR_LSTAR, (uint64_t)syscall_entry);
+    wrmsr(MSR_SFMASK, RFLAGS_TF | RFLAGS_IF | RFLAGS_DF | RFLAGS_AC);
+    wrmsr(MSR_KERNEL_GS_BASE, 0);
+    wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+
+    if (this_cpu()->cpu_id == 0) {
+        idt_set_handler(VEC_SYSCALL, int80_handler);
+        idt_set_user_gate(VEC_SYSCALL);
+    }
+}
+
+int64_t user_run_regs(const struct user_regs *regs) {
+    struct percpu *pc = this_cpu();
+    struct user_regs r = *regs;
+    if (r.rip >= USER_TOP) return bad_rip(r.rip);   // SYSRET can't go there
+    r.rflags = (r.rflags & RFLAGS_USER_MASK) | RFLAGS_IF | 2;
+    return user_enter(&r, (uint8_t *)&pc->tss + offsetof(struct tss, rsp));
+}
+
+int64_t user_run(uint64_t entry, uint64_t stack, uint64_t arg) {
+    struct user_regs r = { .rip = entry, .rsp = stack, .rdi = arg };
+    return user_run_regs(&r);
+}
+
+int user_active(void) {
+    return this_cpu()->user_return != 0;
+}
+
+void user_switch(struct task *prev, struct task *next) {
+    struct percpu *pc = this_cpu();
+
+    // user_enter() points all three at the same stack
+    prev->user_rsp0 = pc->user_return;
+    pc->user_return = next->user_rsp0;
+    pc->kernel_rsp = next->user_rsp0;
+    if (next->user_rsp0) pc->tss.rsp[0] = next->user_rsp0;
+
+    uint64_t root = next->cr3 ? next->cr3 : vmm_kernel_root();
+    if (root && root != read_cr3()) write_cr3(root);
+}
@@ -0,0 +1,47 @@
+// kernel/x86/syscall.h
+// User mode: entry through SYSCALL or int 0x80, exit back to the kernel
+//
+// A kernel task runs user code with user_run(), which returns when the
+// code calls SYS_EXIT or faults. Meanwhile system calls and interrupts
+// from ring 3 run on that task's stack, below user_run()'s frame; the
+// scheduler swaps that stack pointer along with the task. See
+// common/syscall.h for the register convention.
+#pragma once
+
+#include <stdint.h>
+#include "../common/syscall.h"
+
+struct task;
+
+// Registers to enter ring 3 with. RCX and R11 are ignored: SYSRET takes
+// RIP and RFLAGS from them. Only the arithmetic, trap, direction and
+// alignment-check flags of `rflags` are used; interrupts are always on.
+struct user_regs {
+    uint64_t rax, rbx, rcx, rdx, rsi, rdi, rbp;
+    uint64_t r8, r9, r10, r11, r12, r13, r14, r15;
+    uint64_t rip, rsp, rflags;
+};
+
+// Enable SYSCALL on the calling CPU and, on the BSP, install the int 0x80
+// gate. Call on every CPU after idt_init().
+void syscall_init(void);
+
+// Enter ring 3 with `regs`. Returns the SYS_EXIT code, or -128 - vector if
+// the user code took an exception nothing handled. A RIP at or above
+// USER_TOP, here or on return from a system call, counts as a #GP.
+int64_t user_run_regs(const struct user_regs *regs);
+
+// The same with RIP = `entry`, RSP = `stack`, RDI = `arg` and every other
+// register zero
+int64_t user_run(uint64_t entry, uint64_t stack, uint64_t arg);
+
+// Leave ring 3 for good from a system call or exception handler: unwind to
+// the user_run() call, which returns `code`
+__attribute__((noreturn)) void user_exit(int64_t code);
+
+// Nonzero while this CPU is inside user_run()
+int user_active(void);
+
+// Called by the scheduler with interrupts disabled: move this CPU's ring 3
+// entry stack and page tables from `prev` to `next`
+void user_switch(struct task *prev, struct task *next);
@@ -0,0 +1,88 @@
+// kernel/x86/syscall_bench.c
+// Null system call round trip: SYSCALL/SYSRET against int 0x80/IRETQ
+#include "x86/syscall_bench.h"
+#include "boot/cmdline.h"
+#include "lib/printk.h"
+#include "lib/sort.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include "mm/vmm.h"
+#include "x86/syscall.h"
+#include "x86/tsc.h"
+
+#define BENCH_CODE  USER_BASE
+#define BENCH_DATA  (USER_BASE + PAGE_SIZE)
+#define MAX_REPS    64
+
+extern const char syscall_bench_user[], syscall_bench_user_end[];
+
+struct method {
+    const char *name;
+    uint64_t    per_call[MAX_REPS];     // Cycles, loop overhead taken off
+};
+
+static void report(struct method *m, uint32_t reps) {
+    sort_u64(m->per_call, reps);
+    uint64_t median = m->per_call[reps / 2], best = m->per_call[0];
+    kprintf("  %-16s median %5llu cycles (%4llu ns)  best %5llu cycles\n", m->name,
+            (unsigned long long)median, (unsigned long long)tsc_to_ns(median),
+            (unsigned long long)best);
+}
+
+void syscall_bench(void) {
+    uint64_t iters = cmdline_get_u64("syscallbench.iters", 100000);
+    uint32_t reps = cmdline_get_u64("syscallbench.reps", 9);
+    if (reps > MAX_REPS) reps = MAX_REPS;
+    if (!iters || !reps) return;
+
+    struct vm_space vm;
+    if (vmm_space_create(&vm) < 0) {
+        kprintf("syscallbench: no user address space\n");
+        return;
+    }
+    uint64_t code = pmm_alloc_pages(1);
+    uint64_t *data = pmm_alloc_zeroed(1);
+    if (!code || !data) {
+        kprintf("syscallbench: out of memory\n");
+        goto out;
+    }
+    memcpy(phys_to_virt(code), syscall_bench_user, syscall_bench_user_end - syscall_bench_user);
+    if (vmm_map(&vm, BENCH_CODE, code, 0) < 0 ||
+        vmm_map(&vm, BENCH_DATA, virt_to_phys(data), PTE_WRITE | PTE_NX) < 0) {
+        kprintf("syscallbench: cannot map user pages\n");
+        goto out;
+    }
+    vmm_activate(&vm);
+
+    kprintf("syscallbench: %llu null calls per method, %u repetitions\n",
+            (unsigned long long)iters, reps);
+
+    struct method sys = { .name = "syscall/sysret" };
+    struct method gate = { .name = "int 0x80/iretq" };
+    for (uint32_t r = 0; r < reps; r++) {
+        int64_t ret = user_run(BENCH_CODE, BENCH_DATA + PAGE_SIZE, iters);
+        if (ret != 0) {
+            kprintf("syscallbench: user code exited with %lld\n", (long long)ret);
+            goto out;
+        }
+        uint64_t loop = data[2];
+        sys.per_call[r] = (data[0] > loop ? data[0] - loop : 0) / iters;
+        gate.per_call[r] = (data[1] > loop ? data[1] - loop : 0) / iters;
+    }
+    report(&sys, reps);
+    report(&gate, reps);
+
+    uint64_t fast = sys.per_call[reps / 2], slow = gate.per_call[reps / 2];
+    if (fast) {
+        kprintf("  fast path: %llu cycles less per call, %llu.%02llux faster\n",
+                (unsigned long long)(slow > fast ? slow - fast : 0),
+                (unsigned long long)(slow / fast),
+                (unsigned long long)(slow % fast * 100 / fast));
+    }
+
+out:
+    vmm_activate(NULL);
+    vmm_space_destroy(&vm);
+    if (code) pmm_free_pages(code, 1);
+    if (data) pmm_free_pages(virt_to_phys(data), 1);
+}
@@ -0,0 +1,11 @@
+// kernel/x86/syscall_bench.h
+// Null system call round trip: SYSCALL/SYSRET against int 0x80/IRETQ
+#pragma once
+
+// Run a small ring 3 program that times SYS_NULL through both entry paths
+// and an empty loop, repeat it, and print cycles and ns per round trip
+// (loop overhead subtracted) for the median and best repetition.
+// Command line knobs:
+//   syscallbench.iters=N   round trips per method per repetition (default 100000)
+//   syscallbench.reps=N    repetitions (default 9)
+void syscall_bench(void);
@@ -0,0 +1,131 @@
+// kernel/x86/tsc.c
+// Time stamp counter frequency
+#include "x86/tsc.h"
+#include "drivers/hpet.h"
+#include "x86/cpu.h"
+#include "x86/cpufeature.h"
+
+#define PIT_HZ          1193182
+#define PIT_CH2_DATA    0x42
+#define PIT_COMMAND     0x43
+#define PIT_GATE_PORT   0x61    // bit 0: ch2 gate, bit 1: speaker, bit 5: ch2 out
+
+uint64_t tsc_khz;
+uint64_t tsc_ns_mult;
+uint64_t tsc_cycles_mult;
+int tsc_khz_measured;
+
+// KVM and VMware report the frequency they guarantee in leaf 0x40000010
+static uint64_t khz_from_hypervisor(void) {
+    uint32_t a, b, c, d;
+
+    if (!cpu_has(X86_FEATURE_HYPERVISOR)) return 0;
+    cpuid(0x40000000, 0, &a, &b, &c, &d);
+    if (a < 0x40000010) return 0;
+    cpuid(0x40000010, 0, &a, &b, &c, &d);
+    return a;
+}
+
+// Leaf 0x15: TSC = crystal * ebx / eax. Exact when the crystal is given.
+static uint64_t khz_from_crystal(void) {
+    uint32_t a, b, c, d;
+
+    if (boot_cpu.max_leaf < 0x15) return 0;
+    cpuid(0x15, 0, &a, &b, &c, &d);
+    if (a && b && c) return (uint64_t)c * b / a / 1000;
+    return 0;
+}
+
+// Leaf 0x16: nominal base MHz, only as good as the board's clock generator
+static uint64_t khz_from_nominal(void) {
+    uint32_t a, b, c, d;
+
+    if (boot_cpu.max_leaf < 0x16) return 0;
+    cpuid(0x16, 0, &a, &b, &c, &d);
+    return (uint64_t)(a & 0xFFFF) * 1000;
+}
+
+void tsc_sample_hpet(struct tsc_ref *s) {
+    uint64_t best = ~0ULL;
+
+    // An HPET read takes ~0.5-1 us; keep the tightest TSC bracket around it
+    for (int i = 0; i < 5; i++) {
+        uint64_t t0 = rdtsc_ordered();
+        uint64_t h = hpet_read();
+        uint64_t t1 = rdtsc_ordered();
+        if (t1 - t0 < best) {
+            best = t1 - t0;
+            s->tsc = t0 + (t1 - t0) / 2;
+            s->ref = h;
+        }
+    }
+}
+
+uint64_t tsc_khz_between(const struct tsc_ref *a, const struct tsc_ref *b) {
+    uint64_t ns = hpet_delta(a->ref, b->ref) * hpet_period_fs() / 1000000;
+    if (!ns) return 0;
+    return (b->tsc - a->tsc) * 1000000 / ns;
+}
+
+// Count TSC ticks over 10 ms of HPET time
+static uint64_t khz_from_hpet(void) {
+    if (!hpet_present()) return 0;
+
+    struct tsc_ref a, b;
+    uint64_t ticks = 10000000000000ULL / hpet_period_fs();  // 10 ms in fs
+    tsc_sample_hpet(&a);
+    while (hpet_delta(a.ref, hpet_read()) < ticks) cpu_relax();
+    tsc_sample_hpet(&b);
+    return tsc_khz_between(&a, &b);
+}
+
+// Count TSC ticks while PIT channel 2 counts down 10 ms (mode 0)
+static uint64_t khz_from_pit(void) {
+    const uint32_t ms = 10;
+    const uint16_t count = PIT_HZ * ms / 1000;
+
+    uint8_t gate = inb(PIT_GATE_PORT);
+    outb(PIT_GATE_PORT, (gate & ~0x02) | 0x01);
+    outb(PIT_COMMAND, 0xB0);                // ch2, lo/hi byte, mode 0
+    outb(PIT_CH2_DATA, count & 0xFF);
+    outb(PIT_CH2_DATA, count >> 8);
+
+    uint64_t start = rdtsc();
+    uint64_t spins = 0;
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        if (++spins > 100000000) break;     // No PIT: give up
+    }
+    uint64_t end = rdtsc();
+    outb(PIT_GATE_PORT, gate);
+
+    return (end - start) / ms;
+}
+
+void tsc_set_khz(uint64_t khz) {
+    tsc_khz = khz;
+    tsc_ns_mult = (1000000ULL << 32) / tsc_khz;
+    tsc_cycles_mult = (tsc_khz << 32) / 1000000;
+}
+
+const char *tsc_init(void) {
+    const char *source;
+    uint64_t khz;
+
+    tsc_khz_measured = 0;
+    if ((khz = khz_from_hypervisor())) source = "hypervisor";
+    else if ((khz = khz_from_crystal())) source = "cpuid";
+    else if ((khz = khz_from_hpet())) {
+        source = "hpet";
+        tsc_khz_measured = 1;
+    } else if ((khz = khz_from_pit())) {
+        source = "pit";
+        tsc_khz_measured = 1;
+    } else if ((khz = khz_from_nominal())) source = "cpuid";
+    else {
+        khz = 1000000;                      // Something sane: 1 GHz
+        source = "guess";
+    }
+
+    tsc_set_khz(khz);
+    return source;
+}
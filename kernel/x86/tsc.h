@@ -0,0 +1,46 @@
+// kernel/x86/tsc.h
+// Time stamp counter frequency
+#pragma once
+
+#include <stdint.h>
+
+extern uint64_t tsc_khz;
+
+// Nonzero if tsc_khz was timed against the HPET or PIT rather than
+// reported by the hypervisor or CPU (time/clock.h refines those)
+extern int tsc_khz_measured;
+
+// Fixed-point conversion factors (32 fractional bits), set by tsc_init()
+extern uint64_t tsc_ns_mult;
+extern uint64_t tsc_cycles_mult;
+
+// Determine tsc_khz: hypervisor timing leaf, CPUID 0x15 crystal, then a
+// 10 ms measurement against the HPET (drivers/hpet.h) or PIT channel 2,
+// and CPUID 0x16 only when nothing can be measured. Call after
+// hpet_init(). Returns a short name of the source used.
+const char *tsc_init(void);
+
+// Replace tsc_khz and the conversion factors, e.g. after recalibrating
+void tsc_set_khz(uint64_t khz);
+
+// A TSC value and the HPET count read at the same moment
+struct tsc_ref {
+    uint64_t tsc;
+    uint64_t ref;
+};
+
+// Take a sample; needs a working HPET
+void tsc_sample_hpet(struct tsc_ref *s);
+
+// TSC frequency between two samples, or 0 if no HPET time has passed.
+// A 32-bit HPET wraps after about five minutes, so keep them closer.
+uint64_t tsc_khz_between(const struct tsc_ref *a, const struct tsc_ref *b);
+
+// Multiply and shift only: 128-bit division would need libgcc
+static inline uint64_t tsc_to_ns(uint64_t cycles) {
+    return (uint64_t)(((unsigned __int128)cycles * tsc_ns_mult) >> 32);
+}
+
+static inline uint64_t ns_to_tsc(uint64_t ns) {
+    return (uint64_t)(((unsigned __int128)ns * tsc_cycles_mult) >> 32);
+}
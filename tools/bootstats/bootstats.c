@@ -0,0 +1,176 @@
+// tools/bootstats/bootstats.c
+// Per-stage boot time statistics from kernel serial logs
+//
+// Reads serial output of any number of boots on stdin and picks out the
+// kernel's "boottime: stage=us ..." lines (see print_boot_times() in
+// kernel/main.c). Prints median, p95 and spread per stage, and can
+// write them as JSON and compare against an earlier JSON file.
+//
+// Usage: bootstats [-o out.json] [-b baseline.json] [-c commit] < logs
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_STAGES  16
+#define MAX_RUNS    4096
+#define NAME_MAX    32
+
+struct stage {
+    char     name[NAME_MAX];
+    uint64_t us[MAX_RUNS];
+    unsigned count;
+    double   median, p95, min, max;
+    // From the baseline, if it has this stage
+    int      have_base;
+    double   base_median, base_p95;
+};
+
+static struct stage g_stages[MAX_STAGES];
+static unsigned     g_stage_count;
+static unsigned     g_runs;
+
+static struct stage *stage_get(const char *name) {
+    for (unsigned i = 0; i < g_stage_count; i++) {
+        if (!strcmp(g_stages[i].name, name)) return &g_stages[i];
+    }
+    if (g_stage_count == MAX_STAGES) return NULL;
+    struct stage *s = &g_stages[g_stage_count++];
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    return s;
+}
+
+static void parse_line(char *line) {
+    char *p = strstr(line, "boottime:");
+    if (!p || g_runs == MAX_RUNS) return;
+    g_runs++;
+
+    for (char *tok = strtok(p + 9, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+        char *eq = strchr(tok, '=');
+        if (!eq) continue;
+        *eq = 0;
+        struct stage *s = stage_get(tok);
+        if (s && s->count < MAX_RUNS) s->us[s->count++] = strtoull(eq + 1, NULL, 10);
+    }
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of a sorted array
+static double percentile(const uint64_t *v, unsigned n, unsigned pct) {
+    unsigned rank = (n * pct + 99) / 100;
+    return v[rank ? rank - 1 : 0];
+}
+
+static void compute(void) {
+    for (unsigned i = 0; i < g_stage_count; i++) {
+        struct stage *s = &g_stages[i];
+        qsort(s->us, s->count, sizeof(s->us[0]), cmp_u64);
+        s->median = s->count % 2 ? s->us[s->count / 2]
+                  : (s->us[s->count / 2 - 1] + s->us[s->count / 2]) / 2.0;
+        s->p95 = percentile(s->us, s->count, 95);
+        s->min = s->us[0];
+        s->max = s->us[s->count - 1];
+    }
+}
+
+// The baseline is a file this program wrote: one stage per line
+static int load_baseline(const char *path, char *commit, size_t commit_len) {
+    FILE *f = fopen(path, "r");
+    char line[512];
+    if (!f) return -1;
+
+    while (fgets(line, sizeof(line), f)) {
+        char name[NAME_MAX];
+        double median, p95;
+        if (sscanf(line, " \"commit\": \"%63[^\"]\"", commit) == 1) {
+            commit[commit_len - 1] = 0;
+        } else if (sscanf(line, " \"%31[^\"]\": { \"median_us\": %lf, \"p95_us\": %lf",
+                          name, &median, &p95) == 3) {
+            for (unsigned i = 0; i < g_stage_count; i++) {
+                if (!strcmp(g_stages[i].name, name)) {
+                    g_stages[i].have_base = 1;
+                    g_stages[i].base_median = median;
+                    g_stages[i].base_p95 = p95;
+                }
+            }
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static void print_table(const char *base_commit) {
+    printf("%u boots\n%-12s %10s %10s %10s %10s", g_runs, "(us)",
+           "median", "p95", "min", "max");
+    if (base_commit) printf("   median vs %s", base_commit);
+    printf("\n");
+
+    for (unsigned i = 0; i < g_stage_count; i++) {
+        struct stage *s = &g_stages[i];
+        printf("%-12s %10.0f %10.0f %10.0f %10.0f", s->name, s->median, s->p95,
+               s->min, s->max);
+        if (base_commit && s->have_base && s->base_median > 0) {
+            printf("   %+7.1f%%", 100.0 * (s->median - s->base_median) / s->base_median);
+        }
+        printf("\n");
+    }
+}
+
+static int write_json(const char *path, const char *commit) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "{\n  \"commit\": \"%s\",\n  \"runs\": %u,\n  \"stages\": {\n",
+            commit ? commit : "", g_runs);
+    for (unsigned i = 0; i < g_stage_count; i++) {
+        struct stage *s = &g_stages[i];
+        fprintf(f, "    \"%s\": { \"median_us\": %.1f, \"p95_us\": %.1f, "
+                   "\"min_us\": %.0f, \"max_us\": %.0f, \"samples\": %u }%s\n",
+                s->name, s->median, s->p95, s->min, s->max, s->count,
+                i + 1 < g_stage_count ? "," : "");
+    }
+    fprintf(f, "  }\n}\n");
+    return fclose(f);
+}
+
+int main(int argc, char **argv) {
+    const char *out = NULL, *baseline = NULL, *commit = NULL;
+    char base_commit[64] = "baseline";
+    char line[4096];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:b:c:")) != -1) {
+        switch (opt) {
+        case 'o': out = optarg; break;
+        case 'b': baseline = optarg; break;
+        case 'c': commit = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-o out.json] [-b baseline.json] [-c commit] < logs\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    while (fgets(line, sizeof(line), stdin)) parse_line(line);
+    if (g_runs == 0) {
+        fprintf(stderr, "bootstats: no boottime lines in the input\n");
+        return 1;
+    }
+    compute();
+
+    if (baseline && load_baseline(baseline, base_commit, sizeof(base_commit)) != 0) {
+        fprintf(stderr, "bootstats: can't read %s\n", baseline);
+        baseline = NULL;
+    }
+    print_table(baseline ? base_commit : NULL);
+
+    if (out && write_json(out, commit) != 0) {
+        fprintf(stderr, "bootstats: can't write %s\n", out);
+        return 1;
+    }
+    return 0;
+}
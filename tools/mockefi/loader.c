@@ -0,0 +1,49 @@
+// tools/mockefi/loader.c
+// The bootloader compiled for the host, with hooks into its internals
+//
+// main.c is included whole so the harness can reach its static functions
+// and reset its globals between boots. Nothing in it is changed.
+#include "../../bootloader/main.c"
+#include "loader.h"
+
+static UINTN g_static_end;
+
+void loader_reset(void) {
+    g_framebuffer = (struct FramebufferInfo){ 0 };
+    g_rsdp = 0;
+    g_rsdp_revision = 0;
+    g_module_count = 0;
+    g_cmdline[0] = 0;
+    for (UINT32 i = 0; i < BOOT_TS_COUNT; i++) g_timestamps[i] = 0;
+    g_bi_buf = NULL;
+    g_bi_cap = g_bi_used = g_bi_desc_size = 0;
+    g_bi_ts = NULL;
+    g_kernel_read.async = FALSE;
+    g_kernel.base = g_kernel.size = g_kernel.entry = 0;
+    g_history = (struct boot_history){ 0 };
+    g_history_earlier = 0;
+}
+
+EFI_STATUS loader_load_kernel(EFI_SYSTEM_TABLE *ST, VOID **kernel_addr) {
+    EFI_FILE_PROTOCOL *root;
+    EFI_STATUS status = open_root(ST, &root);
+    if (EFI_ERROR(status)) return status;
+
+    status = start_kernel_read(ST, root);
+    if (!EFI_ERROR(status)) status = finish_kernel_read(ST, kernel_addr);
+    uefi_call_wrapper(root->Close, 1, root);
+    return status;
+}
+
+EFI_STATUS loader_prepare_bootinfo(EFI_SYSTEM_TABLE *ST) {
+    EFI_STATUS status = bootinfo_alloc(ST);
+    if (EFI_ERROR(status)) return status;
+    bootinfo_add_static();
+    g_static_end = g_bi_used;
+    return EFI_SUCCESS;
+}
+
+EFI_STATUS loader_memory_map(EFI_SYSTEM_TABLE *ST, UINTN *map_key) {
+    g_bi_used = g_static_end;
+    return bootinfo_add_memory_map(ST, map_key);
+}
@@ -0,0 +1,22 @@
+// tools/mockefi/loader.h
+// Hooks into the bootloader compiled for the host (loader.c)
+#pragma once
+
+#include "efi/efi.h"
+
+EFI_STATUS efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *ST);
+
+// Forget everything the previous boot collected
+void loader_reset(void);
+
+// The loader's kernel read on its own: open the volume, start the read,
+// wait for it
+EFI_STATUS loader_load_kernel(EFI_SYSTEM_TABLE *ST, VOID **kernel_addr);
+
+// Allocate the boot info block and add the static tags, as efi_main does
+// before exiting boot services
+EFI_STATUS loader_prepare_bootinfo(EFI_SYSTEM_TABLE *ST);
+
+// One round of what efi_main repeats per ExitBootServices attempt:
+// fetch the memory map into the block and convert it
+EFI_STATUS loader_memory_map(EFI_SYSTEM_TABLE *ST, UINTN *map_key);
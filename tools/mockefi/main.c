@@ -0,0 +1,543 @@
+// tools/mockefi/main.c
+// Runs the bootloader against mock firmware: regression checks, then timings
+//
+// Every check boot goes all the way through efi_main. The "kernel" it loads
+// is a small relocatable ELF whose entry point jumps back into this program
+// with the BootInfo pointer, which is then validated tag by tag. A matrix of memory
+// map sizes, ExitBootServices failures and file protocol revisions is
+// covered, then a run of boots against the boot history variable, which
+// the mock keeps from one boot to the next. The timings that follow use
+// the options below.
+//
+// Usage: mockefi [-n runs] [-m map_entries] [-f ebs_failures]
+//                [-d disk_mbps] [-k kernel_kib] [-v]
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/bootinfo.h"
+#include "common/elf.h"
+#include "loader.h"
+#include "mockefi.h"
+
+#define ARENA_BYTES     (256u << 20)
+#define MODULE_COUNT    3
+#define CMDLINE         "console=serial qemu_exit"
+#define HISTORY_VAR     u"MyOSBootHistory"
+
+static const uint32_t g_module_sizes[MODULE_COUNT] = { 4096, 100000, 262144 };
+static const char *const g_module_names[MODULE_COUNT] = {
+    "font.psf", "initrd.img", "symbols.map",
+};
+static uint8_t *g_modules[MODULE_COUNT];
+
+static jmp_buf          g_boot_jmp;
+static struct BootInfo *g_entered;
+static uint32_t         g_failures;
+
+//=============================================================================
+// Files
+//=============================================================================
+
+// Where the loaded kernel jumps to
+static void mock_kernel_entry(struct BootInfo *info) {
+    g_entered = info;
+    longjmp(g_boot_jmp, 1);
+}
+
+// The "kernel" is a static PIE like the real one: one PT_LOAD segment with
+// KERNEL_BSS bytes of .bss after the file contents, and a PT_DYNAMIC whose
+// only relocation is an R_X86_64_RELATIVE pointing KERNEL_SLOT at the
+// entry point. The entry is movabs $mock_kernel_entry, %rax; jmp *%rax.
+#define KERNEL_ENTRY    0x200
+#define KERNEL_DYNAMIC  0x300
+#define KERNEL_RELA     0x380
+#define KERNEL_SLOT     0x400
+#define KERNEL_BSS      0x10000
+
+static uint8_t *g_kernel_file;
+static size_t   g_kernel_size;
+
+static void add_files(uint32_t kernel_kib) {
+    size_t size = (size_t)kernel_kib << 10;
+    if (size < 0x1000) size = 0x1000;
+    uint8_t *kernel = calloc(1, size);
+    for (size_t i = KERNEL_SLOT + 8; i < size; i++) kernel[i] = (uint8_t)(i * 131);
+
+    Elf64_Ehdr *eh = (Elf64_Ehdr *)kernel;
+    memcpy(eh->e_ident, "\x7F" "ELF", 4);
+    eh->e_ident[4] = ELFCLASS64;
+    eh->e_ident[5] = ELFDATA2LSB;
+    eh->e_ident[6] = 1;
+    eh->e_type = ET_DYN;
+    eh->e_machine = EM_X86_64;
+    eh->e_version = 1;
+    eh->e_entry = KERNEL_ENTRY;
+    eh->e_phoff = sizeof(*eh);
+    eh->e_ehsize = sizeof(*eh);
+    eh->e_phentsize = sizeof(Elf64_Phdr);
+    eh->e_phnum = 2;
+
+    Elf64_Phdr *ph = (Elf64_Phdr *)(kernel + eh->e_phoff);
+    ph[0] = (Elf64_Phdr){ .p_type = PT_LOAD, .p_flags = PF_R | PF_W | PF_X,
+                          .p_filesz = size, .p_memsz = size + KERNEL_BSS,
+                          .p_align = 0x200000 };
+    ph[1] = (Elf64_Phdr){ .p_type = PT_DYNAMIC, .p_flags = PF_R | PF_W,
+                          .p_offset = KERNEL_DYNAMIC, .p_vaddr = KERNEL_DYNAMIC,
+                          .p_filesz = 4 * sizeof(Elf64_Dyn),
+                          .p_memsz = 4 * sizeof(Elf64_Dyn), .p_align = 8 };
+
+    uint8_t *code = kernel + KERNEL_ENTRY;
+    uint64_t entry = (uint64_t)mock_kernel_entry;
+    code[0] = 0x48;
+    code[1] = 0xB8;
+    memcpy(code + 2, &entry, 8);
+    code[10] = 0xFF;
+    code[11] = 0xE0;
+
+    Elf64_Dyn *dyn = (Elf64_Dyn *)(kernel + KERNEL_DYNAMIC);
+    dyn[0] = (Elf64_Dyn){ DT_RELA, KERNEL_RELA };
+    dyn[1] = (Elf64_Dyn){ DT_RELASZ, 2 * sizeof(Elf64_Rela) };
+    dyn[2] = (Elf64_Dyn){ DT_RELAENT, sizeof(Elf64_Rela) };
+    dyn[3] = (Elf64_Dyn){ DT_NULL, 0 };
+
+    Elf64_Rela *rela = (Elf64_Rela *)(kernel + KERNEL_RELA);
+    rela[0] = (Elf64_Rela){ KERNEL_SLOT, R_X86_64_RELATIVE, KERNEL_ENTRY };
+    rela[1] = (Elf64_Rela){ 0, R_X86_64_NONE, 0 };
+    memset(kernel + KERNEL_SLOT, 0xCC, 8);
+
+    mock_add_file("\\EFI\\BOOT\\kernel.elf", kernel, size);
+    g_kernel_file = kernel;
+    g_kernel_size = size;
+
+    for (int m = 0; m < MODULE_COUNT; m++) {
+        char path[128];
+        g_modules[m] = malloc(g_module_sizes[m]);
+        for (uint32_t i = 0; i < g_module_sizes[m]; i++) {
+            g_modules[m][i] = (uint8_t)(i * 7 + m);
+        }
+        snprintf(path, sizeof(path), "\\EFI\\BOOT\\MODULES\\%s", g_module_names[m]);
+        mock_add_file(path, g_modules[m], g_module_sizes[m]);
+    }
+
+    const char cmdline[] = CMDLINE "\r\nsecond line is ignored\r\n";
+    mock_add_file("\\EFI\\BOOT\\cmdline.txt", cmdline, sizeof(cmdline) - 1);
+}
+
+//=============================================================================
+// Boot and Validation
+//=============================================================================
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// One complete boot; the BootInfo the kernel got, or NULL if efi_main
+// returned instead
+static struct BootInfo *boot(const struct mock_config *cfg, EFI_STATUS *status) {
+    EFI_SYSTEM_TABLE *st = mock_reset(cfg);
+    loader_reset();
+    g_entered = NULL;
+    if (!setjmp(g_boot_jmp)) {
+        *status = efi_main((EFI_HANDLE)1, st);
+        return NULL;
+    }
+    *status = EFI_SUCCESS;
+    return g_entered;
+}
+
+static void fail(const char *config, const char *what) {
+    printf("FAIL [%s]: %s\n", config, what);
+    g_failures++;
+}
+
+static void check_memory_map(const char *name, const struct BootTagMemoryMap *mm,
+                             const struct BootTagEfiMemoryMap *raw) {
+    uint64_t raw_bytes = 0, bytes = 0;
+    uint32_t count = (raw->tag.size - sizeof(*raw)) / raw->desc_size;
+
+    if (raw->desc_size != 48) fail(name, "EFI map descriptor size not preserved");
+    if (count != mock_get_stats()->last_map_count) fail(name, "EFI map is not the last one fetched");
+    for (uint32_t i = 0; i < count; i++) {
+        const EFI_MEMORY_DESCRIPTOR *d =
+            (const void *)(raw->descriptors + (size_t)i * raw->desc_size);
+        raw_bytes += d->NumberOfPages * 4096;
+    }
+
+    for (uint32_t i = 0; i < mm->entry_count; i++) {
+        const struct MemoryMapEntry *e = &mm->entries[i];
+        bytes += e->length;
+        if (i == 0) continue;
+        const struct MemoryMapEntry *p = &mm->entries[i - 1];
+        if (p->base + p->length > e->base) fail(name, "memory map unsorted or overlapping");
+        if (p->base + p->length == e->base && p->type == e->type) {
+            fail(name, "memory map has unmerged neighbours");
+        }
+    }
+    if (bytes != raw_bytes) fail(name, "memory map doesn't cover the EFI map");
+}
+
+// The image must sit 2 MiB aligned, relocated, with its file contents
+// copied and its .bss zeroed (the arena still holds the previous boot)
+static void check_kernel(const char *name, const struct BootTagKernel *k) {
+    const uint8_t *image = (const uint8_t *)k->base;
+    uint64_t slot;
+
+    if (k->base & 0x1FFFFF) fail(name, "kernel not 2 MiB aligned");
+    if (k->size & 0x1FFFFF || k->size < g_kernel_size + KERNEL_BSS) {
+        fail(name, "kernel reservation wrong size");
+    }
+    if (k->entry != k->base + KERNEL_ENTRY) fail(name, "kernel entry not relocated");
+    memcpy(&slot, image + KERNEL_SLOT, sizeof(slot));
+    if (slot != k->base + KERNEL_ENTRY) fail(name, "R_X86_64_RELATIVE not applied");
+    if (memcmp(image + KERNEL_SLOT + 8, g_kernel_file + KERNEL_SLOT + 8,
+               g_kernel_size - KERNEL_SLOT - 8)) {
+        fail(name, "kernel contents corrupt");
+    }
+    for (size_t i = 0; i < KERNEL_BSS; i++) {
+        if (image[g_kernel_size + i]) {
+            fail(name, "kernel .bss not zeroed");
+            break;
+        }
+    }
+}
+
+// Oldest first with rising sequence numbers, each record filled in up to
+// BOOT_TS_KERNEL_LOADED and blank after
+static void check_history(const char *name, const struct BootTagBootHistory *h) {
+    static const uint32_t recorded[] = {
+        BOOT_TS_LOADER_ENTRY, BOOT_TS_GRAPHICS, BOOT_TS_MODULES_LOADED,
+        BOOT_TS_KERNEL_WAIT, BOOT_TS_KERNEL_LOADED,
+    };
+    static const uint32_t blank[] = {
+        BOOT_TS_VAR_STORE, BOOT_TS_MEMORY_MAP, BOOT_TS_EXIT_BOOT_SERVICES,
+    };
+
+    if (h->record_size != sizeof(struct BootHistoryRecord) || !h->count ||
+        h->count > BOOT_HISTORY_MAX ||
+        h->tag.size != sizeof(*h) + h->count * sizeof(struct BootHistoryRecord)) {
+        fail(name, "boot history tag malformed");
+        return;
+    }
+    for (uint32_t i = 0; i < h->count; i++) {
+        const struct BootHistoryRecord *r = &h->records[i];
+        if (r->count != BOOT_TS_COUNT || (i && r->seq <= h->records[i - 1].seq)) {
+            fail(name, "boot history records out of order");
+        }
+        for (size_t j = 0; j < sizeof(recorded) / sizeof(recorded[0]); j++) {
+            if (!r->tsc[recorded[j]]) fail(name, "boot history record incomplete");
+        }
+        for (size_t j = 0; j < sizeof(blank) / sizeof(blank[0]); j++) {
+            if (r->tsc[blank[j]]) fail(name, "boot history record has later stages");
+        }
+    }
+}
+
+static void validate(const char *name, const struct mock_config *cfg,
+                     const struct BootInfo *bi) {
+    const struct mock_stats *st = mock_get_stats();
+
+    if (bi->magic != BOOTINFO_MAGIC || bi->version != BOOTINFO_VERSION) {
+        fail(name, "bad header");
+        return;
+    }
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < bi->total_size / 4; i++) sum += ((const uint32_t *)bi)[i];
+    if (sum) fail(name, "bad checksum");
+
+    const struct BootTagMemoryMap *mm = NULL;
+    const struct BootTagEfiMemoryMap *raw = NULL;
+    const struct BootTagKernel *kernel = NULL;
+    const struct BootTagBootHistory *history = NULL;
+    uint32_t modules = 0, ended = 0, have_fb = 0, have_cmdline = 0, have_ts = 0;
+    const uint8_t *end = (const uint8_t *)bi + bi->total_size;
+
+    for (const struct BootTag *t = (const void *)(bi + 1);
+         (const uint8_t *)t + sizeof(*t) <= end; t = BOOT_TAG_NEXT(t)) {
+        if (t->type == BOOT_TAG_END) {
+            ended = 1;
+            break;
+        }
+        switch (t->type) {
+        case BOOT_TAG_FRAMEBUFFER: {
+            const struct BootTagFramebuffer *fb = (const void *)t;
+            have_fb = fb->info.base == mock_framebuffer() &&
+                      fb->info.width == cfg->fb_width && fb->info.height == cfg->fb_height;
+            break;
+        }
+        case BOOT_TAG_RSDP: {
+            const struct BootTagRsdp *r = (const void *)t;
+            if (r->address != mock_rsdp() || r->revision != 2) fail(name, "wrong RSDP");
+            break;
+        }
+        case BOOT_TAG_MODULE: {
+            const struct BootTagModule *m = (const void *)t;
+            for (int i = 0; i < MODULE_COUNT; i++) {
+                if (!strcmp(m->name, g_module_names[i]) && m->size == g_module_sizes[i] &&
+                    !memcmp((const void *)m->base, g_modules[i], m->size)) {
+                    modules++;
+                }
+            }
+            break;
+        }
+        case BOOT_TAG_CMDLINE:
+            have_cmdline = !strcmp(((const struct BootTagCmdline *)t)->cmdline, CMDLINE);
+            break;
+        case BOOT_TAG_TIMESTAMPS: {
+            const struct BootTagTimestamps *ts = (const void *)t;
+            have_ts = ts->count == BOOT_TS_COUNT;
+            for (uint32_t i = 0; i < ts->count; i++) have_ts &= ts->tsc[i] != 0;
+            break;
+        }
+        case BOOT_TAG_MEMORY_MAP:
+            mm = (const void *)t;
+            break;
+        case BOOT_TAG_EFI_MEMORY_MAP:
+            raw = (const void *)t;
+            break;
+        case BOOT_TAG_KERNEL:
+            kernel = (const void *)t;
+            break;
+        case BOOT_TAG_BOOT_HISTORY:
+            history = (const void *)t;
+            break;
+        }
+    }
+
+    if (!ended) fail(name, "tag list not terminated");
+    if (!have_fb) fail(name, "framebuffer tag missing or wrong");
+    if (modules != MODULE_COUNT) fail(name, "modules missing or corrupt");
+    if (!have_cmdline) fail(name, "command line missing or wrong");
+    if (!have_ts) fail(name, "timestamps missing or incomplete");
+    if (!kernel) fail(name, "kernel tag missing");
+    else check_kernel(name, kernel);
+    if (!mm || !raw) fail(name, "memory map tags missing");
+    else check_memory_map(name, mm, raw);
+    if (history) check_history(name, history);
+
+    if (!st->exited || st->ebs_calls != cfg->ebs_failures + 1) {
+        fail(name, "wrong number of ExitBootServices calls");
+    }
+    if (st->violations) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%u boot service calls after ExitBootServices (first: %s)",
+                 st->violations, st->first_violation);
+        fail(name, msg);
+    }
+    if (cfg->async_files && !st->async_reads) fail(name, "kernel not read asynchronously");
+    if (st->variable_writes != 1) fail(name, "boot history not written exactly once");
+}
+
+static const struct BootTagBootHistory *find_history(const struct BootInfo *bi) {
+    const uint8_t *end = (const uint8_t *)bi + bi->total_size;
+    for (const struct BootTag *t = (const void *)(bi + 1);
+         (const uint8_t *)t + sizeof(*t) <= end && t->type != BOOT_TAG_END;
+         t = BOOT_TAG_NEXT(t)) {
+        if (t->type == BOOT_TAG_BOOT_HISTORY) return (const void *)t;
+    }
+    return NULL;
+}
+
+// Starting from no variable, boot k hands the kernel the min(k - 1,
+// BOOT_HISTORY_MAX - 1) boots before it, the last being k - 1. A variable
+// from some other version is thrown away and counting starts over.
+static uint32_t run_history_checks(void) {
+    struct mock_config cfg = { .map_entries = 64, .fb_width = 640, .fb_height = 480 };
+    uint32_t boots = 0;
+    EFI_STATUS status;
+
+    mock_clear_variables();
+    for (uint32_t k = 1; k <= BOOT_HISTORY_MAX + 3; k++) {
+        char name[64];
+        snprintf(name, sizeof(name), "history boot %u", k);
+        struct BootInfo *bi = boot(&cfg, &status);
+        boots++;
+        if (!bi) {
+            fail(name, "efi_main returned");
+            continue;
+        }
+        validate(name, &cfg, bi);
+
+        const struct BootTagBootHistory *h = find_history(bi);
+        uint32_t want = k - 1 < BOOT_HISTORY_MAX - 1 ? k - 1 : BOOT_HISTORY_MAX - 1;
+        if ((h ? h->count : 0) != want) fail(name, "wrong number of earlier boots");
+        else if (h && h->records[h->count - 1].seq != k - 1) fail(name, "wrong last boot");
+    }
+
+    size_t size;
+    uint32_t *version = mock_variable(HISTORY_VAR, &size);
+    if (!version) {
+        fail("history", "variable not stored");
+        return boots;
+    }
+    *version += 1;
+    struct BootInfo *bi = boot(&cfg, &status);
+    boots++;
+    if (!bi) {
+        fail("history, other version", "efi_main returned");
+    } else {
+        validate("history, other version", &cfg, bi);
+        if (find_history(bi)) fail("history, other version", "stale records passed on");
+        if (!strstr(mock_console(), "Boot history: boot 1,")) {
+            fail("history, other version", "didn't start over");
+        }
+    }
+    return boots;
+}
+
+static void run_checks(void) {
+    static const uint32_t maps[] = { 16, 1500 };
+    static const uint32_t ebs[] = { 0, 3 };
+    uint32_t boots = 0;
+
+    for (int m = 0; m < 2; m++) {
+        for (int f = 0; f < 2; f++) {
+            for (int a = 0; a < 2; a++) {
+                struct mock_config cfg = {
+                    .map_entries = maps[m], .ebs_failures = ebs[f],
+                    .fb_width = 1024, .fb_height = 768, .async_files = a,
+                };
+                char name[64];
+                snprintf(name, sizeof(name), "map %u, %u EBS failures, %s files",
+                         maps[m], ebs[f], a ? "async" : "sync");
+                EFI_STATUS status;
+                struct BootInfo *bi = boot(&cfg, &status);
+                boots++;
+                if (!bi) {
+                    fail(name, "efi_main returned");
+                    printf("%s", mock_console());
+                    continue;
+                }
+                validate(name, &cfg, bi);
+            }
+        }
+    }
+
+    // The loader gives up after five failed ExitBootServices
+    struct mock_config cfg = { .map_entries = 64, .ebs_failures = 5,
+                               .fb_width = 640, .fb_height = 480 };
+    EFI_STATUS status;
+    if (boot(&cfg, &status) || !EFI_ERROR(status)) {
+        fail("5 EBS failures", "loader didn't give up");
+    }
+    boots++;
+
+    boots += run_history_checks();
+
+    printf("checks: %u boots, %u failures\n", boots, g_failures);
+}
+
+//=============================================================================
+// Timing
+//=============================================================================
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *label, uint64_t *ns, uint32_t n) {
+    qsort(ns, n, sizeof(*ns), cmp_u64);
+    printf("%-24s %10.1f %10.1f %10.1f\n", label, ns[n / 2] / 1e3,
+           ns[(n * 95 + 99) / 100 - 1] / 1e3, ns[0] / 1e3);
+}
+
+static void run_timings(const struct mock_config *base, uint32_t runs) {
+    uint64_t *ns = calloc(runs, sizeof(*ns));
+    EFI_STATUS status;
+
+    printf("\n%u runs, %u map entries, %u EBS failures, ",
+           runs, base->map_entries, base->ebs_failures);
+    if (base->disk_mbps) printf("disk %u MB/s\n", base->disk_mbps);
+    else printf("instant disk\n");
+    printf("%-24s %10s %10s %10s\n", "(us)", "median", "p95", "min");
+
+    for (int a = 0; a < 2; a++) {
+        struct mock_config cfg = *base;
+        cfg.async_files = a;
+        for (uint32_t i = 0; i < runs; i++) {
+            uint64_t t = now_ns();
+            if (!boot(&cfg, &status)) {
+                fprintf(stderr, "FAIL: boot failed during timing\n");
+                exit(1);
+            }
+            ns[i] = now_ns() - t;
+        }
+        report(a ? "boot (async files)" : "boot (sync files)", ns, runs);
+    }
+
+    for (int a = 0; a < 2; a++) {
+        struct mock_config cfg = *base;
+        cfg.async_files = a;
+        for (uint32_t i = 0; i < runs; i++) {
+            EFI_SYSTEM_TABLE *st = mock_reset(&cfg);
+            VOID *addr;
+            loader_reset();
+            uint64_t t = now_ns();
+            status = loader_load_kernel(st, &addr);
+            ns[i] = now_ns() - t;
+            if (EFI_ERROR(status)) {
+                fprintf(stderr, "FAIL: kernel load failed during timing\n");
+                exit(1);
+            }
+        }
+        report(a ? "load kernel (async)" : "load kernel (sync)", ns, runs);
+    }
+
+    EFI_SYSTEM_TABLE *st = mock_reset(base);
+    loader_reset();
+    if (EFI_ERROR(loader_prepare_bootinfo(st))) {
+        fprintf(stderr, "FAIL: boot info allocation failed\n");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < runs; i++) {
+        UINTN key;
+        uint64_t t = now_ns();
+        status = loader_memory_map(st, &key);
+        ns[i] = now_ns() - t;
+        if (EFI_ERROR(status)) {
+            fprintf(stderr, "FAIL: memory map failed during timing\n");
+            exit(1);
+        }
+    }
+    report("get memory map", ns, runs);
+    free(ns);
+}
+
+int main(int argc, char **argv) {
+    struct mock_config cfg = {
+        .map_entries = 1500, .fb_width = 1024, .fb_height = 768,
+    };
+    uint32_t runs = 200, kernel_kib = 2048;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:f:d:k:v")) != -1) {
+        switch (opt) {
+        case 'n': runs = strtoul(optarg, NULL, 0); break;
+        case 'm': cfg.map_entries = strtoul(optarg, NULL, 0); break;
+        case 'f': cfg.ebs_failures = strtoul(optarg, NULL, 0); break;
+        case 'd': cfg.disk_mbps = strtoul(optarg, NULL, 0); break;
+        case 'k': kernel_kib = strtoul(optarg, NULL, 0); break;
+        case 'v': cfg.verbose = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-n runs] [-m map_entries] [-f ebs_failures] "
+                            "[-d disk_mbps] [-k kernel_kib] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (runs == 0) runs = 1;
+
+    mock_init(ARENA_BYTES);
+    add_files(kernel_kib);
+
+    run_checks();
+    if (g_failures) return 1;
+
+    run_timings(&cfg, runs);
+    return 0;
+}
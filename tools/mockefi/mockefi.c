@@ -0,0 +1,807 @@
+// tools/mockefi/mockefi.c
+// Mock UEFI firmware for running the bootloader as a Linux program
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "mockefi.h"
+
+#define MAX_FILES       64
+#define MAX_ALLOCS      256
+#define MAX_EVENTS      16
+#define MAX_VARIABLES   16
+#define VAR_NAME_LEN    64
+#define PATH_MAX_LEN    256
+#define CONSOLE_BYTES   (64 * 1024)
+
+// Real firmware reports descriptors bigger than the struct; the loader
+// must step by DescriptorSize, so make sure it does
+#define DESC_SIZE       48
+
+//=============================================================================
+// State
+//=============================================================================
+
+struct mock_file {
+    char   path[PATH_MAX_LEN];
+    UINT8 *data;
+    size_t size;
+};
+
+// An open file or directory. The protocol comes first so the handle the
+// loader holds can be cast back.
+struct handle {
+    EFI_FILE_PROTOCOL proto;
+    char              path[PATH_MAX_LEN];
+    int               is_dir;
+    int               used;
+    size_t            pos;          // File offset, or directory cursor
+};
+
+struct alloc {
+    UINT64 base;
+    UINT64 pages;
+    UINT32 type;
+};
+
+struct variable {
+    CHAR16   name[VAR_NAME_LEN];
+    EFI_GUID guid;
+    UINT32   attributes;
+    UINT8   *data;                  // NULL: slot free
+    size_t   size;
+};
+
+struct event {
+    int                used;
+    int                signaled;
+    uint64_t           due_ns;      // Pending read completes at this time
+    EFI_FILE_IO_TOKEN *token;
+    struct handle     *file;
+};
+
+static struct mock_config g_cfg;
+static struct mock_stats  g_stats;
+
+static UINT8 *g_arena;
+static size_t g_arena_size, g_arena_used;
+
+static struct mock_file g_files[MAX_FILES];
+static uint32_t         g_file_count;
+static struct handle    g_handles[MAX_FILES];
+
+static struct alloc g_allocs[MAX_ALLOCS];
+static uint32_t     g_alloc_count;
+static UINTN        g_map_key;
+static EFI_MEMORY_DESCRIPTOR *g_base_map;      // The synthetic part
+static uint32_t     g_base_count;
+
+static struct event g_events[MAX_EVENTS];
+
+static struct variable g_vars[MAX_VARIABLES];
+
+static char   g_console[CONSOLE_BYTES];
+static size_t g_console_len;
+
+static EFI_SYSTEM_TABLE                g_st;
+static EFI_BOOT_SERVICES               g_bs;
+static EFI_RUNTIME_SERVICES            g_rt;
+static EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL g_conout;
+static EFI_GRAPHICS_OUTPUT_PROTOCOL    g_gop;
+static EFI_GRAPHICS_OUTPUT_PROTOCOL_MODE    g_gop_mode;
+static EFI_GRAPHICS_OUTPUT_MODE_INFORMATION g_gop_info;
+static UINT32                         *g_fb;
+static EFI_SIMPLE_FILE_SYSTEM_PROTOCOL g_fs;
+static EFI_CONFIGURATION_TABLE         g_config_table[2];
+static UINT8                           g_rsdp[36];
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void spin_until(uint64_t t) {
+    while (now_ns() < t) { }
+}
+
+// Time a read of `bytes` takes at the configured disk speed
+static uint64_t read_ns(size_t bytes) {
+    if (g_cfg.disk_mbps == 0) return 0;
+    return (uint64_t)bytes * 1000 / g_cfg.disk_mbps;
+}
+
+// After a failed ExitBootServices only GetMemoryMap and ExitBootServices
+// may be called, and after a successful one nothing at all
+static void check_allowed(const char *what) {
+    if (!g_stats.ebs_calls) return;
+    if (!g_stats.violations) g_stats.first_violation = what;
+    g_stats.violations++;
+}
+
+//=============================================================================
+// Memory
+//=============================================================================
+
+static EFI_STATUS EFIAPI allocate_pages(EFI_ALLOCATE_TYPE type, EFI_MEMORY_TYPE mem_type,
+                                        UINTN pages, EFI_PHYSICAL_ADDRESS *memory) {
+    check_allowed("AllocatePages");
+    size_t bytes = pages * 4096;
+
+    if (type == AllocateAddress) {
+        // Only addresses inside the arena exist; the loader falls back
+        return EFI_NOT_FOUND;
+    }
+    // Pages are page aligned, whatever pool allocations came before
+    size_t start = (g_arena_used + 4095) & ~(size_t)4095;
+    if (start + bytes > g_arena_size || g_alloc_count == MAX_ALLOCS) {
+        return EFI_OUT_OF_RESOURCES;
+    }
+    UINT8 *p = g_arena + start;
+    if (type == AllocateMaxAddress && (UINT64)(p + bytes) > *memory) {
+        return EFI_NOT_FOUND;
+    }
+    g_arena_used = start + bytes;
+    g_allocs[g_alloc_count++] = (struct alloc){ (UINT64)p, pages, mem_type };
+    g_map_key++;
+    *memory = (UINT64)p;
+    return EFI_SUCCESS;
+}
+
+// Any page range inside one allocation may be freed, as the loader does
+// to trim an over-sized allocation down to an aligned one
+static EFI_STATUS EFIAPI free_pages(EFI_PHYSICAL_ADDRESS memory, UINTN pages) {
+    check_allowed("FreePages");
+    UINT64 end = memory + pages * 4096;
+    for (uint32_t i = 0; i < g_alloc_count; i++) {
+        struct alloc *a = &g_allocs[i];
+        UINT64 a_end = a->base + a->pages * 4096;
+        if (memory < a->base || end > a_end || pages == 0) continue;
+
+        // Arena space isn't reused; the map entry shrinks, splits or goes
+        if (memory > a->base && end < a_end) {
+            if (g_alloc_count == MAX_ALLOCS) return EFI_OUT_OF_RESOURCES;
+            g_allocs[g_alloc_count++] = (struct alloc){ end, (a_end - end) / 4096, a->type };
+            a->pages = (memory - a->base) / 4096;
+        } else if (memory > a->base) {
+            a->pages -= pages;
+        } else if (end < a_end) {
+            a->base = end;
+            a->pages -= pages;
+        } else {
+            *a = g_allocs[--g_alloc_count];
+        }
+        g_map_key++;
+        return EFI_SUCCESS;
+    }
+    return EFI_NOT_FOUND;
+}
+
+// Pool memory comes from the arena too, with the size in front for
+// nothing but sanity; it isn't in the map (it sits in firmware pages)
+static EFI_STATUS EFIAPI allocate_pool(EFI_MEMORY_TYPE type, UINTN size, VOID **buffer) {
+    (void)type;
+    check_allowed("AllocatePool");
+    size = (size + 15) & ~(UINTN)15;
+    if (g_arena_used + size > g_arena_size) return EFI_OUT_OF_RESOURCES;
+    *buffer = g_arena + g_arena_used;
+    g_arena_used += size;
+    g_map_key++;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI free_pool(VOID *buffer) {
+    (void)buffer;
+    check_allowed("FreePool");
+    g_map_key++;
+    return EFI_SUCCESS;
+}
+
+static VOID EFIAPI copy_mem(VOID *dst, VOID *src, UINTN len) {
+    check_allowed("CopyMem");
+    memmove(dst, src, len);
+}
+
+static VOID EFIAPI set_mem(VOID *buf, UINTN size, UINT8 value) {
+    check_allowed("SetMem");
+    memset(buf, value, size);
+}
+
+static EFI_STATUS EFIAPI get_memory_map(UINTN *size, EFI_MEMORY_DESCRIPTOR *map,
+                                        UINTN *key, UINTN *desc_size, UINT32 *desc_version) {
+    g_stats.get_map_calls++;
+    uint32_t count = g_base_count + g_alloc_count;
+    UINTN need = (UINTN)count * DESC_SIZE;
+
+    *desc_size = DESC_SIZE;
+    *desc_version = 1;
+    if (*size < need || !map) {
+        *size = need;
+        return EFI_BUFFER_TOO_SMALL;
+    }
+
+    UINT8 *out = (UINT8 *)map;
+    memset(out, 0, need);
+    for (uint32_t i = 0; i < g_base_count; i++) {
+        memcpy(out + (UINTN)i * DESC_SIZE, &g_base_map[i], sizeof(g_base_map[i]));
+    }
+    for (uint32_t i = 0; i < g_alloc_count; i++) {
+        EFI_MEMORY_DESCRIPTOR d = {
+            .Type = g_allocs[i].type,
+            .PhysicalStart = g_allocs[i].base,
+            .NumberOfPages = g_allocs[i].pages,
+        };
+        memcpy(out + (UINTN)(g_base_count + i) * DESC_SIZE, &d, sizeof(d));
+    }
+    *size = need;
+    *key = g_map_key;
+    g_stats.last_map_count = count;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI exit_boot_services(EFI_HANDLE image, UINTN key) {
+    (void)image;
+    if (g_stats.exited) check_allowed("ExitBootServices after success");
+    g_stats.ebs_calls++;
+
+    if (g_stats.ebs_calls <= g_cfg.ebs_failures) {
+        // As if a timer event had allocated memory meanwhile
+        g_map_key++;
+        return EFI_INVALID_PARAMETER;
+    }
+    if (key != g_map_key) return EFI_INVALID_PARAMETER;
+    g_stats.exited = 1;
+    return EFI_SUCCESS;
+}
+
+// A fragmented map: short runs of alternating types at low addresses,
+// with every 16th pair swapped so the loader's sort has work to do
+static void build_base_map(uint32_t entries) {
+    static const UINT32 types[] = {
+        EfiConventionalMemory, EfiBootServicesData, EfiConventionalMemory,
+        EfiLoaderData, EfiBootServicesCode, EfiACPIReclaimMemory,
+        EfiConventionalMemory, EfiRuntimeServicesData, EfiReservedMemoryType,
+    };
+    free(g_base_map);
+    g_base_map = calloc(entries ? entries : 1, sizeof(*g_base_map));
+    g_base_count = entries;
+
+    UINT64 addr = 0;
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < entries; i++) {
+        seed = seed * 1103515245 + 12345;
+        UINT64 pages = 1 + (seed >> 16) % 64;
+        g_base_map[i] = (EFI_MEMORY_DESCRIPTOR){
+            .Type = types[i % (sizeof(types) / sizeof(types[0]))],
+            .PhysicalStart = addr,
+            .NumberOfPages = pages,
+        };
+        addr += pages * 4096;
+    }
+    for (uint32_t i = 0; i + 1 < entries; i += 16) {
+        EFI_MEMORY_DESCRIPTOR t = g_base_map[i];
+        g_base_map[i] = g_base_map[i + 1];
+        g_base_map[i + 1] = t;
+    }
+}
+
+//=============================================================================
+// Console and Graphics
+//=============================================================================
+
+static EFI_STATUS EFIAPI output_string(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *self, CHAR16 *s) {
+    (void)self;
+    check_allowed("OutputString");
+    for (; *s; s++) {
+        char c = *s < 0x80 ? (char)*s : '?';
+        if (c == '\r') continue;
+        if (g_console_len < CONSOLE_BYTES - 1) g_console[g_console_len++] = c;
+        if (g_cfg.verbose) putchar(c);
+    }
+    g_console[g_console_len] = 0;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI clear_screen(EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL *self) {
+    (void)self;
+    check_allowed("ClearScreen");
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI gop_blt(EFI_GRAPHICS_OUTPUT_PROTOCOL *self,
+                                 EFI_GRAPHICS_OUTPUT_BLT_PIXEL *buf,
+                                 EFI_GRAPHICS_OUTPUT_BLT_OPERATION op,
+                                 UINTN sx, UINTN sy, UINTN dx, UINTN dy,
+                                 UINTN w, UINTN h, UINTN delta) {
+    (void)self;
+    check_allowed("Blt");
+    UINT32 fw = g_gop_info.HorizontalResolution, fh = g_gop_info.VerticalResolution;
+    UINT32 *src = (UINT32 *)buf;
+    if (delta == 0) delta = w * 4;
+
+    switch (op) {
+    case EfiBltVideoFill:
+        if (dx + w > fw || dy + h > fh) return EFI_INVALID_PARAMETER;
+        for (UINTN y = 0; y < h; y++) {
+            for (UINTN x = 0; x < w; x++) g_fb[(dy + y) * fw + dx + x] = src[0];
+        }
+        return EFI_SUCCESS;
+    case EfiBltBufferToVideo:
+        if (dx + w > fw || dy + h > fh) return EFI_INVALID_PARAMETER;
+        for (UINTN y = 0; y < h; y++) {
+            memcpy(&g_fb[(dy + y) * fw + dx],
+                   (UINT8 *)buf + (sy + y) * delta + sx * 4, w * 4);
+        }
+        return EFI_SUCCESS;
+    case EfiBltVideoToBltBuffer:
+        if (sx + w > fw || sy + h > fh) return EFI_INVALID_PARAMETER;
+        for (UINTN y = 0; y < h; y++) {
+            memcpy((UINT8 *)buf + (dy + y) * delta + dx * 4,
+                   &g_fb[(sy + y) * fw + sx], w * 4);
+        }
+        return EFI_SUCCESS;
+    case EfiBltVideoToVideo:
+        if (sx + w > fw || sy + h > fh || dx + w > fw || dy + h > fh) {
+            return EFI_INVALID_PARAMETER;
+        }
+        for (UINTN y = 0; y < h; y++) {
+            UINTN row = dy > sy ? h - 1 - y : y;
+            memmove(&g_fb[(dy + row) * fw + dx], &g_fb[(sy + row) * fw + sx], w * 4);
+        }
+        return EFI_SUCCESS;
+    default:
+        return EFI_INVALID_PARAMETER;
+    }
+}
+
+//=============================================================================
+// Events
+// Only what asynchronous file reads need: an event is signalled when its
+// read's due time has passed and someone looks.
+//=============================================================================
+
+static void complete_read(struct event *ev) {
+    struct handle *h = ev->file;
+    struct mock_file *f = NULL;
+    for (uint32_t i = 0; i < g_file_count; i++) {
+        if (!strcmp(g_files[i].path, h->path)) f = &g_files[i];
+    }
+    size_t n = 0;
+    if (f && h->pos < f->size) {
+        n = f->size - h->pos;
+        if (n > ev->token->BufferSize) n = ev->token->BufferSize;
+        memcpy(ev->token->Buffer, f->data + h->pos, n);
+        h->pos += n;
+    }
+    ev->token->BufferSize = n;
+    ev->token->Status = f ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+    ev->token = NULL;
+    ev->signaled = 1;
+}
+
+static void poll_event(struct event *ev) {
+    if (ev->token && now_ns() >= ev->due_ns) complete_read(ev);
+}
+
+static EFI_STATUS EFIAPI create_event(UINT32 type, EFI_TPL tpl, EFI_EVENT_NOTIFY fn,
+                                      VOID *ctx, EFI_EVENT *out) {
+    (void)tpl; (void)ctx;
+    check_allowed("CreateEvent");
+    if (type != 0 || fn) return EFI_UNSUPPORTED;
+    for (int i = 0; i < MAX_EVENTS; i++) {
+        if (!g_events[i].used) {
+            g_events[i] = (struct event){ .used = 1 };
+            *out = &g_events[i];
+            return EFI_SUCCESS;
+        }
+    }
+    return EFI_OUT_OF_RESOURCES;
+}
+
+static EFI_STATUS EFIAPI wait_for_event(UINTN count, EFI_EVENT *events, UINTN *index) {
+    check_allowed("WaitForEvent");
+    for (;;) {
+        for (UINTN i = 0; i < count; i++) {
+            struct event *ev = events[i];
+            poll_event(ev);
+            if (ev->signaled) {
+                ev->signaled = 0;
+                *index = i;
+                return EFI_SUCCESS;
+            }
+            if (!ev->token) return EFI_INVALID_PARAMETER;   // Would hang forever
+        }
+    }
+}
+
+static EFI_STATUS EFIAPI check_event(EFI_EVENT event) {
+    struct event *ev = event;
+    check_allowed("CheckEvent");
+    poll_event(ev);
+    if (!ev->signaled) return EFI_NOT_READY;
+    ev->signaled = 0;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI close_event(EFI_EVENT event) {
+    struct event *ev = event;
+    check_allowed("CloseEvent");
+    ev->used = 0;
+    return EFI_SUCCESS;
+}
+
+//=============================================================================
+// File System
+//=============================================================================
+
+// FAT names are case-insensitive. Returns what follows "dir\" in path.
+static const char *under(const char *dir, const char *path) {
+    size_t n = strlen(dir);
+    if (strlen(path) <= n || path[n] != '\\' || strncasecmp(path, dir, n)) return NULL;
+    return path + n + 1;
+}
+
+static struct mock_file *find_file(const char *path) {
+    for (uint32_t i = 0; i < g_file_count; i++) {
+        if (!strcasecmp(g_files[i].path, path)) return &g_files[i];
+    }
+    return NULL;
+}
+
+static int is_dir(const char *path) {
+    for (uint32_t i = 0; i < g_file_count; i++) {
+        if (under(path, g_files[i].path)) return 1;
+    }
+    return !path[0];    // The root always exists
+}
+
+static void fill_info(EFI_FILE_INFO *info, const char *name, UINT64 size, int dir) {
+    size_t len = strlen(name);
+    memset(info, 0, sizeof(*info));
+    info->Size = sizeof(*info) + (len + 1) * 2;
+    info->FileSize = size;
+    info->PhysicalSize = (size + 4095) & ~4095ull;
+    info->Attribute = dir ? EFI_FILE_DIRECTORY : 0;
+    for (size_t i = 0; i <= len; i++) info->FileName[i] = (CHAR16)name[i];
+}
+
+static EFI_FILE_PROTOCOL *new_handle(const char *path, int dir);
+
+static EFI_STATUS EFIAPI file_open(EFI_FILE_PROTOCOL *self, EFI_FILE_PROTOCOL **out,
+                                   CHAR16 *name, UINT64 mode, UINT64 attr) {
+    struct handle *h = (struct handle *)self;
+    char path[PATH_MAX_LEN];
+    size_t n = 0;
+    (void)attr;
+    check_allowed("File.Open");
+    if (mode != EFI_FILE_MODE_READ) return EFI_WRITE_PROTECTED;
+
+    // Absolute names start at the root, others inside this directory
+    if (name[0] != '\\') {
+        n = strlen(h->path);
+        memcpy(path, h->path, n);
+        path[n++] = '\\';
+    }
+    for (; *name && n < sizeof(path) - 1; name++) path[n++] = (char)*name;
+    path[n] = 0;
+    if (n && path[n - 1] == '\\') path[--n] = 0;
+
+    if (find_file(path)) {
+        *out = new_handle(find_file(path)->path, 0);
+    } else if (is_dir(path)) {
+        *out = new_handle(path, 1);
+    } else {
+        return EFI_NOT_FOUND;
+    }
+    return *out ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+}
+
+static EFI_STATUS EFIAPI file_close(EFI_FILE_PROTOCOL *self) {
+    check_allowed("File.Close");
+    ((struct handle *)self)->used = 0;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI file_read(EFI_FILE_PROTOCOL *self, UINTN *size, VOID *buf) {
+    struct handle *h = (struct handle *)self;
+    check_allowed("File.Read");
+
+    if (h->is_dir) {
+        // One EFI_FILE_INFO per call for the next child, size 0 at the end
+        for (; h->pos < g_file_count; h->pos++) {
+            const char *name = under(h->path, g_files[h->pos].path);
+            if (!name || strchr(name, '\\')) continue;
+            UINTN need = sizeof(EFI_FILE_INFO) + (strlen(name) + 1) * 2;
+            if (*size < need) {
+                *size = need;
+                return EFI_BUFFER_TOO_SMALL;
+            }
+            fill_info(buf, name, g_files[h->pos].size, 0);
+            *size = need;
+            h->pos++;
+            return EFI_SUCCESS;
+        }
+        *size = 0;
+        return EFI_SUCCESS;
+    }
+
+    struct mock_file *f = find_file(h->path);
+    size_t n = h->pos < f->size ? f->size - h->pos : 0;
+    if (n > *size) n = *size;
+    spin_until(now_ns() + read_ns(n));
+    memcpy(buf, f->data + h->pos, n);
+    h->pos += n;
+    *size = n;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI file_read_ex(EFI_FILE_PROTOCOL *self, EFI_FILE_IO_TOKEN *token) {
+    struct handle *h = (struct handle *)self;
+    struct event *ev = token->Event;
+    check_allowed("File.ReadEx");
+    if (h->is_dir || !ev || ev->token) return EFI_INVALID_PARAMETER;
+
+    struct mock_file *f = find_file(h->path);
+    size_t n = h->pos < f->size ? f->size - h->pos : 0;
+    if (n > token->BufferSize) n = token->BufferSize;
+    ev->token = token;
+    ev->file = h;
+    ev->due_ns = now_ns() + read_ns(n);
+    g_stats.async_reads++;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI file_get_info(EFI_FILE_PROTOCOL *self, EFI_GUID *type,
+                                       UINTN *size, VOID *buf) {
+    struct handle *h = (struct handle *)self;
+    EFI_GUID info_guid = EFI_FILE_INFO_GUID;
+    check_allowed("File.GetInfo");
+    if (!guid_equal(type, &info_guid)) return EFI_UNSUPPORTED;
+
+    const char *name = strrchr(h->path, '\\');
+    name = name ? name + 1 : h->path;
+    UINTN need = sizeof(EFI_FILE_INFO) + (strlen(name) + 1) * 2;
+    if (*size < need) {
+        *size = need;
+        return EFI_BUFFER_TOO_SMALL;
+    }
+    fill_info(buf, name, h->is_dir ? 0 : find_file(h->path)->size, h->is_dir);
+    *size = need;
+    return EFI_SUCCESS;
+}
+
+static EFI_FILE_PROTOCOL *new_handle(const char *path, int dir) {
+    for (int i = 0; i < MAX_FILES; i++) {
+        struct handle *h = &g_handles[i];
+        if (h->used) continue;
+        memset(h, 0, sizeof(*h));
+        h->used = 1;
+        h->is_dir = dir;
+        snprintf(h->path, sizeof(h->path), "%s", path);
+        h->proto.Revision = g_cfg.async_files ? EFI_FILE_PROTOCOL_REVISION2
+                                              : EFI_FILE_PROTOCOL_REVISION;
+        h->proto.Open = file_open;
+        h->proto.Close = file_close;
+        h->proto.Read = file_read;
+        h->proto.GetInfo = file_get_info;
+        if (g_cfg.async_files) h->proto.ReadEx = file_read_ex;
+        return &h->proto;
+    }
+    return NULL;
+}
+
+static EFI_STATUS EFIAPI open_volume(EFI_SIMPLE_FILE_SYSTEM_PROTOCOL *self,
+                                     EFI_FILE_PROTOCOL **root) {
+    (void)self;
+    check_allowed("OpenVolume");
+    *root = new_handle("", 1);
+    return *root ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+}
+
+void mock_add_file(const char *path, const void *data, size_t size) {
+    if (g_file_count == MAX_FILES) {
+        fprintf(stderr, "mockefi: too many files\n");
+        exit(1);
+    }
+    struct mock_file *f = &g_files[g_file_count++];
+    snprintf(f->path, sizeof(f->path), "%s", path);
+    f->data = malloc(size ? size : 1);
+    memcpy(f->data, data, size);
+    f->size = size;
+}
+
+void mock_clear_files(void) {
+    for (uint32_t i = 0; i < g_file_count; i++) free(g_files[i].data);
+    g_file_count = 0;
+}
+
+//=============================================================================
+// Variables
+// Kept across mock_reset, like non-volatile storage across reboots. The
+// loader only runs before ExitBootServices, so any call after it is a
+// violation whatever the attributes say.
+//=============================================================================
+
+static size_t name_len(const CHAR16 *name) {
+    size_t n = 0;
+    while (name[n]) n++;
+    return n;
+}
+
+static struct variable *find_variable(const CHAR16 *name, const EFI_GUID *guid) {
+    for (int i = 0; i < MAX_VARIABLES; i++) {
+        struct variable *v = &g_vars[i];
+        if (v->data && !memcmp(v->name, name, (name_len(name) + 1) * sizeof(CHAR16)) &&
+            (!guid || guid_equal(&v->guid, guid))) {
+            return v;
+        }
+    }
+    return NULL;
+}
+
+static EFI_STATUS EFIAPI get_variable(CHAR16 *name, EFI_GUID *guid, UINT32 *attributes,
+                                      UINTN *size, VOID *data) {
+    check_allowed("GetVariable");
+    struct variable *v = find_variable(name, guid);
+    if (!v) return EFI_NOT_FOUND;
+    if (attributes) *attributes = v->attributes;
+    if (*size < v->size) {
+        *size = v->size;
+        return EFI_BUFFER_TOO_SMALL;
+    }
+    memcpy(data, v->data, v->size);
+    *size = v->size;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI set_variable(CHAR16 *name, EFI_GUID *guid, UINT32 attributes,
+                                      UINTN size, VOID *data) {
+    check_allowed("SetVariable");
+    g_stats.variable_writes++;
+    if (name_len(name) >= VAR_NAME_LEN) return EFI_INVALID_PARAMETER;
+
+    struct variable *v = find_variable(name, guid);
+    if (!size) {
+        if (!v) return EFI_NOT_FOUND;
+        free(v->data);
+        v->data = NULL;
+        return EFI_SUCCESS;
+    }
+    if (!v) {
+        for (int i = 0; i < MAX_VARIABLES && !v; i++) {
+            if (!g_vars[i].data) v = &g_vars[i];
+        }
+        if (!v) return EFI_OUT_OF_RESOURCES;
+        memcpy(v->name, name, (name_len(name) + 1) * sizeof(CHAR16));
+        v->guid = *guid;
+    } else {
+        free(v->data);
+    }
+    v->attributes = attributes;
+    v->data = malloc(size);
+    memcpy(v->data, data, size);
+    v->size = size;
+    return EFI_SUCCESS;
+}
+
+void *mock_variable(const CHAR16 *name, size_t *size) {
+    struct variable *v = find_variable(name, NULL);
+    if (!v) return NULL;
+    *size = v->size;
+    return v->data;
+}
+
+void mock_clear_variables(void) {
+    for (int i = 0; i < MAX_VARIABLES; i++) {
+        free(g_vars[i].data);
+        g_vars[i].data = NULL;
+    }
+}
+
+//=============================================================================
+// System Table
+//=============================================================================
+
+static EFI_STATUS EFIAPI locate_protocol(EFI_GUID *guid, VOID *reg, VOID **out) {
+    EFI_GUID gop_guid = EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID;
+    EFI_GUID fs_guid = EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
+    (void)reg;
+    check_allowed("LocateProtocol");
+
+    if (guid_equal(guid, &gop_guid)) {
+        *out = &g_gop;
+    } else if (guid_equal(guid, &fs_guid)) {
+        *out = &g_fs;
+    } else {
+        return EFI_NOT_FOUND;
+    }
+    return EFI_SUCCESS;
+}
+
+void mock_init(size_t arena_bytes) {
+    g_arena = mmap(NULL, arena_bytes, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (g_arena == MAP_FAILED) {
+        perror("mockefi: mmap");
+        exit(1);
+    }
+    g_arena_size = arena_bytes;
+
+    g_bs.AllocatePages = allocate_pages;
+    g_bs.FreePages = free_pages;
+    g_bs.GetMemoryMap = get_memory_map;
+    g_bs.AllocatePool = allocate_pool;
+    g_bs.FreePool = free_pool;
+    g_bs.CreateEvent = create_event;
+    g_bs.WaitForEvent = wait_for_event;
+    g_bs.CheckEvent = check_event;
+    g_bs.CopyMem = copy_mem;
+    g_bs.SetMem = set_mem;
+    g_bs.CloseEvent = close_event;
+    g_bs.ExitBootServices = exit_boot_services;
+    g_bs.LocateProtocol = locate_protocol;
+
+    g_rt.GetVariable = get_variable;
+    g_rt.SetVariable = set_variable;
+
+    g_conout.OutputString = output_string;
+    g_conout.ClearScreen = clear_screen;
+
+    g_gop.Blt = gop_blt;
+    g_gop.Mode = &g_gop_mode;
+    g_gop_mode.Info = &g_gop_info;
+    g_gop_mode.SizeOfInfo = sizeof(g_gop_info);
+
+    g_fs.OpenVolume = open_volume;
+
+    // RSDP: signature and revision are all the loader could look at
+    memcpy(g_rsdp, "RSD PTR ", 8);
+    g_rsdp[15] = 2;
+    g_config_table[0] = (EFI_CONFIGURATION_TABLE){
+        EFI_ACPI_TABLE_GUID, g_rsdp };
+    g_config_table[1] = (EFI_CONFIGURATION_TABLE){
+        EFI_ACPI_20_TABLE_GUID, g_rsdp };
+
+    g_st.ConOut = &g_conout;
+    g_st.BootServices = &g_bs;
+    g_st.RuntimeServices = &g_rt;
+    g_st.NumberOfTableEntries = 2;
+    g_st.ConfigurationTable = g_config_table;
+}
+
+EFI_SYSTEM_TABLE *mock_reset(const struct mock_config *cfg) {
+    int new_fb = !g_fb || cfg->fb_width != g_cfg.fb_width ||
+                 cfg->fb_height != g_cfg.fb_height;
+    int new_map = !g_base_map || cfg->map_entries != g_cfg.map_entries;
+    g_cfg = *cfg;
+
+    if (new_fb) {
+        free(g_fb);
+        g_fb = calloc((size_t)cfg->fb_width * cfg->fb_height, 4);
+        g_gop_info.HorizontalResolution = cfg->fb_width;
+        g_gop_info.VerticalResolution = cfg->fb_height;
+        g_gop_info.PixelsPerScanLine = cfg->fb_width;
+        g_gop_info.PixelFormat = PixelBlueGreenRedReserved8BitPerColor;
+        g_gop_mode.FrameBufferBase = (UINT64)g_fb;
+        g_gop_mode.FrameBufferSize = (UINTN)cfg->fb_width * cfg->fb_height * 4;
+    }
+    if (new_map) build_base_map(cfg->map_entries);
+
+    memset(&g_stats, 0, sizeof(g_stats));
+    memset(g_handles, 0, sizeof(g_handles));
+    memset(g_events, 0, sizeof(g_events));
+    g_arena_used = 0;
+    g_alloc_count = 0;
+    g_map_key = 1;
+    g_console_len = 0;
+    g_console[0] = 0;
+    return &g_st;
+}
+
+const struct mock_stats *mock_get_stats(void) { return &g_stats; }
+const char *mock_console(void) { return g_console; }
+uint64_t mock_rsdp(void) { return (uint64_t)g_rsdp; }
+uint64_t mock_framebuffer(void) { return (uint64_t)g_fb; }
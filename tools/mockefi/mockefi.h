@@ -0,0 +1,61 @@
+// tools/mockefi/mockefi.h
+// Mock UEFI firmware for running the bootloader as a Linux program
+//
+// Provides just enough of a system table for bootloader/main.c: boot
+// services backed by a private memory arena, a synthetic memory map of any
+// size, a console that records output, a GOP with a malloc'd framebuffer,
+// a simple file system over files registered with mock_add_file() and
+// variable services whose variables outlive mock_reset().
+//
+// "Physical" addresses handed out are host pointers into the arena, which
+// is executable, so the loader can really jump to the kernel it loaded.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "efi/efi.h"
+
+struct mock_config {
+    uint32_t map_entries;       // Descriptors in the synthetic memory map
+    uint32_t ebs_failures;      // ExitBootServices calls that fail first
+    uint32_t fb_width;
+    uint32_t fb_height;
+    uint32_t disk_mbps;         // File read speed; 0 = instant
+    int      async_files;       // Revision 2 file protocol (ReadEx)
+    int      verbose;           // Echo console output to stdout
+};
+
+struct mock_stats {
+    uint32_t    get_map_calls;
+    uint32_t    ebs_calls;          // ExitBootServices attempts
+    int         exited;             // ExitBootServices succeeded
+    uint32_t    async_reads;        // ReadEx requests
+    uint32_t    violations;         // Boot services used when not allowed
+    const char *first_violation;
+    uint32_t    last_map_count;     // Descriptors in the last GetMemoryMap
+    uint32_t    variable_writes;    // SetVariable calls
+};
+
+// Set up the firmware; the arena is reused by every boot
+void mock_init(size_t arena_bytes);
+
+// Start a fresh boot with this configuration: empty arena, new memory
+// map, console and statistics cleared. Files and variables stay.
+EFI_SYSTEM_TABLE *mock_reset(const struct mock_config *cfg);
+
+// Register a file; path is absolute with backslashes ("\\EFI\\BOOT\\x")
+void mock_add_file(const char *path, const void *data, size_t size);
+void mock_clear_files(void);
+
+// A stored variable's contents, any vendor GUID, or NULL. Writable, to
+// fake what the firmware kept.
+void *mock_variable(const CHAR16 *name, size_t *size);
+void mock_clear_variables(void);
+
+const struct mock_stats *mock_get_stats(void);
+const char *mock_console(void);     // Everything printed since mock_reset
+
+// Where the fake RSDP and framebuffer live, for checking the boot info
+uint64_t mock_rsdp(void);
+uint64_t mock_framebuffer(void);
@@ -0,0 +1,70 @@
+// user/aio.h
+// The process's side of an I/O ring (common/aio.h)
+//
+// Fill entries from aio_get_sqe(), publish them with aio_commit(), and
+// hand them to the kernel with sys_aio_enter() unless a CPU polls the
+// ring (aio_need_wakeup() clear). Completions come from aio_peek_cqe()
+// without a system call; aio_cqe_seen() gives each slot back.
+#pragma once
+
+#include <stdint.h>
+#include "common/aio.h"
+#include "sys.h"
+
+struct aio {
+    struct aio_ring_hdr *hdr;
+    struct aio_sqe      *sq;
+    struct aio_cqe      *cq;
+    uint8_t             *buf;           // The buffer area
+    uint32_t             sq_tail;       // Filled, published or not
+    uint32_t             cq_head;
+};
+
+// Returns 0, or -1 if the kernel refused
+static inline int aio_open(struct aio *a, uint32_t entries, uint32_t buf_pages,
+                           uint32_t flags) {
+    int64_t addr = sys_aio_setup(entries, buf_pages, flags);
+    if (addr < 0) return -1;
+
+    uint8_t *base = (uint8_t *)addr;
+    a->hdr = (struct aio_ring_hdr *)base;
+    a->sq = (struct aio_sqe *)(base + a->hdr->sq_off);
+    a->cq = (struct aio_cqe *)(base + a->hdr->cq_off);
+    a->buf = base + a->hdr->buf_off;
+    a->sq_tail = a->hdr->sq_tail;
+    a->cq_head = a->hdr->cq_head;
+    return 0;
+}
+
+// The next free SQ entry, or NULL while the kernel has all of them
+static inline struct aio_sqe *aio_get_sqe(struct aio *a) {
+    uint32_t head = __atomic_load_n(&a->hdr->sq_head, __ATOMIC_ACQUIRE);
+    if (a->sq_tail - head == a->hdr->sq_entries) return NULL;
+    return &a->sq[a->sq_tail++ & (a->hdr->sq_entries - 1)];
+}
+
+// Make the entries filled so far visible to the kernel
+static inline void aio_commit(struct aio *a) {
+    __atomic_store_n(&a->hdr->sq_tail, a->sq_tail, __ATOMIC_RELEASE);
+}
+
+// Published entries the kernel has not taken yet
+static inline uint32_t aio_sq_pending(struct aio *a) {
+    return a->sq_tail - __atomic_load_n(&a->hdr->sq_head, __ATOMIC_ACQUIRE);
+}
+
+// Nonzero if nothing polls the ring: submitting takes sys_aio_enter().
+// Check again while waiting, the poller may stop at any time.
+static inline int aio_need_wakeup(struct aio *a) {
+    return __atomic_load_n(&a->hdr->sq_flags, __ATOMIC_ACQUIRE) & AIO_SQ_NEED_WAKEUP;
+}
+
+// The oldest completion not yet seen, or NULL
+static inline struct aio_cqe *aio_peek_cqe(struct aio *a) {
+    if (a->cq_head == __atomic_load_n(&a->hdr->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &a->cq[a->cq_head & (a->hdr->cq_entries - 1)];
+}
+
+static inline void aio_cqe_seen(struct aio *a) {
+    __atomic_store_n(&a->hdr->cq_head, ++a->cq_head, __ATOMIC_RELEASE);
+}
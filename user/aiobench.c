@@ -0,0 +1,133 @@
+// user/aiobench.c
+// Random 4 KiB reads: a system call each, through the I/O ring, and
+// through the ring with a kernel CPU polling it
+//
+// Started once per mode by the kernel's aiobench (kernel/proc/aio_bench.c),
+// which packs the mode, queue depth, read count and the span of block
+// device 0 to read from into the argument. Every read lands in the ring's
+// buffer area, so all three modes do the same DMA.
+#include "aio.h"
+
+#define MODE_SYNC       0
+#define MODE_RING       1
+#define MODE_SQPOLL     2
+#define ARG_QD_SHIFT    2
+#define ARG_ITERS_SHIFT 11
+#define ARG_SPAN_SHIFT  35
+
+#define ENTRIES         256
+#define BLOCK           4096
+#define SECTORS         (BLOCK / 512)
+
+static uint64_t g_rand = 0x9E3779B97F4A7C15ULL;
+
+// xorshift64
+static uint64_t next_sector(uint64_t span) {
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 7;
+    g_rand ^= g_rand << 17;
+    return g_rand % span * SECTORS;
+}
+
+static void result(const char *name, uint64_t reads, uint64_t ns, uint64_t calls) {
+    print("  ");
+    print(name);
+    print_u64(reads);
+    print(" reads, ");
+    print_u64(ns ? reads * 1000000000ULL / ns : 0);
+    print(" IOPS, ");
+    print_u64(calls);
+    print(" system calls\n");
+}
+
+static int sync_reads(struct aio *a, uint64_t iters, uint64_t span) {
+    uint64_t start = sys_clock();
+    for (uint64_t i = 0; i < iters; i++) {
+        if (sys_blk_io(0, AIO_OP_READ, next_sector(span), a->buf, SECTORS) != 0) return 2;
+    }
+    result("sync    ", iters, sys_clock() - start, iters);
+    return 0;
+}
+
+// A timeout, a no-op and a futex wake in one call: the last two complete
+// on the spot, the timeout a millisecond later
+static int ops(struct aio *a) {
+    static const uint64_t order[] = { 2, 3, 1 };
+    uint64_t start = sys_clock();
+
+    *aio_get_sqe(a) = (struct aio_sqe){ .op = AIO_OP_TIMEOUT, .arg = 1000000, .user_data = 1 };
+    *aio_get_sqe(a) = (struct aio_sqe){ .op = AIO_OP_NOP, .user_data = 2 };
+    *aio_get_sqe(a) = (struct aio_sqe){ .op = AIO_OP_FUTEX_WAKE, .count = 1,
+                                        .arg = (uint64_t)a->buf, .user_data = 3 };
+    aio_commit(a);
+    if (sys_aio_enter(3, 3) != 3) return 3;
+    uint64_t ns = sys_clock() - start;
+
+    for (int i = 0; i < 3; i++) {
+        struct aio_cqe *c = aio_peek_cqe(a);
+        if (!c || c->user_data != order[i] || c->res != 0) return 3;
+        aio_cqe_seen(a);
+    }
+    if (ns < 1000000) return 3;
+    print("  ops     timeout, no-op and futex wake completed in order after ");
+    print_u64(ns / 1000);
+    print(" us\n");
+    return 0;
+}
+
+// Keep `qd` reads in flight. Without a poller, one aio_enter() submits
+// what was queued and waits for the next completion; with one, the
+// process only enters the kernel if the poller is gone.
+static int ring_reads(struct aio *a, int poll, uint64_t qd, uint64_t iters, uint64_t span) {
+    uint64_t submitted = 0, completed = 0, calls = 0;
+    uint64_t start = sys_clock();
+
+    while (completed < iters) {
+        struct aio_sqe *s;
+        while (submitted - completed < qd && submitted < iters && (s = aio_get_sqe(a))) {
+            *s = (struct aio_sqe){
+                .op = AIO_OP_READ, .count = SECTORS, .sector = next_sector(span),
+                .arg = submitted % qd * BLOCK, .user_data = submitted,
+            };
+            submitted++;
+        }
+        aio_commit(a);
+
+        if (!poll) {
+            sys_aio_enter(aio_sq_pending(a), 1);
+            calls++;
+        } else if (aio_sq_pending(a) && aio_need_wakeup(a)) {
+            sys_aio_enter(aio_sq_pending(a), 0);
+            calls++;
+        }
+
+        struct aio_cqe *c;
+        int seen = 0;
+        while ((c = aio_peek_cqe(a))) {
+            if (c->res != 0) return 4;
+            aio_cqe_seen(a);
+            completed++;
+            seen++;
+        }
+        if (!seen) __builtin_ia32_pause();
+    }
+    result(poll ? "sqpoll  " : "ring    ", iters, sys_clock() - start, calls);
+    return 0;
+}
+
+int main(uint64_t arg) {
+    uint32_t mode = arg & 3;
+    uint64_t qd = (arg >> ARG_QD_SHIFT) & ((1 << (ARG_ITERS_SHIFT - ARG_QD_SHIFT)) - 1);
+    uint64_t iters = (arg >> ARG_ITERS_SHIFT) & ((1ULL << (ARG_SPAN_SHIFT - ARG_ITERS_SHIFT)) - 1);
+    uint64_t span = arg >> ARG_SPAN_SHIFT;
+    if (!qd || qd > ENTRIES || !span) return 1;
+
+    struct aio a;
+    if (aio_open(&a, ENTRIES, qd, mode == MODE_SQPOLL ? AIO_SETUP_SQPOLL : 0) < 0) return 1;
+    if (mode == MODE_SYNC) return sync_reads(&a, iters, span);
+    if (mode == MODE_RING) {
+        int err = ops(&a);
+        if (err) return err;
+    }
+    return ring_reads(&a, mode == MODE_SQPOLL, qd, iters, span);
+}
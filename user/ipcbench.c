@@ -0,0 +1,191 @@
+// user/ipcbench.c
+// Channel latency and throughput, run as a client and a server process
+//
+// Started twice by the kernel's ipcbench (kernel/proc/ipc_bench.c), which
+// packs the role and parameters into the argument. Both open the same
+// channel: a request ring, a response ring and a buffer for copied bulk
+// data. The client drives every test and prints the results.
+#include "ring.h"
+
+#define ARG_SERVER      (1ULL << 0)
+#define ARG_SAME_CPU    (1ULL << 1)
+#define ARG_CHAN_SHIFT  4
+#define ARG_ITERS_SHIFT 8
+
+#define SPIN            20000           // Polls before sleeping, other CPU only
+#define BULK_BYTES      (256 * 1024)
+#define BULK_WORDS      (BULK_BYTES / 8)
+#define PAGE_WORDS      512
+
+enum {
+    MSG_PING,                           // Echoed back
+    MSG_DATA,                           // Counted
+    MSG_FLUSH,                          // Answered with the count
+    MSG_GRANT,                          // a = grant handle, b = chunk number
+    MSG_COPY,                           // b = chunk number, data in the channel
+    MSG_STOP,
+};
+
+struct msg {
+    uint64_t kind, a, b;
+    uint64_t pad[4];                    // Fill the slot: 56 bytes of payload
+};
+
+struct channel {
+    struct ring req;                    // Client to server
+    struct ring resp;                   // Server to client
+    _Alignas(4096) uint64_t copy[BULK_WORDS];
+};
+
+#define CHANNEL_PAGES   ((sizeof(struct channel) + 4095) / 4096)
+
+static uint64_t g_buf[BULK_WORDS] __attribute__((aligned(4096)));
+
+static void fill(uint64_t *buf, uint64_t chunk) {
+    for (uint64_t i = 0; i < BULK_WORDS; i++) buf[i] = chunk + i;
+}
+
+// First word of every page: enough to tell the right pages arrived
+static int check(const uint64_t *buf, uint64_t chunk) {
+    for (uint64_t i = 0; i < BULK_WORDS; i += PAGE_WORDS) {
+        if (buf[i] != chunk + i) return -1;
+    }
+    return 0;
+}
+
+static void copy_words(uint64_t *dst, const uint64_t *src) {
+    for (uint64_t i = 0; i < BULK_WORDS; i++) dst[i] = src[i];
+}
+
+//=============================================================================
+// Server
+//=============================================================================
+
+static int serve(struct channel *ch, uint32_t chan, uint32_t spin) {
+    struct msg m;
+    uint64_t count = 0;
+
+    for (;;) {
+        ring_recv(&ch->req, &m, sizeof(m), spin);
+        switch (m.kind) {
+        case MSG_PING:
+            ring_send(&ch->resp, &m, sizeof(m));
+            break;
+        case MSG_DATA:
+            count++;
+            break;
+        case MSG_FLUSH:
+            m.a = count;
+            count = 0;
+            ring_send(&ch->resp, &m, sizeof(m));
+            break;
+        case MSG_GRANT:
+            m.a = sys_accept(chan, (int64_t)m.a, g_buf) == BULK_BYTES / 4096 &&
+                  check(g_buf, m.b) == 0;
+            ring_send(&ch->resp, &m, sizeof(m));
+            break;
+        case MSG_COPY:
+            copy_words(g_buf, ch->copy);
+            m.a = check(g_buf, m.b) == 0;
+            ring_send(&ch->resp, &m, sizeof(m));
+            break;
+        case MSG_STOP:
+            return 0;
+        default:
+            return 1;
+        }
+    }
+}
+
+//=============================================================================
+// Client
+//=============================================================================
+
+static void result(const char *name, uint64_t n, const char *what, uint64_t value,
+                   const char *unit) {
+    print("  ");
+    print(name);
+    print_u64(n);
+    print(what);
+    print_u64(value);
+    print(unit);
+}
+
+static int bulk(struct channel *ch, uint32_t chan, uint32_t spin, uint64_t chunks, int grant,
+                uint64_t *ns) {
+    struct msg m = { 0 };
+    uint64_t start = sys_clock();
+
+    for (uint64_t i = 0; i < chunks; i++) {
+        fill(g_buf, i);
+        if (grant) {
+            int64_t h = sys_grant(chan, g_buf, BULK_BYTES);
+            if (h < 0) return -1;
+            m.kind = MSG_GRANT;
+            m.a = h;
+        } else {
+            copy_words(ch->copy, g_buf);
+            m.kind = MSG_COPY;
+        }
+        m.b = i;
+        ring_send(&ch->req, &m, sizeof(m));
+        ring_recv(&ch->resp, &m, sizeof(m), spin);
+        if (!m.a) return -1;
+    }
+    *ns = sys_clock() - start;
+    return 0;
+}
+
+static int drive(struct channel *ch, uint32_t chan, uint32_t spin, uint64_t iters) {
+    struct msg m = { 0 };
+
+    // Ping-pong: one message each way per round trip
+    uint64_t start = sys_clock();
+    for (uint64_t i = 0; i < iters; i++) {
+        m.kind = MSG_PING;
+        m.a = i;
+        ring_send(&ch->req, &m, sizeof(m));
+        ring_recv(&ch->resp, &m, sizeof(m), spin);
+        if (m.a != i) return 2;
+    }
+    uint64_t ns = sys_clock() - start;
+    result("ping-pong    ", iters, " round trips, avg ", ns / iters, " ns\n");
+
+    // Streaming: as fast as the ring takes them, one answer at the end
+    start = sys_clock();
+    m.kind = MSG_DATA;
+    for (uint64_t i = 0; i < iters; i++) ring_send(&ch->req, &m, sizeof(m));
+    m.kind = MSG_FLUSH;
+    ring_send(&ch->req, &m, sizeof(m));
+    ring_recv(&ch->resp, &m, sizeof(m), spin);
+    ns = sys_clock() - start;
+    if (m.a != iters) return 3;
+    result("stream       ", iters, " x 56 B messages, ",
+           ns ? iters * 1000000000ULL / ns : 0, " msg/s\n");
+
+    // Bulk: the same 256 KiB buffers handed over as pages and copied
+    uint64_t chunks = iters / 256 + 1;
+    if (bulk(ch, chan, spin, chunks, 1, &ns) < 0) return 4;
+    result("bulk grant   ", chunks, " x 256 KiB, ",
+           ns ? chunks * BULK_BYTES * 1000 / ns : 0, " MB/s\n");
+    if (bulk(ch, chan, spin, chunks, 0, &ns) < 0) return 5;
+    result("bulk copy    ", chunks, " x 256 KiB, ",
+           ns ? chunks * BULK_BYTES * 1000 / ns : 0, " MB/s\n");
+
+    m.kind = MSG_STOP;
+    ring_send(&ch->req, &m, sizeof(m));
+    return 0;
+}
+
+int main(uint64_t arg) {
+    uint32_t chan = (arg >> ARG_CHAN_SHIFT) & 15;
+    uint64_t iters = arg >> ARG_ITERS_SHIFT;
+    uint32_t spin = (arg & ARG_SAME_CPU) ? 0 : SPIN;
+
+    int64_t addr = sys_chan_open(chan, CHANNEL_PAGES);
+    if (addr < 0) return 1;
+    struct channel *ch = (struct channel *)addr;
+
+    if (arg & ARG_SERVER) return serve(ch, chan, spin);
+    return drive(ch, chan, spin, iters);
+}
@@ -0,0 +1,137 @@
+// user/ring.h
+// Lock-free message ring in channel memory, with a futex doorbell
+//
+// A bounded queue of fixed 64-byte slots (Vyukov's sequence-numbered
+// ring). Producers claim positions with a compare-and-swap on `tail`, so
+// any number may push (ring_push); a single producer can skip the CAS
+// (ring_push_sp). There is one consumer. Each slot's sequence number says
+// whose turn it is: equal to the position, free for that lap's producer;
+// position + 1, full. It is stored minus the slot index so that the zeroed
+// pages of a new channel are already a valid empty ring.
+//
+// The kernel is only entered to sleep and wake. A consumer that finds the
+// ring empty announces itself in `sleeping`, checks again, and waits on
+// `doorbell`; a producer that sees `sleeping` rings the bell and wakes it.
+#pragma once
+
+#include <stdint.h>
+#include "sys.h"
+
+#define RING_SLOTS      256             // Power of two
+#define RING_MSG_SIZE   56
+
+struct ring_slot {
+    uint64_t seq;
+    uint8_t  data[RING_MSG_SIZE];
+};
+
+struct ring {
+    _Alignas(64) uint64_t tail;         // Next position to claim (producers)
+    _Alignas(64) uint64_t head;         // Next position to read (consumer)
+    _Alignas(64) uint32_t doorbell;     // Futex word, bumped to wake the consumer
+    uint32_t              sleeping;     // The consumer is going to wait on it
+    _Alignas(64) struct ring_slot slots[RING_SLOTS];
+};
+
+static inline uint64_t ring_seq(struct ring_slot *s, uint64_t index) {
+    return __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) + index;
+}
+
+static inline void ring_copy(void *dst, const void *src, uint32_t len) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    while (len--) *d++ = *s++;
+}
+
+// After publishing: wake the consumer if it may be asleep. The fence
+// orders our slot store before the `sleeping` load, pairing with the one
+// in ring_wait().
+static inline void ring_notify(struct ring *r) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->sleeping, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&r->doorbell, 1, __ATOMIC_RELEASE);
+        sys_futex_wake(&r->doorbell, 1);
+    }
+}
+
+static inline void ring_publish(struct ring *r, struct ring_slot *s, uint64_t pos,
+                                const void *msg, uint32_t len) {
+    ring_copy(s->data, msg, len);
+    __atomic_store_n(&s->seq, pos + 1 - (pos & (RING_SLOTS - 1)), __ATOMIC_RELEASE);
+    ring_notify(r);
+}
+
+// Any number of producers. Returns 0, or -1 if the ring is full.
+static inline int ring_push(struct ring *r, const void *msg, uint32_t len) {
+    uint64_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        uint64_t index = pos & (RING_SLOTS - 1);
+        int64_t diff = (int64_t)(ring_seq(&r->slots[index], index) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                ring_publish(r, &r->slots[index], pos, msg, len);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;                  // Last lap's message still unread
+        } else {
+            pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// The only producer. Returns 0, or -1 if the ring is full.
+static inline int ring_push_sp(struct ring *r, const void *msg, uint32_t len) {
+    uint64_t pos = r->tail;
+    uint64_t index = pos & (RING_SLOTS - 1);
+    if (ring_seq(&r->slots[index], index) != pos) return -1;
+    r->tail = pos + 1;
+    ring_publish(r, &r->slots[index], pos, msg, len);
+    return 0;
+}
+
+static inline int ring_empty(struct ring *r) {
+    uint64_t pos = r->head;
+    uint64_t index = pos & (RING_SLOTS - 1);
+    return ring_seq(&r->slots[index], index) != pos + 1;
+}
+
+// Consumer. Returns 0, or -1 if the ring is empty.
+static inline int ring_pop(struct ring *r, void *msg, uint32_t len) {
+    uint64_t pos = r->head;
+    uint64_t index = pos & (RING_SLOTS - 1);
+    struct ring_slot *s = &r->slots[index];
+    if (ring_seq(s, index) != pos + 1) return -1;
+
+    ring_copy(msg, s->data, len);
+    __atomic_store_n(&s->seq, pos + RING_SLOTS - index, __ATOMIC_RELEASE);
+    r->head = pos + 1;
+    return 0;
+}
+
+// Consumer: sleep until the ring may have something
+static inline void ring_wait(struct ring *r) {
+    uint32_t bell = __atomic_load_n(&r->doorbell, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&r->sleeping, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (ring_empty(r)) sys_futex_wait(&r->doorbell, bell);
+    __atomic_store_n(&r->sleeping, 0, __ATOMIC_RELAXED);
+}
+
+// Consumer: pop, spinning up to `spin` times before sleeping
+static inline void ring_recv(struct ring *r, void *msg, uint32_t len, uint32_t spin) {
+    for (;;) {
+        for (uint32_t i = 0; i <= spin; i++) {
+            if (ring_pop(r, msg, len) == 0) return;
+            __builtin_ia32_pause();
+        }
+        ring_wait(r);
+    }
+}
+
+// Producer: push, yielding while the ring is full so a consumer on the
+// same CPU gets to drain it
+static inline void ring_send(struct ring *r, const void *msg, uint32_t len) {
+    while (ring_push_sp(r, msg, len) < 0) sys_yield();
+}
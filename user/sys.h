@@ -0,0 +1,115 @@
+// user/sys.h
+// System call wrappers and console output for user programs
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common/syscall.h"
+
+static inline int64_t syscall3(uint64_t n, uint64_t a, uint64_t b, uint64_t c) {
+    int64_t ret;
+    __asm__ volatile("syscall"
+                     : "=a"(ret)
+                     : "a"(n), "D"(a), "S"(b), "d"(c)
+                     : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline int64_t syscall5(uint64_t n, uint64_t a, uint64_t b, uint64_t c, uint64_t d,
+                               uint64_t e) {
+    int64_t ret;
+    register uint64_t r10 __asm__("r10") = d;
+    register uint64_t r8 __asm__("r8") = e;
+    __asm__ volatile("syscall"
+                     : "=a"(ret)
+                     : "a"(n), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8)
+                     : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline int64_t syscall2(uint64_t n, uint64_t a, uint64_t b) {
+    return syscall3(n, a, b, 0);
+}
+
+__attribute__((noreturn)) static inline void sys_exit(int64_t code) {
+    syscall2(SYS_EXIT, code, 0);
+    __builtin_unreachable();
+}
+
+static inline int64_t sys_write(const void *buf, size_t len) {
+    return syscall2(SYS_WRITE, (uint64_t)buf, len);
+}
+
+static inline int64_t sys_fork(void) {
+    return syscall2(SYS_FORK, 0, 0);
+}
+
+static inline int64_t sys_wait(int64_t pid, int64_t *status) {
+    return syscall2(SYS_WAIT, pid, (uint64_t)status);
+}
+
+static inline int64_t sys_getpid(void) {
+    return syscall2(SYS_GETPID, 0, 0);
+}
+
+static inline void sys_yield(void) {
+    syscall2(SYS_YIELD, 0, 0);
+}
+
+static inline uint64_t sys_clock(void) {
+    return syscall2(SYS_CLOCK, 0, 0);
+}
+
+// Address of shared channel `id`, mapped `pages` long (or as long as its
+// first opener made it), or a negative error
+static inline int64_t sys_chan_open(uint32_t id, uint32_t pages) {
+    return syscall2(SYS_CHAN_OPEN, id, pages);
+}
+
+static inline int64_t sys_futex_wait(volatile uint32_t *addr, uint32_t val) {
+    return syscall2(SYS_FUTEX_WAIT, (uint64_t)addr, val);
+}
+
+static inline int64_t sys_futex_wake(volatile uint32_t *addr, uint32_t n) {
+    return syscall2(SYS_FUTEX_WAKE, (uint64_t)addr, n);
+}
+
+static inline int64_t sys_grant(uint32_t id, void *buf, size_t len) {
+    return syscall3(SYS_GRANT, id, (uint64_t)buf, len);
+}
+
+static inline int64_t sys_accept(uint32_t id, int64_t handle, void *buf) {
+    return syscall3(SYS_ACCEPT, id, handle, (uint64_t)buf);
+}
+
+// Address of this process's I/O ring (common/aio.h), or a negative error
+static inline int64_t sys_aio_setup(uint32_t entries, uint32_t buf_pages, uint32_t flags) {
+    return syscall3(SYS_AIO_SETUP, entries, buf_pages, flags);
+}
+
+static inline int64_t sys_aio_enter(uint32_t to_submit, uint32_t min_complete) {
+    return syscall2(SYS_AIO_ENTER, to_submit, min_complete);
+}
+
+// One AIO_OP_READ, AIO_OP_WRITE or AIO_OP_FLUSH, waited for. `buf` must
+// be physically contiguous, as the ring's buffer area is.
+static inline int64_t sys_blk_io(uint32_t dev, uint32_t op, uint64_t sector, void *buf,
+                                 uint32_t count) {
+    return syscall5(SYS_BLK_IO, dev, op, sector, (uint64_t)buf, count);
+}
+
+static inline void print(const char *s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    sys_write(s, n);
+}
+
+static inline void print_u64(uint64_t v) {
+    char buf[20];
+    int n = sizeof(buf);
+    do {
+        buf[--n] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    sys_write(buf + n, sizeof(buf) - n);
+}
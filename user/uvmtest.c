@@ -0,0 +1,51 @@
+// user/uvmtest.c
+// Demand paging and copy-on-write, seen from ring 3
+//
+// A 4 MiB initialized array makes a large image of which only a few pages
+// are ever touched; the kernel's exec= report shows how few were mapped.
+// Exits 0 if every check passes, else the number of the first that failed.
+#include "sys.h"
+
+#define PAGE_WORDS  512
+#define BIG_WORDS   (4 * 1024 * 1024 / 8)
+#define BSS_PAGES   64
+
+// volatile: every check must really read memory, not the initializer
+static volatile uint64_t big[BIG_WORDS] = { 1, [BIG_WORDS - 1] = 2 };
+static volatile uint64_t scratch[BSS_PAGES * PAGE_WORDS];
+
+int main(void) {
+    // Reads map the image's pages, or the zero page for .bss
+    if (big[0] != 1 || big[BIG_WORDS - 1] != 2 || big[PAGE_WORDS] != 0) return 1;
+    for (int i = 0; i < BSS_PAGES; i++) {
+        if (scratch[i * PAGE_WORDS]) return 2;
+    }
+
+    // Writes give private copies
+    for (int i = 0; i < 16; i++) scratch[i * PAGE_WORDS] = i + 1;
+    big[PAGE_WORDS] = 42;
+
+    int64_t pid = sys_fork();
+    if (pid < 0) return 3;
+    if (pid == 0) {
+        // The child sees the parent's memory until it writes, and its
+        // writes stay its own
+        if (scratch[PAGE_WORDS] != 2 || big[PAGE_WORDS] != 42) sys_exit(100);
+        scratch[0] = 100;
+        big[PAGE_WORDS] = 43;
+        sys_exit((int64_t)(scratch[0] + big[PAGE_WORDS]));
+    }
+
+    int64_t status = 0;
+    if (sys_wait(pid, &status) != pid) return 4;
+    if (status != 143) return 5;
+    if (scratch[0] != 1 || big[PAGE_WORDS] != 42) return 6;
+
+    // The child is gone and the pages are ours alone: no copies this time
+    scratch[0] = 7;
+    big[PAGE_WORDS] = 8;
+    if (sys_wait(0, &status) != -ECHILD) return 7;
+
+    print("uvmtest: ok\n");
+    return 0;
+}